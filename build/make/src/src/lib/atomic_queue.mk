@@ -0,0 +1,15 @@
+${BUILD_DIR}/objs/src/lib/atomic_queue.${OBJ_EXT}: src/lib/atomic_queue.c \
+ src/freeradius-devel/autoconf.h \
+ src/freeradius-devel/automask.h src/freeradius-devel/build.h \
+ src/freeradius-devel/autoconf.h src/freeradius-devel/features.h \
+ src/freeradius-devel/radpaths.h \
+ src/freeradius-devel/atomic_queue.h \
+
+src/lib/atomic_queue.c :
+ src/freeradius-devel/autoconf.h :
+ src/freeradius-devel/automask.h src/freeradius-devel/build.h :
+ src/freeradius-devel/autoconf.h src/freeradius-devel/features.h :
+ src/freeradius-devel/radpaths.h :
+ :
+ src/freeradius-devel/atomic_queue.h :
+ :
@@ -0,0 +1,54 @@
+${BUILD_DIR}/objs/src/lib/cursor.${OBJ_EXT}: src/lib/cursor.c \
+ src/freeradius-devel/autoconf.h src/freeradius-devel/automask.h \
+ src/freeradius-devel/build.h src/freeradius-devel/autoconf.h \
+ src/freeradius-devel/features.h src/freeradius-devel/radpaths.h \
+ src/freeradius-devel/libradius.h src/freeradius-devel/build.h \
+ src/freeradius-devel/features.h \
+ src/freeradius-devel/missing.h \
+ src/freeradius-devel/threads.h src/freeradius-devel/radius.h \
+ src/freeradius-devel/rfc2865.h src/freeradius-devel/rfc2866.h \
+ src/freeradius-devel/rfc2867.h src/freeradius-devel/rfc2868.h \
+ src/freeradius-devel/rfc2869.h src/freeradius-devel/rfc3162.h \
+ src/freeradius-devel/rfc3576.h src/freeradius-devel/rfc3580.h \
+ src/freeradius-devel/rfc4072.h src/freeradius-devel/rfc4372.h \
+ src/freeradius-devel/rfc4675.h src/freeradius-devel/rfc4818.h \
+ src/freeradius-devel/rfc4849.h src/freeradius-devel/rfc5580.h \
+ src/freeradius-devel/rfc5607.h src/freeradius-devel/rfc5904.h \
+ src/freeradius-devel/rfc6572.h src/freeradius-devel/rfc6677.h \
+ src/freeradius-devel/rfc6911.h src/freeradius-devel/rfc6929.h \
+ src/freeradius-devel/rfc6930.h src/freeradius-devel/rfc7055.h \
+ src/freeradius-devel/rfc7155.h src/freeradius-devel/rfc7268.h \
+ src/freeradius-devel/attributes.h src/freeradius-devel/freeradius.h \
+ src/freeradius-devel/vqp.h src/freeradius-devel/token.h \
+ src/freeradius-devel/hash.h src/freeradius-devel/regex.h \
+ src/freeradius-devel/sha1.h \
+ src/freeradius-devel/md4.h \
+ src/freeradius-devel/packet.h src/freeradius-devel/tcp.h
+src/lib/cursor.c :
+ src/freeradius-devel/autoconf.h src/freeradius-devel/automask.h :
+ src/freeradius-devel/build.h src/freeradius-devel/autoconf.h :
+ src/freeradius-devel/features.h src/freeradius-devel/radpaths.h :
+ src/freeradius-devel/libradius.h src/freeradius-devel/build.h :
+ src/freeradius-devel/features.h :
+ :
+ src/freeradius-devel/missing.h :
+ :
+ src/freeradius-devel/threads.h src/freeradius-devel/radius.h :
+ src/freeradius-devel/rfc2865.h src/freeradius-devel/rfc2866.h :
+ src/freeradius-devel/rfc2867.h src/freeradius-devel/rfc2868.h :
+ src/freeradius-devel/rfc2869.h src/freeradius-devel/rfc3162.h :
+ src/freeradius-devel/rfc3576.h src/freeradius-devel/rfc3580.h :
+ src/freeradius-devel/rfc4072.h src/freeradius-devel/rfc4372.h :
+ src/freeradius-devel/rfc4675.h src/freeradius-devel/rfc4818.h :
+ src/freeradius-devel/rfc4849.h src/freeradius-devel/rfc5580.h :
+ src/freeradius-devel/rfc5607.h src/freeradius-devel/rfc5904.h :
+ src/freeradius-devel/rfc6572.h src/freeradius-devel/rfc6677.h :
+ src/freeradius-devel/rfc6911.h src/freeradius-devel/rfc6929.h :
+ src/freeradius-devel/rfc6930.h src/freeradius-devel/rfc7055.h :
+ src/freeradius-devel/rfc7155.h src/freeradius-devel/rfc7268.h :
+ src/freeradius-devel/attributes.h src/freeradius-devel/freeradius.h :
+ src/freeradius-devel/vqp.h src/freeradius-devel/token.h :
+ src/freeradius-devel/hash.h src/freeradius-devel/regex.h :
+ src/freeradius-devel/sha1.h :
+ src/freeradius-devel/md4.h :
+ src/freeradius-devel/packet.h src/freeradius-devel/tcp.h :
@@ -0,0 +1,10 @@
+${BUILD_DIR}/objs/src/lib/snprintf.${OBJ_EXT}: src/lib/snprintf.c \
+ src/freeradius-devel/autoconf.h \
+ src/freeradius-devel/automask.h src/freeradius-devel/build.h \
+ src/freeradius-devel/autoconf.h src/freeradius-devel/features.h \
+ src/freeradius-devel/radpaths.h src/lib/snprintf.h
+src/lib/snprintf.c :
+ src/freeradius-devel/autoconf.h :
+ src/freeradius-devel/automask.h src/freeradius-devel/build.h :
+ src/freeradius-devel/autoconf.h src/freeradius-devel/features.h :
+ src/freeradius-devel/radpaths.h src/lib/snprintf.h :
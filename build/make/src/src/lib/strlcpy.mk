@@ -0,0 +1,12 @@
+${BUILD_DIR}/objs/src/lib/strlcpy.${OBJ_EXT}: src/lib/strlcpy.c \
+ src/freeradius-devel/autoconf.h \
+ src/freeradius-devel/automask.h src/freeradius-devel/build.h \
+ src/freeradius-devel/autoconf.h src/freeradius-devel/features.h \
+ src/freeradius-devel/radpaths.h src/freeradius-devel/missing.h \
+
+src/lib/strlcpy.c :
+ src/freeradius-devel/autoconf.h :
+ src/freeradius-devel/automask.h src/freeradius-devel/build.h :
+ src/freeradius-devel/autoconf.h src/freeradius-devel/features.h :
+ src/freeradius-devel/radpaths.h src/freeradius-devel/missing.h :
+ :
@@ -0,0 +1,14 @@
+${BUILD_DIR}/objs/src/modules/rlm_eap/libeap/comp128.${OBJ_EXT}: \
+ src/modules/rlm_eap/libeap/comp128.c \
+ src/freeradius-devel/autoconf.h src/freeradius-devel/automask.h \
+ src/freeradius-devel/build.h src/freeradius-devel/autoconf.h \
+ src/freeradius-devel/features.h src/freeradius-devel/radpaths.h \
+ src/modules/rlm_eap/libeap/comp128.h \
+
+ :
+ src/modules/rlm_eap/libeap/comp128.c :
+ src/freeradius-devel/autoconf.h src/freeradius-devel/automask.h :
+ src/freeradius-devel/build.h src/freeradius-devel/autoconf.h :
+ src/freeradius-devel/features.h src/freeradius-devel/radpaths.h :
+ src/modules/rlm_eap/libeap/comp128.h :
+ :
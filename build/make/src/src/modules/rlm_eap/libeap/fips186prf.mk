@@ -0,0 +1,13 @@
+${BUILD_DIR}/objs/src/modules/rlm_eap/libeap/fips186prf.${OBJ_EXT}: \
+ src/modules/rlm_eap/libeap/fips186prf.c \
+ src/freeradius-devel/autoconf.h src/freeradius-devel/automask.h \
+ src/freeradius-devel/build.h src/freeradius-devel/autoconf.h \
+ src/freeradius-devel/features.h src/freeradius-devel/radpaths.h \
+ src/freeradius-devel/sha1.h
+ :
+ src/modules/rlm_eap/libeap/fips186prf.c :
+ src/freeradius-devel/autoconf.h src/freeradius-devel/automask.h :
+ src/freeradius-devel/build.h src/freeradius-devel/autoconf.h :
+ src/freeradius-devel/features.h src/freeradius-devel/radpaths.h :
+ :
+ src/freeradius-devel/sha1.h :
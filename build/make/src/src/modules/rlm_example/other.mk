@@ -0,0 +1,13 @@
+${BUILD_DIR}/objs/src/modules/rlm_example/other.${OBJ_EXT}: \
+ src/modules/rlm_example/other.c \
+ src/freeradius-devel/autoconf.h src/freeradius-devel/automask.h \
+ src/freeradius-devel/build.h src/freeradius-devel/autoconf.h \
+ src/freeradius-devel/features.h src/freeradius-devel/radpaths.h \
+ src/modules/rlm_example/other.h
+ :
+ src/modules/rlm_example/other.c :
+ src/freeradius-devel/autoconf.h src/freeradius-devel/automask.h :
+ src/freeradius-devel/build.h src/freeradius-devel/autoconf.h :
+ src/freeradius-devel/features.h src/freeradius-devel/radpaths.h :
+ :
+ src/modules/rlm_example/other.h :
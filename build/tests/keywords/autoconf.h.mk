@@ -0,0 +1,166 @@
+AC_BSDSTYLE := 3
+AC_CTIMERSTYLE := POSIXSTYLE
+AC_ENABLE_OPENSSL_VERSION_CHECK := 1
+AC_FR_LITTLE_ENDIAN := 1
+AC_GETHOSTBYADDRRSTYLE := GNUSTYLE
+AC_GETHOSTBYNAMERSTYLE := GNUSTYLE
+AC_GNUSTYLE := 1
+AC_HAVE_ARPA_INET_H := 1
+AC_HAVE_ASN1_STRING_GET0_DATA := 1
+AC_HAVE_BUILTIN_BSWAP_64 := 1
+AC_HAVE_BUILTIN_CHOOSE_EXPR := 1
+AC_HAVE_BUILTIN_TYPES_COMPATIBLE_P := 1
+AC_HAVE_CLOCK_GETTIME := 1
+AC_HAVE_CLOSEFROM := 1
+AC_HAVE_CONF_MODULES_LOAD_FILE := 1
+AC_HAVE_CRYPT := /**/
+AC_HAVE_CRYPT_H := 1
+AC_HAVE_CRYPT_R := /**/
+AC_HAVE_CTIME_R := 1
+AC_HAVE_DIRENT_H := 1
+AC_HAVE_DLADDR := 1
+AC_HAVE_DLFCN_H := 1
+AC_HAVE_ERRNO_H := 1
+AC_HAVE_EXECINFO := 1
+AC_HAVE_FCNTL := 1
+AC_HAVE_FCNTL_H := 1
+AC_HAVE_FEATURES_H := 1
+AC_HAVE_FNMATCH_H := 1
+AC_HAVE_FOPENCOOKIE := 1
+AC_HAVE_GETADDRINFO := 1
+AC_HAVE_GETGRNAM_R := 1
+AC_HAVE_GETNAMEINFO := 1
+AC_HAVE_GETOPT_H := 1
+AC_HAVE_GETOPT_LONG := 1
+AC_HAVE_GETPWNAM_R := 1
+AC_HAVE_GETRESUID := 1
+AC_HAVE_GETTIMEOFDAY := 1
+AC_HAVE_GETUSERSHELL := 1
+AC_HAVE_GLOB_H := 1
+AC_HAVE_GMTIME_R := 1
+AC_HAVE_GRP_H := 1
+AC_HAVE_HMAC_CTX_FREE := 1
+AC_HAVE_HMAC_CTX_NEW := 1
+AC_HAVE_IF_INDEXTONAME := 1
+AC_HAVE_IN6_PKTINFO := /**/
+AC_HAVE_INET_ATON := 1
+AC_HAVE_INET_NTOP := 1
+AC_HAVE_INET_PTON := 1
+AC_HAVE_INITGROUPS := 1
+AC_HAVE_INTTYPES_H := 1
+AC_HAVE_IP_PKTINFO := /**/
+AC_HAVE_LIBCRYPTO := 1
+AC_HAVE_LIBDL := 1
+AC_HAVE_LIBNSL := 1
+AC_HAVE_LIBREADLINE := 1
+AC_HAVE_LIBRESOLV := 1
+AC_HAVE_LIBSSL := 1
+AC_HAVE_LIMITS_H := 1
+AC_HAVE_LINUX_IF_PACKET_H := 1
+AC_HAVE_LOCALTIME_R := 1
+AC_HAVE_MALLOC_H := 1
+AC_HAVE_MALLOPT := 1
+AC_HAVE_MEMORY_H := 1
+AC_HAVE_MKDIRAT := 1
+AC_HAVE_NETDB_H := 1
+AC_HAVE_NETINET_IN_H := 1
+AC_HAVE_NET_IF_H := 1
+AC_HAVE_OPENAT := 1
+AC_HAVE_OPENSSL_ASN1_H := 1
+AC_HAVE_OPENSSL_CONF_H := 1
+AC_HAVE_OPENSSL_CRYPTO_H := 1
+AC_HAVE_OPENSSL_ENGINE_H := 1
+AC_HAVE_OPENSSL_ERR_H := 1
+AC_HAVE_OPENSSL_EVP_H := 1
+AC_HAVE_OPENSSL_HMAC_H := 1
+AC_HAVE_OPENSSL_MD4_H := 1
+AC_HAVE_OPENSSL_MD5_H := 1
+AC_HAVE_OPENSSL_OCSP_H := 1
+AC_HAVE_OPENSSL_RAND_H := 1
+AC_HAVE_OPENSSL_SHA_H := 1
+AC_HAVE_OPENSSL_SSL_H := 1
+AC_HAVE_PTHREAD_H := 1
+AC_HAVE_PTHREAD_SIGMASK := 1
+AC_HAVE_PWD_H := 1
+AC_HAVE_READLINE_HISTORY := 1
+AC_HAVE_READLINE_HISTORY_H := 1
+AC_HAVE_READLINE_READLINE_H := 1
+AC_HAVE_REGEX := 1
+AC_HAVE_REG_EXTENDED := 1
+AC_HAVE_SEMAPHORE_H := 1
+AC_HAVE_RECVMMSG := 1
+AC_HAVE_SENDMMSG := 1
+AC_HAVE_SETLINEBUF := 1
+AC_HAVE_SETRESUID := 1
+AC_HAVE_SETSID := 1
+AC_HAVE_SETUID := 1
+AC_HAVE_SETVBUF := 1
+AC_HAVE_SIGACTION := 1
+AC_HAVE_SIGNAL_H := 1
+AC_HAVE_SIGPROCMASK := 1
+AC_HAVE_SIG_T := 1
+AC_HAVE_SNPRINTF := 1
+AC_HAVE_SSL_GET_CLIENT_RANDOM := 1
+AC_HAVE_SSL_GET_SERVER_RANDOM := 1
+AC_HAVE_SSL_SESSION_GET_MASTER_KEY := 1
+AC_HAVE_STDALIGN_H := 1
+AC_HAVE_STDATOMIC_H := 1
+AC_HAVE_STDBOOL_H := 1
+AC_HAVE_STDDEF_H := 1
+AC_HAVE_STDINT_H := 1
+AC_HAVE_STDIO_H := 1
+AC_HAVE_STDLIB_H := 1
+AC_HAVE_STRCASECMP := 1
+AC_HAVE_STRINGS_H := 1
+AC_HAVE_STRING_H := 1
+AC_HAVE_STRNCASECMP := 1
+AC_HAVE_STRSEP := 1
+AC_HAVE_STRSIGNAL := 1
+AC_HAVE_STRUCT_ADDRINFO := 1
+AC_HAVE_STRUCT_IN6_ADDR := 1
+AC_HAVE_STRUCT_SOCKADDR_IN6 := 1
+AC_HAVE_STRUCT_SOCKADDR_STORAGE := 1
+AC_HAVE_SYSLOG_H := 1
+AC_HAVE_SYS_FCNTL_H := 1
+AC_HAVE_SYS_MMAN_H := 1
+AC_HAVE_SYS_PRCTL_H := 1
+AC_HAVE_SYS_PTRACE_H := 1
+AC_HAVE_SYS_RESOURCE_H := 1
+AC_HAVE_SYS_SELECT_H := 1
+AC_HAVE_SYS_SOCKET_H := 1
+AC_HAVE_SYS_STAT_H := 1
+AC_HAVE_SYS_TIME_H := 1
+AC_HAVE_SYS_TYPES_H := 1
+AC_HAVE_SYS_UN_H := 1
+AC_HAVE_SYS_WAIT_H := 1
+AC_HAVE_UNISTD_H := 1
+AC_HAVE_UNLINKAT := 1
+AC_HAVE_UTIME_H := 1
+AC_HAVE_UTMPX_H := 1
+AC_HAVE_UTMP_H := 1
+AC_HAVE_VDPRINTF := 1
+AC_HAVE_VSNPRINTF := 1
+AC_HAVE___UINT128_T := 1
+AC_PACKAGE_BUGREPORT := "http://bugs.freeradius.org"
+AC_PACKAGE_NAME := "freeradius"
+AC_PACKAGE_STRING := "freeradius $Id$"
+AC_PACKAGE_TARNAME := "freeradius"
+AC_PACKAGE_URL := "http://www.freeradius.org"
+AC_PACKAGE_VERSION := "$Id$"
+AC_POSIXSTYLE := 1
+AC_RADIUSD_VERSION := 030021
+AC_RADIUSD_VERSION_COMMIT := d3fd90b
+AC_RADIUSD_VERSION_STRING := "3.0.21"
+AC_RETSIGTYPE := void
+AC_SOLARISSTYLE := 2
+AC_STDC_HEADERS := 1
+AC_SYSVSTYLE := 2
+AC_TIME_WITH_SYS_TIME := 1
+AC_TLS_STORAGE_CLASS := __thread
+AC_WITH_ASCEND_BINARY := 1
+AC_WITH_DHCP := 1
+AC_WITH_TCP := 1
+AC_WITH_THREADS := 1
+AC_WITH_UDPFROMTO := /**/
+AC_WITH_VMPS := 1
+AC_ut_xtime := ut_tv.tv_sec
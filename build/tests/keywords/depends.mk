@@ -0,0 +1,236 @@
+build/tests/keywords/3gpp:  build/tests/keywords/update
+
+build/tests/keywords/array:  build/tests/keywords/if
+
+build/tests/keywords/base64:  build/tests/keywords/hex
+
+build/tests/keywords/cache:  build/tests/keywords/update build/tests/keywords/if
+
+build/tests/keywords/cache-htable:  build/tests/keywords/update build/tests/keywords/if build/tests/keywords/cache
+
+build/tests/keywords/case-attr-error:  build/tests/keywords/case-empty
+
+build/tests/keywords/case-empty:  build/tests/keywords/switch
+
+build/tests/keywords/case-empty-string:  build/tests/keywords/switch
+
+build/tests/keywords/cast-byte:  build/tests/keywords/update build/tests/keywords/if
+
+build/tests/keywords/cast-integer:  build/tests/keywords/update build/tests/keywords/if
+
+build/tests/keywords/cast-ipaddr:  build/tests/keywords/update build/tests/keywords/if
+
+build/tests/keywords/cast-short:  build/tests/keywords/update build/tests/keywords/if
+
+build/tests/keywords/cmp:  build/tests/keywords/update
+
+build/tests/keywords/cmp-ipaddr:  build/tests/keywords/update
+
+build/tests/keywords/comments:  build/tests/keywords/update build/tests/keywords/if
+
+build/tests/keywords/crypt:  build/tests/keywords/update build/tests/keywords/if
+
+build/tests/keywords/else-error:  build/tests/keywords/update build/tests/keywords/if
+
+build/tests/keywords/escape:  build/tests/keywords/update build/tests/keywords/if build/tests/keywords/xlat-attr-index
+
+build/tests/keywords/escape-sequences:  build/tests/keywords/update build/tests/keywords/if build/tests/keywords/xlat-attr-index
+
+build/tests/keywords/expand:  build/tests/keywords/update build/tests/keywords/switch
+
+build/tests/keywords/expr:  build/tests/keywords/update build/tests/keywords/if
+
+build/tests/keywords/foreach-break:  build/tests/keywords/foreach
+
+build/tests/keywords/foreach-break-2:  build/tests/keywords/foreach build/tests/keywords/foreach-break
+
+build/tests/keywords/foreach-break-3:  build/tests/keywords/foreach build/tests/keywords/foreach-break
+
+build/tests/keywords/foreach-break-4:  build/tests/keywords/foreach build/tests/keywords/foreach-break-3
+
+build/tests/keywords/foreach-isolation:  build/tests/keywords/foreach build/tests/keywords/if-multivalue
+
+build/tests/keywords/foreach-nested:  build/tests/keywords/foreach
+
+build/tests/keywords/foreach-regex:  build/tests/keywords/foreach build/tests/keywords/if-regex-match
+
+build/tests/keywords/foreach-return:  build/tests/keywords/foreach build/tests/keywords/foreach-break
+
+build/tests/keywords/hex:  build/tests/keywords/update
+
+build/tests/keywords/if:  build/tests/keywords/update
+
+build/tests/keywords/if-bob:  build/tests/keywords/if
+
+build/tests/keywords/if-chain:  build/tests/keywords/if-elsif
+
+build/tests/keywords/if-else:  build/tests/keywords/if
+
+build/tests/keywords/if-elsif:  build/tests/keywords/if build/tests/keywords/if-else
+
+build/tests/keywords/if-multivalue:  build/tests/keywords/update build/tests/keywords/if
+
+build/tests/keywords/if-paircmp:  build/tests/keywords/update build/tests/keywords/if
+
+build/tests/keywords/if-prefix:  build/tests/keywords/update build/tests/keywords/if build/tests/keywords/ipprefix
+
+build/tests/keywords/if-rcode-error:  build/tests/keywords/if
+
+build/tests/keywords/if-regex-bad-attribute:  build/tests/keywords/if-regex-match build/tests/keywords/if-regex-error
+
+build/tests/keywords/if-regex-error:  build/tests/keywords/if-regex-match
+
+build/tests/keywords/if-regex-match:  build/tests/keywords/if
+
+build/tests/keywords/if-regex-match-comp:  build/tests/keywords/if
+
+build/tests/keywords/if-regex-match-named:  build/tests/keywords/if
+
+build/tests/keywords/if-regex-multivalue:  build/tests/keywords/update build/tests/keywords/if
+
+build/tests/keywords/if-skip:  build/tests/keywords/if
+
+build/tests/keywords/integer:  build/tests/keywords/update
+
+build/tests/keywords/ipaddr:  build/tests/keywords/update build/tests/keywords/if
+
+build/tests/keywords/ipaddr-error:  build/tests/keywords/update build/tests/keywords/ipaddr
+
+build/tests/keywords/ipprefix:  build/tests/keywords/update build/tests/keywords/if
+
+build/tests/keywords/length:  build/tests/keywords/hex
+
+build/tests/keywords/load-balance:  build/tests/keywords/update build/tests/keywords/if build/tests/keywords/foreach
+
+build/tests/keywords/map-xlat:  build/tests/keywords/update
+
+build/tests/keywords/md5:  build/tests/keywords/update build/tests/keywords/if
+
+build/tests/keywords/module-failure-message:  build/tests/keywords/update
+
+build/tests/keywords/pad:  build/tests/keywords/if build/tests/keywords/update build/tests/keywords/return
+
+build/tests/keywords/pairs:  build/tests/keywords/update build/tests/keywords/if
+
+build/tests/keywords/pap:  build/tests/keywords/update build/tests/keywords/if
+
+build/tests/keywords/pap-ssha2:  build/tests/keywords/update build/tests/keywords/if build/tests/keywords/pap
+
+build/tests/keywords/redundant:  build/tests/keywords/update build/tests/keywords/if build/tests/keywords/foreach
+
+build/tests/keywords/redundant-load-balance:  build/tests/keywords/update build/tests/keywords/if build/tests/keywords/foreach
+
+build/tests/keywords/redundant-redundant:  build/tests/keywords/update build/tests/keywords/if build/tests/keywords/foreach build/tests/keywords/redundant build/tests/keywords/redundant-load-balance
+
+build/tests/keywords/regex-escape:  build/tests/keywords/update build/tests/keywords/if
+
+build/tests/keywords/regex-lhs:  build/tests/keywords/update build/tests/keywords/if build/tests/keywords/regex-escape
+
+build/tests/keywords/return:  build/tests/keywords/update build/tests/keywords/if
+
+build/tests/keywords/return-group:  build/tests/keywords/return
+
+build/tests/keywords/return-section:  build/tests/keywords/update build/tests/keywords/if
+
+build/tests/keywords/sha1:  build/tests/keywords/update build/tests/keywords/if
+
+build/tests/keywords/sha2:  build/tests/keywords/update build/tests/keywords/if
+
+build/tests/keywords/smash:  build/tests/keywords/update
+
+build/tests/keywords/string:  build/tests/keywords/cmp
+
+build/tests/keywords/switch-attr-cast:  build/tests/keywords/switch build/tests/keywords/switch-attr-cmp
+
+build/tests/keywords/switch-attr-cmp:  build/tests/keywords/switch
+
+build/tests/keywords/switch-default:  build/tests/keywords/switch
+
+build/tests/keywords/switch-hash:  build/tests/keywords/switch build/tests/keywords/switch-default
+
+build/tests/keywords/switch-value-error:  build/tests/keywords/switch
+
+build/tests/keywords/switch-value-error2:  build/tests/keywords/switch-value-error
+
+build/tests/keywords/switch-virtual:  build/tests/keywords/update build/tests/keywords/switch
+
+build/tests/keywords/switch-xlat-error:  build/tests/keywords/switch
+
+build/tests/keywords/unknown:  build/tests/keywords/wimax
+
+build/tests/keywords/unknown-if:  build/tests/keywords/unknown-update
+
+build/tests/keywords/unknown-name:  build/tests/keywords/update build/tests/keywords/unknown
+
+build/tests/keywords/unknown-update:  build/tests/keywords/update build/tests/keywords/unknown
+
+build/tests/keywords/update-add-ref-index:  build/tests/keywords/update build/tests/keywords/array
+
+build/tests/keywords/update-add-ref-tag:  build/tests/keywords/update build/tests/keywords/array
+
+build/tests/keywords/update-all:  build/tests/keywords/update
+
+build/tests/keywords/update-array:  build/tests/keywords/update build/tests/keywords/array
+
+build/tests/keywords/update-delete:  build/tests/keywords/update
+
+build/tests/keywords/update-error:  build/tests/keywords/update
+
+build/tests/keywords/update-error-2:  build/tests/keywords/update-error
+
+build/tests/keywords/update-error-3:  build/tests/keywords/update-error
+
+build/tests/keywords/update-exec:  build/tests/keywords/update build/tests/keywords/if build/tests/keywords/redundant
+
+build/tests/keywords/update-filter:  build/tests/keywords/update
+
+build/tests/keywords/update-index:  build/tests/keywords/update build/tests/keywords/update-remove-index
+
+build/tests/keywords/update-list-error:  build/tests/keywords/update
+
+build/tests/keywords/update-operator:  build/tests/keywords/update
+
+build/tests/keywords/update-remove-any:  build/tests/keywords/update
+
+build/tests/keywords/update-remove-index:  build/tests/keywords/update build/tests/keywords/update-remove-value
+
+build/tests/keywords/update-remove-list:  build/tests/keywords/update
+
+build/tests/keywords/update-remove-tag:  build/tests/keywords/update build/tests/keywords/update-remove-value build/tests/keywords/update-remove-index build/tests/keywords/update-tag
+
+build/tests/keywords/update-remove-value:  build/tests/keywords/update
+
+build/tests/keywords/update-tag:  build/tests/keywords/update
+
+build/tests/keywords/update-xlat:  build/tests/keywords/update
+
+build/tests/keywords/urlquote:  build/tests/keywords/update build/tests/keywords/if
+
+build/tests/keywords/virtual:  build/tests/keywords/update build/tests/keywords/if
+
+build/tests/keywords/virtual-exists:  build/tests/keywords/update build/tests/keywords/if
+
+build/tests/keywords/virtual-load-balance:  build/tests/keywords/update build/tests/keywords/if build/tests/keywords/foreach
+
+build/tests/keywords/virtual-rhs:  build/tests/keywords/update build/tests/keywords/if
+
+build/tests/keywords/virtual_policy:  build/tests/keywords/update build/tests/keywords/if build/tests/keywords/foreach
+
+build/tests/keywords/with_dots:  build/tests/keywords/update
+
+build/tests/keywords/xlat-attr:  build/tests/keywords/update
+
+build/tests/keywords/xlat-attr-index:  build/tests/keywords/update
+
+build/tests/keywords/xlat-attr-tag:  build/tests/keywords/update
+
+build/tests/keywords/xlat-error:  build/tests/keywords/if build/tests/keywords/xlat-attr-tag
+
+build/tests/keywords/xlat-explode:  build/tests/keywords/update
+
+build/tests/keywords/xlat-list:  build/tests/keywords/update
+
+build/tests/keywords/xlat-octets:  build/tests/keywords/update build/tests/keywords/if
+
+build/tests/keywords/xlat-virtual-attr:  build/tests/keywords/if
+
@@ -0,0 +1,24 @@
+build/tests/modules/files/default: build/tests/modules/files/files
+
+build/tests/modules/files/doug: build/tests/modules/files/files
+
+build/tests/modules/ldap/acct: build/tests/modules/ldap/auth
+
+build/tests/modules/preprocess/huntgroup: build/tests/modules/preprocess/xlat
+
+build/tests/modules/sql/acct_1_update: build/tests/modules/sql/acct_0_start
+
+build/tests/modules/sql/acct_2_stop: build/tests/modules/sql/acct_1_update
+
+build/tests/modules/sql_mysql/acct_1_update: build/tests/modules/sql_mysql/acct_0_start
+
+build/tests/modules/sql_mysql/acct_2_stop: build/tests/modules/sql_mysql/acct_1_update
+
+build/tests/modules/sql_postgresql/acct_1_update: build/tests/modules/sql_postgresql/acct_0_start
+
+build/tests/modules/sql_postgresql/acct_2_stop: build/tests/modules/sql_postgresql/acct_1_update
+
+build/tests/modules/sql_sqlite/acct_1_update: build/tests/modules/sql_sqlite/acct_0_start
+
+build/tests/modules/sql_sqlite/acct_2_stop: build/tests/modules/sql_sqlite/acct_1_update
+
@@ -22,7 +22,7 @@
  * Copyright 2015 Alan DeKok <aland@deployingradius.com>
  */
 
-RCSIDH(heap_h, "$Id$")
+RCSIDH(channel_h, "$Id$")
 
 #ifdef __cplusplus
 extern "C" {
@@ -37,6 +37,18 @@ extern "C" {
 RADIUS_PACKET *fr_dhcp_recv(int sockfd);
 int fr_dhcp_send(RADIUS_PACKET *packet);
 
+/*
+ *	The most packets read or written with one system call.
+ */
+#define DHCP_BATCH_SIZE (32)
+
+typedef struct fr_dhcp_batch fr_dhcp_batch_t;
+
+fr_dhcp_batch_t *fr_dhcp_batch_alloc(TALLOC_CTX *ctx, int sockfd);
+int fr_dhcp_batch_recv(fr_dhcp_batch_t *batch);
+RADIUS_PACKET *fr_dhcp_batch_packet(fr_dhcp_batch_t *batch, int i);
+int fr_dhcp_batch_send(fr_dhcp_batch_t *batch, RADIUS_PACKET *packet);
+
 int fr_dhcp_add_arp_entry(int fd, char const *interface, VALUE_PAIR *hwvp, VALUE_PAIR *clvp);
 
 int8_t fr_dhcp_attr_cmp(void const *a, void const *b);
@@ -874,6 +874,7 @@ typedef enum {
 #define RBTREE_FLAG_NONE    (0)
 #define RBTREE_FLAG_REPLACE (1 << 0)
 #define RBTREE_FLAG_LOCK    (1 << 1)
+#define RBTREE_FLAG_RWLOCK  (1 << 2)	//!< Lock, but let lookups and walks run in parallel.
 
 typedef int (*rb_comparator_t)(void const *ctx, void const *data);
 typedef int (*rb_walker_t)(void *ctx, void *data);
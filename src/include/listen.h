@@ -146,6 +146,16 @@ typedef struct listen_socket_t {
 	pthread_mutex_t mutex;
 	uint8_t		*data;
 	size_t		partial;
+
+	/* for coalescing packets sent to home servers */
+	pthread_mutex_t	send_mutex;	//!< Protects send_queue.
+	uint8_t		*send_queue;	//!< Packets waiting to be written.
+	size_t		send_queue_used;
+	int		send_queue_packets;
+	int		**send_error;	//!< Where to tell each queued sender how
+					//!< its packet was written.
+	uint8_t		*send_spare;	//!< Being written, owned by the holder of "mutex".
+	int		**send_spare_error;
 #endif
 
 	RADCLIENT_LIST	*clients;
@@ -54,13 +54,21 @@ typedef struct module_instance_t {
 	bool			force;
 	rlm_rcode_t		code;
 	fr_module_hup_t	       	*mh;
+#ifdef WITH_STATS
+	fr_stats_latency_t	stats;		//!< Time spent in the module's methods.
+#endif
 } module_instance_t;
 
+#ifdef WITH_STATS
+extern fr_stats_latency_t	radius_section_stats[MOD_COUNT];	//!< Time spent in each section, by component.
+#endif
+
 module_instance_t	*module_instantiate(CONF_SECTION *modules, char const *askedname);
 module_instance_t	*module_instantiate_method(CONF_SECTION *modules, char const *askedname, rlm_components_t *method);
 module_instance_t	*module_find(CONF_SECTION *modules, char const *askedname);
 int			find_module_sibling_section(CONF_SECTION **out, CONF_SECTION *module, char const *name);
 int			module_hup_module(CONF_SECTION *cs, module_instance_t *node, time_t when);
+int			module_instance_walk(rb_walker_t callback, void *ctx);
 
 #ifdef __cplusplus
 }
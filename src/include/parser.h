@@ -84,6 +84,9 @@ struct fr_cond_t {
 
 	DICT_ATTR const *cast;
 
+	bool		fast_cmp;	//!< LHS attribute can be compared directly against RHS data.
+	VALUE_PAIR	*check;		//!< Pre-built check pair for PASS2_PAIRCOMPARE.
+
 	fr_cond_op_t	next_op;
 	fr_cond_t	*next;
 };
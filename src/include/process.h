@@ -64,6 +64,9 @@ extern time_t fr_start_time;
 int request_enqueue(REQUEST *request);
 #endif
 
+TALLOC_CTX *request_pool_alloc(char const *name);
+void request_pool_free(TALLOC_CTX *ctx);
+
 int request_receive(TALLOC_CTX *ctx, rad_listen_t *listener, RADIUS_PACKET *packet,
 		    RADCLIENT *client, RAD_REQUEST_FUNP fun);
 
@@ -55,6 +55,33 @@ typedef struct rc_stats {
 	uint64_t failed;		//!< Requests which failed a fitler
 } rc_stats_t;
 
+/*
+ *	Latency histogram, used in load mode.
+ *
+ *	Values below RC_HIST_SUB are counted exactly.  Above that, each
+ *	power of two is split into RC_HIST_SUB buckets, so a bucket is
+ *	never wider than 1/RC_HIST_SUB of the values it holds.
+ */
+#define RC_HIST_SUB_BITS	5
+#define RC_HIST_SUB		(1 << RC_HIST_SUB_BITS)
+#define RC_HIST_BUCKETS		((32 - RC_HIST_SUB_BITS + 1) * RC_HIST_SUB)
+
+typedef struct rc_histogram {
+	uint64_t	count;				//!< Number of values recorded.
+	uint32_t	max;				//!< Largest value recorded.
+	uint64_t	bucket[RC_HIST_BUCKETS];
+} rc_histogram_t;
+
+typedef struct rc_load_stats {
+	uint64_t	sent;			//!< Requests sent.
+	uint64_t	received;		//!< Replies received.
+	uint64_t	accepted;		//!< Access-Accept, Accounting-Response, CoA-ACK, etc.
+	uint64_t	rejected;		//!< Any other reply.
+	uint64_t	lost;			//!< Requests which timed out.
+	uint64_t	errors;			//!< Requests we failed to send.
+	rc_histogram_t	latency;		//!< Latency of replies, in microseconds.
+} rc_load_stats_t;
+
 typedef struct rc_file_pair {
 	char const *packets;		//!< The file containing the request packet
 	char const *filters;		//!< The file containing the definition of the
@@ -83,6 +110,8 @@ struct rc_request {
 	int		tries;
 	bool		done;		//!< Whether the request is complete.
 
+	uint64_t	sent_at;	//!< When the request was sent, in microseconds (load mode).
+
 	char const	*name;		//!< Test name (as specified in the request).
 };
 
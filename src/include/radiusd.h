@@ -158,6 +158,8 @@ typedef struct main_config {
 	struct timeval	init_delay;			//!< Initial request processing delay.
 
 	uint32_t       	talloc_pool_size;		//!< Size of pool to allocate to hold each #REQUEST.
+	uint32_t	talloc_pool_cache;		//!< Maximum number of empty pools to keep for
+							//!< re-use by new requests.
 	bool		debug_memory;			//!< Cleanup the server properly on exit, freeing
 							//!< up any memory we allocated.
 	bool		memory_report;			//!< Print a memory report on what's left unfreed.
@@ -244,6 +246,9 @@ struct rad_request {
 	fr_request_process_t	process;	//!< The function to call to move the request through the state machine.
 
 	struct timeval		response_delay;	//!< How long to wait before sending Access-Rejects.
+#ifdef WITH_STATS
+	struct timeval		queued;		//!< When the request was last put into the thread pool queue.
+#endif
 	fr_state_action_t	timer_action;	//!< What action to perform when the timer event fires.
 	fr_event_t		*ev;		//!< Event in event loop tied to this request.
 
@@ -35,6 +35,10 @@ RCSIDH(radsniff_h, "$Id$")
 #  include <collectd/client.h>
 #endif
 
+#ifdef WITH_THREADS
+#  include <pthread.h>
+#endif
+
 #define RS_DEFAULT_PREFIX	"radsniff"	//!< Default instance
 #define RS_DEFAULT_SECRET	"testing123"	//!< Default secret
 #define RS_DEFAULT_TIMEOUT	5200		//!< Standard timeout of 5s + 300ms to cover network latency
@@ -42,6 +46,10 @@ RCSIDH(radsniff_h, "$Id$")
 #define RS_RETRANSMIT_MAX	5		//!< Maximum number of times we expect to see a packet retransmitted
 #define RS_MAX_ATTRS		50		//!< Maximum number of attributes we can filter on.
 #define RS_SOCKET_REOPEN_DELAY  5000		//!< How long we delay re-opening a collectd socket.
+#define RS_WORKER_MAX		64		//!< Maximum number of worker threads.
+#define RS_WORKER_BACKLOG	65536		//!< Maximum number of packets queued for a single worker.
+#define RS_WORKER_TICK		100		//!< How often (in ms) idle workers expire requests during
+						//!< live capture.
 
 /*
  *	Logging macros
@@ -83,6 +91,7 @@ typedef enum {
 } stats_out_t;
 
 typedef struct rs rs_t;
+typedef struct rs_worker rs_worker_t;
 
 #ifdef HAVE_COLLECTDC_H
 typedef struct rs_stats_tmpl rs_stats_tmpl_t;
@@ -177,6 +186,7 @@ typedef struct rs_request {
 
 	struct timeval		when;			//!< Time when the packet was received, or next time an event
 							//!< is scheduled.
+	rs_worker_t		*worker;		//!< Worker whose trees and event list the request is in.
 	fr_pcap_t		*in;			//!< PCAP handle the original request was received on.
 	RADIUS_PACKET		*packet;		//!< The original packet.
 	RADIUS_PACKET		*expect;		//!< Request/response.
@@ -212,9 +222,57 @@ typedef struct rs_event {
 	fr_pcap_t		*in;			//!< PCAP handle event occurred on.
 	fr_pcap_t		*out;			//!< Where to write output.
 
-	rs_stats_t		*stats;			//!< Where to write stats.
+	struct rs_update	*stats;			//!< Stats to start processing when the first packet
+							//!< is read from a file.
 } rs_event_t;
 
+/** A packet copied out of the capture buffer, waiting to be processed by a worker
+ *
+ */
+typedef struct rs_packet rs_packet_t;
+struct rs_packet {
+	uint64_t		count;			//!< Packet counter value assigned by the reader.
+	rs_event_t		*event;			//!< Input the packet was read from.
+	rs_packet_t		*next;			//!< Next packet in the worker's queue.
+
+	struct pcap_pkthdr	header;			//!< PCAP packet header.
+	uint8_t			data[];			//!< PCAP packet data.
+};
+
+/** Decode and matching state
+ *
+ * Packets are sharded between workers using their IP addresses, so requests, their responses
+ * and any retransmissions always end up with the same worker.  Without worker threads there's
+ * a single worker, and packets are processed by the thread which reads them.
+ */
+struct rs_worker {
+	int			id;			//!< Worker number.
+
+	fr_event_list_t		*list;			//!< Request cleanup events.
+	rbtree_t		*request_tree;		//!< Requests waiting for responses.
+	rbtree_t		*link_tree;		//!< Requests indexed by their linking attributes.
+	rs_stats_t		*stats;			//!< Stats for packets processed by this worker, merged
+							//!< with the global stats at each interval.
+
+#ifdef WITH_THREADS
+	pthread_t		thread;			//!< The worker thread.
+	pthread_mutex_t		mutex;			//!< Held whilst the worker is processing packets,
+							//!< or its stats are being merged.
+
+	pthread_mutex_t		queue_mutex;		//!< Protects the packet queue.
+	pthread_cond_t		queue_cond;		//!< Signalled when packets are queued, or the worker
+							//!< should exit.
+	pthread_cond_t		space_cond;		//!< Signalled when the worker has emptied the queue,
+							//!< and when it's processed the packets it took.
+	rs_packet_t		*head;			//!< First packet in the queue.
+	rs_packet_t		**tail;			//!< Where to add the next packet.
+	int			queued;			//!< Number of packets in the queue.
+	uint64_t		dropped;		//!< Packets dropped because the queue was full.
+	bool			busy;			//!< Processing packets taken from the queue.
+	bool			done;			//!< The reader has finished, exit once the queue is empty.
+#endif
+};
+
 /** FD data which gets passed to callbacks
  *
  */
@@ -223,6 +281,9 @@ typedef struct rs_update {
 
 	fr_pcap_t		*in;			//!< Linked list of PCAP handles to check for drops.
 	rs_stats_t		*stats;			//!< Stats to process.
+
+	struct timeval		when;			//!< When the current interval ends.  Packet timestamps
+							//!< are used instead of the clock when reading from files.
 } rs_update_t;
 
 
@@ -269,6 +330,9 @@ struct rs {
 	int			buffer_pkts;		//!< Size of the ring buffer to setup for live capture.
 	uint64_t		limit;			//!< Maximum number of packets to capture
 
+	int			workers;		//!< Number of worker threads. If 0 packets are processed
+							//!< by the thread which reads them.
+
 	struct {
 		int			interval;		//!< Time between stats updates in seconds.
 		stats_out_t		out;			//!< Where to write stats.
@@ -46,6 +46,9 @@ typedef enum {
 typedef struct fr_socket_limit_t {
 	uint32_t	max_connections;
 	uint32_t	num_connections;
+	uint32_t	min_connections;	//!< Connections to keep open to a home server.
+	uint32_t	spare_ids;		//!< Open another connection to a home server when
+						//!< the least loaded one has fewer free Ids than this.
 	uint32_t	max_requests;
 	uint32_t	num_requests;
 	uint32_t	lifetime;
@@ -78,6 +81,8 @@ typedef struct home_server {
 	int			proto;			//!< TCP or UDP.
 
 	fr_socket_limit_t 	limit;
+	bool			coalesce_writes;	//!< Write packets queued by several threads as
+							//!< one TLS record.
 
 	char const		*secret;
 
@@ -32,6 +32,15 @@ extern "C" {
 
 typedef struct fr_state_t fr_state_t;
 
+typedef struct fr_state_stats_t {
+	uint32_t	shards;			//!< Number of independently locked shards.
+	uint32_t	entries;		//!< Entries in all shards.
+	uint32_t	max_shard_entries;	//!< Entries in the fullest shard.
+	uint64_t	expired;		//!< Entries removed by the expiry timer.
+	uint64_t	full;			//!< Entries not created because the table was full.
+	uint64_t	contended;		//!< Times a shard lock was already held.
+} fr_state_stats_t;
+
 fr_state_t *fr_state_init(TALLOC_CTX *ctx);
 void fr_state_delete(fr_state_t *state);
 
@@ -45,6 +54,8 @@ void *fr_state_get_data(fr_state_t *state, REQUEST *request, RADIUS_PACKET *pack
 bool fr_state_put_data(fr_state_t *state, REQUEST *request, RADIUS_PACKET *original, RADIUS_PACKET *packet,
 		       void *data, void (*free_data)(void *));
 
+void fr_state_stats(fr_state_stats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -30,6 +30,46 @@ extern "C" {
 #endif
 
 #ifdef WITH_STATS
+/*
+ *	Log-linear latency histogram, in the style of HdrHistogram.
+ *
+ *	Values below FR_STATS_HIST_SUB microseconds are recorded
+ *	exactly.  Above that, every power of two is split into
+ *	FR_STATS_HIST_SUB linear buckets, so the error of any
+ *	reported percentile is bounded by 1/FR_STATS_HIST_SUB
+ *	(12.5%).  The last bucket holds everything above ~134s.
+ */
+#define FR_STATS_HIST_SUB_BITS	(3)
+#define FR_STATS_HIST_SUB	(1 << FR_STATS_HIST_SUB_BITS)
+#define FR_STATS_HIST_OCTAVES	(25)
+#define FR_STATS_HIST_BUCKETS	(FR_STATS_HIST_SUB * FR_STATS_HIST_OCTAVES)
+
+typedef struct fr_stats_hist_t {
+	uint64_t	count;				//!< Number of samples.
+	uint64_t	sum;				//!< Sum of all samples (usec).
+	uint32_t	max;				//!< Largest sample seen (usec).
+	uint32_t	bucket[FR_STATS_HIST_BUCKETS];
+} fr_stats_hist_t;
+
+/*
+ *	Latency histogram which is written to by many threads.
+ *
+ *	A thread which has claimed a shard with radius_stats_thread_init()
+ *	is its only writer, so recording takes no lock and does not
+ *	bounce cache lines between CPUs.  Threads which couldn't claim
+ *	one (or never tried) write to shard 0 under a mutex.  Readers
+ *	merge the shards with fr_stats_latency_merge().
+ *
+ *	Shards are allocated when they're first written to, so that
+ *	histograms which few threads (or none) write to stay small.
+ *	They're released with fr_stats_latency_free().
+ */
+#define FR_STATS_SHARDS		(32)
+
+typedef struct fr_stats_latency_t {
+	fr_stats_hist_t	*shard[FR_STATS_SHARDS];
+} fr_stats_latency_t;
+
 typedef struct fr_stats_t {
 	uint64_t	total_requests;
 	uint64_t	total_invalid_requests;
@@ -46,6 +86,7 @@ typedef struct fr_stats_t {
 	uint64_t	total_timeouts;
 	time_t		last_packet;
 	uint64_t	elapsed[8];
+	fr_stats_hist_t	latency;
 } fr_stats_t;
 
 typedef struct fr_stats_ema_t {
@@ -74,18 +115,31 @@ extern fr_stats_t	proxy_dsc_stats;
 #endif
 #endif
 
+extern fr_stats_latency_t	radius_queue_wait_stats;
+extern fr_stats_latency_t	radius_processing_stats;
+
 void radius_stats_init(int flag);
+void radius_stats_thread_init(int thread_num);
 void request_stats_final(REQUEST *request);
 void request_stats_reply(REQUEST *request);
 void radius_stats_ema(fr_stats_ema_t *ema,
 		      struct timeval *start, struct timeval *end);
 
+bool fr_stats_tv_usec(uint32_t *out, struct timeval const *start, struct timeval const *end);
+void fr_stats_hist_add(fr_stats_hist_t *hist, uint32_t usec);
+void fr_stats_hist_merge(fr_stats_hist_t *out, fr_stats_hist_t const *in);
+uint32_t fr_stats_hist_percentile(fr_stats_hist_t const *hist, double pct);
+void fr_stats_latency_add(fr_stats_latency_t *lat, struct timeval const *start, struct timeval const *end);
+void fr_stats_latency_merge(fr_stats_hist_t *out, fr_stats_latency_t const *lat);
+void fr_stats_latency_free(fr_stats_latency_t *lat);
+
 #define FR_STATS_INC(_x, _y) radius_ ## _x ## _stats._y++;if (listener) listener->stats._y++;if (client) client->_x._y++;
 #define FR_STATS_TYPE_INC(_x) _x++
 
 #else  /* WITH_STATS */
 #define request_stats_init(_x)
 #define request_stats_final(_x)
+#define radius_stats_thread_init(_x)
 
 #define FR_STATS_INC(_x, _y)
 #define FR_STATS_TYPE_INC(_x)
@@ -15,6 +15,12 @@ extern "C" {
 #endif
 
 #ifdef WITH_UDPFROMTO
+/*
+ *	Size of the control buffer needed for the source or
+ *	destination address of one packet.
+ */
+#define UDPFROMTO_CMSG_SIZE	(256)
+
 int udpfromto_init(int s);
 int recvfromto(int s, void *buf, size_t len, int flags,
 	       struct sockaddr *from, socklen_t *fromlen,
@@ -22,6 +28,16 @@ int recvfromto(int s, void *buf, size_t len, int flags,
 int sendfromto(int s, void *buf, size_t len, int flags,
 	       struct sockaddr *from, socklen_t fromlen,
 	       struct sockaddr *to, socklen_t tolen);
+
+#ifdef HAVE_RECVMMSG
+int recvmmsgfromto(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags,
+		   struct sockaddr_storage *to, socklen_t *tolen);
+#endif
+
+#ifdef HAVE_SENDMMSG
+int sendmmsgfromto(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags,
+		   struct sockaddr_storage const *from);
+#endif
 #endif
 
 #ifdef __cplusplus
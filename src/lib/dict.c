@@ -28,6 +28,7 @@ RCSID("$Id$")
 #endif
 
 #include	<ctype.h>
+#include	<fcntl.h>
 
 #ifdef HAVE_MALLOC_H
 #include	<malloc.h>
@@ -37,6 +38,10 @@ RCSID("$Id$")
 #include	<sys/stat.h>
 #endif
 
+#ifdef HAVE_SYS_MMAN_H
+#include	<sys/mman.h>
+#endif
+
 static fr_hash_table_t *vendors_byname = NULL;
 static fr_hash_table_t *vendors_byvalue = NULL;
 
@@ -422,6 +427,163 @@ static int dict_stat_check(char const *dir, char const *file)
 	return 0;
 }
 
+/*
+ *	A compiled copy of the dictionaries, so that programs which
+ *	are started often don't have to parse all of the text files.
+ *
+ *	While dict_init() reads the text files, each vendor, attribute,
+ *	VALUE and VALUE-ALIAS it adds is also appended to a buffer, as
+ *	is the name, size and mtime of each file which was read.  These
+ *	are written to the cache file.  The next dict_init() checks the
+ *	files against the cache, and if none of them have changed, it
+ *	adds the entries from the cache instead of reading the files.
+ *
+ *	The cache is used when FR_DICTIONARY_CACHE is set to the name
+ *	of the cache file.
+ */
+#define DICT_CACHE_MAGIC	"FRDICT01"
+#define DICT_CACHE_MAGIC_LEN	(8)
+
+typedef enum dict_cache_type_t {
+	DICT_CACHE_VENDOR = 1,
+	DICT_CACHE_ATTRIBUTE,
+	DICT_CACHE_VALUE,
+	DICT_CACHE_VALUE_ALIAS
+} dict_cache_type_t;
+
+typedef struct dict_cache_buf_t {
+	uint8_t		*data;
+	size_t		len;
+	size_t		size;
+} dict_cache_buf_t;
+
+static bool		dict_cache_recording = false;
+static dict_cache_buf_t	dict_cache_files;
+static uint32_t		dict_cache_num_files = 0;
+static dict_cache_buf_t	dict_cache_entries;
+
+/*
+ *	Stop recording, and throw away what we have.
+ */
+static void dict_cache_reset(void)
+{
+	free(dict_cache_files.data);
+	free(dict_cache_entries.data);
+	memset(&dict_cache_files, 0, sizeof(dict_cache_files));
+	memset(&dict_cache_entries, 0, sizeof(dict_cache_entries));
+	dict_cache_num_files = 0;
+	dict_cache_recording = false;
+}
+
+static void dict_cache_put(dict_cache_buf_t *buf, void const *data, size_t len)
+{
+	if (!dict_cache_recording) return;
+
+	if ((buf->len + len) > buf->size) {
+		uint8_t *p;
+		size_t size = buf->size ? buf->size : 65536;
+
+		while (size < (buf->len + len)) size *= 2;
+
+		/*
+		 *	Out of memory.  Don't write the cache this time.
+		 */
+		p = realloc(buf->data, size);
+		if (!p) {
+			dict_cache_reset();
+			return;
+		}
+
+		buf->data = p;
+		buf->size = size;
+	}
+
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+}
+
+static void dict_cache_put_u32(dict_cache_buf_t *buf, uint32_t value)
+{
+	dict_cache_put(buf, &value, sizeof(value));
+}
+
+/*
+ *	Strings are stored with their trailing NUL, so they can be
+ *	used directly from the mapped cache file.
+ */
+static void dict_cache_put_str(dict_cache_buf_t *buf, char const *str)
+{
+	size_t len = strlen(str) + 1;
+
+	dict_cache_put_u32(buf, len);
+	dict_cache_put(buf, str, len);
+}
+
+static void dict_cache_add_file(char const *fn, struct stat const *stat_buf)
+{
+	int64_t mtime = stat_buf->st_mtime;
+	int64_t size = stat_buf->st_size;
+
+	if (!dict_cache_recording) return;
+
+	dict_cache_put_str(&dict_cache_files, fn);
+	dict_cache_put(&dict_cache_files, &mtime, sizeof(mtime));
+	dict_cache_put(&dict_cache_files, &size, sizeof(size));
+	dict_cache_num_files++;
+}
+
+static void dict_cache_add_vendor(char const *name, DICT_VENDOR const *dv)
+{
+	uint8_t type = DICT_CACHE_VENDOR;
+
+	if (!dict_cache_recording) return;
+
+	dict_cache_put(&dict_cache_entries, &type, sizeof(type));
+	dict_cache_put_str(&dict_cache_entries, name);
+	dict_cache_put_u32(&dict_cache_entries, dv->vendorpec);
+	dict_cache_put_u32(&dict_cache_entries, dv->type);
+	dict_cache_put_u32(&dict_cache_entries, dv->length);
+	dict_cache_put_u32(&dict_cache_entries, dv->flags);
+}
+
+static void dict_cache_add_attr(char const *name, int attr, unsigned int vendor, PW_TYPE type,
+				ATTR_FLAGS const *flags)
+{
+	uint8_t entry = DICT_CACHE_ATTRIBUTE;
+
+	if (!dict_cache_recording) return;
+
+	dict_cache_put(&dict_cache_entries, &entry, sizeof(entry));
+	dict_cache_put_str(&dict_cache_entries, name);
+	dict_cache_put_u32(&dict_cache_entries, attr);
+	dict_cache_put_u32(&dict_cache_entries, vendor);
+	dict_cache_put_u32(&dict_cache_entries, type);
+	dict_cache_put(&dict_cache_entries, flags, sizeof(*flags));
+}
+
+static void dict_cache_add_value(char const *namestr, char const *attrstr, int value)
+{
+	uint8_t type = DICT_CACHE_VALUE;
+
+	if (!dict_cache_recording) return;
+
+	dict_cache_put(&dict_cache_entries, &type, sizeof(type));
+	dict_cache_put_str(&dict_cache_entries, namestr);
+	dict_cache_put_str(&dict_cache_entries, attrstr);
+	dict_cache_put_u32(&dict_cache_entries, value);
+}
+
+static void dict_cache_add_value_alias(char const *attrstr, char const *aliasstr)
+{
+	uint8_t type = DICT_CACHE_VALUE_ALIAS;
+
+	if (!dict_cache_recording) return;
+
+	dict_cache_put(&dict_cache_entries, &type, sizeof(type));
+	dict_cache_put_str(&dict_cache_entries, attrstr);
+	dict_cache_put_str(&dict_cache_entries, aliasstr);
+}
+
 typedef struct fr_pool_t {
 	void	*page_end;
 	void	*free_ptr;
@@ -1905,6 +2067,8 @@ static int process_attribute(char const* fn, int const line,
 		return -1;
 	}
 
+	dict_cache_add_attr(argv[0], value, vendor, type, &flags);
+
 	return 0;
 }
 
@@ -1947,6 +2111,8 @@ static int process_value(char const* fn, int const line, char **argv,
 		return -1;
 	}
 
+	dict_cache_add_value(argv[1], argv[0], value);
+
 	return 0;
 }
 
@@ -2018,6 +2184,8 @@ static int process_value_alias(char const* fn, int const line, char **argv,
 		return -1;
 	}
 
+	dict_cache_add_value_alias(argv[0], argv[1]);
+
 	return 0;
 }
 
@@ -2163,6 +2331,8 @@ static int process_vendor(char const* fn, int const line, char **argv,
 	dv->length = length;
 	dv->flags = continuation;
 
+	dict_cache_add_vendor(argv[0], dv);
+
 	return 0;
 }
 
@@ -2338,6 +2508,7 @@ static int my_dict_init(char const *parent, char const *filename,
 #endif
 
 	dict_stat_add(&statbuf);
+	dict_cache_add_file(fn, &statbuf);
 
 	/*
 	 *	Seed the random pool with data.
@@ -2624,24 +2795,10 @@ static int null_callback(UNUSED void *ctx, UNUSED void *data)
 
 
 /*
- *	Initialize the directory, then fix the attr member of
- *	all attributes.
+ *	Create the hash tables which hold the dictionaries.
  */
-int dict_init(char const *dir, char const *fn)
+static int dict_tables_create(void)
 {
-	/*
-	 *	Check if we need to change anything.  If not, don't do
-	 *	anything.
-	 */
-	if (dict_stat_check(dir, fn)) {
-		return 0;
-	}
-
-	/*
-	 *	Free the dictionaries, and the stat cache.
-	 */
-	dict_free();
-
 	/*
 	 *	Create the table of vendor by name.   There MAY NOT
 	 *	be multiple vendors of the same name.
@@ -2716,10 +2873,360 @@ int dict_init(char const *dir, char const *fn)
 		return -1;
 	}
 
+	return 0;
+}
+
+/*
+ *	Free VALUEs which are waiting for their attribute to be defined.
+ */
+static void dict_value_fixup_free(void)
+{
+	value_fixup_t *this, *next;
+
+	for (this = value_fixup; this != NULL; this = next) {
+		next = this->next;
+		free(this);
+	}
+
+	value_fixup = NULL;
+}
+
+typedef struct dict_cache_reader_t {
+	uint8_t const	*p;
+	uint8_t const	*end;
+} dict_cache_reader_t;
+
+static bool dict_cache_get(dict_cache_reader_t *r, void *out, size_t len)
+{
+	if ((size_t) (r->end - r->p) < len) return false;
+
+	memcpy(out, r->p, len);
+	r->p += len;
+
+	return true;
+}
+
+static bool dict_cache_get_u32(dict_cache_reader_t *r, uint32_t *out)
+{
+	return dict_cache_get(r, out, sizeof(*out));
+}
+
+static bool dict_cache_get_str(dict_cache_reader_t *r, char const **out)
+{
+	uint32_t len;
+
+	if (!dict_cache_get_u32(r, &len)) return false;
+
+	if ((len == 0) || ((size_t) (r->end - r->p) < len) || (r->p[len - 1] != '\0')) return false;
+
+	*out = (char const *) r->p;
+	r->p += len;
+
+	return true;
+}
+
+/*
+ *	Add the entries from the cache file.
+ *
+ *	Returns 1 if the dictionaries were loaded from the cache, 0 if
+ *	the cache can't be used, or -1 if the cache was only partially
+ *	loaded, and the dictionaries have to be freed.
+ */
+static int dict_cache_load(char const *file, char const *dict_file)
+{
+	int		fd, rcode = 0;
+	struct stat	stat_buf;
+	uint8_t		*data;
+	size_t		len;
+	dict_cache_reader_t r;
+	char		magic[DICT_CACHE_MAGIC_LEN];
+	uint64_t	magic_number;
+	uint32_t	i, num, flags_len, hash;
+	char const	*name;
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0) return 0;
+
+	/*
+	 *	Don't trust a cache which anyone can change, any more
+	 *	than we trust dictionaries which anyone can change.
+	 */
+	if ((fstat(fd, &stat_buf) < 0) || !S_ISREG(stat_buf.st_mode) || (stat_buf.st_size == 0)
+#ifdef S_IWOTH
+	    || ((stat_buf.st_mode & S_IWOTH) != 0)
+#endif
+		) {
+		close(fd);
+		return 0;
+	}
+	len = stat_buf.st_size;
+
+#ifdef HAVE_SYS_MMAN_H
+	data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) return 0;
+#else
+	data = malloc(len);
+	if (!data) {
+		close(fd);
+		return 0;
+	}
+	if (read(fd, data, len) != (ssize_t) len) {
+		close(fd);
+		free(data);
+		return 0;
+	}
+	close(fd);
+#endif
+
+	r.p = data;
+	r.end = data + len;
+
+	/*
+	 *	The cache has to come from the same version of the
+	 *	server, and be for the same dictionary.
+	 */
+	if (!dict_cache_get(&r, magic, sizeof(magic)) ||
+	    (memcmp(magic, DICT_CACHE_MAGIC, sizeof(magic)) != 0) ||
+	    !dict_cache_get(&r, &magic_number, sizeof(magic_number)) ||
+	    (magic_number != RADIUSD_MAGIC_NUMBER) ||
+	    !dict_cache_get_u32(&r, &flags_len) || (flags_len != sizeof(ATTR_FLAGS)) ||
+	    !dict_cache_get_str(&r, &name) || (strcmp(name, dict_file) != 0) ||
+	    !dict_cache_get_u32(&r, &hash) ||
+	    (fr_hash_update(r.p, r.end - r.p, 0) != hash) ||
+	    !dict_cache_get_u32(&r, &num)) goto done;
+
+	/*
+	 *	Check that none of the dictionaries have changed.
+	 *	The stat information is cached exactly as if the
+	 *	files had been read, so that dict_stat_check() works.
+	 */
+	for (i = 0; i < num; i++) {
+		int64_t mtime, size;
+		struct stat file_stat;
+
+		if (!dict_cache_get_str(&r, &name) ||
+		    !dict_cache_get(&r, &mtime, sizeof(mtime)) ||
+		    !dict_cache_get(&r, &size, sizeof(size))) goto invalid;
+
+		if ((stat(name, &file_stat) < 0) || !S_ISREG(file_stat.st_mode) ||
+		    (file_stat.st_mtime != mtime) || (file_stat.st_size != size)) goto invalid;
+
+#ifdef S_IWOTH
+		if ((file_stat.st_mode & S_IWOTH) != 0) goto invalid;
+#endif
+
+		dict_stat_add(&file_stat);
+		fr_rand_seed(&file_stat, sizeof(file_stat));
+	}
+
+	/*
+	 *	From here on, any failure means the tables contain
+	 *	some of the entries from the cache.
+	 */
+	rcode = -1;
+
+	while (r.p < r.end) {
+		uint8_t		type;
+		uint32_t	a, b, c, d;
+		char const	*other;
+
+		if (!dict_cache_get(&r, &type, sizeof(type))) goto corrupt;
+
+		switch (type) {
+		case DICT_CACHE_VENDOR:
+		{
+			DICT_VENDOR *dv;
+
+			if (!dict_cache_get_str(&r, &name) ||
+			    !dict_cache_get_u32(&r, &a) || !dict_cache_get_u32(&r, &b) ||
+			    !dict_cache_get_u32(&r, &c) || !dict_cache_get_u32(&r, &d)) goto corrupt;
+
+			if (dict_addvendor(name, a) < 0) goto done;
+
+			dv = dict_vendorbyvalue(a);
+			if (!dv) goto corrupt;
+
+			dv->type = b;
+			dv->length = c;
+			dv->flags = d;
+		}
+			break;
+
+		case DICT_CACHE_ATTRIBUTE:
+		{
+			ATTR_FLAGS flags;
+
+			if (!dict_cache_get_str(&r, &name) ||
+			    !dict_cache_get_u32(&r, &a) || !dict_cache_get_u32(&r, &b) ||
+			    !dict_cache_get_u32(&r, &c) || !dict_cache_get(&r, &flags, sizeof(flags))) goto corrupt;
+
+			if (dict_addattr(name, (int) a, b, (PW_TYPE) c, flags) < 0) goto done;
+		}
+			break;
+
+		case DICT_CACHE_VALUE:
+			if (!dict_cache_get_str(&r, &name) || !dict_cache_get_str(&r, &other) ||
+			    !dict_cache_get_u32(&r, &a)) goto corrupt;
+
+			if (dict_addvalue(name, other, (int) a) < 0) goto done;
+			break;
+
+		case DICT_CACHE_VALUE_ALIAS:
+		{
+			char *argv[2];
+
+			if (!dict_cache_get_str(&r, &name) || !dict_cache_get_str(&r, &other)) goto corrupt;
+
+			memcpy(&argv[0], &name, sizeof(argv[0]));
+			memcpy(&argv[1], &other, sizeof(argv[1]));
+
+			if (process_value_alias(file, 0, argv, 2) < 0) goto done;
+		}
+			break;
+
+		default:
+			goto corrupt;
+		}
+	}
+
+	rcode = 1;
+	goto done;
+
+corrupt:
+	fr_strerror_printf("dict_init: Invalid entry in dictionary cache \"%s\"", file);
+	goto done;
+
+invalid:
+	dict_stat_free();
+
+done:
+#ifdef HAVE_SYS_MMAN_H
+	munmap(data, len);
+#else
+	free(data);
+#endif
+
+	return rcode;
+}
+
+/*
+ *	Write what we recorded to the cache file.  Failures are
+ *	ignored, we just parse the text files again next time.
+ */
+static void dict_cache_save(char const *file, char const *dict_file)
+{
+	int			fd;
+	FILE			*fp;
+	char			buffer[1024];
+	dict_cache_buf_t	header;
+	uint64_t		magic_number = RADIUSD_MAGIC_NUMBER;
+	uint32_t		hash;
+
+	if (!dict_cache_recording) return;
+
+	memset(&header, 0, sizeof(header));
+	dict_cache_put(&header, DICT_CACHE_MAGIC, DICT_CACHE_MAGIC_LEN);
+	dict_cache_put(&header, &magic_number, sizeof(magic_number));
+	dict_cache_put_u32(&header, sizeof(ATTR_FLAGS));
+	dict_cache_put_str(&header, dict_file);
+
+	/*
+	 *	Checked on load, so that a damaged cache can't add
+	 *	bogus attributes.
+	 */
+	hash = fr_hash_update(&dict_cache_num_files, sizeof(dict_cache_num_files), 0);
+	hash = fr_hash_update(dict_cache_files.data, dict_cache_files.len, hash);
+	hash = fr_hash_update(dict_cache_entries.data, dict_cache_entries.len, hash);
+	dict_cache_put_u32(&header, hash);
+	dict_cache_put_u32(&header, dict_cache_num_files);
+
+	/*
+	 *	Write a temporary file and rename it, so that
+	 *	nothing ever reads a partially written cache.
+	 */
+	snprintf(buffer, sizeof(buffer), "%s.%u", file, (unsigned int) getpid());
+
+	fd = open(buffer, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) goto done;
+
+	fp = fdopen(fd, "w");
+	if (!fp) {
+		close(fd);
+		unlink(buffer);
+		goto done;
+	}
+
+	if (!dict_cache_recording ||
+	    (fwrite(header.data, 1, header.len, fp) != header.len) ||
+	    (fwrite(dict_cache_files.data, 1, dict_cache_files.len, fp) != dict_cache_files.len) ||
+	    (fwrite(dict_cache_entries.data, 1, dict_cache_entries.len, fp) != dict_cache_entries.len)) {
+		fclose(fp);
+		unlink(buffer);
+		goto done;
+	}
+
+	if (fclose(fp) != 0) {
+		unlink(buffer);
+		goto done;
+	}
+
+	if (rename(buffer, file) < 0) unlink(buffer);
+
+done:
+	free(header.data);
+	dict_cache_reset();
+}
+
+/*
+ *	Initialize the directory, then fix the attr member of
+ *	all attributes.
+ */
+int dict_init(char const *dir, char const *fn)
+{
+	int		rcode = 0;
+	char const	*cache_file;
+	char		dict_file[1024];
+
+	/*
+	 *	Check if we need to change anything.  If not, don't do
+	 *	anything.
+	 */
+	if (dict_stat_check(dir, fn)) {
+		return 0;
+	}
+
+	/*
+	 *	Free the dictionaries, and the stat cache.
+	 */
+	dict_free();
+
+	if (dict_tables_create() < 0) return -1;
+
 	value_fixup = NULL;	/* just to be safe. */
 
-	if (my_dict_init(dir, fn, NULL, 0) < 0)
+	cache_file = getenv("FR_DICTIONARY_CACHE");
+	if (cache_file && *cache_file) {
+		snprintf(dict_file, sizeof(dict_file), "%s/%s", dir, fn);
+
+		rcode = dict_cache_load(cache_file, dict_file);
+		if (rcode < 0) {
+			/*
+			 *	Start again, using the text files.
+			 */
+			dict_free();
+			dict_value_fixup_free();
+			if (dict_tables_create() < 0) return -1;
+			rcode = 0;
+		}
+
+		if (rcode == 0) dict_cache_recording = true;
+	}
+
+	if ((rcode == 0) && (my_dict_init(dir, fn, NULL, 0) < 0)) {
+		dict_cache_reset();
 		return -1;
+	}
 
 	if (value_fixup) {
 		DICT_ATTR const *a;
@@ -2733,6 +3240,7 @@ int dict_init(char const *dir, char const *fn)
 				fr_strerror_printf(
 					"dict_init: No ATTRIBUTE \"%s\" defined for VALUE \"%s\"",
 					this->attrstr, this->dval->name);
+				dict_cache_reset();
 				return -1; /* leak, but they should die... */
 			}
 
@@ -2744,6 +3252,7 @@ int dict_init(char const *dir, char const *fn)
 			if (!fr_hash_table_replace(values_byname,
 						     this->dval)) {
 				fr_strerror_printf("dict_addvalue: Duplicate value name %s for attribute %s", this->dval->name, a->name);
+				dict_cache_reset();
 				return -1;
 			}
 
@@ -2765,6 +3274,8 @@ int dict_init(char const *dir, char const *fn)
 		}
 	}
 
+	dict_cache_save(cache_file, dict_file);
+
 	/*
 	 *	Walk over all of the hash tables to ensure they're
 	 *	initialized.  We do this because the threads may perform
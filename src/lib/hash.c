@@ -1,15 +1,18 @@
 /*
- * hash.c	Non-thread-safe split-ordered hash table.
+ * hash.c	Non-thread-safe open addressing hash table.
  *
- *  The weird "reverse" function is based on an idea from
- *  "Split-Ordered Lists - Lock-free Resizable Hash Tables", with
- *  modifications so that they're not lock-free. :(
+ *  The layout is based on the "Swiss Table" design.  The table is
+ *  an array of slots, plus a parallel array of one byte "control"
+ *  entries, one per slot.  The control byte says whether the slot
+ *  is empty, deleted, or full.  If it's full, the control byte holds
+ *  7 bits of the hash of the data in the slot.
  *
- *  However, the split-order idea allows a fast & easy splitting of the
- *  hash bucket chain when the hash table is resized.  Without it, we'd
- *  have to check & update the pointers for every node in the buck chain,
- *  rather than being able to move 1/2 of the entries in the chain with
- *  one update.
+ *  Lookups scan the control bytes 16 at a time (with one SSE2
+ *  comparison where available), and only look at slots where those
+ *  7 bits match.  Nearly all lookups therefore touch one cache line
+ *  of control bytes, and one slot.  Unlike a chained table, there
+ *  are no per-entry nodes to allocate, free, or chase pointers
+ *  through.
  *
  * Version:	$Id$
  *
@@ -34,348 +37,315 @@ RCSID("$Id$")
 
 #include <freeradius-devel/libradius.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 /*
- *	A reasonable number of buckets to start off with.
- *	Should be a power of two.
+ *	The number of control bytes examined at once.
  */
-#define FR_HASH_NUM_BUCKETS (64)
+#define FR_HASH_GROUP_WIDTH	(16)
 
-typedef struct fr_hash_entry_t {
-	struct fr_hash_entry_t *next;
-	uint32_t	reversed;
-	uint32_t	key;
-	void const 	*data;
-} fr_hash_entry_t;
+/*
+ *	A reasonable number of slots to start off with.
+ *	Must be a power of two, and at least one group.
+ */
+#define FR_HASH_NUM_SLOTS	(16)
+
+/*
+ *	Control bytes.  A full slot has the top bit clear, and the
+ *	low 7 bits of the key in the rest.
+ */
+#define CTRL_EMPTY		((int8_t) -128)	/* 0x80 */
+#define CTRL_DELETED		((int8_t) -2)	/* 0xfe */
+
+#define CTRL_IS_FULL(_c)	((_c) >= 0)
 
+/*
+ *	The table grows when it would be more than 7/8 full,
+ *	counting deleted slots.
+ */
+#define MAX_LOAD(_capacity)	((_capacity) - ((_capacity) >> 3))
+
+typedef struct fr_hash_slot_t {
+	uint32_t	key;
+	void const	*data;
+} fr_hash_slot_t;
 
 struct fr_hash_table_t {
 	int			num_elements;
-	int			num_buckets; /* power of 2 */
-	int			next_grow;
-	int			mask;
+	int			num_deleted;
+	uint32_t		capacity;	/* power of 2 */
+	uint32_t		mask;
+	int			walking;	/* don't move slots */
 
 	fr_hash_table_free_t	free;
 	fr_hash_table_hash_t	hash;
 	fr_hash_table_cmp_t	cmp;
 
-	fr_hash_entry_t	null;
-
-	fr_hash_entry_t	**buckets;
+	/*
+	 *	capacity + FR_HASH_GROUP_WIDTH bytes.  The last group
+	 *	mirrors the first, so a group can be read starting at
+	 *	any slot without wrapping.
+	 */
+	int8_t			*ctrl;
+	fr_hash_slot_t		*slots;
 };
 
-#ifdef TESTING
-static int grow = 0;
-#endif
-
 /*
- * perl -e 'foreach $i (0..255) {$r = 0; foreach $j (0 .. 7 ) { if (($i & ( 1<< $j)) != 0) { $r |= (1 << (7 - $j));}} print $r, ", ";if (($i & 7) == 7) {print "\n";}}'
+ *	The caller's hash functions aren't always well distributed
+ *	(some just return an integer from the data), so mix the bits
+ *	before using them to pick a slot.  This is a bijection, so
+ *	equal keys are still equal.
  */
-static const uint8_t reversed_byte[256] = {
-	0,  128, 64, 192, 32, 160, 96,  224,
-	16, 144, 80, 208, 48, 176, 112, 240,
-	8,  136, 72, 200, 40, 168, 104, 232,
-	24, 152, 88, 216, 56, 184, 120, 248,
-	4,  132, 68, 196, 36, 164, 100, 228,
-	20, 148, 84, 212, 52, 180, 116, 244,
-	12, 140, 76, 204, 44, 172, 108, 236,
-	28, 156, 92, 220, 60, 188, 124, 252,
-	2,  130, 66, 194, 34, 162, 98,  226,
-	18, 146, 82, 210, 50, 178, 114, 242,
-	10, 138, 74, 202, 42, 170, 106, 234,
-	26, 154, 90, 218, 58, 186, 122, 250,
-	6,  134, 70, 198, 38, 166, 102, 230,
-	22, 150, 86, 214, 54, 182, 118, 246,
-	14, 142, 78, 206, 46, 174, 110, 238,
-	30, 158, 94, 222, 62, 190, 126, 254,
-	1,  129, 65, 193, 33, 161, 97,  225,
-	17, 145, 81, 209, 49, 177, 113, 241,
-	9,  137, 73, 201, 41, 169, 105, 233,
-	25, 153, 89, 217, 57, 185, 121, 249,
-	5,  133, 69, 197, 37, 165, 101, 229,
-	21, 149, 85, 213, 53, 181, 117, 245,
-	13, 141, 77, 205, 45, 173, 109, 237,
-	29, 157, 93, 221, 61, 189, 125, 253,
-	3,  131, 67, 195, 35, 163, 99,  227,
-	19, 147, 83, 211, 51, 179, 115, 243,
-	11, 139, 75, 203, 43, 171, 107, 235,
-	27, 155, 91, 219, 59, 187, 123, 251,
-	7,  135, 71, 199, 39, 167, 103, 231,
-	23, 151, 87, 215, 55, 183, 119, 247,
-	15, 143, 79, 207, 47, 175, 111, 239,
-	31, 159, 95, 223, 63, 191, 127, 255
-};
-
+static inline uint32_t hash_mix(uint32_t key)
+{
+	key ^= key >> 16;
+	key *= 0x7feb352d;
+	key ^= key >> 15;
+	key *= 0x846ca68b;
+	key ^= key >> 16;
 
-/*
- * perl -e 'foreach $i (0..255) {$r = 0;foreach $j (0 .. 7) { $r = $i & (1 << (7 - $j)); last if ($r)} print $i & ~($r), ", ";if (($i & 7) == 7) {print "\n";}}'
- */
-static uint8_t parent_byte[256] = {
-	0, 0, 0, 1, 0, 1, 2, 3,
-	0, 1, 2, 3, 4, 5, 6, 7,
-	0, 1, 2, 3, 4, 5, 6, 7,
-	8, 9, 10, 11, 12, 13, 14, 15,
-	0, 1, 2, 3, 4, 5, 6, 7,
-	8, 9, 10, 11, 12, 13, 14, 15,
-	16, 17, 18, 19, 20, 21, 22, 23,
-	24, 25, 26, 27, 28, 29, 30, 31,
-	0, 1, 2, 3, 4, 5, 6, 7,
-	8, 9, 10, 11, 12, 13, 14, 15,
-	16, 17, 18, 19, 20, 21, 22, 23,
-	24, 25, 26, 27, 28, 29, 30, 31,
-	32, 33, 34, 35, 36, 37, 38, 39,
-	40, 41, 42, 43, 44, 45, 46, 47,
-	48, 49, 50, 51, 52, 53, 54, 55,
-	56, 57, 58, 59, 60, 61, 62, 63,
-	0, 1, 2, 3, 4, 5, 6, 7,
-	8, 9, 10, 11, 12, 13, 14, 15,
-	16, 17, 18, 19, 20, 21, 22, 23,
-	24, 25, 26, 27, 28, 29, 30, 31,
-	32, 33, 34, 35, 36, 37, 38, 39,
-	40, 41, 42, 43, 44, 45, 46, 47,
-	48, 49, 50, 51, 52, 53, 54, 55,
-	56, 57, 58, 59, 60, 61, 62, 63,
-	64, 65, 66, 67, 68, 69, 70, 71,
-	72, 73, 74, 75, 76, 77, 78, 79,
-	80, 81, 82, 83, 84, 85, 86, 87,
-	88, 89, 90, 91, 92, 93, 94, 95,
-	96, 97, 98, 99, 100, 101, 102, 103,
-	104, 105, 106, 107, 108, 109, 110, 111,
-	112, 113, 114, 115, 116, 117, 118, 119,
-	120, 121, 122, 123, 124, 125, 126, 127
-};
+	return key;
+}
 
+#define H1(_key)	((_key) >> 7)
+#define H2(_key)	((int8_t) ((_key) & 0x7f))
 
 /*
- *	Reverse a key.
+ *	Return a bitmask of the control bytes in the group which
+ *	are equal to "c".  Bit N is for the Nth slot of the group.
  */
-static uint32_t reverse(uint32_t key)
+static inline uint32_t group_match(int8_t const *group, int8_t c)
 {
-	return ((reversed_byte[key & 0xff] << 24) |
-		(reversed_byte[(key >> 8) & 0xff] << 16) |
-		(reversed_byte[(key >> 16) & 0xff] << 8) |
-		(reversed_byte[(key >> 24) & 0xff]));
+#ifdef __SSE2__
+	__m128i ctrl = _mm_loadu_si128((__m128i const *) group);
+
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(c), ctrl));
+#else
+	uint32_t mask = 0;
+	int i;
+
+	for (i = 0; i < FR_HASH_GROUP_WIDTH; i++) {
+		if (group[i] == c) mask |= (1 << i);
+	}
+
+	return mask;
+#endif
 }
 
 /*
- *	Take the parent by discarding the highest bit that is set.
+ *	Return a bitmask of the empty or deleted slots in the group.
  */
-static uint32_t parent_of(uint32_t key)
+static inline uint32_t group_match_free(int8_t const *group)
 {
-	if (key > 0x00ffffff)
-		return (key & 0x00ffffff) | (parent_byte[key >> 24] << 24);
+#ifdef __SSE2__
+	__m128i ctrl = _mm_loadu_si128((__m128i const *) group);
 
-	if (key > 0x0000ffff)
-		return (key & 0x0000ffff) | (parent_byte[key >> 16] << 16);
+	/*
+	 *	Both have the top bit set, full slots don't.
+	 */
+	return _mm_movemask_epi8(ctrl);
+#else
+	uint32_t mask = 0;
+	int i;
 
-	if (key > 0x000000ff)
-		return (key & 0x000000ff) | (parent_byte[key >> 8] << 8);
+	for (i = 0; i < FR_HASH_GROUP_WIDTH; i++) {
+		if (!CTRL_IS_FULL(group[i])) mask |= (1 << i);
+	}
 
-	return parent_byte[key];
+	return mask;
+#endif
 }
 
-
-static fr_hash_entry_t *list_find(fr_hash_table_t *ht,
-				    fr_hash_entry_t *head,
-				    uint32_t reversed,
-				    void const *data)
+static inline int lowest_bit(uint32_t mask)
 {
-	fr_hash_entry_t *cur;
-
-	for (cur = head; cur != &ht->null; cur = cur->next) {
-		if (cur->reversed == reversed) {
-			if (ht->cmp) {
-				int cmp = ht->cmp(data, cur->data);
-				if (cmp > 0) break;
-				if (cmp < 0) continue;
-			}
-			return cur;
-		}
-		if (cur->reversed > reversed) break;
+#ifdef __GNUC__
+	return __builtin_ctz(mask);
+#else
+	int i = 0;
+
+	while ((mask & 1) == 0) {
+		mask >>= 1;
+		i++;
 	}
 
-	return NULL;
+	return i;
+#endif
 }
 
-
 /*
- *	Inserts a new entry into the list, in order.
+ *	Set a control byte, and its mirror if it's in the first group.
  */
-static int list_insert(fr_hash_table_t *ht,
-		       fr_hash_entry_t **head, fr_hash_entry_t *node)
+static inline void ctrl_set(fr_hash_table_t *ht, uint32_t i, int8_t c)
 {
-	fr_hash_entry_t **last, *cur;
+	ht->ctrl[i] = c;
+	if (i < FR_HASH_GROUP_WIDTH) ht->ctrl[ht->capacity + i] = c;
+}
 
-	last = head;
+/*
+ *	Allocate the arrays for a table of the given size.
+ */
+static int fr_hash_table_alloc(fr_hash_table_t *ht, uint32_t capacity)
+{
+	int8_t		*ctrl;
+	fr_hash_slot_t	*slots;
 
-	for (cur = *head; cur != &ht->null; cur = cur->next) {
-		if (cur->reversed > node->reversed) break;
-		last = &(cur->next);
+	ctrl = malloc(capacity + FR_HASH_GROUP_WIDTH);
+	if (!ctrl) return -1;
 
-		if (cur->reversed == node->reversed) {
-			if (ht->cmp) {
-				int cmp = ht->cmp(node->data, cur->data);
-				if (cmp > 0) break;
-				if (cmp < 0) continue;
-			}
-			return 0;
-		}
+	slots = malloc(sizeof(*slots) * capacity);
+	if (!slots) {
+		free(ctrl);
+		return -1;
 	}
 
-	node->next = *last;
-	*last = node;
+	memset(ctrl, CTRL_EMPTY, capacity + FR_HASH_GROUP_WIDTH);
 
-	return 1;
-}
+	ht->ctrl = ctrl;
+	ht->slots = slots;
+	ht->capacity = capacity;
+	ht->mask = capacity - 1;
+	ht->num_elements = 0;
+	ht->num_deleted = 0;
 
+	return 0;
+}
 
 /*
- *	Delete an entry from the list.
+ *	Find the slot holding data which matches, or -1.
  */
-static int list_delete(fr_hash_table_t *ht,
-		       fr_hash_entry_t **head, fr_hash_entry_t *node)
+static int fr_hash_table_find_slot(fr_hash_table_t const *ht, uint32_t key, void const *data)
 {
-	fr_hash_entry_t **last, *cur;
+	uint32_t pos = H1(key) & ht->mask;
+	uint32_t probes = 0;
+	int8_t h2 = H2(key);
+
+	/*
+	 *	Triangular probing visits every group exactly once
+	 *	when the capacity is a power of 2.
+	 */
+	while (probes <= ht->capacity) {
+		int8_t const *group = ht->ctrl + pos;
+		uint32_t match = group_match(group, h2);
+
+		while (match) {
+			int bit = lowest_bit(match);
+			uint32_t i = (pos + bit) & ht->mask;
+			fr_hash_slot_t const *slot = &ht->slots[i];
+
+			if ((slot->key == key) && (!ht->cmp || (ht->cmp(data, slot->data) == 0))) return i;
 
-	last = head;
+			match &= match - 1;
+		}
+
+		/*
+		 *	An empty slot means the data would have
+		 *	been put here, so it's not in the table.
+		 */
+		if (group_match(group, CTRL_EMPTY)) return -1;
 
-	for (cur = *head; cur != &ht->null; cur = cur->next) {
-		if (cur == node) break;
-		last = &(cur->next);
+		probes += FR_HASH_GROUP_WIDTH;
+		pos = (pos + probes) & ht->mask;
 	}
 
-	*last = node->next;
-	return 1;
+	return -1;
 }
 
-
 /*
- *	Create the table.
- *
- *	Memory usage in bytes is (20/3) * number of entries.
+ *	Find the first empty or deleted slot for a key.
  */
-fr_hash_table_t *fr_hash_table_create(fr_hash_table_hash_t hashNode,
-					  fr_hash_table_cmp_t cmpNode,
-					  fr_hash_table_free_t freeNode)
+static uint32_t fr_hash_table_free_slot(fr_hash_table_t const *ht, uint32_t key)
 {
-	fr_hash_table_t *ht;
+	uint32_t pos = H1(key) & ht->mask;
+	uint32_t probes = 0;
 
-	if (!hashNode) return NULL;
+	for (;;) {
+		uint32_t match = group_match_free(ht->ctrl + pos);
 
-	ht = malloc(sizeof(*ht));
-	if (!ht) return NULL;
-
-	memset(ht, 0, sizeof(*ht));
-	ht->free = freeNode;
-	ht->hash = hashNode;
-	ht->cmp = cmpNode;
-	ht->num_buckets = FR_HASH_NUM_BUCKETS;
-	ht->mask = ht->num_buckets - 1;
-
-	/*
-	 *	Have a default load factor of 2.5.  In practice this
-	 *	means that the average load will hit 3 before the
-	 *	table grows.
-	 */
-	ht->next_grow = (ht->num_buckets << 1) + (ht->num_buckets >> 1);
+		if (match) return (pos + lowest_bit(match)) & ht->mask;
 
-	ht->buckets = malloc(sizeof(*ht->buckets) * ht->num_buckets);
-	if (!ht->buckets) {
-		free(ht);
-		return NULL;
+		probes += FR_HASH_GROUP_WIDTH;
+		pos = (pos + probes) & ht->mask;
 	}
-	memset(ht->buckets, 0, sizeof(*ht->buckets) * ht->num_buckets);
+}
 
-	ht->null.reversed = ~0;
-	ht->null.key = ~0;
-	ht->null.next = &ht->null;
+/*
+ *	Put data into a slot.  The caller has checked that it's not
+ *	already in the table, and that there's room.
+ */
+static void fr_hash_table_put(fr_hash_table_t *ht, uint32_t key, void const *data)
+{
+	uint32_t i;
 
-	ht->buckets[0] = &ht->null;
+	i = fr_hash_table_free_slot(ht, key);
+	if (ht->ctrl[i] == CTRL_DELETED) ht->num_deleted--;
 
-	return ht;
+	ctrl_set(ht, i, H2(key));
+	ht->slots[i].key = key;
+	ht->slots[i].data = data;
+	ht->num_elements++;
 }
 
-
 /*
- *	If the current bucket is uninitialized, initialize it
- *	by recursively copying information from the parent.
- *
- *	We may have a situation where entry E is a parent to 2 other
- *	entries E' and E".  If we split E into E and E', then the
- *	nodes meant for E" end up in E or E', either of which is
- *	wrong.  To solve that problem, we walk down the whole chain,
- *	inserting the elements into the correct place.
+ *	Move all of the data to new arrays.  If the table is mostly
+ *	deleted slots, this just cleans them out, otherwise the table
+ *	doubles in size.
  */
-static void fr_hash_table_fixup(fr_hash_table_t *ht, uint32_t entry)
+static int fr_hash_table_grow(fr_hash_table_t *ht)
 {
-	uint32_t parent_entry;
-	fr_hash_entry_t **last, *cur;
-	uint32_t this;
-
-	parent_entry = parent_of(entry);
+	fr_hash_table_t	old;
+	uint32_t	i, capacity;
 
-	/* parent_entry == entry if and only if entry == 0 */
+	capacity = ht->capacity;
+	if ((uint32_t) ht->num_elements >= (capacity >> 1)) capacity <<= 1;
 
-	if (!ht->buckets[parent_entry]) {
-		fr_hash_table_fixup(ht, parent_entry);
+	old = *ht;
+	if (fr_hash_table_alloc(ht, capacity) < 0) {
+		*ht = old;
+		return -1;
 	}
 
-	/*
-	 *	Keep walking down cur, trying to find entries that
-	 *	don't belong here any more.  There may be multiple
-	 *	ones, so we can't have a naive algorithm...
-	 */
-	last = &ht->buckets[parent_entry];
-	this = parent_entry;
-
-	for (cur = *last; cur != &ht->null; cur = cur->next) {
-		uint32_t real_entry;
+	for (i = 0; i < old.capacity; i++) {
+		if (!CTRL_IS_FULL(old.ctrl[i])) continue;
 
-		real_entry = cur->key & ht->mask;
-		if (real_entry != this) { /* ht->buckets[real_entry] == NULL */
-			*last = &ht->null;
-			ht->buckets[real_entry] = cur;
-			this = real_entry;
-		}
-
-		last = &(cur->next);
+		fr_hash_table_put(ht, old.slots[i].key, old.slots[i].data);
 	}
 
-	/*
-	 *	We may NOT have initialized this bucket, so do it now.
-	 */
-	if (!ht->buckets[entry]) ht->buckets[entry] = &ht->null;
-}
+	free(old.ctrl);
+	free(old.slots);
 
-/*
- *	This should be a power of two.  Changing it to 4 doesn't seem
- *	to make any difference.
- */
-#define GROW_FACTOR (2)
+	return 0;
+}
 
 /*
- *	Grow the hash table.
+ *	Create the table.
+ *
+ *	Memory usage in bytes is about 20 per slot, with the table
+ *	between 7/16 and 7/8 full.
  */
-static void fr_hash_table_grow(fr_hash_table_t *ht)
+fr_hash_table_t *fr_hash_table_create(fr_hash_table_hash_t hashNode,
+					  fr_hash_table_cmp_t cmpNode,
+					  fr_hash_table_free_t freeNode)
 {
-	fr_hash_entry_t **buckets;
+	fr_hash_table_t *ht;
 
-	buckets = malloc(sizeof(*buckets) * GROW_FACTOR * ht->num_buckets);
-	if (!buckets) return;
+	if (!hashNode) return NULL;
 
-	memcpy(buckets, ht->buckets,
-	       sizeof(*buckets) * ht->num_buckets);
-	memset(&buckets[ht->num_buckets], 0,
-	       sizeof(*buckets) * ht->num_buckets);
+	ht = malloc(sizeof(*ht));
+	if (!ht) return NULL;
 
-	free(ht->buckets);
-	ht->buckets = buckets;
-	ht->num_buckets *= GROW_FACTOR;
-	ht->next_grow *= GROW_FACTOR;
-	ht->mask = ht->num_buckets - 1;
-#ifdef TESTING
-	grow = 1;
-	fprintf(stderr, "GROW TO %d\n", ht->num_buckets);
-#endif
+	memset(ht, 0, sizeof(*ht));
+	ht->free = freeNode;
+	ht->hash = hashNode;
+	ht->cmp = cmpNode;
+
+	if (fr_hash_table_alloc(ht, FR_HASH_NUM_SLOTS) < 0) {
+		free(ht);
+		return NULL;
+	}
+
+	return ht;
 }
 
 
@@ -385,68 +355,34 @@ static void fr_hash_table_grow(fr_hash_table_t *ht)
 int fr_hash_table_insert(fr_hash_table_t *ht, void const *data)
 {
 	uint32_t key;
-	uint32_t entry;
-	uint32_t reversed;
-	fr_hash_entry_t *node;
 
 	if (!ht || !data) return 0;
 
-	key = ht->hash(data);
-	entry = key & ht->mask;
-	reversed = reverse(key);
-
-	if (!ht->buckets[entry]) fr_hash_table_fixup(ht, entry);
-
-	/*
-	 *	If we try to do our own memory allocation here, the
-	 *	speedup is only ~15% or so, which isn't worth it.
-	 */
-	node = malloc(sizeof(*node));
-	if (!node) return 0;
-	memset(node, 0, sizeof(*node));
-
-	node->next = &ht->null;
-	node->reversed = reversed;
-	node->key = key;
-	node->data = data;
+	key = hash_mix(ht->hash(data));
 
 	/* already in the table, can't insert it */
-	if (!list_insert(ht, &ht->buckets[entry], node)) {
-		free(node);
-		return 0;
-	}
+	if (fr_hash_table_find_slot(ht, key, data) >= 0) return 0;
 
 	/*
 	 *	Check the load factor, and grow the table if
 	 *	necessary.
+	 *
+	 *	Slots can't be moved while the table is being walked,
+	 *	so we fill it further instead.  There must always be
+	 *	at least one empty slot, so that lookups terminate.
 	 */
-	ht->num_elements++;
-	if (ht->num_elements >= ht->next_grow) {
-		fr_hash_table_grow(ht);
-	}
-
-	return 1;
-}
-
-
-/*
- *	Internal find a node routine.
- */
-static fr_hash_entry_t *fr_hash_table_find(fr_hash_table_t *ht, void const *data)
-{
-	uint32_t key;
-	uint32_t entry;
-	uint32_t reversed;
+	if ((uint32_t) (ht->num_elements + ht->num_deleted + 1) > MAX_LOAD(ht->capacity)) {
+		if (!ht->walking) {
+			if (fr_hash_table_grow(ht) < 0) return 0;
 
-	if (!ht) return NULL;
-
-	key = ht->hash(data);
-	entry = key & ht->mask;
-	reversed = reverse(key);
+		} else if ((uint32_t) (ht->num_elements + ht->num_deleted + 1) >= ht->capacity) {
+			return 0;
+		}
+	}
 
-	if (!ht->buckets[entry]) fr_hash_table_fixup(ht, entry);
+	fr_hash_table_put(ht, key, data);
 
-	return list_find(ht, ht->buckets[entry], reversed, data);
+	return 1;
 }
 
 
@@ -455,21 +391,19 @@ static fr_hash_entry_t *fr_hash_table_find(fr_hash_table_t *ht, void const *data
  */
 int fr_hash_table_replace(fr_hash_table_t *ht, void const *data)
 {
-	fr_hash_entry_t *node;
+	int i;
 	void *tofree;
 
 	if (!ht || !data) return 0;
 
-	node = fr_hash_table_find(ht, data);
-	if (!node) {
-		return fr_hash_table_insert(ht, data);
-	}
+	i = fr_hash_table_find_slot(ht, hash_mix(ht->hash(data)), data);
+	if (i < 0) return fr_hash_table_insert(ht, data);
 
 	if (ht->free) {
-		memcpy(&tofree, &node->data, sizeof(tofree));
+		memcpy(&tofree, &ht->slots[i].data, sizeof(tofree));
 		ht->free(tofree);
 	}
-	node->data = data;
+	ht->slots[i].data = data;
 
 	return 1;
 }
@@ -480,13 +414,15 @@ int fr_hash_table_replace(fr_hash_table_t *ht, void const *data)
  */
 void *fr_hash_table_finddata(fr_hash_table_t *ht, void const *data)
 {
-	fr_hash_entry_t *node;
+	int i;
 	void *out;
 
-	node = fr_hash_table_find(ht, data);
-	if (!node) return NULL;
+	if (!ht) return NULL;
+
+	i = fr_hash_table_find_slot(ht, hash_mix(ht->hash(data)), data);
+	if (i < 0) return NULL;
 
-	memcpy(&out, &node->data, sizeof(out));
+	memcpy(&out, &ht->slots[i].data, sizeof(out));
 
 	return out;
 }
@@ -498,28 +434,24 @@ void *fr_hash_table_finddata(fr_hash_table_t *ht, void const *data)
  */
 void *fr_hash_table_yank(fr_hash_table_t *ht, void const *data)
 {
-	uint32_t key;
-	uint32_t entry;
-	uint32_t reversed;
+	int i;
 	void *old;
-	fr_hash_entry_t *node;
 
 	if (!ht) return NULL;
 
-	key = ht->hash(data);
-	entry = key & ht->mask;
-	reversed = reverse(key);
-
-	if (!ht->buckets[entry]) fr_hash_table_fixup(ht, entry);
+	i = fr_hash_table_find_slot(ht, hash_mix(ht->hash(data)), data);
+	if (i < 0) return NULL;
 
-	node = list_find(ht, ht->buckets[entry], reversed, data);
-	if (!node) return NULL;
+	memcpy(&old, &ht->slots[i].data, sizeof(old));
 
-	list_delete(ht, &ht->buckets[entry], node);
+	/*
+	 *	The slot may be part of another key's probe
+	 *	sequence, so it's marked as deleted, not empty.
+	 */
+	ctrl_set(ht, i, CTRL_DELETED);
+	ht->slots[i].data = NULL;
 	ht->num_elements--;
-
-	memcpy(&old, &node->data, sizeof(old));
-	free(node);
+	ht->num_deleted++;
 
 	return old;
 }
@@ -546,31 +478,21 @@ int fr_hash_table_delete(fr_hash_table_t *ht, void const *data)
  */
 void fr_hash_table_free(fr_hash_table_t *ht)
 {
-	int i;
-	fr_hash_entry_t *node, *next;
+	uint32_t i;
 
 	if (!ht) return;
 
-	/*
-	 *	Walk over the buckets, freeing them all.
-	 */
-	for (i = 0; i < ht->num_buckets; i++) {
-		if (ht->buckets[i]) for (node = ht->buckets[i];
-					 node != &ht->null;
-					 node = next) {
-			next = node->next;
-
-			if (node->data && ht->free) {
-				void *tofree;
-				memcpy(&tofree, &node->data, sizeof(tofree));
-				ht->free(tofree);
-			}
+	if (ht->free) for (i = 0; i < ht->capacity; i++) {
+		void *tofree;
 
-			free(node);
-		}
+		if (!CTRL_IS_FULL(ht->ctrl[i])) continue;
+
+		memcpy(&tofree, &ht->slots[i].data, sizeof(tofree));
+		ht->free(tofree);
 	}
 
-	free(ht->buckets);
+	free(ht->ctrl);
+	free(ht->slots);
 	free(ht);
 }
 
@@ -588,36 +510,33 @@ int fr_hash_table_num_elements(fr_hash_table_t *ht)
 
 /*
  *	Walk over the nodes, allowing deletes & inserts to happen.
+ *
+ *	Data inserted during the walk may or may not be visited.
  */
 int fr_hash_table_walk(fr_hash_table_t *ht,
 			 fr_hash_table_walk_t callback,
 			 void *context)
 {
-	int i, rcode;
+	int i, rcode = 0;
 
 	if (!ht || !callback) return 0;
 
-	for (i = ht->num_buckets - 1; i >= 0; i--) {
-		fr_hash_entry_t *node, *next;
-
-		/*
-		 *	Ensure that the current bucket is filled.
-		 */
-		if (!ht->buckets[i]) fr_hash_table_fixup(ht, i);
+	ht->walking++;
 
-		for (node = ht->buckets[i]; node != &ht->null; node = next) {
-			void *arg;
+	for (i = ht->capacity - 1; i >= 0; i--) {
+		void *arg;
 
-			next = node->next;
+		if (!CTRL_IS_FULL(ht->ctrl[i])) continue;
 
-			memcpy(&arg, &node->data, sizeof(arg));
-			rcode = callback(context, arg);
+		memcpy(&arg, &ht->slots[i].data, sizeof(arg));
+		rcode = callback(context, arg);
 
-			if (rcode != 0) return rcode;
-		}
+		if (rcode != 0) break;
 	}
 
-	return 0;
+	ht->walking--;
+
+	return rcode;
 }
 
 
@@ -627,69 +546,37 @@ int fr_hash_table_walk(fr_hash_table_t *ht,
  */
 int fr_hash_table_info(fr_hash_table_t *ht)
 {
-	int i, a, collisions, uninitialized;
-	int array[256];
+	uint32_t i, probes, max_probes;
+	uint64_t total;
 
 	if (!ht) return 0;
 
-	uninitialized = collisions = 0;
-	memset(array, 0, sizeof(array));
+	total = max_probes = 0;
 
-	for (i = 0; i < ht->num_buckets; i++) {
-		uint32_t key;
-		int load;
-		fr_hash_entry_t *node, *next;
+	for (i = 0; i < ht->capacity; i++) {
+		uint32_t pos;
 
-		/*
-		 *	If we haven't inserted or looked up an entry
-		 *	in a bucket, it's uninitialized.
-		 */
-		if (!ht->buckets[i]) {
-			uninitialized++;
-			continue;
-		}
-
-		load = 0;
-		key = ~0;
-		for (node = ht->buckets[i]; node != &ht->null; node = next) {
-			if (node->reversed == key) {
-				collisions++;
-			} else {
-				key = node->reversed;
-			}
-			next = node->next;
-			load++;
-		}
-
-		if (load > 255) load = 255;
-		array[load]++;
-	}
-
-	printf("HASH TABLE %p\tbuckets: %d\t(%d uninitialized)\n", ht,
-		ht->num_buckets, uninitialized);
-	printf("\tnum entries %d\thash collisions %d\n",
-		ht->num_elements, collisions);
-
-	a = 0;
-	for (i = 1; i < 256; i++) {
-		if (!array[i]) continue;
-		printf("%d\t%d\n", i, array[i]);
+		if (!CTRL_IS_FULL(ht->ctrl[i])) continue;
 
 		/*
-		 *	Since the entries are ordered, the lookup cost
-		 *	for any one element in a chain is (on average)
-		 *	the cost of walking half of the chain.
+		 *	Count the groups we look at before finding it.
 		 */
-		if (i > 1) {
-			a += array[i] * i;
+		pos = H1(ht->slots[i].key) & ht->mask;
+		probes = 0;
+		while (((i - pos) & ht->mask) >= FR_HASH_GROUP_WIDTH) {
+			probes += FR_HASH_GROUP_WIDTH;
+			pos = (pos + probes) & ht->mask;
 		}
+		probes = (probes / FR_HASH_GROUP_WIDTH) + 1;
+
+		total += probes;
+		if (probes > max_probes) max_probes = probes;
 	}
-	a /= 2;
-	a += array[1];
 
-	printf("\texpected lookup cost = %d/%d or %f\n\n",
-	       ht->num_elements, a,
-	       (float) ht->num_elements / (float) a);
+	printf("HASH TABLE %p\tslots: %u\n", ht, ht->capacity);
+	printf("\tnum entries %d\tdeleted %d\n", ht->num_elements, ht->num_deleted);
+	printf("\texpected lookup cost = %f groups (max %u)\n\n",
+	       ht->num_elements ? (double) total / ht->num_elements : 0.0, max_probes);
 
 	return 0;
 }
@@ -773,81 +660,138 @@ uint32_t fr_hash_string(char const *p)
 
 #ifdef TESTING
 /*
- *  cc -g -DTESTING -I ../include hash.c -o hash
+ *  Benchmark, and sanity check.
+ *
+ *  From the top-level directory:
+ *
+ *  cc -O2 -DTESTING -I. -Isrc -include src/freeradius-devel/autoconf.h \
+ *	-include src/freeradius-devel/build.h src/lib/hash.c -o hash \
+ *	-Lbuild/lib/.libs -lfreeradius-radius -ltalloc
  *
- *  ./hash
+ *  ./hash [num_entries]
  */
+#include <sys/time.h>
+
 static uint32_t hash_int(void const *data)
 {
-	return fr_hash((int *) data, sizeof(int));
+	return fr_hash((int const *) data, sizeof(int));
+}
+
+static int cmp_int(void const *one, void const *two)
+{
+	int a = *(int const *) one;
+	int b = *(int const *) two;
+
+	return (a > b) - (a < b);
+}
+
+static double elapsed(struct timeval *start)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+
+	return ((now.tv_sec - start->tv_sec) * 1000000.0) + (now.tv_usec - start->tv_usec);
 }
 
 #define MAX 1024*1024
 int main(int argc, char **argv)
 {
-	int i, *p, *q, k;
+	int i, k, max, *q;
 	fr_hash_table_t *ht;
 	int *array;
+	struct timeval start;
+	double usec;
 
-	ht = fr_hash_table_create(hash_int, NULL, NULL);
+	max = MAX;
+	if (argc > 1) max = atoi(argv[1]);
+	if (max <= 0) exit(1);
+
+	ht = fr_hash_table_create(hash_int, cmp_int, NULL);
 	if (!ht) {
 		fprintf(stderr, "Hash create failed\n");
-		fr_exit(1);
+		exit(1);
 	}
 
-	array = malloc(sizeof(int) * MAX);
-	if (!array) fr_exit(1);
+	array = malloc(sizeof(int) * max * 2);
+	if (!array) exit(1);
 
-	for (i = 0; i < MAX; i++) {
-		p = array + i;
-		*p = i;
+	for (i = 0; i < max * 2; i++) array[i] = i;
 
-		if (!fr_hash_table_insert(ht, p)) {
+	gettimeofday(&start, NULL);
+	for (i = 0; i < max; i++) {
+		if (!fr_hash_table_insert(ht, &array[i])) {
 			fprintf(stderr, "Failed insert %08x\n", i);
-			fr_exit(1);
-		}
-#ifdef TEST_INSERT
-		q = fr_hash_table_finddata(ht, p);
-		if (q != p) {
-			fprintf(stderr, "Bad data %d\n", i);
-			fr_exit(1);
+			exit(1);
 		}
-#endif
 	}
+	usec = elapsed(&start);
+	printf("insert\t\t%d\t%.1f ns/op\n", max, (usec * 1000.0) / max);
 
 	fr_hash_table_info(ht);
 
 	/*
-	 *	Build this to see how lookups result in shortening
-	 *	of the hash chains.
+	 *	Look up every entry several times, so the table is
+	 *	mostly in cache, as it would be in the server.
 	 */
-	if (1) {
-		for (i = 0; i < MAX ; i++) {
-			q = fr_hash_table_finddata(ht, &i);
+	gettimeofday(&start, NULL);
+	for (k = 0; k < 4; k++) {
+		for (i = 0; i < max; i++) {
+			q = fr_hash_table_finddata(ht, &array[i]);
 			if (!q || *q != i) {
 				fprintf(stderr, "Failed finding %d\n", i);
-				fr_exit(1);
-			}
-
-#if 0
-			if (!fr_hash_table_delete(ht, &i)) {
-				fprintf(stderr, "Failed deleting %d\n", i);
-				fr_exit(1);
-			}
-			q = fr_hash_table_finddata(ht, &i);
-			if (q) {
-				fprintf(stderr, "Failed to delete %08x\n", i);
-				fr_exit(1);
+				exit(1);
 			}
-#endif
 		}
+	}
+	usec = elapsed(&start);
+	printf("lookup (hit)\t%d\t%.1f ns/op\n", max * 4, (usec * 1000.0) / (max * 4));
+
+	gettimeofday(&start, NULL);
+	for (i = max; i < max * 2; i++) {
+		if (fr_hash_table_finddata(ht, &array[i])) {
+			fprintf(stderr, "Found missing %d\n", i);
+			exit(1);
+		}
+	}
+	usec = elapsed(&start);
+	printf("lookup (miss)\t%d\t%.1f ns/op\n", max, (usec * 1000.0) / max);
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < max; i += 2) {
+		if (!fr_hash_table_delete(ht, &array[i])) {
+			fprintf(stderr, "Failed deleting %d\n", i);
+			exit(1);
+		}
+	}
+	usec = elapsed(&start);
+	printf("delete\t\t%d\t%.1f ns/op\n", max / 2, (usec * 1000.0) / (max / 2));
+
+	for (i = 0; i < max; i++) {
+		q = fr_hash_table_finddata(ht, &array[i]);
+		if ((i & 1) ? (!q || (*q != i)) : (q != NULL)) {
+			fprintf(stderr, "Bad lookup after delete %d\n", i);
+			exit(1);
+		}
+	}
 
-		fr_hash_table_info(ht);
+	/*
+	 *	Re-insert into the deleted slots.
+	 */
+	for (i = 0; i < max; i += 2) {
+		if (!fr_hash_table_insert(ht, &array[i])) {
+			fprintf(stderr, "Failed re-insert %d\n", i);
+			exit(1);
+		}
+	}
+	if (fr_hash_table_num_elements(ht) != max) {
+		fprintf(stderr, "Wrong number of entries %d\n", fr_hash_table_num_elements(ht));
+		exit(1);
 	}
 
 	fr_hash_table_free(ht);
 	free(array);
 
-	fr_exit(0);
+	return 0;
 }
 #endif
@@ -591,6 +591,33 @@ uint32_t fr_packet_list_num_elements(fr_packet_list_t *pl)
 	return rbtree_num_elements(pl->tree);
 }
 
+/*
+ *	Mark a free Id on the socket as used, starting from a random
+ *	number.  Returns the Id, or -1 if all of them are in use.
+ */
+static int fr_packet_socket_id_alloc(fr_packet_socket_t *ps)
+{
+	int j, k, start_j, start_k;
+
+	start_j = fr_rand() & 0x1f;
+#define ID_j ((j + start_j) & 0x1f)
+	for (j = 0; j < 32; j++) {
+		if (ps->id[ID_j] == 0xff) continue;
+
+		start_k = fr_rand() & 0x07;
+#define ID_k ((k + start_k) & 0x07)
+		for (k = 0; k < 8; k++) {
+			if ((ps->id[ID_j] & (1 << ID_k)) != 0) continue;
+
+			ps->id[ID_j] |= (1 << ID_k);
+			return (ID_j * 8) + ID_k;
+		}
+	}
+#undef ID_j
+#undef ID_k
+
+	return -1;
+}
 
 /*
  *	1 == ID was allocated & assigned
@@ -614,9 +641,12 @@ uint32_t fr_packet_list_num_elements(fr_packet_list_t *pl)
 bool fr_packet_list_id_alloc(fr_packet_list_t *pl, int proto,
 			    RADIUS_PACKET **request_p, void **pctx)
 {
-	int i, j, k, fd, id, start_i, start_j, start_k;
+	int i, fd, id, start_i;
 	int src_any = 0;
 	fr_packet_socket_t *ps= NULL;
+#ifdef WITH_TCP
+	fr_packet_socket_t *best = NULL;
+#endif
 	RADIUS_PACKET *request = *request_p;
 
 	VERIFY_PACKET(request);
@@ -760,32 +790,34 @@ bool fr_packet_list_id_alloc(fr_packet_list_t *pl, int proto,
 		 *	Otherwise, this socket is OK to use.
 		 */
 
+#ifdef WITH_TCP
 		/*
-		 *	Look for a free Id, starting from a random number.
+		 *	TCP sockets are connections to the same
+		 *	destination.  Use the one with the fewest
+		 *	outstanding packets, so that the load is
+		 *	spread across all of them.
 		 */
-		start_j = fr_rand() & 0x1f;
-#define ID_j ((j + start_j) & 0x1f)
-		for (j = 0; j < 32; j++) {
-			if (ps->id[ID_j] == 0xff) continue;
-
-
-			start_k = fr_rand() & 0x07;
-#define ID_k ((k + start_k) & 0x07)
-			for (k = 0; k < 8; k++) {
-				if ((ps->id[ID_j] & (1 << ID_k)) != 0) continue;
+		if (proto == IPPROTO_TCP) {
+			if (!best || (ps->num_outgoing < best->num_outgoing)) best = ps;
+			continue;
+		}
+#endif
 
-				ps->id[ID_j] |= (1 << ID_k);
-				id = (ID_j * 8) + ID_k;
-				fd = i;
-				break;
-			}
-			if (fd >= 0) break;
+		id = fr_packet_socket_id_alloc(ps);
+		if (id >= 0) {
+			fd = i;
+			break;
 		}
+	}
 #undef ID_i
-#undef ID_j
-#undef ID_k
-		if (fd >= 0) break;
+
+#ifdef WITH_TCP
+	if ((fd < 0) && best) {
+		ps = best;
+		id = fr_packet_socket_id_alloc(ps);
+		if (id >= 0) fd = ps - pl->sockets;
 	}
+#endif
 
 	/*
 	 *	Ask the caller to allocate a new ID.
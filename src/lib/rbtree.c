@@ -27,10 +27,36 @@ RCSID("$Id$")
 #ifdef HAVE_PTHREAD_H
 #include <pthread.h>
 
-#define PTHREAD_MUTEX_LOCK(_x) if (_x->lock) pthread_mutex_lock(&((_x)->mutex))
-#define PTHREAD_MUTEX_UNLOCK(_x) if (_x->lock) pthread_mutex_unlock(&((_x)->mutex))
+/*
+ *	With RBTREE_FLAG_RWLOCK, lookups and walks take a shared lock,
+ *	and only the functions which modify the tree take an exclusive
+ *	one.  So threads looking up entries in a tree which is rarely
+ *	written don't serialise on the lock.
+ */
+#define PTHREAD_MUTEX_LOCK(_x) if (_x->lock) { \
+	if (_x->rwlock) { \
+		pthread_rwlock_wrlock(&((_x)->rwmutex)); \
+	} else { \
+		pthread_mutex_lock(&((_x)->mutex)); \
+	} \
+}
+#define PTHREAD_READ_LOCK(_x) if (_x->lock) { \
+	if (_x->rwlock) { \
+		pthread_rwlock_rdlock(&((_x)->rwmutex)); \
+	} else { \
+		pthread_mutex_lock(&((_x)->mutex)); \
+	} \
+}
+#define PTHREAD_MUTEX_UNLOCK(_x) if (_x->lock) { \
+	if (_x->rwlock) { \
+		pthread_rwlock_unlock(&((_x)->rwmutex)); \
+	} else { \
+		pthread_mutex_unlock(&((_x)->mutex)); \
+	} \
+}
 #else
 #define PTHREAD_MUTEX_LOCK(_x)
+#define PTHREAD_READ_LOCK(_x)
 #define PTHREAD_MUTEX_UNLOCK(_x)
 #endif
 
@@ -62,7 +88,9 @@ struct rbtree_t {
 	bool			replace;
 #ifdef HAVE_PTHREAD_H
 	bool			lock;
+	bool			rwlock;
 	pthread_mutex_t		mutex;
+	pthread_rwlock_t	rwmutex;
 #endif
 };
 #define RBTREE_MAGIC (0x5ad09c42)
@@ -100,7 +128,13 @@ void rbtree_free(rbtree_t *tree)
 	PTHREAD_MUTEX_UNLOCK(tree);
 
 #ifdef HAVE_PTHREAD_H
-	if (tree->lock) pthread_mutex_destroy(&tree->mutex);
+	if (tree->lock) {
+		if (tree->rwlock) {
+			pthread_rwlock_destroy(&tree->rwmutex);
+		} else {
+			pthread_mutex_destroy(&tree->mutex);
+		}
+	}
 #endif
 
 	talloc_free(tree);
@@ -125,8 +159,11 @@ rbtree_t *rbtree_create(TALLOC_CTX *ctx, rb_comparator_t compare, rb_free_t node
 	tree->compare = compare;
 	tree->replace = (flags & RBTREE_FLAG_REPLACE) != 0 ? true : false;
 #ifdef HAVE_PTHREAD_H
-	tree->lock = (flags & RBTREE_FLAG_LOCK) != 0 ? true : false;
-	if (tree->lock) {
+	tree->rwlock = (flags & RBTREE_FLAG_RWLOCK) != 0 ? true : false;
+	tree->lock = ((flags & RBTREE_FLAG_LOCK) != 0) || tree->rwlock ? true : false;
+	if (tree->rwlock) {
+		pthread_rwlock_init(&tree->rwmutex, NULL);
+	} else if (tree->lock) {
 		pthread_mutex_init(&tree->mutex, NULL);
 	}
 #endif
@@ -512,7 +549,7 @@ rbnode_t *rbtree_find(rbtree_t *tree, void const *data)
 {
 	rbnode_t *current;
 
-	PTHREAD_MUTEX_LOCK(tree);
+	PTHREAD_READ_LOCK(tree);
 	current = tree->root;
 
 	while (current != NIL) {
@@ -696,7 +733,14 @@ int rbtree_walk(rbtree_t *tree, rb_order_t order, rb_walker_t compare, void *con
 
 	if (tree->root == NIL) return 0;
 
-	PTHREAD_MUTEX_LOCK(tree);
+	/*
+	 *	Only the delete walk changes the tree.
+	 */
+	if (order == RBTREE_DELETE_ORDER) {
+		PTHREAD_MUTEX_LOCK(tree);
+	} else {
+		PTHREAD_READ_LOCK(tree);
+	}
 
 	switch (order) {
 	case RBTREE_PRE_ORDER:
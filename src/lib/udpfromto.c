@@ -157,14 +157,129 @@ int udpfromto_init(int s)
 	return setsockopt(s, proto, flag, &opt, sizeof(opt));
 }
 
+/*
+ *	Update the 'to' address from the auxiliary data which recvmsg()
+ *	returned with a packet.
+ */
+static void udpfromto_dst(struct msghdr *msgh, struct sockaddr *to, socklen_t *tolen)
+{
+	struct cmsghdr *cmsg;
+
+	for (cmsg = CMSG_FIRSTHDR(msgh);
+	     cmsg != NULL;
+	     cmsg = CMSG_NXTHDR(msgh, cmsg)) {
+
+#ifdef IP_PKTINFO
+		if ((cmsg->cmsg_level == SOL_IP) &&
+		    (cmsg->cmsg_type == IP_PKTINFO)) {
+			struct in_pktinfo *i =
+				(struct in_pktinfo *) CMSG_DATA(cmsg);
+			((struct sockaddr_in *)to)->sin_addr = i->ipi_addr;
+			*tolen = sizeof(struct sockaddr_in);
+			break;
+		}
+#endif
+
+#ifdef IP_RECVDSTADDR
+		if ((cmsg->cmsg_level == IPPROTO_IP) &&
+		    (cmsg->cmsg_type == IP_RECVDSTADDR)) {
+			struct in_addr *i = (struct in_addr *) CMSG_DATA(cmsg);
+			((struct sockaddr_in *)to)->sin_addr = *i;
+			*tolen = sizeof(struct sockaddr_in);
+			break;
+		}
+#endif
+
+#ifdef IPV6_PKTINFO
+		if ((cmsg->cmsg_level == IPPROTO_IPV6) &&
+		    (cmsg->cmsg_type == IPV6_PKTINFO)) {
+			struct in6_pktinfo *i =
+				(struct in6_pktinfo *) CMSG_DATA(cmsg);
+			((struct sockaddr_in6 *)to)->sin6_addr = i->ipi6_addr;
+			*tolen = sizeof(struct sockaddr_in6);
+			break;
+		}
+#endif
+	}
+}
+
+/*
+ *	Add the auxiliary data which tells sendmsg() to use 'from' as
+ *	the source address.  cbuf must be UDPFROMTO_CMSG_SIZE bytes.
+ */
+static void udpfromto_src(struct msghdr *msgh, char *cbuf, struct sockaddr const *from)
+{
+	memset(cbuf, 0, UDPFROMTO_CMSG_SIZE);
+	msgh->msg_control = NULL;
+	msgh->msg_controllen = 0;
+
+# if defined(IP_PKTINFO) || defined(IP_SENDSRCADDR)
+	if (from->sa_family == AF_INET) {
+		struct sockaddr_in const *s4 = (struct sockaddr_in const *) from;
+
+#  ifdef IP_PKTINFO
+		struct cmsghdr *cmsg;
+		struct in_pktinfo *pkt;
+
+		msgh->msg_control = cbuf;
+		msgh->msg_controllen = CMSG_SPACE(sizeof(*pkt));
+
+		cmsg = CMSG_FIRSTHDR(msgh);
+		cmsg->cmsg_level = SOL_IP;
+		cmsg->cmsg_type = IP_PKTINFO;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(*pkt));
+
+		pkt = (struct in_pktinfo *) CMSG_DATA(cmsg);
+		memset(pkt, 0, sizeof(*pkt));
+		pkt->ipi_spec_dst = s4->sin_addr;
+
+#  elif defined(IP_SENDSRCADDR)
+		struct cmsghdr *cmsg;
+		struct in_addr *in;
+
+		msgh->msg_control = cbuf;
+		msgh->msg_controllen = CMSG_SPACE(sizeof(*in));
+
+		cmsg = CMSG_FIRSTHDR(msgh);
+		cmsg->cmsg_level = IPPROTO_IP;
+		cmsg->cmsg_type = IP_SENDSRCADDR;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(*in));
+
+		in = (struct in_addr *) CMSG_DATA(cmsg);
+		*in = s4->sin_addr;
+#  endif
+	}
+#endif
+
+#  if defined(IPV6_PKTINFO)
+	if (from->sa_family == AF_INET6) {
+		struct sockaddr_in6 const *s6 = (struct sockaddr_in6 const *) from;
+
+		struct cmsghdr *cmsg;
+		struct in6_pktinfo *pkt;
+
+		msgh->msg_control = cbuf;
+		msgh->msg_controllen = CMSG_SPACE(sizeof(*pkt));
+
+		cmsg = CMSG_FIRSTHDR(msgh);
+		cmsg->cmsg_level = IPPROTO_IPV6;
+		cmsg->cmsg_type = IPV6_PKTINFO;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(*pkt));
+
+		pkt = (struct in6_pktinfo *) CMSG_DATA(cmsg);
+		memset(pkt, 0, sizeof(*pkt));
+		pkt->ipi6_addr = s6->sin6_addr;
+	}
+#  endif	/* IPV6_PKTINFO */
+}
+
 int recvfromto(int s, void *buf, size_t len, int flags,
 	       struct sockaddr *from, socklen_t *fromlen,
 	       struct sockaddr *to, socklen_t *tolen)
 {
 	struct msghdr msgh;
-	struct cmsghdr *cmsg;
 	struct iovec iov;
-	char cbuf[256];
+	char cbuf[UDPFROMTO_CMSG_SIZE];
 	int err;
 	struct sockaddr_storage si;
 	socklen_t si_len = sizeof(si);
@@ -263,43 +378,7 @@ int recvfromto(int s, void *buf, size_t len, int flags,
 
 	if (fromlen) *fromlen = msgh.msg_namelen;
 
-	/* Process auxiliary received data in msgh */
-	for (cmsg = CMSG_FIRSTHDR(&msgh);
-	     cmsg != NULL;
-	     cmsg = CMSG_NXTHDR(&msgh,cmsg)) {
-
-#ifdef IP_PKTINFO
-		if ((cmsg->cmsg_level == SOL_IP) &&
-		    (cmsg->cmsg_type == IP_PKTINFO)) {
-			struct in_pktinfo *i =
-				(struct in_pktinfo *) CMSG_DATA(cmsg);
-			((struct sockaddr_in *)to)->sin_addr = i->ipi_addr;
-			*tolen = sizeof(struct sockaddr_in);
-			break;
-		}
-#endif
-
-#ifdef IP_RECVDSTADDR
-		if ((cmsg->cmsg_level == IPPROTO_IP) &&
-		    (cmsg->cmsg_type == IP_RECVDSTADDR)) {
-			struct in_addr *i = (struct in_addr *) CMSG_DATA(cmsg);
-			((struct sockaddr_in *)to)->sin_addr = *i;
-			*tolen = sizeof(struct sockaddr_in);
-			break;
-		}
-#endif
-
-#ifdef IPV6_PKTINFO
-		if ((cmsg->cmsg_level == IPPROTO_IPV6) &&
-		    (cmsg->cmsg_type == IPV6_PKTINFO)) {
-			struct in6_pktinfo *i =
-				(struct in6_pktinfo *) CMSG_DATA(cmsg);
-			((struct sockaddr_in6 *)to)->sin6_addr = i->ipi6_addr;
-			*tolen = sizeof(struct sockaddr_in6);
-			break;
-		}
-#endif
-	}
+	udpfromto_dst(&msgh, to, tolen);
 
 	return err;
 }
@@ -310,7 +389,7 @@ int sendfromto(int s, void *buf, size_t len, int flags,
 {
 	struct msghdr msgh;
 	struct iovec iov;
-	char cbuf[256];
+	char cbuf[UDPFROMTO_CMSG_SIZE];
 
 	/*
 	 *	Unknown address family, die.
@@ -374,8 +453,7 @@ int sendfromto(int s, void *buf, size_t len, int flags,
 		return sendto(s, buf, len, flags, to, tolen);
 	}
 
-	/* Set up control buffer iov and msgh structures. */
-	memset(&cbuf, 0, sizeof(cbuf));
+	/* Set up iov and msgh structures. */
 	memset(&msgh, 0, sizeof(msgh));
 	memset(&iov, 0, sizeof(iov));
 	iov.iov_base = buf;
@@ -386,67 +464,145 @@ int sendfromto(int s, void *buf, size_t len, int flags,
 	msgh.msg_name = to;
 	msgh.msg_namelen = tolen;
 
-# if defined(IP_PKTINFO) || defined(IP_SENDSRCADDR)
-	if (from->sa_family == AF_INET) {
-		struct sockaddr_in *s4 = (struct sockaddr_in *) from;
+	udpfromto_src(&msgh, cbuf, from);
 
-#  ifdef IP_PKTINFO
-		struct cmsghdr *cmsg;
-		struct in_pktinfo *pkt;
+	return sendmsg(s, &msgh, flags);
+}
 
-		msgh.msg_control = cbuf;
-		msgh.msg_controllen = CMSG_SPACE(sizeof(*pkt));
+#ifdef HAVE_RECVMMSG
+/** Like recvfromto(), but reads up to vlen packets with one system call
+ *
+ * The caller sets up each msgvec[i].msg_hdr with the iovec to read into,
+ * a buffer for the source address, and a control buffer of
+ * UDPFROMTO_CMSG_SIZE bytes.  msg_namelen and msg_controllen are
+ * overwritten by recvmmsg(), and must be reset before each call.
+ *
+ * @param s the socket to read from.
+ * @param msgvec the messages to read into.
+ * @param vlen the number of entries in msgvec.
+ * @param flags as for recvmmsg().
+ * @param to where the destination address of each packet is written.
+ * @param tolen the length of each destination address.
+ * @return the number of packets read, or -1 on error.
+ */
+int recvmmsgfromto(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags,
+		   struct sockaddr_storage *to, socklen_t *tolen)
+{
+	int i, rcode;
+	struct sockaddr_storage si;
+	socklen_t si_len = sizeof(si);
 
-		cmsg = CMSG_FIRSTHDR(&msgh);
-		cmsg->cmsg_level = SOL_IP;
-		cmsg->cmsg_type = IP_PKTINFO;
-		cmsg->cmsg_len = CMSG_LEN(sizeof(*pkt));
+#ifdef __clang_analyzer__
+	memset(&si, 0, sizeof(si));
+#endif
 
-		pkt = (struct in_pktinfo *) CMSG_DATA(cmsg);
-		memset(pkt, 0, sizeof(*pkt));
-		pkt->ipi_spec_dst = s4->sin_addr;
+	/*
+	 *	The port, and the address if the socket is bound to
+	 *	one, are the same for every packet.
+	 */
+	if (getsockname(s, (struct sockaddr *)&si, &si_len) < 0) {
+		return -1;
+	}
 
-#  elif defined(IP_SENDSRCADDR)
-		struct cmsghdr *cmsg;
-		struct in_addr *in;
+	rcode = recvmmsg(s, msgvec, vlen, flags, NULL);
+	if (rcode <= 0) return rcode;
 
-		msgh.msg_control = cbuf;
-		msgh.msg_controllen = CMSG_SPACE(sizeof(*in));
+	for (i = 0; i < rcode; i++) {
+		memcpy(&to[i], &si, si_len);
+		tolen[i] = si_len;
+		udpfromto_dst(&msgvec[i].msg_hdr, (struct sockaddr *) &to[i], &tolen[i]);
+	}
 
-		cmsg = CMSG_FIRSTHDR(&msgh);
-		cmsg->cmsg_level = IPPROTO_IP;
-		cmsg->cmsg_type = IP_SENDSRCADDR;
-		cmsg->cmsg_len = CMSG_LEN(sizeof(*in));
+	return rcode;
+}
+#endif	/* HAVE_RECVMMSG */
 
-		in = (struct in_addr *) CMSG_DATA(cmsg);
-		*in = s4->sin_addr;
-#  endif
+#ifdef HAVE_SENDMMSG
+/** Like sendfromto(), but writes vlen packets with as few system calls as possible
+ *
+ * The caller sets up each msgvec[i].msg_hdr with the iovec to write, the
+ * destination address, and a control buffer of UDPFROMTO_CMSG_SIZE bytes.
+ * On return, msgvec[i].msg_len is the number of bytes written for each
+ * packet, or 0 if it couldn't be written.  errno is then set from the
+ * last packet which couldn't be written.
+ *
+ * @param s the socket to write to.
+ * @param msgvec the messages to write.
+ * @param vlen the number of entries in msgvec.
+ * @param flags as for sendmmsg().
+ * @param from the source address of each packet.  AF_UNSPEC means
+ *	let the kernel choose.
+ * @return the number of packets written, or -1 if none could be written.
+ */
+int sendmmsgfromto(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags,
+		   struct sockaddr_storage const *from)
+{
+	unsigned int i, sent;
+	int rcode;
+	bool set_src = true;
+
+#ifdef __FreeBSD__
+	struct sockaddr_storage bound;
+	socklen_t bound_len = sizeof(bound);
+
+	/*
+	 *	See sendfromto().
+	 */
+	if (getsockname(s, (struct sockaddr *) &bound, &bound_len) < 0) {
+		return -1;
 	}
-#endif
 
-#  if defined(IPV6_PKTINFO)
-	if (from->sa_family == AF_INET6) {
-		struct sockaddr_in6 *s6 = (struct sockaddr_in6 *) from;
+	switch (bound.ss_family) {
+	case AF_INET:
+		if (((struct sockaddr_in *) &bound)->sin_addr.s_addr != INADDR_ANY) {
+			set_src = false;
+		}
+		break;
 
-		struct cmsghdr *cmsg;
-		struct in6_pktinfo *pkt;
+	case AF_INET6:
+		if (!IN6_IS_ADDR_UNSPECIFIED(&((struct sockaddr_in6 *) &bound)->sin6_addr)) {
+			set_src = false;
+		}
+		break;
+	}
+#endif	/* !__FreeBSD__ */
 
-		msgh.msg_control = cbuf;
-		msgh.msg_controllen = CMSG_SPACE(sizeof(*pkt));
+	for (i = 0; i < vlen; i++) {
+		struct msghdr *msgh = &msgvec[i].msg_hdr;
 
-		cmsg = CMSG_FIRSTHDR(&msgh);
-		cmsg->cmsg_level = IPPROTO_IPV6;
-		cmsg->cmsg_type = IPV6_PKTINFO;
-		cmsg->cmsg_len = CMSG_LEN(sizeof(*pkt));
+		msgvec[i].msg_len = 0;
 
-		pkt = (struct in6_pktinfo *) CMSG_DATA(cmsg);
-		memset(pkt, 0, sizeof(*pkt));
-		pkt->ipi6_addr = s6->sin6_addr;
+		if (!set_src) {
+			msgh->msg_control = NULL;
+			msgh->msg_controllen = 0;
+			continue;
+		}
+
+		udpfromto_src(msgh, msgh->msg_control, (struct sockaddr const *) &from[i]);
 	}
-#  endif	/* IPV6_PKTINFO */
 
-	return sendmsg(s, &msgh, flags);
+	/*
+	 *	sendmmsg() stops at the first packet it can't write.
+	 *	Skip that packet, and carry on with the rest.
+	 */
+	sent = 0;
+	i = 0;
+	while (i < vlen) {
+		rcode = sendmmsg(s, msgvec + i, vlen - i, flags);
+		if (rcode <= 0) {
+			i++;
+			continue;
+		}
+
+		sent += rcode;
+		i += rcode;
+	}
+
+	if (sent == 0) return -1;
+
+	return sent;
 }
+#endif	/* HAVE_SENDMMSG */
 
 
 #ifdef TESTING
@@ -27,6 +27,7 @@
 #include <freeradius-devel/modcall.h>
 #include <freeradius-devel/md5.h>
 #include <freeradius-devel/channel.h>
+#include <freeradius-devel/state.h>
 
 #include <libgen.h>
 #ifdef HAVE_INTTYPES_H
@@ -2230,6 +2231,21 @@ static char const *elapsed_names[8] = {
 	"1us", "10us", "100us", "1ms", "10ms", "100ms", "1s", "10s"
 };
 
+/*
+ *	Print percentiles (in usec) for a latency histogram.
+ */
+static void command_print_hist(rad_listen_t *listener, char const *name, fr_stats_hist_t const *hist)
+{
+	cprintf(listener, "%s.samples\t%" PRIu64 "\n", name, hist->count);
+	if (!hist->count) return;
+
+	cprintf(listener, "%s.avg_usec\t%" PRIu64 "\n", name, hist->sum / hist->count);
+	cprintf(listener, "%s.p50_usec\t%u\n", name, fr_stats_hist_percentile(hist, 50.0));
+	cprintf(listener, "%s.p99_usec\t%u\n", name, fr_stats_hist_percentile(hist, 99.0));
+	cprintf(listener, "%s.p999_usec\t%u\n", name, fr_stats_hist_percentile(hist, 99.9));
+	cprintf(listener, "%s.max_usec\t%u\n", name, hist->max);
+}
+
 static int command_print_stats(rad_listen_t *listener, fr_stats_t *stats,
 			       int auth, int server)
 {
@@ -2264,6 +2280,8 @@ static int command_print_stats(rad_listen_t *listener, fr_stats_t *stats,
 			elapsed_names[i], stats->elapsed[i]);
 	}
 
+	command_print_hist(listener, "latency", &stats->latency);
+
 	return CMD_OK;
 }
 
@@ -2272,6 +2290,7 @@ static int command_print_stats(rad_listen_t *listener, fr_stats_t *stats,
 static int command_stats_queue(rad_listen_t *listener, UNUSED int argc, UNUSED char *argv[])
 {
 	int array[RAD_LISTEN_MAX], pps[2];
+	fr_stats_hist_t hist;
 
 	thread_pool_queue_stats(array, pps);
 
@@ -2284,6 +2303,70 @@ static int command_stats_queue(rad_listen_t *listener, UNUSED int argc, UNUSED c
 	cprintf(listener, "queue_pps_in\t\t%d\n", pps[0]);
 	cprintf(listener, "queue_pps_out\t\t%d\n", pps[1]);
 
+	fr_stats_latency_merge(&hist, &radius_queue_wait_stats);
+	command_print_hist(listener, "queue_wait", &hist);
+
+	fr_stats_latency_merge(&hist, &radius_processing_stats);
+	command_print_hist(listener, "processing", &hist);
+
+	return CMD_OK;
+}
+#endif
+
+static int command_stats_module(rad_listen_t *listener, int argc, char *argv[])
+{
+	CONF_SECTION *cs;
+	module_instance_t *mi;
+	fr_stats_hist_t hist;
+
+	if (argc < 1) {
+		cprintf_error(listener, "No module name was given\n");
+		return 0;
+	}
+
+	cs = cf_section_find("modules");
+	if (!cs) return 0;
+
+	mi = module_find(cs, argv[0]);
+	if (!mi) {
+		cprintf_error(listener, "No such module \"%s\"\n", argv[0]);
+		return 0;
+	}
+
+	fr_stats_latency_merge(&hist, &mi->stats);
+	command_print_hist(listener, "latency", &hist);
+
+	return CMD_OK;
+}
+
+static int command_stats_state(rad_listen_t *listener, UNUSED int argc, UNUSED char *argv[])
+{
+	fr_state_stats_t stats;
+
+	fr_state_stats(&stats);
+
+	cprintf(listener, "shards\t\t\t%u\n", stats.shards);
+	cprintf(listener, "entries\t\t\t%u\n", stats.entries);
+	cprintf(listener, "max_shard_entries\t%u\n", stats.max_shard_entries);
+	cprintf(listener, "expired\t\t\t%" PRIu64 "\n", stats.expired);
+	cprintf(listener, "full\t\t\t%" PRIu64 "\n", stats.full);
+	cprintf(listener, "lock_contended\t\t%" PRIu64 "\n", stats.contended);
+
+	return CMD_OK;
+}
+
+#ifdef WITH_TLS
+static int command_stats_ktls(rad_listen_t *listener, UNUSED int argc, UNUSED char *argv[])
+{
+	fr_tls_ktls_stats_t stats;
+
+	tls_ktls_stats(&stats);
+
+	cprintf(listener, "connections		%" PRIu64 "\n", stats.connections);
+	cprintf(listener, "kernel_send		%" PRIu64 "\n", stats.send);
+	cprintf(listener, "kernel_recv		%" PRIu64 "\n", stats.recv);
+	cprintf(listener, "fallback		%" PRIu64 "\n", stats.fallback);
+
 	return CMD_OK;
 }
 #endif
@@ -2689,9 +2772,19 @@ static fr_command_table_t command_table_stats[] = {
 	  command_stats_home_server, NULL },
 #endif
 
+#ifdef WITH_TLS
+	{ "ktls", FR_READ,
+	  "stats ktls - show how many TLS connections had their encryption moved into the kernel",
+	  command_stats_ktls, NULL },
+#endif
+
+	{ "module", FR_READ,
+	  "stats module <module> - show time spent in the given module",
+	  command_stats_module, NULL },
+
 #ifdef HAVE_PTHREAD_H
 	{ "queue", FR_READ,
-	  "stats queue - show statistics for packet queues",
+	  "stats queue - show statistics for packet queues, and time spent queued and processing",
 	  command_stats_queue, NULL },
 #endif
 
@@ -2700,6 +2793,10 @@ static fr_command_table_t command_table_stats[] = {
 	  "- show statistics for given socket",
 	  command_stats_socket, NULL },
 
+	{ "state", FR_READ,
+	  "stats state - show how many session-state entries exist, and how often their locks are contended",
+	  command_stats_state, NULL },
+
 #ifndef NDEBUG
 	{ "memory", FR_READ,
 	  "stats memory [blocks|full|total] - show statistics on used memory",
@@ -647,9 +647,43 @@ int radius_evaluate_map(REQUEST *request, UNUSED int modreturn, UNUSED int depth
 #ifndef NDEBUG
 			rad_assert(radius_find_compare(map->lhs->tmpl_da)); /* expensive assert */
 #endif
+			/*
+			 *	The check pair was built in pass2.
+			 */
+			if (c->check) {
+				EVAL_DEBUG("CMP WITH PAIRCOMPARE (PRE-BUILT)");
+				rcode = paircompare(request, request->packet->vps, c->check, NULL);
+				rcode = (rcode == 0) ? 1 : 0;
+				break;
+			}
+
 			rcode = cond_normalise_and_cmp(request, c, PW_TYPE_INVALID, NULL, NULL, 0);
 			break;
 		}
+
+		/*
+		 *	Operands need no casting, so compare the data
+		 *	directly.  See pass2_cond_fast_cmp().
+		 */
+		if (c->fast_cmp) {
+			vp_tmpl_t const *rhs = map->rhs;
+
+			for (vp = tmpl_cursor_init(&rcode, &cursor, request, map->lhs);
+			     vp;
+			     vp = tmpl_cursor_next(&cursor, map->lhs)) {
+				if (vp->da->type != map->lhs->tmpl_da->type) {
+					rcode = cond_normalise_and_cmp(request, c, vp->da->type, vp->da,
+								       &vp->data, vp->vp_length);
+				} else {
+					rcode = value_data_cmp_op(map->op, vp->da->type, &vp->data, vp->vp_length,
+								  rhs->tmpl_data_type, &rhs->tmpl_data_value,
+								  rhs->tmpl_data_length);
+				}
+				if (rcode != 0) break;
+			}
+			break;
+		}
+
 		for (vp = tmpl_cursor_init(&rcode, &cursor, request, map->lhs);
 		     vp;
 	     	     vp = tmpl_cursor_next(&cursor, map->lhs)) {
@@ -1550,13 +1550,12 @@ static int auth_socket_recv(rad_listen_t *listener)
 		return 0;
 	} /* switch over packet types */
 
-	ctx = talloc_pool(NULL, main_config.talloc_pool_size);
+	ctx = request_pool_alloc("auth_listener_pool");
 	if (!ctx) {
 		rad_recv_discard(listener->fd);
 		FR_STATS_INC(auth, total_packets_dropped);
 		return 0;
 	}
-	talloc_set_name_const(ctx, "auth_listener_pool");
 
 	/*
 	 *	Now that we've sanity checked everything, receive the
@@ -1566,7 +1565,7 @@ static int auth_socket_recv(rad_listen_t *listener)
 	if (!packet) {
 		FR_STATS_INC(auth, total_malformed_requests);
 		if (DEBUG_ENABLED) ERROR("Receive - %s", fr_strerror());
-		talloc_free(ctx);
+		request_pool_free(ctx);
 		return 0;
 	}
 
@@ -1596,7 +1595,7 @@ static int auth_socket_recv(rad_listen_t *listener)
 
 	if (!request_receive(ctx, listener, packet, client, fun)) {
 		FR_STATS_INC(auth, total_packets_dropped);
-		talloc_free(ctx);
+		request_pool_free(ctx);
 		return 0;
 	}
 
@@ -1667,13 +1666,12 @@ static int acct_socket_recv(rad_listen_t *listener)
 		return 0;
 	} /* switch over packet types */
 
-	ctx = talloc_pool(NULL, main_config.talloc_pool_size);
+	ctx = request_pool_alloc("acct_listener_pool");
 	if (!ctx) {
 		rad_recv_discard(listener->fd);
 		FR_STATS_INC(acct, total_packets_dropped);
 		return 0;
 	}
-	talloc_set_name_const(ctx, "acct_listener_pool");
 
 	/*
 	 *	Now that we've sanity checked everything, receive the
@@ -1683,7 +1681,7 @@ static int acct_socket_recv(rad_listen_t *listener)
 	if (!packet) {
 		FR_STATS_INC(acct, total_malformed_requests);
 		if (DEBUG_ENABLED) ERROR("Receive - %s", fr_strerror());
-		talloc_free(ctx);
+		request_pool_free(ctx);
 		return 0;
 	}
 
@@ -1693,7 +1691,7 @@ static int acct_socket_recv(rad_listen_t *listener)
 	if (!request_receive(ctx, listener, packet, client, fun)) {
 		FR_STATS_INC(acct, total_packets_dropped);
 		rad_free(&packet);
-		talloc_free(ctx);
+		request_pool_free(ctx);
 		return 0;
 	}
 
@@ -1943,13 +1941,12 @@ static int coa_socket_recv(rad_listen_t *listener)
 		return 0;
 	} /* switch over packet types */
 
-	ctx = talloc_pool(NULL, main_config.talloc_pool_size);
+	ctx = request_pool_alloc("coa_socket_recv_pool");
 	if (!ctx) {
 		rad_recv_discard(listener->fd);
 		FR_STATS_INC(coa, total_packets_dropped);
 		return 0;
 	}
-	talloc_set_name_const(ctx, "coa_socket_recv_pool");
 
 	/*
 	 *	Now that we've sanity checked everything, receive the
@@ -1959,14 +1956,14 @@ static int coa_socket_recv(rad_listen_t *listener)
 	if (!packet) {
 		FR_STATS_INC(coa, total_malformed_requests);
 		if (DEBUG_ENABLED) ERROR("Receive - %s", fr_strerror());
-		talloc_free(ctx);
+		request_pool_free(ctx);
 		return 0;
 	}
 
 	if (!request_receive(ctx, listener, packet, client, fun)) {
 		FR_STATS_INC(coa, total_packets_dropped);
 		rad_free(&packet);
-		talloc_free(ctx);
+		request_pool_free(ctx);
 		return 0;
 	}
 
@@ -2759,6 +2756,18 @@ static int _listener_free(rad_listen_t *this)
 			pthread_mutex_destroy(&(sock->mutex));
 #endif
 		}
+
+#if defined(WITH_PROXY) && defined(HAVE_PTHREAD_H)
+		/*
+		 *	Outgoing TLS connections don't have this->tls.
+		 */
+		if ((this->type == RAD_LISTEN_PROXY) && ((listen_socket_t *) this->data)->ssn) {
+			listen_socket_t *sock = this->data;
+
+			pthread_mutex_destroy(&(sock->mutex));
+			pthread_mutex_destroy(&(sock->send_mutex));
+		}
+#endif
 #endif	/* WITH_TLS */
 	}
 #endif				/* WITH_TCP */
@@ -2880,6 +2889,34 @@ rad_listen_t *proxy_new_listener(TALLOC_CTX *ctx, home_server_t *home, uint16_t
 
 		this->recv = proxy_tls_recv;
 		this->send = proxy_tls_send;
+
+#ifdef HAVE_PTHREAD_H
+		if ((pthread_mutex_init(&sock->mutex, NULL) < 0) ||
+		    (pthread_mutex_init(&sock->send_mutex, NULL) < 0)) {
+			ERROR("Failed initializing mutex for new proxy socket '%s'", buffer);
+			listen_free(&this);
+			return NULL;
+		}
+#endif
+
+		/*
+		 *	The queue and the spare buffer are swapped on
+		 *	every flush, so allocate both now.  Every packet
+		 *	has at least a 20 octet header, which limits how
+		 *	many senders can be waiting on one buffer.
+		 */
+		if (home->coalesce_writes) {
+			sock->send_queue = talloc_array(sock, uint8_t, SSL3_RT_MAX_PLAIN_LENGTH);
+			sock->send_spare = talloc_array(sock, uint8_t, SSL3_RT_MAX_PLAIN_LENGTH);
+			sock->send_error = talloc_array(sock, int *, SSL3_RT_MAX_PLAIN_LENGTH / 20);
+			sock->send_spare_error = talloc_array(sock, int *, SSL3_RT_MAX_PLAIN_LENGTH / 20);
+			if (!sock->send_queue || !sock->send_spare ||
+			    !sock->send_error || !sock->send_spare_error) {
+				ERROR("Out of memory");
+				listen_free(&this);
+				return NULL;
+			}
+		}
 	}
 #endif
 #endif
@@ -172,6 +172,7 @@ static const CONF_PARSER resources[] = {
 	 *	it exists.
 	 */
 	{ "talloc_pool_size", FR_CONF_POINTER(PW_TYPE_INTEGER, &main_config.talloc_pool_size), NULL },
+	{ "talloc_pool_cache", FR_CONF_POINTER(PW_TYPE_INTEGER, &main_config.talloc_pool_cache), NULL },
 	CONF_PARSER_TERMINATOR
 };
 
@@ -845,6 +846,7 @@ int main_config_init(void)
 	 *	Which should be enough for many configurations.
 	 */
 	main_config.talloc_pool_size = 8 * 1024; /* default */
+	main_config.talloc_pool_cache = 256; /* default */
 
 	/*
 	 *	Read the distribution dictionaries first, then
@@ -1118,6 +1120,7 @@ do {\
 
 	FR_INTEGER_BOUND_CHECK("resources.talloc_pool_size", main_config.talloc_pool_size, >=, 2 * 1024);
 	FR_INTEGER_BOUND_CHECK("resources.talloc_pool_size", main_config.talloc_pool_size, <=, 1024 * 1024);
+	FR_INTEGER_BOUND_CHECK("resources.talloc_pool_cache", main_config.talloc_pool_cache, <=, 65536);
 
 	/*
 	 * Set default initial request processing delay to 1/3 of a second.
@@ -75,13 +75,28 @@ typedef struct {
 	CONF_SECTION		*cs;
 	vp_map_t	*map;		/* update */
 	vp_tmpl_t	*vpt;		/* switch */
+	fr_hash_table_t		*cases;		/* switch, when every case is static data */
 	fr_cond_t		*cond;		/* if/elsif */
+	modcallable		*chain_end;	/* if/elsif, first sibling after the if/elsif/else chain */
 	bool			done_pass2;
 } modgroup;
 
+#ifdef WITH_UNLANG
+/*
+ *	A "case" statement in a hashed "switch".
+ */
+typedef struct {
+	PW_TYPE			type;
+	value_data_t const	*data;
+	size_t			len;
+	modcallable		*mc;
+} modcall_case_t;
+#endif
+
 typedef struct {
 	modcallable mc;
 	module_instance_t *modinst;
+	packetmethod method;		/* resolved when the section is compiled */
 } modsingle;
 
 typedef struct {
@@ -277,6 +292,9 @@ static rlm_rcode_t CC_HINT(nonnull) call_modsingle(rlm_components_t component, m
 	int blocked;
 	int indent = request->log.indent;
 	char const *old;
+#ifdef WITH_STATS
+	struct timeval start, end;
+#endif
 
 	/*
 	 *	If the request should stop, refuse to do anything.
@@ -300,10 +318,23 @@ static rlm_rcode_t CC_HINT(nonnull) call_modsingle(rlm_components_t component, m
 	old = request->module;
 	request->module = sp->modinst->name;
 
+#ifdef WITH_STATS
+	gettimeofday(&start, NULL);
+#endif
+
 	safe_lock(sp->modinst);
-	request->rcode = sp->modinst->entry->module->methods[component](sp->modinst->insthandle, request);
+	request->rcode = sp->method(sp->modinst->insthandle, request);
 	safe_unlock(sp->modinst);
 
+#ifdef WITH_STATS
+	/*
+	 *	Includes time spent waiting for the module mutex,
+	 *	as the request has to pay for that, too.
+	 */
+	gettimeofday(&end, NULL);
+	fr_stats_latency_add(&sp->modinst->stats, &start, &end);
+#endif
+
 	request->module = old;
 
 	/*
@@ -807,6 +838,7 @@ redo:
 		value_data_t data;
 		vp_map_t map;
 		vp_tmpl_t vpt;
+		VALUE_PAIR *vp;
 
 		MOD_LOG_OPEN_BRACE;
 
@@ -825,12 +857,13 @@ redo:
 
 		null_case = found = NULL;
 		data.ptr = NULL;
+		vp = NULL;
 
 		/*
 		 *	The attribute doesn't exist.  We can skip
 		 *	directly to the default 'case' statement.
 		 */
-		if ((g->vpt->type == TMPL_TYPE_ATTR) && (tmpl_find_vp(NULL, request, g->vpt) < 0)) {
+		if ((g->vpt->type == TMPL_TYPE_ATTR) && (tmpl_find_vp(&vp, request, g->vpt) < 0)) {
 		find_null_case:
 			for (this = g->children; this; this = this->next) {
 				rad_assert(this->type == MOD_CASE);
@@ -845,6 +878,27 @@ redo:
 			goto do_null_case;
 		}
 
+		/*
+		 *	Every 'case' statement is static data of the
+		 *	same type as the attribute, so we can look the
+		 *	value up directly.
+		 */
+		if (g->cases) {
+			modcall_case_t my_case, *found_case;
+
+			rad_assert(vp != NULL);
+
+			my_case.type = vp->da->type;
+			my_case.data = &vp->data;
+			my_case.len = vp->vp_length;
+
+			found_case = fr_hash_table_finddata(g->cases, &my_case);
+			if (!found_case) goto find_null_case;
+
+			found = found_case->mc;
+			goto do_null_case;
+		}
+
 		/*
 		 *	Expand the template if necessary, so that it
 		 *	is evaluated once instead of for each 'case'
@@ -1101,6 +1155,20 @@ calculate_result:
 
 next_sibling:
 	if (do_next_sibling) {
+#ifdef WITH_UNLANG
+		/*
+		 *	We've run an "if" or "elsif", so the rest of
+		 *	the chain can't be taken.  Jump over it, unless
+		 *	we have to say that we're skipping each part.
+		 */
+		if (if_taken && !RDEBUG_ENABLED2) {
+			rad_assert((c->type == MOD_IF) || (c->type == MOD_ELSIF));
+
+			entry->c = mod_callabletogroup(c)->chain_end;
+			if (entry->c) goto redo;
+			goto finish;
+		}
+#endif
 		entry->c = entry->c->next;
 
 		if (entry->c) goto redo;
@@ -2675,6 +2743,7 @@ allocate_csingle:
 
 	single = talloc_zero(parent, modsingle);
 	single->modinst = this;
+	single->method = this->entry->module->methods[method];
 	*modname = this->entry->module->name;
 
 	csingle = mod_singletocallable(single);
@@ -3194,6 +3263,56 @@ static bool pass2_fixup_undefined(CONF_ITEM const *ci, vp_tmpl_t *vpt)
 	return true;
 }
 
+/** Check whether a condition can skip normalisation at run time
+ *
+ * An attribute compared against data of the same type (or an IP
+ * address compared against a prefix of the same family) needs no
+ * casts, so radius_evaluate_map() can hand the operands straight
+ * to value_data_cmp_op().
+ */
+static bool pass2_cond_fast_cmp(fr_cond_t const *c)
+{
+	vp_map_t const *map = c->data.map;
+	PW_TYPE lhs_type, rhs_type;
+
+	if (c->pass2_fixup != PASS2_FIXUP_NONE) return false;
+
+	if ((map->lhs->type != TMPL_TYPE_ATTR) ||
+	    (map->rhs->type != TMPL_TYPE_DATA)) return false;
+
+	switch (map->op) {
+	case T_OP_CMP_EQ:
+	case T_OP_NE:
+	case T_OP_LT:
+	case T_OP_LE:
+	case T_OP_GT:
+	case T_OP_GE:
+		break;
+
+	default:
+		return false;
+	}
+
+	lhs_type = map->lhs->tmpl_da->type;
+	rhs_type = map->rhs->tmpl_data_type;
+
+	if (!c->cast) return (lhs_type == rhs_type);
+
+	if (c->cast->type != rhs_type) return false;
+
+	if (lhs_type == rhs_type) return true;
+
+	/*
+	 *	Framed-IP-Address < 192.0.2.0/24 is parsed with a
+	 *	prefix cast.  value_data_cmp_op() compares addresses
+	 *	against prefixes itself, so the LHS needn't be cast.
+	 */
+	if ((lhs_type == PW_TYPE_IPV4_ADDR) && (rhs_type == PW_TYPE_IPV4_PREFIX)) return true;
+	if ((lhs_type == PW_TYPE_IPV6_ADDR) && (rhs_type == PW_TYPE_IPV6_PREFIX)) return true;
+
+	return false;
+}
+
 static bool pass2_callback(void *ctx, fr_cond_t *c)
 {
 	vp_map_t *map;
@@ -3472,6 +3591,31 @@ static bool pass2_callback(void *ctx, fr_cond_t *c)
 	 *	@todo v3.1: do the same thing for the RHS...
 	 */
 
+	/*
+	 *	&Attr == literal, where the attribute was only defined
+	 *	after the condition was parsed.  Cast the literal now,
+	 *	so that it isn't re-parsed on every evaluation.
+	 *
+	 *	IP addresses are left alone, as parser.c chooses
+	 *	between address and prefix types for them.  If the
+	 *	cast fails, evaluate.c reports the error at run time,
+	 *	as before.
+	 */
+	if ((map->lhs->type == TMPL_TYPE_ATTR) &&
+	    (map->rhs->type == TMPL_TYPE_LITERAL) && !c->cast &&
+	    (map->op != T_OP_REG_EQ) && (map->op != T_OP_REG_NE)) {
+		switch (map->lhs->tmpl_da->type) {
+		case PW_TYPE_IPV4_ADDR:
+		case PW_TYPE_IPV6_ADDR:
+		case PW_TYPE_COMBO_IP_ADDR:
+			break;
+
+		default:
+			(void) tmpl_cast_in_place(map->rhs, map->lhs->tmpl_da->type, map->lhs->tmpl_da);
+			break;
+		}
+	}
+
 	/*
 	 *	Only attributes can have a paircompare registered, and
 	 *	they can only be with the current REQUEST, and only
@@ -3479,12 +3623,12 @@ static bool pass2_callback(void *ctx, fr_cond_t *c)
 	 */
 	if ((map->lhs->type != TMPL_TYPE_ATTR) ||
 	    (map->lhs->tmpl_request != REQUEST_CURRENT) ||
-	    (map->lhs->tmpl_list != PAIR_LIST_REQUEST)) {
+	    (map->lhs->tmpl_list != PAIR_LIST_REQUEST) ||
+	    !radius_find_compare(map->lhs->tmpl_da)) {
+		c->fast_cmp = pass2_cond_fast_cmp(c);
 		return true;
 	}
 
-	if (!radius_find_compare(map->lhs->tmpl_da)) return true;
-
 	if (map->rhs->type == TMPL_TYPE_REGEX) {
 		cf_log_err(map->ci, "Cannot compare virtual attribute %s via a regex",
 			   map->lhs->name);
@@ -3509,6 +3653,27 @@ static bool pass2_callback(void *ctx, fr_cond_t *c)
 	 */
 	c->pass2_fixup = PASS2_PAIRCOMPARE;
 
+	/*
+	 *	The RHS is fixed, so build the check pair now,
+	 *	instead of allocating a new one for every request.
+	 */
+	if ((map->rhs->type == TMPL_TYPE_DATA) &&
+	    (map->rhs->tmpl_data_type == map->lhs->tmpl_da->type)) {
+		c->check = fr_pair_afrom_da(c, map->lhs->tmpl_da);
+		if (!c->check) {
+			cf_log_err(map->ci, "Out of memory");
+			return false;
+		}
+		c->check->op = map->op;
+
+		if (value_data_copy(c->check, &c->check->data, map->rhs->tmpl_data_type,
+				    &map->rhs->tmpl_data_value, map->rhs->tmpl_data_length) < 0) {
+			cf_log_err(map->ci, "Failed copying value: %s", fr_strerror());
+			return false;
+		}
+		c->check->vp_length = map->rhs->tmpl_data_length;
+	}
+
 	return true;
 }
 
@@ -3551,6 +3716,113 @@ static bool modcall_pass2_update(modgroup *g)
 }
 #endif
 
+#ifdef WITH_UNLANG
+static uint32_t case_hash(void const *data)
+{
+	modcall_case_t const *a = data;
+
+	switch (a->type) {
+	case PW_TYPE_STRING:
+	case PW_TYPE_OCTETS:
+		return fr_hash(a->data->ptr, a->len);
+
+	default:
+		return fr_hash(a->data, dict_attr_sizes[a->type][0]);
+	}
+}
+
+static int case_cmp(void const *one, void const *two)
+{
+	modcall_case_t const *a = one;
+	modcall_case_t const *b = two;
+
+	return value_data_cmp(a->type, a->data, a->len, b->type, b->data, b->len);
+}
+
+static int _switch_cases_free(modgroup *g)
+{
+	fr_hash_table_free(g->cases);
+	return 0;
+}
+
+/*
+ *	If we're switching over an attribute, and all of the 'case'
+ *	statements are static data, put them into a hash table.  The
+ *	interpreter then finds the matching 'case' with one lookup,
+ *	instead of evaluating each one in turn.
+ *
+ *	Anything else is left to the interpreter.
+ */
+static bool pass2_switch_hash(modgroup *g)
+{
+	modcallable *this;
+	modgroup *h;
+	modcall_case_t *entry;
+	DICT_ATTR const *da;
+	int num = 0;
+
+	if (g->vpt->type != TMPL_TYPE_ATTR) return true;
+	if ((g->vpt->tmpl_num == NUM_ALL) || (g->vpt->tmpl_num == NUM_COUNT)) return true;
+
+	da = g->vpt->tmpl_da;
+	switch (da->type) {
+	case PW_TYPE_STRING:
+	case PW_TYPE_OCTETS:
+	case PW_TYPE_BYTE:
+	case PW_TYPE_SHORT:
+	case PW_TYPE_INTEGER:
+	case PW_TYPE_INTEGER64:
+	case PW_TYPE_SIGNED:
+	case PW_TYPE_DATE:
+	case PW_TYPE_IPV4_ADDR:
+	case PW_TYPE_IPV6_ADDR:
+	case PW_TYPE_ETHERNET:
+		break;
+
+	default:
+		return true;
+	}
+
+	for (this = g->children; this; this = this->next) {
+		h = mod_callabletogroup(this);
+		if (!h->vpt) continue;
+
+		if ((h->vpt->type != TMPL_TYPE_DATA) || (h->vpt->tmpl_data_type != da->type)) return true;
+		num++;
+	}
+
+	if (!num) return true;
+
+	g->cases = fr_hash_table_create(case_hash, case_cmp, NULL);
+	if (!g->cases) return false;
+	talloc_set_destructor(g, _switch_cases_free);
+
+	entry = talloc_array(g, modcall_case_t, num);
+	if (!entry) return false;
+
+	for (this = g->children; this; this = this->next) {
+		h = mod_callabletogroup(this);
+		if (!h->vpt) continue;
+
+		entry->type = h->vpt->tmpl_data_type;
+		entry->data = &h->vpt->tmpl_data_value;
+		entry->len = h->vpt->tmpl_data_length;
+		entry->mc = this;
+
+		/*
+		 *	Duplicate values are OK.  As with the
+		 *	interpreter, the first one wins.
+		 */
+		if (!fr_hash_table_finddata(g->cases, entry) &&
+		    !fr_hash_table_insert(g->cases, entry)) return false;
+
+		entry++;
+	}
+
+	return true;
+}
+#endif
+
 /*
  *	Do a second-stage pass on compiling the modules.
  */
@@ -3618,6 +3890,20 @@ bool modcall_pass2(modcallable *mc)
 				}
 			}
 
+			/*
+			 *	Remember where the chain ends, so that
+			 *	the interpreter can jump straight there
+			 *	once one of the conditions is taken.
+			 */
+			for (g->chain_end = c->next;
+			     g->chain_end && ((g->chain_end->type == MOD_ELSIF) || (g->chain_end->type == MOD_ELSE));
+			     g->chain_end = g->chain_end->next) {
+				if (g->chain_end->type == MOD_ELSE) {
+					g->chain_end = g->chain_end->next;
+					break;
+				}
+			}
+
 			if (!modcall_pass2(g->children)) return false;
 			g->done_pass2 = true;
 			break;
@@ -3721,6 +4007,10 @@ bool modcall_pass2(modcallable *mc)
 
 		do_children:
 			if (!modcall_pass2(g->children)) return false;
+			if ((c->type == MOD_SWITCH) && !pass2_switch_hash(g)) {
+				cf_log_err_cs(g->cs, "Failed building index for switch statement");
+				return false;
+			}
 			g->done_pass2 = true;
 			break;
 
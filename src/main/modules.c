@@ -88,6 +88,13 @@ const section_type_value_t section_type_value[MOD_COUNT] = {
 #endif
 };
 
+#ifdef WITH_STATS
+/*
+ *	Time spent running each section, in all virtual servers.
+ */
+fr_stats_latency_t radius_section_stats[MOD_COUNT];
+#endif
+
 #ifndef RTLD_NOW
 #define RTLD_NOW (0)
 #endif
@@ -426,6 +433,10 @@ static void module_instance_free(void *data)
 	}
 #endif
 
+#ifdef WITH_STATS
+	fr_stats_latency_free(&module->stats);
+#endif
+
 	xlat_unregister(module->name, NULL, module->insthandle);
 
 	/*
@@ -477,6 +488,12 @@ static int _module_entry_free(module_entry_t *this)
  */
 int modules_free(void)
 {
+#ifdef WITH_STATS
+	int i;
+
+	for (i = 0; i < MOD_COUNT; i++) fr_stats_latency_free(&radius_section_stats[i]);
+#endif
+
 	rbtree_free(instance_tree);
 	rbtree_free(module_tree);
 
@@ -709,6 +726,19 @@ module_instance_t *module_find(CONF_SECTION *modules, char const *askedname)
 }
 
 
+/** Call a function for every module instance, in order of name
+ *
+ * @param callback to call.  Walking stops if it returns non-zero.
+ * @param ctx to pass to the callback, along with the module_instance_t.
+ * @return the return code of the last callback.
+ */
+int module_instance_walk(rb_walker_t callback, void *ctx)
+{
+	if (!instance_tree) return 0;
+
+	return rbtree_walk(instance_tree, RBTREE_IN_ORDER, callback, ctx);
+}
+
 /** Load a module, and instantiate it.
  *
  */
@@ -977,6 +1007,9 @@ rlm_rcode_t indexed_modcall(rlm_components_t comp, int idx, REQUEST *request)
 	rlm_rcode_t rcode;
 	modcallable *list = NULL;
 	virtual_server_t *server;
+#ifdef WITH_STATS
+	struct timeval start, end;
+#endif
 
 	/*
 	 *	Hack to find the correct virtual server.
@@ -1019,7 +1052,16 @@ rlm_rcode_t indexed_modcall(rlm_components_t comp, int idx, REQUEST *request)
 		}
 	}
 	request->component = section_type_value[comp].section;
+#ifdef WITH_STATS
+	gettimeofday(&start, NULL);
+#endif
+
 	rcode = modcall(comp, list, request);
+
+#ifdef WITH_STATS
+	gettimeofday(&end, NULL);
+	fr_stats_latency_add(&radius_section_stats[comp], &start, &end);
+#endif
 	request->component = "<core>";
 
 	return rcode;
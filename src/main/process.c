@@ -579,6 +579,115 @@ static void request_timer(void *ctx)
 	request->process(request, action);
 }
 
+/*
+ *	Cache of the talloc pools which hold a REQUEST, its packets,
+ *	and everything else allocated for it.  When a request is
+ *	freed, the pool is emptied and kept for the next one, instead
+ *	of being returned to malloc.
+ *
+ *	Pools are allocated by the thread reading the socket, and
+ *	freed by whichever thread finishes the request, so there's
+ *	one cache shared by all threads.
+ */
+#define REQUEST_POOL_RECLAIM_INTERVAL	(10)
+
+static TALLOC_CTX	**pool_cache = NULL;
+static uint32_t		pool_cache_num = 0;		//!< Number of pools in the cache.
+static uint32_t		pool_cache_low_water = 0;	//!< Fewest pools in the cache since the last reclaim.
+static time_t		pool_cache_reclaim = 0;		//!< When we last freed idle pools.
+
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t	pool_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/** Get a talloc pool to hold a new request
+ *
+ * @param name to give the pool.
+ * @return an empty pool, or NULL on error.
+ */
+TALLOC_CTX *request_pool_alloc(char const *name)
+{
+	TALLOC_CTX *ctx = NULL;
+
+	PTHREAD_MUTEX_LOCK(&pool_cache_mutex);
+	if (pool_cache_num > 0) {
+		ctx = pool_cache[--pool_cache_num];
+		if (pool_cache_num < pool_cache_low_water) pool_cache_low_water = pool_cache_num;
+	}
+	PTHREAD_MUTEX_UNLOCK(&pool_cache_mutex);
+
+	if (!ctx) {
+		ctx = talloc_pool(NULL, main_config.talloc_pool_size);
+		if (!ctx) return NULL;
+	}
+	talloc_set_name_const(ctx, name);
+
+	return ctx;
+}
+
+/** Free a talloc pool allocated by request_pool_alloc()
+ *
+ * The pool is emptied, and put back into the cache if there's space.
+ *
+ * Pools which haven't been needed for REQUEST_POOL_RECLAIM_INTERVAL
+ * are freed, so that the cache shrinks again after a burst of
+ * traffic.
+ *
+ * @param ctx to free.
+ */
+void request_pool_free(TALLOC_CTX *ctx)
+{
+	time_t now;
+
+	if (!ctx) return;
+
+	if (!main_config.talloc_pool_cache) {
+		talloc_free(ctx);
+		return;
+	}
+
+	talloc_free_children(ctx);
+
+	now = time(NULL);
+
+	PTHREAD_MUTEX_LOCK(&pool_cache_mutex);
+	if (!pool_cache) {
+		pool_cache = talloc_array(NULL, TALLOC_CTX *, main_config.talloc_pool_cache);
+		if (!pool_cache) {
+			PTHREAD_MUTEX_UNLOCK(&pool_cache_mutex);
+			talloc_free(ctx);
+			return;
+		}
+		pool_cache_reclaim = now;
+	}
+
+	if ((now - pool_cache_reclaim) >= REQUEST_POOL_RECLAIM_INTERVAL) {
+		while ((pool_cache_low_water > 0) && (pool_cache_num > 0)) {
+			talloc_free(pool_cache[--pool_cache_num]);
+			pool_cache_low_water--;
+		}
+		pool_cache_low_water = pool_cache_num;
+		pool_cache_reclaim = now;
+	}
+
+	if (pool_cache_num < main_config.talloc_pool_cache) {
+		pool_cache[pool_cache_num++] = ctx;
+		ctx = NULL;
+	}
+	PTHREAD_MUTEX_UNLOCK(&pool_cache_mutex);
+
+	if (ctx) talloc_free(ctx);
+}
+
+static void request_pool_cache_free(void)
+{
+	while (pool_cache_num > 0) {
+		talloc_free(pool_cache[--pool_cache_num]);
+	}
+	TALLOC_FREE(pool_cache);
+	pool_cache_low_water = 0;
+}
+
 /*
  *	Wrapper for talloc pools.  If there's no parent, just free the
  *	request.  If there is a parent, free the parent INSTEAD of the
@@ -599,7 +708,7 @@ static void request_free(REQUEST *request)
 
 	ptr = talloc_parent(request);
 	rad_assert(ptr != NULL);
-	talloc_free(ptr);
+	request_pool_free(ptr);
 }
 
 
@@ -1823,9 +1932,8 @@ skip_dup:
 	 *	Allocate a pool for the request.
 	 */
 	if (!ctx) {
-		ctx = talloc_pool(NULL, main_config.talloc_pool_size);
+		ctx = request_pool_alloc("request_receive_pool");
 		if (!ctx) return 0;
-		talloc_set_name_const(ctx, "request_receive_pool");
 
 		/*
 		 *	The packet is still allocated from a different
@@ -1836,7 +1944,7 @@ skip_dup:
 
 	request = request_setup(ctx, listener, packet, client, fun);
 	if (!request) {
-		talloc_free(ctx);
+		request_pool_free(ctx);
 		return 1;
 	}
 
@@ -2009,6 +2117,7 @@ static void tcp_socket_timer(void *ctx)
 	struct timeval end, now;
 	char buffer[256];
 	fr_socket_limit_t *limit;
+	bool keep_warm = false;
 
 	ASSERT_MASTER;
 
@@ -2020,6 +2129,7 @@ static void tcp_socket_timer(void *ctx)
 #ifdef WITH_PROXY
 	case RAD_LISTEN_PROXY:
 		limit = &sock->home->limit;
+		keep_warm = (limit->num_connections <= limit->min_connections);
 		break;
 #endif
 
@@ -2087,6 +2197,13 @@ static void tcp_socket_timer(void *ctx)
 		idle.tv_sec = sock->last_packet + limit->idle_timeout;
 		idle.tv_usec = 0;
 
+		/*
+		 *	Don't close idle connections which keep the
+		 *	home server at "min_connections".  Check
+		 *	again later, in case there are more by then.
+		 */
+		if (keep_warm && (idle.tv_sec <= now.tv_sec)) idle.tv_sec = now.tv_sec + limit->idle_timeout;
+
 		if (timercmp(&idle, &now, <=)) {
 			listener->print(listener, buffer, sizeof(buffer));
 			DEBUG("Reached idle timeout on socket %s", buffer);
@@ -2263,6 +2380,88 @@ static void remove_from_proxy_hash(REQUEST *request)
 	PTHREAD_MUTEX_UNLOCK(&proxy_mutex);
 }
 
+#ifdef WITH_TCP
+/*
+ *	Whether another connection should be opened to the home
+ *	server.  Connections are opened until there are
+ *	"min_connections" of them, and after that only when the least
+ *	loaded connection is running out of Ids.
+ *
+ *	Called with the proxy mutex held.
+ */
+static bool proxy_connection_wanted(home_server_t *home, rad_listen_t *least_loaded)
+{
+	if (home->proto != IPPROTO_TCP) return false;
+
+#ifdef HAVE_PTHREAD_H
+	if (proxy_no_new_sockets) return false;
+#endif
+
+	if ((home->limit.max_connections > 0) &&
+	    (home->limit.num_connections >= home->limit.max_connections)) return false;
+
+	if (home->limit.num_connections < home->limit.min_connections) return true;
+
+	if (!least_loaded || !home->limit.spare_ids) return false;
+
+	return ((least_loaded->count + home->limit.spare_ids) >= 256);
+}
+#endif
+
+/*
+ *	Open a new connection to the home server, and add it to the
+ *	proxy list.  Called with the proxy mutex held, which is
+ *	released while the new socket is added to the event loop.
+ *
+ *	The home server is marked as failed only if the request
+ *	"needs" the connection.  Failing to open a spare connection
+ *	doesn't stop the existing ones from being used.
+ */
+static rad_listen_t *proxy_connection_open(REQUEST *request, bool needed)
+{
+	rad_listen_t *this;
+	listen_socket_t *sock;
+
+	RDEBUG3("proxy: Trying to open a new listener to the home server");
+	this = proxy_new_listener(proxy_ctx, request->home_server, 0);
+	if (!this) {
+		if (needed) request->home_server->state = HOME_STATE_CONNECTION_FAIL;
+		return NULL;
+	}
+
+	sock = this->data;
+	if (!fr_packet_list_socket_add(proxy_list, this->fd,
+				       sock->proto,
+				       &sock->other_ipaddr, sock->other_port,
+				       this)) {
+
+#ifdef HAVE_PTHREAD_H
+		proxy_no_new_sockets = true;
+#endif
+
+		/*
+		 *	This is bad.  However, the
+		 *	packet list now supports 256
+		 *	open sockets, which should
+		 *	minimize this problem.
+		 */
+		ERROR("Failed adding proxy socket: %s",
+		      fr_strerror());
+		listen_free(&this);
+		return NULL;
+	}
+
+	/*
+	 *	Add it to the event loop.  Ensure that we have
+	 *	only one mutex locked at a time.
+	 */
+	PTHREAD_MUTEX_UNLOCK(&proxy_mutex);
+	radius_update_listener(this);
+	PTHREAD_MUTEX_LOCK(&proxy_mutex);
+
+	return this;
+}
+
 static int insert_into_proxy_hash(REQUEST *request)
 {
 	char buf[128];
@@ -2282,10 +2481,16 @@ static int insert_into_proxy_hash(REQUEST *request)
 	request->num_proxied_requests = 1;
 	request->num_proxied_responses = 0;
 
-	for (tries = 0; tries < 2; tries++) {
-		rad_listen_t *this;
-		listen_socket_t *sock;
+#ifdef WITH_TCP
+	/*
+	 *	Warm up the pool of connections to the home server.
+	 */
+	if (proxy_connection_wanted(request->home_server, NULL)) {
+		(void) proxy_connection_open(request, false);
+	}
+#endif
 
+	for (tries = 0; tries < 2; tries++) {
 		RDEBUG3("proxy: Trying to allocate ID (%d/2)", tries);
 		success = fr_packet_list_id_alloc(proxy_list,
 						request->home_server->proto,
@@ -2298,46 +2503,13 @@ static int insert_into_proxy_hash(REQUEST *request)
 		if (proxy_no_new_sockets) break;
 #endif
 
-		RDEBUG3("proxy: Trying to open a new listener to the home server");
-		this = proxy_new_listener(proxy_ctx, request->home_server, 0);
-		if (!this) {
-			request->home_server->state = HOME_STATE_CONNECTION_FAIL;
+		proxy_listener = proxy_connection_open(request, true);
+		if (!proxy_listener) {
 			PTHREAD_MUTEX_UNLOCK(&proxy_mutex);
 			goto fail;
 		}
 
 		request->proxy->src_port = 0; /* Use any new socket */
-		proxy_listener = this;
-
-		sock = this->data;
-		if (!fr_packet_list_socket_add(proxy_list, this->fd,
-					       sock->proto,
-					       &sock->other_ipaddr, sock->other_port,
-					       this)) {
-
-#ifdef HAVE_PTHREAD_H
-			proxy_no_new_sockets = true;
-#endif
-			PTHREAD_MUTEX_UNLOCK(&proxy_mutex);
-
-			/*
-			 *	This is bad.  However, the
-			 *	packet list now supports 256
-			 *	open sockets, which should
-			 *	minimize this problem.
-			 */
-			ERROR("Failed adding proxy socket: %s",
-			      fr_strerror());
-			goto fail;
-		}
-
-		/*
-		 *	Add it to the event loop.  Ensure that we have
-		 *	only one mutex locked at a time.
-		 */
-		PTHREAD_MUTEX_UNLOCK(&proxy_mutex);
-		radius_update_listener(this);
-		PTHREAD_MUTEX_LOCK(&proxy_mutex);
 	}
 
 	if (!proxy_listener || !success) {
@@ -2364,6 +2536,17 @@ static int insert_into_proxy_hash(REQUEST *request)
 
 #ifdef WITH_TCP
 	request->proxy_listener->count++;
+
+	/*
+	 *	The Id was allocated from the least loaded connection.
+	 *	If even that one is running low on Ids, open another
+	 *	connection now, rather than when they have all run out.
+	 */
+	if (proxy_connection_wanted(request->home_server, request->proxy_listener)) {
+		RDEBUG3("proxy: Connection has %d outstanding requests, opening another",
+			request->proxy_listener->count);
+		(void) proxy_connection_open(request, false);
+	}
 #endif
 
 	PTHREAD_MUTEX_UNLOCK(&proxy_mutex);
@@ -5942,6 +6125,8 @@ void radius_event_free(void)
 
 	TALLOC_FREE(el);
 
+	request_pool_cache_free();
+
 	if (debug_condition) talloc_free(debug_condition);
 }
 
@@ -35,6 +35,7 @@ RCSID("$Id$")
 #endif
 
 #include <assert.h>
+#include <math.h>
 
 typedef struct REQUEST REQUEST;	/* to shut up warnings about mschap.h */
 
@@ -73,6 +74,12 @@ static int sleep_time = -1;
 static rc_request_t *request_head = NULL;
 static rc_request_t *rc_request_tail = NULL;
 
+static uint32_t load_rate = 0;			//!< Packets per second to send in load mode.
+static bool load_poisson = false;		//!< Send packets with exponential inter-arrival times.
+static uint32_t load_duration = 10;		//!< How long to send packets for.
+static uint32_t load_interval = 1;		//!< How often to print statistics.
+static uint32_t load_sockets = 1;		//!< How many source sockets to use.
+
 static char const *radclient_version = "radclient version " RADIUSD_VERSION_STRING
 #ifdef RADIUSD_VERSION_COMMIT
 " (git #" STRINGIFY(RADIUSD_VERSION_COMMIT) ")"
@@ -92,10 +99,14 @@ static void NEVER_RETURNS usage(void)
 	fprintf(stderr, "  -c <count>             Send each packet 'count' times.\n");
 	fprintf(stderr, "  -d <raddb>             Set user dictionary directory (defaults to " RADDBDIR ").\n");
 	fprintf(stderr, "  -D <dictdir>           Set main dictionary directory (defaults to " DICTDIR ").\n");
+	fprintf(stderr, "  -E                     In load mode, send packets with Poisson (not evenly spaced) arrivals.\n");
 	fprintf(stderr, "  -f <file>[:<file>]     Read packets from file, not stdin.\n");
 	fprintf(stderr, "                         If a second file is provided, it will be used to verify responses\n");
 	fprintf(stderr, "  -F                     Print the file name, packet number and reply code.\n");
 	fprintf(stderr, "  -h                     Print usage help information.\n");
+	fprintf(stderr, "  -I <seconds>           In load mode, print statistics every 'seconds' (default 1).\n");
+	fprintf(stderr, "  -L <num>               Load mode.  Send 'num' packets/s, without waiting for replies.\n");
+	fprintf(stderr, "  -N <num>               In load mode, send from at least 'num' source sockets.\n");
 	fprintf(stderr, "  -n <num>               Send N requests/s\n");
 	fprintf(stderr, "  -p <num>               Send 'num' packets from a file in parallel.\n");
 	fprintf(stderr, "  -q                     Do not print anything out.\n");
@@ -103,6 +114,7 @@ static void NEVER_RETURNS usage(void)
 	fprintf(stderr, "  -s                     Print out summary information of auth results.\n");
 	fprintf(stderr, "  -S <file>              read secret from file, not command line.\n");
 	fprintf(stderr, "  -t <timeout>           Wait 'timeout' seconds before retrying (may be a floating point number).\n");
+	fprintf(stderr, "  -T <seconds>           In load mode, send packets for 'seconds' (default 10).\n");
 	fprintf(stderr, "  -v                     Show program version information.\n");
 	fprintf(stderr, "  -x                     Debugging mode.\n");
 
@@ -820,6 +832,71 @@ static void deallocate_id(rc_request_t *request)
 	if (request->reply) rad_free(&request->reply);
 }
 
+/*
+ *	Open another socket, and add it to the packet list.
+ */
+static int radclient_socket_add(fr_ipaddr_t *dst_ipaddr, uint16_t dst_port)
+{
+	int mysockfd;
+
+#ifdef WITH_TCP
+	if (proto) {
+		mysockfd = fr_socket_client_tcp(NULL, dst_ipaddr, dst_port, false);
+		if (mysockfd < 0) {
+			ERROR("Failed opening socket");
+			exit(1);
+		}
+	} else
+#endif
+	{
+		mysockfd = fr_socket(&client_ipaddr, 0);
+		if (mysockfd < 0) {
+			ERROR("Failed opening socket");
+			exit(1);
+		}
+
+#ifdef WITH_UDPFROMTO
+		if (udpfromto_init(mysockfd) < 0) {
+			ERROR("Failed initializing socket");
+			exit(1);
+		}
+#endif
+	}
+	if (!fr_packet_list_socket_add(pl, mysockfd, ipproto, dst_ipaddr, dst_port, NULL)) {
+		ERROR("Can't add new socket");
+		exit(1);
+	}
+
+	return mysockfd;
+}
+
+/*
+ *	Copy the cleartext password into the password attribute,
+ *	so that it's encrypted with the current authentication vector.
+ */
+static void radclient_password_update(rc_request_t *request)
+{
+	VALUE_PAIR *vp;
+
+	if (!request->password) return;
+
+	if ((vp = fr_pair_find_by_num(request->packet->vps, PW_USER_PASSWORD, 0, TAG_ANY)) != NULL) {
+		fr_pair_value_strcpy(vp, request->password->vp_strvalue);
+
+	} else if ((vp = fr_pair_find_by_num(request->packet->vps, PW_CHAP_PASSWORD, 0, TAG_ANY)) != NULL) {
+		uint8_t buffer[17];
+
+		rad_chap_encode(request->packet, buffer, fr_rand() & 0xff, request->password);
+		fr_pair_value_memcpy(vp, buffer, 17);
+
+	} else if (fr_pair_find_by_num(request->packet->vps, PW_MS_CHAP_PASSWORD, 0, TAG_ANY) != NULL) {
+		mschapv1_encode(request->packet, &request->packet->vps, request->password->vp_strvalue);
+
+	} else {
+		DEBUG("WARNING: No password in the request");
+	}
+}
+
 /*
  *	Send one packet.
  */
@@ -851,39 +928,7 @@ static int send_one_packet(rc_request_t *request)
 		request->packet->src_ipaddr.af = server_ipaddr.af;
 		rcode = fr_packet_list_id_alloc(pl, ipproto, &request->packet, NULL);
 		if (!rcode) {
-			int mysockfd;
-
-#ifdef WITH_TCP
-			if (proto) {
-				mysockfd = fr_socket_client_tcp(NULL,
-								&request->packet->dst_ipaddr,
-								request->packet->dst_port, false);
-				if (mysockfd < 0) {
-					ERROR("Failed opening socket");
-					exit(1);
-				}
-			} else
-#endif
-			{
-				mysockfd = fr_socket(&client_ipaddr, 0);
-				if (mysockfd < 0) {
-					ERROR("Failed opening socket");
-					exit(1);
-				}
-
-#ifdef WITH_UDPFROMTO
-				if (udpfromto_init(mysockfd) < 0) {
-					ERROR("Failed initializing socket");
-					exit(1);
-				}
-#endif
-			}
-			if (!fr_packet_list_socket_add(pl, mysockfd, ipproto,
-						       &request->packet->dst_ipaddr,
-						       request->packet->dst_port, NULL)) {
-				ERROR("Can't add new socket");
-				exit(1);
-			}
+			radclient_socket_add(&request->packet->dst_ipaddr, request->packet->dst_port);
 			goto retry;
 		}
 
@@ -898,25 +943,7 @@ static int send_one_packet(rc_request_t *request)
 		 *	Update the password, so it can be encrypted with the
 		 *	new authentication vector.
 		 */
-		if (request->password) {
-			VALUE_PAIR *vp;
-
-			if ((vp = fr_pair_find_by_num(request->packet->vps, PW_USER_PASSWORD, 0, TAG_ANY)) != NULL) {
-				fr_pair_value_strcpy(vp, request->password->vp_strvalue);
-
-			} else if ((vp = fr_pair_find_by_num(request->packet->vps, PW_CHAP_PASSWORD, 0, TAG_ANY)) != NULL) {
-				uint8_t buffer[17];
-
-				rad_chap_encode(request->packet, buffer, fr_rand() & 0xff, request->password);
-				fr_pair_value_memcpy(vp, buffer, 17);
-
-			} else if (fr_pair_find_by_num(request->packet->vps, PW_MS_CHAP_PASSWORD, 0, TAG_ANY) != NULL) {
-				mschapv1_encode(request->packet, &request->packet->vps, request->password->vp_strvalue);
-
-			} else {
-				DEBUG("WARNING: No password in the request");
-			}
-		}
+		radclient_password_update(request);
 
 		request->timestamp = time(NULL);
 		request->tries = 1;
@@ -1146,6 +1173,545 @@ packet_done:
 	return 0;
 }
 
+/*
+ *	Load mode.
+ *
+ *	Packets are sent at a fixed rate, whether or not the server
+ *	has replied to the previous ones.  Each packet is a copy of
+ *	one of the requests read from the input files, which are used
+ *	in turn.  Requests aren't retried.  If there's no reply
+ *	within the timeout, the request is counted as lost.
+ */
+#define LOAD_MAX_BURST	(64)
+
+static uint64_t load_now(void)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+
+	return ((uint64_t) now.tv_sec * 1000000) + now.tv_usec;
+}
+
+static unsigned int hist_index(uint32_t value)
+{
+	unsigned int msb, shift;
+
+	if (value < RC_HIST_SUB) return value;
+
+	for (msb = RC_HIST_SUB_BITS; (msb < 31) && (value >> (msb + 1)); msb++);
+
+	shift = msb - RC_HIST_SUB_BITS;
+
+	return ((shift + 1) * RC_HIST_SUB) + ((value >> shift) - RC_HIST_SUB);
+}
+
+/*
+ *	The largest value which falls into a bucket.
+ */
+static uint32_t hist_value(unsigned int idx)
+{
+	unsigned int shift;
+
+	if (idx < RC_HIST_SUB) return idx;
+
+	shift = (idx / RC_HIST_SUB) - 1;
+
+	return (uint32_t) ((((uint64_t) RC_HIST_SUB + (idx % RC_HIST_SUB) + 1) << shift) - 1);
+}
+
+static void hist_add(rc_histogram_t *hist, uint64_t value)
+{
+	if (value > UINT32_MAX) value = UINT32_MAX;
+
+	hist->bucket[hist_index(value)]++;
+	hist->count++;
+	if (value > hist->max) hist->max = value;
+}
+
+static void hist_merge(rc_histogram_t *out, rc_histogram_t const *in)
+{
+	unsigned int i;
+
+	for (i = 0; i < RC_HIST_BUCKETS; i++) out->bucket[i] += in->bucket[i];
+	out->count += in->count;
+	if (in->max > out->max) out->max = in->max;
+}
+
+/*
+ *	Return the value below which 'percent' of the values fall.
+ */
+static uint32_t hist_percentile(rc_histogram_t const *hist, double percent)
+{
+	uint64_t target, seen = 0;
+	unsigned int i;
+
+	if (!hist->count) return 0;
+
+	target = (uint64_t) ((hist->count * percent) / 100.0);
+	if (target < 1) target = 1;
+
+	for (i = 0; i < RC_HIST_BUCKETS; i++) {
+		seen += hist->bucket[i];
+		if (seen >= target) {
+			uint32_t value = hist_value(i);
+
+			return (value > hist->max) ? hist->max : value;
+		}
+	}
+
+	return hist->max;
+}
+
+static void load_stats_merge(rc_load_stats_t *out, rc_load_stats_t const *in)
+{
+	out->sent += in->sent;
+	out->received += in->received;
+	out->accepted += in->accepted;
+	out->rejected += in->rejected;
+	out->lost += in->lost;
+	out->errors += in->errors;
+	hist_merge(&out->latency, &in->latency);
+}
+
+/*
+ *	Wrap a value to the range min..max.  The full 64 bit range has
+ *	one more value than fits in a uint64_t, but then there's
+ *	nothing to wrap.
+ */
+static uint64_t load_range(uint64_t value, uint64_t min, uint64_t max)
+{
+	uint64_t span = max - min + 1;
+
+	if (!span) return value;
+
+	return min + (value % span);
+}
+
+/*
+ *	Expand the substitutions in a string from a request template.
+ *
+ *	%{seq}		- The number of the packet being sent, starting at 0.
+ *	%{seq:a-b}	- The packet number, wrapped to the range a..b.
+ *	%{rand:a-b}	- A random number between a and b.
+ *	%{randmac}	- A random MAC address.
+ *	%%		- A literal '%'.
+ */
+static int load_expand(char *out, size_t outlen, char const *in, uint64_t seq)
+{
+	char const *p = in;
+	char *q = out, *end = out + outlen - 1;
+
+	while (*p && (q < end)) {
+		char const *close;
+		char name[16];
+		size_t len;
+		uint64_t min = 0, max = 0;
+		bool range = false;
+
+		if (*p != '%') {
+			*q++ = *p++;
+			continue;
+		}
+
+		if (p[1] == '%') {
+			*q++ = '%';
+			p += 2;
+			continue;
+		}
+
+		if ((p[1] != '{') || !(close = strchr(p + 2, '}'))) {
+			*q++ = *p++;
+			continue;
+		}
+
+		len = strcspn(p + 2, ":}");
+		if (len >= sizeof(name)) {
+			fr_strerror_printf("Unknown substitution in \"%s\"", in);
+			return -1;
+		}
+		strlcpy(name, p + 2, len + 1);
+
+		if (p[2 + len] == ':') {
+			char *dash, *stop;
+
+			/*
+			 *	strtoull() accepts leading spaces and
+			 *	signs, so check for the digits ourselves.
+			 */
+			if (!isdigit((int) p[3 + len])) {
+			invalid:
+				fr_strerror_printf("Invalid range in \"%s\"", in);
+				return -1;
+			}
+
+			min = strtoull(p + 3 + len, &dash, 10);
+			if ((*dash != '-') || (dash > close) || !isdigit((int) dash[1])) goto invalid;
+
+			max = strtoull(dash + 1, &stop, 10);
+			if ((stop != close) || (max < min)) goto invalid;
+
+			range = true;
+		}
+
+		if (strcmp(name, "seq") == 0) {
+			uint64_t value = seq;
+
+			if (range) value = load_range(seq, min, max);
+			q += snprintf(q, end - q + 1, "%" PRIu64, value);
+
+		} else if (strcmp(name, "rand") == 0) {
+			uint64_t value;
+
+			if (!range) {
+				fr_strerror_printf("%%{rand} needs a range in \"%s\"", in);
+				return -1;
+			}
+			value = ((uint64_t) fr_rand() << 32) | fr_rand();
+			q += snprintf(q, end - q + 1, "%" PRIu64, load_range(value, min, max));
+
+		} else if (strcmp(name, "randmac") == 0) {
+			uint32_t hi = fr_rand(), lo = fr_rand();
+
+			/*
+			 *	Locally administered, unicast.
+			 */
+			q += snprintf(q, end - q + 1, "%02x:%02x:%02x:%02x:%02x:%02x",
+				      ((hi >> 8) & 0xfc) | 0x02, hi & 0xff,
+				      (lo >> 24) & 0xff, (lo >> 16) & 0xff, (lo >> 8) & 0xff, lo & 0xff);
+
+		} else {
+			fr_strerror_printf("Unknown substitution %%{%s} in \"%s\"", name, in);
+			return -1;
+		}
+		if (q > end) q = end;
+
+		p = close + 1;
+	}
+	*q = '\0';
+
+	return 0;
+}
+
+/*
+ *	Create a request from a template, and send it.
+ */
+static rc_request_t *load_send(TALLOC_CTX *ctx, rc_request_t *template, uint64_t seq)
+{
+	rc_request_t *request;
+	VALUE_PAIR *vp;
+	vp_cursor_t cursor;
+	int i;
+
+	request = talloc_zero(ctx, rc_request_t);
+	if (!request) return NULL;
+
+	request->num = seq;
+	request->files = template->files;
+	request->name = template->name;
+
+	request->packet = rad_alloc(request, false);
+	if (!request->packet) goto error;
+
+	request->packet->code = template->packet->code;
+	request->packet->src_ipaddr = template->packet->src_ipaddr;
+	request->packet->src_port = template->packet->src_port;
+	request->packet->dst_ipaddr = template->packet->dst_ipaddr;
+	request->packet->dst_port = template->packet->dst_port;
+#ifdef WITH_TCP
+	request->packet->proto = template->packet->proto;
+#endif
+	request->packet->sockfd = -1;
+	request->packet->id = -1;
+	request->packet->vps = fr_pair_list_copy(request->packet, template->packet->vps);
+
+	for (vp = fr_cursor_init(&cursor, &request->packet->vps);
+	     vp;
+	     vp = fr_cursor_next(&cursor)) {
+		char buffer[1024];
+
+		if ((vp->da->type != PW_TYPE_STRING) || !strchr(vp->vp_strvalue, '%')) continue;
+
+		if (load_expand(buffer, sizeof(buffer), vp->vp_strvalue, seq) < 0) {
+			REDEBUG("%s", fr_strerror());
+			goto error;
+		}
+		fr_pair_value_strcpy(vp, buffer);
+	}
+
+	if (template->password) {
+		request->password = fr_pair_find_by_num(request->packet->vps, PW_CLEARTEXT_PASSWORD, 0, TAG_ANY);
+	}
+
+	while (!fr_packet_list_id_alloc(pl, ipproto, &request->packet, NULL)) {
+		fr_nonblock(radclient_socket_add(&request->packet->dst_ipaddr, request->packet->dst_port));
+	}
+
+	for (i = 0; i < 4; i++) {
+		((uint32_t *) request->packet->vector)[i] = fr_rand();
+	}
+
+	radclient_password_update(request);
+
+	request->sent_at = load_now();
+	if (rad_send(request->packet, NULL, secret) < 0) {
+		REDEBUG("Failed to send packet for ID %d", request->packet->id);
+		fr_packet_list_id_free(pl, request->packet, true);
+		goto error;
+	}
+
+	return request;
+
+error:
+	talloc_free(request);
+	return NULL;
+}
+
+/*
+ *	Unlink a request from the list of outstanding requests, and free it.
+ */
+static void load_done(rc_request_t **head, rc_request_t **tail, rc_request_t *request)
+{
+	if (request->prev) {
+		request->prev->next = request->next;
+	} else {
+		*head = request->next;
+	}
+
+	if (request->next) {
+		request->next->prev = request->prev;
+	} else {
+		*tail = request->prev;
+	}
+
+	fr_packet_list_id_free(pl, request->packet, true);
+	talloc_free(request);
+}
+
+static void load_recv(rc_load_stats_t *load_stats, rc_request_t **head, rc_request_t **tail, fd_set *set)
+{
+	RADIUS_PACKET *reply, **packet_p;
+	rc_request_t *request;
+	uint64_t now;
+
+	while ((reply = fr_packet_list_recv(pl, set)) != NULL) {
+		now = load_now();
+
+		FD_CLR(reply->sockfd, set);
+
+		packet_p = fr_packet_list_find_byreply(pl, reply);
+		if (!packet_p) {
+			rad_free(&reply);
+			continue;
+		}
+		request = fr_packet2myptr(rc_request_t, packet, packet_p);
+
+		if (rad_verify(reply, request->packet, secret) < 0) {
+			REDEBUG("Reply verification failed");
+			rad_free(&reply);
+			continue;
+		}
+
+		load_stats->received++;
+		hist_add(&load_stats->latency, now - request->sent_at);
+
+		switch (reply->code) {
+		case PW_CODE_ACCESS_ACCEPT:
+		case PW_CODE_ACCOUNTING_RESPONSE:
+		case PW_CODE_COA_ACK:
+		case PW_CODE_DISCONNECT_ACK:
+			load_stats->accepted++;
+			break;
+
+		default:
+			load_stats->rejected++;
+			break;
+		}
+
+		rad_free(&reply);
+		load_done(head, tail, request);
+	}
+}
+
+static void load_report_header(void)
+{
+	printf("%8s %10s %10s %8s %8s %10s %10s %10s %10s\n",
+	       "time", "sent", "recv", "lost", "errors", "recv/s", "p50(us)", "p99(us)", "max(us)");
+}
+
+static void load_report(double elapsed, double period, rc_load_stats_t const *load_stats)
+{
+	printf("%8.1f %10" PRIu64 " %10" PRIu64 " %8" PRIu64 " %8" PRIu64 " %10.1f %10u %10u %10u\n",
+	       elapsed, load_stats->sent, load_stats->received, load_stats->lost, load_stats->errors,
+	       period > 0 ? load_stats->received / period : 0,
+	       hist_percentile(&load_stats->latency, 50), hist_percentile(&load_stats->latency, 99),
+	       load_stats->latency.max);
+	fflush(stdout);
+}
+
+/*
+ *	Generate load for "load_duration" seconds, and print
+ *	statistics every "load_interval" seconds.
+ */
+static int load_run(void)
+{
+	TALLOC_CTX *ctx;
+	rc_request_t *template = request_head, *request;
+	rc_request_t *head = NULL, *tail = NULL;
+	rc_load_stats_t *total, *interval;
+	uint64_t start, now, end, next_send, next_report, last_report, wait;
+	double elapsed;
+	uint64_t timeout_usec = timeout * 1000000;
+	uint64_t seq = 0;
+	double offset = 0;
+	bool sending = true;
+
+	ctx = talloc_pool(NULL, 64 * 1024);
+	total = talloc_zero(ctx, rc_load_stats_t);
+	interval = talloc_zero(ctx, rc_load_stats_t);
+	if (!ctx || !total || !interval) {
+		ERROR("Out of memory");
+		return -1;
+	}
+
+	load_report_header();
+
+	start = load_now();
+	end = start + ((uint64_t) load_duration * 1000000);
+	next_send = start;
+	next_report = last_report = start;
+	next_report += (uint64_t) load_interval * 1000000;
+
+	while (sending || head) {
+		fd_set set;
+		struct timeval tv;
+		int max_fd, burst = 0;
+
+		now = load_now();
+
+		/*
+		 *	Send everything which is due, but don't
+		 *	starve the receive side if we fall behind.
+		 */
+		while (sending && (now >= next_send) && (burst++ < LOAD_MAX_BURST)) {
+			if (next_send >= end) {
+				sending = false;
+				break;
+			}
+
+			request = load_send(ctx, template, seq++);
+			if (!request) {
+				interval->errors++;
+			} else {
+				interval->sent++;
+
+				request->next = NULL;
+				request->prev = tail;
+				if (tail) {
+					tail->next = request;
+				} else {
+					head = request;
+				}
+				tail = request;
+			}
+
+			template = template->next ? template->next : request_head;
+
+			if (load_poisson) {
+				offset += -log(1.0 - (fr_rand() / 4294967296.0)) * 1000000.0 / load_rate;
+			} else {
+				offset += 1000000.0 / load_rate;
+			}
+			next_send = start + (uint64_t) offset;
+		}
+
+		/*
+		 *	Requests are sent in order, so the oldest are
+		 *	at the head of the list.
+		 */
+		now = load_now();
+		while (head && ((head->sent_at + timeout_usec) <= now)) {
+			request = head;
+			RDEBUG("No reply from server for ID %d socket %d",
+			       request->packet->id, request->packet->sockfd);
+			interval->lost++;
+			load_done(&head, &tail, request);
+		}
+
+		if (now >= next_report) {
+			load_report((now - start) / 1000000.0, (now - last_report) / 1000000.0, interval);
+			load_stats_merge(total, interval);
+			memset(interval, 0, sizeof(*interval));
+
+			last_report = now;
+			next_report += (uint64_t) load_interval * 1000000;
+		}
+
+		if (!sending && !head) break;
+
+		/*
+		 *	Sleep until the next packet is due, a request
+		 *	times out, or a report is due.
+		 */
+		wait = next_report;
+		if (sending && (next_send < wait)) wait = next_send;
+		if (head && ((head->sent_at + timeout_usec) < wait)) wait = head->sent_at + timeout_usec;
+		if (burst > LOAD_MAX_BURST) wait = now;
+
+		now = load_now();
+		wait = (wait > now) ? wait - now : 0;
+		tv.tv_sec = wait / 1000000;
+		tv.tv_usec = wait % 1000000;
+
+		FD_ZERO(&set);
+		max_fd = fr_packet_list_fd_set(pl, &set);
+		if (max_fd < 0) {
+			ERROR("No sockets to listen on");
+			return -1;
+		}
+
+		if (select(max_fd, &set, NULL, NULL, &tv) > 0) load_recv(interval, &head, &tail, &set);
+	}
+
+	now = load_now();
+	if (interval->sent || interval->received || interval->lost || interval->errors) {
+		load_report((now - start) / 1000000.0, (now - last_report) / 1000000.0, interval);
+	}
+	load_stats_merge(total, interval);
+
+	/*
+	 *	Sending takes load_duration, but waiting for the last
+	 *	replies takes longer.
+	 */
+	elapsed = (now - start) / 1000000.0;
+
+	printf("Load summary:\n"
+	       "\tOffered rate  : %u/s (%s)\n"
+	       "\tSent          : %" PRIu64 "\n"
+	       "\tReceived      : %" PRIu64 "\n"
+	       "\tAccepted      : %" PRIu64 "\n"
+	       "\tRejected      : %" PRIu64 "\n"
+	       "\tLost          : %" PRIu64 "\n"
+	       "\tErrors        : %" PRIu64 "\n"
+	       "\tElapsed       : %.3fs\n"
+	       "\tAchieved rate : %.1f/s\n"
+	       "\tLatency (us)  : p50 %u, p90 %u, p99 %u, p99.9 %u, max %u\n",
+	       load_rate, load_poisson ? "poisson" : "constant",
+	       total->sent, total->received, total->accepted, total->rejected, total->lost, total->errors,
+	       elapsed, (elapsed > 0) ? total->received / elapsed : 0,
+	       hist_percentile(&total->latency, 50), hist_percentile(&total->latency, 90),
+	       hist_percentile(&total->latency, 99), hist_percentile(&total->latency, 99.9),
+	       total->latency.max);
+
+	stats.accepted = total->accepted;
+	stats.rejected = total->rejected;
+	stats.lost = total->lost + total->errors;
+
+	talloc_free(ctx);
+
+	return 0;
+}
+
 int main(int argc, char **argv)
 {
 	int		c;
@@ -1183,7 +1749,7 @@ int main(int argc, char **argv)
 		exit(1);
 	}
 
-	while ((c = getopt(argc, argv, "46c:d:D:f:Fhn:p:qr:sS:t:vx"
+	while ((c = getopt(argc, argv, "46c:d:D:Ef:FhI:L:n:N:p:qr:sS:t:T:vx"
 #ifdef WITH_TCP
 		"P:"
 #endif
@@ -1210,6 +1776,10 @@ int main(int argc, char **argv)
 			radius_dir = optarg;
 			break;
 
+		case 'E':
+			load_poisson = true;
+			break;
+
 		case 'f':
 		{
 			char const *p;
@@ -1235,6 +1805,24 @@ int main(int argc, char **argv)
 			print_filename = true;
 			break;
 
+		case 'I':
+			if (!isdigit((int) *optarg)) usage();
+			load_interval = atoi(optarg);
+			if (load_interval == 0) usage();
+			break;
+
+		case 'L':
+			if (!isdigit((int) *optarg)) usage();
+			load_rate = atoi(optarg);
+			if (load_rate == 0) usage();
+			break;
+
+		case 'N':
+			if (!isdigit((int) *optarg)) usage();
+			load_sockets = atoi(optarg);
+			if ((load_sockets == 0) || (load_sockets > 256)) usage();
+			break;
+
 		case 'n':
 			persec = atoi(optarg);
 			if (persec <= 0) usage();
@@ -1319,6 +1907,12 @@ int main(int argc, char **argv)
 			timeout = atof(optarg);
 			break;
 
+		case 'T':
+			if (!isdigit((int) *optarg)) usage();
+			load_duration = atoi(optarg);
+			if (load_duration == 0) usage();
+			break;
+
 		case 'v':
 			fr_debug_lvl = 1;
 			DEBUG("%s", radclient_version);
@@ -1482,6 +2076,29 @@ int main(int argc, char **argv)
 		}
 	}
 
+	/*
+	 *	Load mode has its own loop.  Replies may arrive on
+	 *	any of the sockets, so none of them can block.
+	 */
+	if (load_rate) {
+		uint32_t i;
+
+#ifdef WITH_TCP
+		if (proto) {
+			ERROR("Load mode (-L) can only be used with UDP");
+			exit(1);
+		}
+#endif
+		fr_nonblock(sockfd);
+		for (i = 1; i < load_sockets; i++) {
+			fr_nonblock(radclient_socket_add(&server_ipaddr, server_port));
+		}
+
+		if (load_run() < 0) exit(1);
+
+		goto finish;
+	}
+
 	/*
 	 *	Walk over the packets to send, until
 	 *	we're all done.
@@ -1614,6 +2231,7 @@ int main(int argc, char **argv)
 		}
 	} while (!done);
 
+finish:
 	rbtree_free(filename_tree);
 	fr_packet_list_free(pl);
 	while (request_head) TALLOC_FREE(request_head);
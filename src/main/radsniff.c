@@ -45,13 +45,28 @@ RCSID("$Id$")
 
 static rs_t *conf;
 static struct timeval start_pcap = {0, 0};
+#ifdef __THREAD
+static __THREAD char timestr[50];
+#else
 static char timestr[50];
+#endif
 
-static rbtree_t *request_tree = NULL;
-static rbtree_t *link_tree = NULL;
+static rs_worker_t **workers;			//!< Per-shard decode and matching state.
 static fr_event_list_t *events;
 static bool cleanup;
 
+#ifdef WITH_THREADS
+static int workers_running;			//!< Number of worker threads started.
+static struct timeval last_pcap;		//!< Timestamp of the last packet given to a worker.
+static pthread_mutex_t output_mutex = PTHREAD_MUTEX_INITIALIZER;	//!< Serialises packet logging
+									//!< and writes to the output pcap.
+#  define OUTPUT_LOCK		if (conf->workers) pthread_mutex_lock(&output_mutex)
+#  define OUTPUT_UNLOCK		if (conf->workers) pthread_mutex_unlock(&output_mutex)
+#else
+#  define OUTPUT_LOCK
+#  define OUTPUT_UNLOCK
+#endif
+
 static int self_pipe[2] = {-1, -1};		//!< Signals from sig handlers
 
 typedef int (*rbcmp)(void const *, void const *);
@@ -197,6 +212,7 @@ static void rs_time_print(char *out, size_t len, struct timeval const *t)
 {
 	size_t ret;
 	struct timeval now;
+	struct tm tm;
 	uint32_t usec;
 
 	if (!t) {
@@ -204,7 +220,7 @@ static void rs_time_print(char *out, size_t len, struct timeval const *t)
 		t = &now;
 	}
 
-	ret = strftime(out, len, "%Y-%m-%d %H:%M:%S", localtime(&t->tv_sec));
+	ret = strftime(out, len, "%Y-%m-%d %H:%M:%S", localtime_r(&t->tv_sec, &tm));
 	if (ret >= len) {
 		return;
 	}
@@ -504,7 +520,10 @@ static inline void rs_packet_print(rs_request_t *request, uint64_t count, rs_sta
 	if (!conf->logger) return;
 
 	if (request) request->logged = true;
+
+	OUTPUT_LOCK;
 	conf->logger(count, status, handle, packet, elapsed, latency, response, body);
+	OUTPUT_UNLOCK;
 }
 
 static void rs_stats_print(rs_latency_t *stats, PW_CODE code)
@@ -658,6 +677,126 @@ static void rs_stats_process_counters(rs_latency_t *stats)
 	}
 }
 
+#ifdef WITH_THREADS
+/** Add the counters a worker gathered over the interval to the global stats
+ *
+ * The worker's interval counters are reset, so they can be used for the next interval.
+ */
+static void rs_stats_merge(rs_stats_t *stats, rs_stats_t *worker_stats)
+{
+	size_t i, j;
+	size_t rs_codes_len = (sizeof(rs_useful_codes) / sizeof(*rs_useful_codes));
+
+	for (i = 0; i < rs_codes_len; i++) {
+		rs_latency_t *out = &stats->exchange[rs_useful_codes[i]];
+		rs_latency_t *in = &worker_stats->exchange[rs_useful_codes[i]];
+
+		out->interval.received_total += in->interval.received_total;
+		out->interval.linked_total += in->interval.linked_total;
+		out->interval.unlinked_total += in->interval.unlinked_total;
+		out->interval.reused_total += in->interval.reused_total;
+		out->interval.lost_total += in->interval.lost_total;
+		for (j = 0; j <= RS_RETRANSMIT_MAX; j++) {
+			out->interval.rt_total[j] += in->interval.rt_total[j];
+		}
+
+		out->interval.latency_total += in->interval.latency_total;
+		if (in->interval.latency_high > out->interval.latency_high) {
+			out->interval.latency_high = in->interval.latency_high;
+		}
+		if (in->interval.latency_low &&
+		    (!out->interval.latency_low || (in->interval.latency_low < out->interval.latency_low))) {
+			out->interval.latency_low = in->interval.latency_low;
+		}
+
+		memset(&in->interval, 0, sizeof(in->interval));
+	}
+
+	if (timercmp(&worker_stats->quiet, &stats->quiet, >)) stats->quiet = worker_stats->quiet;
+}
+
+/** Check whether any workers dropped packets because they couldn't keep up
+ *
+ */
+static int rs_check_worker_drop(void)
+{
+	static uint64_t	last_dropped = 0;
+	uint64_t	dropped = 0;
+	int		i;
+
+	for (i = 0; i < conf->workers; i++) {
+		pthread_mutex_lock(&workers[i]->queue_mutex);
+		dropped += workers[i]->dropped;
+		pthread_mutex_unlock(&workers[i]->queue_mutex);
+	}
+
+	if (dropped > last_dropped) {
+		ERROR("Workers dropped %" PRIu64 " packets", dropped - last_dropped);
+		last_dropped = dropped;
+		return -1;
+	}
+
+	return 0;
+}
+
+/** Wait for the workers to process the packets they've been given
+ *
+ * Then expire their requests up to the end of the interval, as would have happened if the
+ * reader had processed the packets itself.
+ *
+ * @param now the end of the interval.
+ */
+static void rs_workers_drain(struct timeval const *now)
+{
+	struct timeval	when;
+	int		i;
+
+	for (i = 0; i < workers_running; i++) {
+		rs_worker_t *worker = workers[i];
+
+		pthread_mutex_lock(&worker->queue_mutex);
+		while (worker->head || worker->busy) pthread_cond_wait(&worker->space_cond, &worker->queue_mutex);
+		pthread_mutex_unlock(&worker->queue_mutex);
+
+		pthread_mutex_lock(&worker->mutex);
+		do {
+			when = *now;
+		} while (fr_event_run(worker->list, &when) == 1);
+		pthread_mutex_unlock(&worker->mutex);
+	}
+}
+#endif
+
+static void rs_stats_process(void *ctx);
+
+/** Schedule processing of the stats at the end of the next interval
+ *
+ */
+static void rs_stats_schedule(rs_update_t *this, struct timeval const *now)
+{
+	static fr_event_t *event;
+
+	this->when.tv_sec = now->tv_sec + conf->stats.interval;
+	this->when.tv_usec = 0;
+
+	if (!fr_event_insert(this->list, rs_stats_process, this, &this->when, &event)) {
+		ERROR("Failed inserting stats interval event");
+	}
+}
+
+/** Start the first stats interval, muting stats until the requests seen in it have timed out
+ *
+ * @param this stats to process.
+ * @param now the current time, or the timestamp of the first packet when reading from files.
+ */
+static void rs_stats_start(rs_update_t *this, struct timeval const *now)
+{
+	rs_stats_schedule(this, now);
+
+	INFO("Muting stats for the next %i milliseconds (warmup)", conf->stats.timeout);
+	rs_tv_add_ms(now, conf->stats.timeout, &this->stats->quiet);
+}
+
 /** Process stats for a single interval
  *
  */
@@ -670,27 +809,62 @@ static void rs_stats_process(void *ctx)
 	rs_stats_t		*stats = this->stats;
 	struct timeval		now;
 
-	gettimeofday(&now, NULL);
+	if (conf->from_dev) {
+		gettimeofday(&now, NULL);
+	} else {
+		now = this->when;
+	}
 
 	stats->intervals++;
 
+#ifdef WITH_THREADS
+	/*
+	 *	The reader doesn't wait for the workers, so when
+	 *	reading from files, packets from before the end of
+	 *	the interval may not have been processed yet.
+	 */
+	if (conf->workers && !conf->from_dev) rs_workers_drain(&now);
+
+	/*
+	 *	Workers only count, the global stats are where the
+	 *	averages are calculated.
+	 */
+	for (i = 0; i < (size_t) conf->workers; i++) {
+		pthread_mutex_lock(&workers[i]->mutex);
+		rs_stats_merge(stats, workers[i]->stats);
+		pthread_mutex_unlock(&workers[i]->mutex);
+	}
+#endif
+
 	INFO("######### Stats Iteration %i #########", stats->intervals);
 
 	/*
 	 *	Verify that none of the pcap handles have dropped packets.
+	 *	libpcap doesn't keep stats for files.
 	 */
-	INFO("Interface capture rate:");
-	for (in_p = this->in;
-	     in_p;
-	     in_p = in_p->next) {
-		if (rs_check_pcap_drop(in_p, conf->stats.interval) < 0) {
-			ERROR("Muting stats for the next %i milliseconds", conf->stats.timeout);
+	if (conf->from_dev) {
+		INFO("Interface capture rate:");
+		for (in_p = this->in;
+		     in_p;
+		     in_p = in_p->next) {
+			if (rs_check_pcap_drop(in_p, conf->stats.interval) < 0) {
+				ERROR("Muting stats for the next %i milliseconds", conf->stats.timeout);
 
-			rs_tv_add_ms(&now, conf->stats.timeout, &stats->quiet);
-			goto clear;
+				rs_tv_add_ms(&now, conf->stats.timeout, &stats->quiet);
+				goto clear;
+			}
 		}
 	}
 
+#ifdef WITH_THREADS
+	if (conf->workers && (rs_check_worker_drop() < 0)) {
+		ERROR("Muting stats for the next %i milliseconds", conf->stats.timeout);
+
+		rs_tv_add_ms(&now, conf->stats.timeout, &stats->quiet);
+		goto clear;
+	}
+#endif
+
 	if ((stats->quiet.tv_sec + (stats->quiet.tv_usec / 1000000.0)) -
 	    (now.tv_sec + (now.tv_usec / 1000000.0)) > 0) {
 		INFO("Stats muted because of warmup, or previous error");
@@ -729,16 +903,7 @@ static void rs_stats_process(void *ctx)
 		       sizeof(stats->exchange[rs_useful_codes[i]].interval));
 	}
 
-	{
-		static fr_event_t *event;
-
-		now.tv_sec += conf->stats.interval;
-		now.tv_usec = 0;
-
-		if (!fr_event_insert(this->list, rs_stats_process, ctx, &now, &event)) {
-			ERROR("Failed inserting stats interval event");
-		}
-	}
+	rs_stats_schedule(this, &now);
 }
 
 
@@ -809,17 +974,17 @@ static int _request_free(rs_request_t *request)
 	 *	something has gone very badly wrong.
 	 */
 	if (request->in_request_tree) {
-		ret = rbtree_deletebydata(request_tree, request);
+		ret = rbtree_deletebydata(request->worker->request_tree, request);
 		RS_ASSERT(ret);
 	}
 
 	if (request->in_link_tree) {
-		ret = rbtree_deletebydata(link_tree, request);
+		ret = rbtree_deletebydata(request->worker->link_tree, request);
 		RS_ASSERT(ret);
 	}
 
 	if (request->event) {
-		ret = fr_event_delete(events, &request->event);
+		ret = fr_event_delete(request->worker->list, &request->event);
 		RS_ASSERT(ret);
 	}
 
@@ -917,6 +1082,8 @@ static inline int rs_response_to_pcap(rs_event_t *event, rs_request_t *request,
 {
 	if (!event->out) return 0;
 
+	OUTPUT_LOCK;
+
 	/*
 	 *	If we're filtering by response then the requests then the capture buffer
 	 *	associated with the request should contain buffered request packets.
@@ -959,6 +1126,8 @@ static inline int rs_response_to_pcap(rs_event_t *event, rs_request_t *request,
 	 */
 	pcap_dump((void *)event->out->dumper, header, data);
 
+	OUTPUT_UNLOCK;
+
 	return 0;
 }
 
@@ -994,7 +1163,9 @@ static inline int rs_request_to_pcap(rs_event_t *event, rs_request_t *request, s
 		return 0;
 	}
 
+	OUTPUT_LOCK;
 	pcap_dump((void *)event->out->dumper, header, data);
+	OUTPUT_UNLOCK;
 
 	return 0;
 }
@@ -1008,9 +1179,43 @@ static inline int rs_request_to_pcap(rs_event_t *event, rs_request_t *request, s
 		_x = NULL;\
 	} while (0)
 
-static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkthdr const *header, uint8_t const *data)
+/** Decode the attributes in a packet
+ *
+ * Debug output from the decoder is suppressed by switching off the log file, which isn't
+ * safe to do when there are multiple workers, as other threads may be writing to it.
+ * Workers hold the output lock instead, so the decoder's output isn't interleaved with
+ * other packets.
+ */
+static int rs_packet_decode(RADIUS_PACKET *packet, RADIUS_PACKET *original)
+{
+	int ret;
+	FILE *log_fp = fr_log_fp;
+
+	if (conf->workers) {
+		/*
+		 *	libradius only writes debug output at this
+		 *	level, don't serialise decoding otherwise.
+		 */
+		if (fr_debug_lvl <= 3) return rad_decode(packet, original, conf->radius_secret);
+
+		OUTPUT_LOCK;
+		ret = rad_decode(packet, original, conf->radius_secret);
+		OUTPUT_UNLOCK;
+
+		return ret;
+	}
+
+	fr_log_fp = NULL;
+	ret = rad_decode(packet, original, conf->radius_secret);
+	fr_log_fp = log_fp;
+
+	return ret;
+}
+
+static void rs_packet_process(rs_worker_t *worker, uint64_t count, rs_event_t *event,
+			      struct pcap_pkthdr const *header, uint8_t const *data)
 {
-	rs_stats_t		*stats = event->stats;
+	rs_stats_t		*stats = worker->stats;
 	struct timeval		elapsed = {0, 0};
 	struct timeval		latency;
 
@@ -1037,10 +1242,6 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 
 	memset(&search, 0, sizeof(search));
 
-	if (!start_pcap.tv_sec) {
-		start_pcap = header->ts;
-	}
-
 	if (RIDEBUG_ENABLED()) {
 		rs_time_print(timestr, sizeof(timestr), &header->ts);
 	}
@@ -1132,7 +1333,7 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 	 *	recover once some requests timeout, so make an effort to deal
 	 *	with allocation failures gracefully.
 	 */
-	current = rad_alloc(conf, false);
+	current = rad_alloc(worker, false);
 	if (!current) {
 		REDEBUG("Failed allocating memory to hold decoded packet");
 		rs_tv_add_ms(&header->ts, conf->stats.timeout, &stats->quiet);
@@ -1188,7 +1389,7 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 	{
 		/* look for a matching request and use it for decoding */
 		search.expect = current;
-		original = rbtree_finddata(request_tree, &search);
+		original = rbtree_finddata(worker->request_tree, &search);
 
 		/*
 		 *	Verify this code is allowed
@@ -1210,13 +1411,7 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 		 *	rad_packet_ok does checks to verify the packet is actually valid.
 		 */
 		if (conf->decode_attrs) {
-			int ret;
-			FILE *log_fp = fr_log_fp;
-
-			fr_log_fp = NULL;
-			ret = rad_decode(current, original ? original->expect : NULL, conf->radius_secret);
-			fr_log_fp = log_fp;
-			if (ret != 0) {
+			if (rs_packet_decode(current, original ? original->expect : NULL) != 0) {
 				rad_free(&current);
 				REDEBUG("Failed decoding");
 				return;
@@ -1245,7 +1440,7 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 				original->rt_rsp++;
 
 				rad_free(&original->linked);
-				fr_event_delete(event->list, &original->event);
+				fr_event_delete(worker->list, &original->event);
 			/*
 			 *	...nope it's the first response to a request.
 			 */
@@ -1260,7 +1455,7 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 			 */
 			original->linked = talloc_steal(original, current);
 			rs_tv_add_ms(&header->ts, conf->stats.timeout, &original->when);
-			if (!fr_event_insert(event->list, _rs_event, original, &original->when,
+			if (!fr_event_insert(worker->list, _rs_event, original, &original->when,
 					     &original->event)) {
 				REDEBUG("Failed inserting new event");
 				/*
@@ -1317,14 +1512,7 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 		 *	rad_packet_ok does checks to verify the packet is actually valid.
 		 */
 		if (conf->decode_attrs) {
-			int ret;
-			FILE *log_fp = fr_log_fp;
-
-			fr_log_fp = NULL;
-			ret = rad_decode(current, NULL, conf->radius_secret);
-			fr_log_fp = log_fp;
-
-			if (ret != 0) {
+			if (rs_packet_decode(current, NULL) != 0) {
 				rad_free(&current);
 				REDEBUG("Failed decoding");
 				return;
@@ -1362,8 +1550,8 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 		if (search.link_vps) {
 			rs_request_t *tuple;
 
-			original = rbtree_finddata(link_tree, &search);
-			tuple = rbtree_finddata(request_tree, &search);
+			original = rbtree_finddata(worker->link_tree, &search);
+			tuple = rbtree_finddata(worker->request_tree, &search);
 
 			/*
 			 *	If the packet we matched using attributes is not the same
@@ -1377,7 +1565,7 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 		 *	Detect duplicates using the normal 5-tuple of src/dst ips/ports id
 		 */
 		} else {
-			original = rbtree_finddata(request_tree, &search);
+			original = rbtree_finddata(worker->request_tree, &search);
 			if (original && (memcmp(original->expect->vector, current->vector,
 			    			sizeof(original->expect->vector)) != 0)) {
 				/*
@@ -1423,22 +1611,23 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 
 			/* Request may need to be reinserted as the 5 tuple of the response may of changed */
 			if (rs_packet_cmp(original, &search) != 0) {
-				rbtree_deletebydata(request_tree, original);
+				rbtree_deletebydata(worker->request_tree, original);
 			}
 
 			rad_free(&original->expect);
 			original->expect = talloc_steal(original, search.expect);
 
 			/* Disarm the timer for the cleanup event for the original request */
-			fr_event_delete(event->list, &original->event);
+			fr_event_delete(worker->list, &original->event);
 		/*
 		 *	...nope it's a new request.
 		 */
 		} else {
-			original = talloc_zero(conf, rs_request_t);
+			original = talloc_zero(worker, rs_request_t);
 			talloc_set_destructor(original, _request_free);
 
 			original->id = count;
+			original->worker = worker;
 			original->in = event->in;
 			original->stats_req = &stats->exchange[current->code];
 
@@ -1461,7 +1650,7 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 				original->link_vps = search.link_vps;
 
 				/* We should never have conflicts */
-				ret = rbtree_insert(link_tree, original);
+				ret = rbtree_insert(worker->link_tree, original);
 				RS_ASSERT(ret);
 				original->in_link_tree = true;
 			}
@@ -1481,7 +1670,7 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 			bool ret;
 
 			/* We should never have conflicts */
-			ret = rbtree_insert(request_tree, original);
+			ret = rbtree_insert(worker->request_tree, original);
 			RS_ASSERT(ret);
 			original->in_request_tree = true;
 		}
@@ -1491,7 +1680,7 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 		 */
 		original->packet->timestamp = header->ts;
 		rs_tv_add_ms(&header->ts, conf->stats.timeout, &original->when);
-		if (!fr_event_insert(event->list, _rs_event, original,
+		if (!fr_event_insert(worker->list, _rs_event, original,
 				     &original->when, &original->event)) {
 			REDEBUG("Failed inserting new event");
 
@@ -1571,6 +1760,12 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 		rad_free(&current);
 	}
 
+	/*
+	 *	With worker threads the reader enforces the limit,
+	 *	as it's the only thread which can stop the event loop.
+	 */
+	if (conf->workers) return;
+
 	captured++;
 	/*
 	 *	We've hit our capture limit, break out of the event loop
@@ -1581,6 +1776,237 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 	}
 }
 
+#ifdef WITH_THREADS
+/** Pick the worker which should process a packet
+ *
+ * Only the IP addresses are hashed, and in a way where the hash doesn't change if the source
+ * and destination are swapped.  Responses then go to the same worker as their requests, as do
+ * retransmissions linked by attribute, which may come from a different source port.
+ *
+ * Packets we can't parse go to the first worker, which will complain about them.
+ */
+static rs_worker_t *rs_worker_select(rs_event_t *event, struct pcap_pkthdr const *header, uint8_t const *data)
+{
+	ssize_t		len;
+	uint8_t const	*p = data;
+	uint32_t	hash;
+
+	len = fr_pcap_link_layer_offset(data, header->caplen, event->in->link_layer);
+	if ((len < 0) || ((size_t) len >= header->caplen)) return workers[0];
+	p += len;
+
+	switch ((p[0] & 0xf0) >> 4) {
+	case 4:
+	{
+		ip_header_t const *ip = (ip_header_t const *) p;
+
+		if ((len + sizeof(*ip)) > header->caplen) return workers[0];
+		hash = fr_hash(&ip->ip_src, sizeof(ip->ip_src)) ^ fr_hash(&ip->ip_dst, sizeof(ip->ip_dst));
+	}
+		break;
+
+	case 6:
+	{
+		ip_header6_t const *ip6 = (ip_header6_t const *) p;
+
+		if ((len + sizeof(*ip6)) > header->caplen) return workers[0];
+		hash = fr_hash(&ip6->ip_src, sizeof(ip6->ip_src)) ^ fr_hash(&ip6->ip_dst, sizeof(ip6->ip_dst));
+	}
+		break;
+
+	default:
+		return workers[0];
+	}
+
+	return workers[hash % conf->workers];
+}
+
+/** Process packets queued by the reader
+ *
+ * Cleanup events for requests are run using the timestamps of the packets when reading from
+ * files, and using the current time when capturing live.
+ */
+static void *rs_worker_thread(void *arg)
+{
+	rs_worker_t	*worker = arg;
+	rs_packet_t	*head, *packet;
+	struct timeval	now;
+	struct timespec	wake;
+	bool		done;
+
+	for (;;) {
+		pthread_mutex_lock(&worker->queue_mutex);
+		while (!worker->head && !worker->done) {
+			if (!conf->from_dev) {
+				pthread_cond_wait(&worker->queue_cond, &worker->queue_mutex);
+				continue;
+			}
+
+			gettimeofday(&now, NULL);
+			rs_tv_add_ms(&now, RS_WORKER_TICK, &now);
+			wake.tv_sec = now.tv_sec;
+			wake.tv_nsec = now.tv_usec * 1000;
+			if (pthread_cond_timedwait(&worker->queue_cond, &worker->queue_mutex, &wake) == ETIMEDOUT) break;
+		}
+		head = worker->head;
+		done = worker->done;
+
+		worker->busy = (head != NULL);
+		worker->head = NULL;
+		worker->tail = &worker->head;
+		worker->queued = 0;
+		pthread_cond_signal(&worker->space_cond);
+		pthread_mutex_unlock(&worker->queue_mutex);
+
+		/*
+		 *	Expire requests using the time of the last packet
+		 *	read, not just the last one this worker saw.
+		 */
+		if (!head && done) {
+			if (!conf->from_dev) {
+				pthread_mutex_lock(&worker->mutex);
+				do {
+					now = last_pcap;
+				} while (fr_event_run(worker->list, &now) == 1);
+				pthread_mutex_unlock(&worker->mutex);
+			}
+			break;
+		}
+
+		pthread_mutex_lock(&worker->mutex);
+		while (head) {
+			packet = head;
+			head = packet->next;
+
+			if (!conf->from_dev) {
+				do {
+					now = packet->header.ts;
+				} while (fr_event_run(worker->list, &now) == 1);
+			}
+
+			rs_packet_process(worker, packet->count, packet->event, &packet->header, packet->data);
+			free(packet);
+		}
+
+		if (conf->from_dev) {
+			gettimeofday(&now, NULL);
+			while (fr_event_run(worker->list, &now) == 1);
+		}
+		pthread_mutex_unlock(&worker->mutex);
+
+		/*
+		 *	The reader may be waiting for us to finish,
+		 *	so it can close a stats interval.
+		 */
+		pthread_mutex_lock(&worker->queue_mutex);
+		worker->busy = false;
+		pthread_cond_signal(&worker->space_cond);
+		pthread_mutex_unlock(&worker->queue_mutex);
+	}
+
+	return NULL;
+}
+
+/** Tell the workers to exit once they've processed their queues, and wait for them
+ *
+ */
+static void rs_workers_stop(void)
+{
+	int i;
+
+	for (i = 0; i < workers_running; i++) {
+		pthread_mutex_lock(&workers[i]->queue_mutex);
+		workers[i]->done = true;
+		pthread_cond_signal(&workers[i]->queue_cond);
+		pthread_mutex_unlock(&workers[i]->queue_mutex);
+	}
+
+	for (i = 0; i < workers_running; i++) {
+		pthread_join(workers[i]->thread, NULL);
+	}
+	workers_running = 0;
+}
+
+static int _rs_worker_free(rs_worker_t *worker)
+{
+	rs_packet_t *packet;
+
+	while ((packet = worker->head)) {
+		worker->head = packet->next;
+		free(packet);
+	}
+
+	pthread_mutex_destroy(&worker->mutex);
+	pthread_mutex_destroy(&worker->queue_mutex);
+	pthread_cond_destroy(&worker->queue_cond);
+	pthread_cond_destroy(&worker->space_cond);
+
+	return 0;
+}
+#endif
+
+/** Process a packet, or pass a copy of it to the worker responsible for it
+ *
+ */
+static void rs_packet_dispatch(uint64_t count, rs_event_t *event, struct pcap_pkthdr const *header,
+			       uint8_t const *data)
+{
+#ifdef WITH_THREADS
+	rs_worker_t	*worker;
+	rs_packet_t	*packet;
+#endif
+
+	if (!start_pcap.tv_sec) {
+		start_pcap = header->ts;
+	}
+
+	if (!conf->workers) {
+		rs_packet_process(workers[0], count, event, header, data);
+		return;
+	}
+
+#ifdef WITH_THREADS
+	worker = rs_worker_select(event, header, data);
+
+	packet = malloc(sizeof(*packet) + header->caplen);
+	if (!packet) {
+		ERROR("Failed allocating memory to hold packet");
+		return;
+	}
+	last_pcap = header->ts;
+
+	packet->count = count;
+	packet->event = event;
+	packet->next = NULL;
+	packet->header = *header;
+	memcpy(packet->data, data, header->caplen);
+
+	pthread_mutex_lock(&worker->queue_mutex);
+	while (worker->queued >= RS_WORKER_BACKLOG) {
+		/*
+		 *	Live traffic won't wait for us, and the capture
+		 *	buffer is better at holding it than we are.
+		 */
+		if (conf->from_dev) {
+			worker->dropped++;
+			pthread_mutex_unlock(&worker->queue_mutex);
+			free(packet);
+			return;
+		}
+		pthread_cond_wait(&worker->space_cond, &worker->queue_mutex);
+	}
+	*worker->tail = packet;
+	worker->tail = &packet->next;
+	if (worker->queued++ == 0) pthread_cond_signal(&worker->queue_cond);
+	pthread_mutex_unlock(&worker->queue_mutex);
+
+	if ((conf->limit > 0) && (count >= conf->limit)) {
+		INFO("Read %" PRIu64 " packets, exiting...", count);
+		fr_event_loop_exit(events, 1);
+	}
+#endif
+}
+
 static void rs_got_packet(fr_event_list_t *el, int fd, void *ctx)
 {
 	static uint64_t	count = 0;	/* Packets seen */
@@ -1620,12 +2046,14 @@ static void rs_got_packet(fr_event_list_t *el, int fd, void *ctx)
 				return;
 			}
 
+			if (!start_pcap.tv_sec && event->stats) rs_stats_start(event->stats, &header->ts);
+
 			do {
 				now = header->ts;
 			} while (fr_event_run(el, &now) == 1);
 			count++;
 
-			rs_packet_process(count, event, header, data);
+			rs_packet_dispatch(count, event, header, data);
 		}
 		return;
 	}
@@ -1634,7 +2062,7 @@ static void rs_got_packet(fr_event_list_t *el, int fd, void *ctx)
 	 *	Consume multiple packets from the capture buffer.
 	 *	We occasionally need to yield to allow events to run.
 	 */
-	for (i = 0; i < RS_FORCE_YIELD; i++) {
+	for (i = 0; (i < RS_FORCE_YIELD) && !fr_event_loop_exiting(el); i++) {
 		ret = pcap_next_ex(handle, &header, &data);
 		if (ret == 0) {
 			/* No more packets available at this time */
@@ -1646,7 +2074,7 @@ static void rs_got_packet(fr_event_list_t *el, int fd, void *ctx)
 		}
 
 		count++;
-		rs_packet_process(count, event, header, data);
+		rs_packet_dispatch(count, event, header, data);
 	}
 }
 
@@ -1886,6 +2314,88 @@ fr_event_list_t *list, int fd, UNUSED void *ctx)
 	}
 }
 
+/** Allocate the decode and matching state for each worker
+ *
+ * Without worker threads there's a single worker, which uses the main event list and stats.
+ */
+static int rs_workers_init(rs_stats_t *stats)
+{
+	int i, num = conf->workers ? conf->workers : 1;
+
+	workers = talloc_zero_array(conf, rs_worker_t *, num);
+	if (!workers) return -1;
+
+	for (i = 0; i < num; i++) {
+		rs_worker_t *worker;
+
+		worker = workers[i] = talloc_zero(conf, rs_worker_t);
+		if (!worker) return -1;
+		worker->id = i;
+
+		worker->request_tree = rbtree_create(worker, (rbcmp) rs_packet_cmp, _unmark_request, 0);
+		if (!worker->request_tree) {
+			ERROR("Failed creating request tree");
+			return -1;
+		}
+
+		if (conf->link_da_num > 0) {
+			worker->link_tree = rbtree_create(worker, (rbcmp) rs_rtx_cmp, _unmark_link, 0);
+			if (!worker->link_tree) {
+				ERROR("Failed creating RTX tree");
+				return -1;
+			}
+		}
+
+		if (!conf->workers) {
+			worker->list = events;
+			worker->stats = stats;
+			continue;
+		}
+
+#ifdef WITH_THREADS
+		worker->list = fr_event_list_create(worker, NULL);
+		if (!worker->list) {
+			ERROR();
+			return -1;
+		}
+
+		worker->stats = talloc_zero(worker, rs_stats_t);
+		if (!worker->stats) return -1;
+
+		worker->tail = &worker->head;
+		pthread_mutex_init(&worker->mutex, NULL);
+		pthread_mutex_init(&worker->queue_mutex, NULL);
+		pthread_cond_init(&worker->queue_cond, NULL);
+		pthread_cond_init(&worker->space_cond, NULL);
+		talloc_set_destructor(worker, _rs_worker_free);
+#endif
+	}
+
+	return 0;
+}
+
+#ifdef WITH_THREADS
+/** Start the worker threads
+ *
+ * Must be called after daemonizing, as threads don't survive a fork.
+ */
+static int rs_workers_start(void)
+{
+	int i, rcode;
+
+	for (i = 0; i < conf->workers; i++) {
+		rcode = pthread_create(&workers[i]->thread, NULL, rs_worker_thread, workers[i]);
+		if (rcode != 0) {
+			ERROR("Failed creating worker thread: %s", fr_syserror(rcode));
+			return -1;
+		}
+		workers_running++;
+	}
+
+	return 0;
+}
+#endif
+
 static void NEVER_RETURNS usage(int status)
 {
 	FILE *output = status ? stderr : stdout;
@@ -1909,6 +2419,9 @@ static void NEVER_RETURNS usage(int status)
 	fprintf(output, "  -h                    This help message.\n");
 	fprintf(output, "  -i <interface>        Capture packets from interface (defaults to all if supported).\n");
 	fprintf(output, "  -I <file>             Read packets from file (overrides input of -F).\n");
+#ifdef WITH_THREADS
+	fprintf(output, "  -j <threads>          Decode and match packets using this many worker threads.\n");
+#endif
 	fprintf(output, "  -l <attr>[,<attr>]    Output packet sig and a list of attributes.\n");
 	fprintf(output, "  -L <attr>[,<attr>]    Detect retransmissions using these attributes to link requests.\n");
 	fprintf(output, "  -m                    Don't put interface(s) into promiscuous mode.\n");
@@ -1999,7 +2512,7 @@ int main(int argc, char *argv[])
 	/*
 	 *  Get options
 	 */
-	while ((opt = getopt(argc, argv, "ab:c:Cd:D:e:Ff:hi:I:l:L:mp:P:qr:R:s:Svw:xXW:T:P:N:O:")) != EOF) {
+	while ((opt = getopt(argc, argv, "ab:c:Cd:D:e:Ff:hi:I:j:l:L:mp:P:qr:R:s:Svw:xXW:T:P:N:O:")) != EOF) {
 		switch (opt) {
 		case 'a':
 		{
@@ -2080,6 +2593,16 @@ int main(int argc, char *argv[])
 			conf->from_file = true;
 			break;
 
+#ifdef WITH_THREADS
+		case 'j':
+			conf->workers = atoi(optarg);
+			if ((conf->workers <= 0) || (conf->workers > RS_WORKER_MAX)) {
+				ERROR("Number of worker threads must be between 1 and %i", RS_WORKER_MAX);
+				usage(64);
+			}
+			break;
+#endif
+
 		case 'l':
 			conf->list_attributes = optarg;
 			break;
@@ -2301,12 +2824,6 @@ int main(int argc, char *argv[])
 		if (conf->link_da_num < 0) {
 			usage(64);
 		}
-
-		link_tree = rbtree_create(conf, (rbcmp) rs_rtx_cmp, _unmark_link, 0);
-		if (!link_tree) {
-			ERROR("Failed creating RTX tree");
-			goto finish;
-		}
 	}
 
 	if (conf->filter_request) {
@@ -2363,15 +2880,6 @@ int main(int argc, char *argv[])
 		conf->decode_attrs = true;
 	}
 
-	/*
-	 *	Setup the request tree
-	 */
-	request_tree = rbtree_create(conf, (rbcmp) rs_packet_cmp, _unmark_request, 0);
-	if (!request_tree) {
-		ERROR("Failed creating request tree");
-		goto finish;
-	}
-
 	/*
 	 *	Get the default capture device
 	 */
@@ -2579,6 +3087,14 @@ int main(int argc, char *argv[])
 			goto finish;
 		}
 
+		/*
+		 *  Setup the request trees for each worker
+		 */
+		if (rs_workers_init(&stats) < 0) {
+			ERROR("Failed initialising workers");
+			goto finish;
+		}
+
 		/*
 		 *  Initialise the signal handler pipe
 		 */
@@ -2604,7 +3120,7 @@ int main(int argc, char *argv[])
 			event->list = events;
 			event->in = in_p;
 			event->out = out;
-			event->stats = &stats;
+			if (conf->stats.interval) event->stats = &update;
 
 			if (!fr_event_fd_insert(events, 0, in_p->fd, rs_got_packet, event)) {
 				ERROR("Failed inserting file descriptor");
@@ -2619,23 +3135,15 @@ int main(int argc, char *argv[])
 		gettimeofday(&now, NULL);
 
 		/*
-		 *  Insert our stats processor
+		 *  Insert our stats processor.  When reading from files
+		 *  the intervals are timed from the first packet.
 		 */
 		if (conf->stats.interval) {
-			static fr_event_t *event;
-
 			update.list = events;
 			update.stats = &stats;
 			update.in = in;
 
-			now.tv_sec += conf->stats.interval;
-			now.tv_usec = 0;
-			if (!fr_event_insert(events, rs_stats_process, (void *) &update, &now, &event)) {
-				ERROR("Failed inserting stats event");
-			}
-
-			INFO("Muting stats for the next %i milliseconds (warmup)", conf->stats.timeout);
-			rs_tv_add_ms(&now, conf->stats.timeout, &stats.quiet);
+			if (conf->from_dev) rs_stats_start(&update, &now);
 		}
 	}
 
@@ -2658,12 +3166,28 @@ int main(int argc, char *argv[])
 	fr_set_signal(SIGQUIT, rs_signal_self);
 #endif
 
+#ifdef WITH_THREADS
+	if (conf->workers) {
+		if (rs_workers_start() < 0) goto finish;
+		DEBUG("Started %i worker threads", conf->workers);
+	}
+#endif
+
 	fr_event_loop(events);	/* Enter the main event loop */
 
 	DEBUG("Done sniffing");
+	ret = 0;
 
 	finish:
 
+#ifdef WITH_THREADS
+	/*
+	 *	Let the workers finish with any packets they've
+	 *	been given, before freeing their state.
+	 */
+	rs_workers_stop();
+#endif
+
 	cleanup = true;
 
 	/*
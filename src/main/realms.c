@@ -46,9 +46,42 @@ typedef struct realm_regex realm_regex_t;
 struct realm_regex {
 	REALM		*realm;		//!< The realm this regex matches.
 	regex_t		*preg;		//!< The pre-compiled regular expression.
+	uint32_t	order;		//!< Position of the realm in the configuration.
+	bool		indexed;	//!< Whether the regex is fully described by #realms_suffix.
 	realm_regex_t	*next;		//!< The next realm in the list of regular expressions.
 };
 static realm_regex_t *realms_regex = NULL;
+static uint32_t realms_regex_count = 0;
+
+typedef struct realm_suffix realm_suffix_t;
+
+/** Node in a trie of realm name suffixes
+ *
+ * Most realm regexes are of the form "example\.com$" or
+ * "^(.*\.)?example\.com$", i.e. a literal suffix, with or without a
+ * label boundary.  Those are stored in a trie keyed by the reversed,
+ * lowercased literal, so finding every one which matches a name
+ * costs one walk backwards over the name.
+ *
+ * Each node records the first (in configuration order) regex which
+ * matches when the suffix spelled by the path to the node starts at
+ * a given position in the name.
+ */
+struct realm_suffix {
+	char		c;		//!< Lowercased character of this node.
+	realm_regex_t	*any;		//!< Matches wherever the suffix starts.
+	realm_regex_t	*nonempty;	//!< Matches if at least one character precedes the suffix.
+	realm_regex_t	*exact;		//!< Matches only if the suffix is the whole name.
+	realm_suffix_t	*child;		//!< First node of the next character.
+	realm_suffix_t	*next;		//!< Next sibling.
+};
+static realm_suffix_t *realms_suffix = NULL;
+
+typedef enum realm_suffix_type {
+	REALM_SUFFIX_ANY = 0,
+	REALM_SUFFIX_NONEMPTY,
+	REALM_SUFFIX_EXACT
+} realm_suffix_type_t;
 #endif /* HAVE_REGEX */
 
 struct realm_config {
@@ -340,6 +373,12 @@ void realms_free(void)
 	rbtree_free(realms_byname);
 	realms_byname = NULL;
 
+#ifdef HAVE_REGEX
+	TALLOC_FREE(realms_suffix);
+	realms_regex = NULL;
+	realms_regex_count = 0;
+#endif
+
 	realm_pool_free(NULL);
 
 	talloc_free(realm_config);
@@ -350,6 +389,8 @@ void realms_free(void)
 #ifdef WITH_PROXY
 static CONF_PARSER limit_config[] = {
 	{ "max_connections", FR_CONF_OFFSET(PW_TYPE_INTEGER, home_server_t, limit.max_connections), "16" },
+	{ "min_connections", FR_CONF_OFFSET(PW_TYPE_INTEGER, home_server_t, limit.min_connections), "0" },
+	{ "spare_ids", FR_CONF_OFFSET(PW_TYPE_INTEGER, home_server_t, limit.spare_ids), "64" },
 	{ "max_requests", FR_CONF_OFFSET(PW_TYPE_INTEGER, home_server_t, limit.max_requests), "0" },
 	{ "lifetime", FR_CONF_OFFSET(PW_TYPE_INTEGER, home_server_t, limit.lifetime), "0" },
 	{ "idle_timeout", FR_CONF_OFFSET(PW_TYPE_INTEGER, home_server_t, limit.idle_timeout), "0" },
@@ -411,6 +452,10 @@ static CONF_PARSER home_server_config[] = {
 
 	{ "limit", FR_CONF_POINTER(PW_TYPE_SUBSECTION, NULL), (void const *) limit_config },
 
+#ifdef WITH_TLS
+	{ "coalesce_writes", FR_CONF_OFFSET(PW_TYPE_BOOLEAN, home_server_t, coalesce_writes), "no" },
+#endif
+
 #ifdef WITH_COA
 	{ "coa", FR_CONF_POINTER(PW_TYPE_SUBSECTION, NULL), (void const *) home_server_coa },
 #endif
@@ -483,9 +528,17 @@ void realm_home_server_sanitize(home_server_t *home, CONF_SECTION *cs)
 	/*
 	 *	UDP sockets can't be connection limited.
 	 */
-	if (home->proto != IPPROTO_TCP) home->limit.max_connections = 0;
+	if (home->proto != IPPROTO_TCP) {
+		home->limit.max_connections = 0;
+		home->limit.min_connections = 0;
+	}
 #endif
 
+	if (home->limit.max_connections > 0) {
+		FR_INTEGER_BOUND_CHECK("min_connections", home->limit.min_connections, <=, home->limit.max_connections);
+	}
+	FR_INTEGER_BOUND_CHECK("spare_ids", home->limit.spare_ids, <=, 255);
+
 	if ((home->limit.idle_timeout > 0) && (home->limit.idle_timeout < 5))
 		home->limit.idle_timeout = 5;
 	if ((home->limit.lifetime > 0) && (home->limit.lifetime < 5))
@@ -2020,6 +2073,218 @@ static int realm_add(realm_config_t *rc, CONF_SECTION *cs)
 }
 
 #ifdef HAVE_REGEX
+/** Add one literal suffix to the suffix trie
+ *
+ * Nodes are fully initialised before being linked in, as dynamic
+ * realms may be added while other threads are looking up realms.
+ */
+static void realm_suffix_add(realm_regex_t *rr, char const *literal, size_t len, realm_suffix_type_t type)
+{
+	realm_suffix_t *node, *child;
+	char const *p;
+
+	if (!realms_suffix) realms_suffix = talloc_zero(NULL, realm_suffix_t);
+	node = realms_suffix;
+
+	for (p = literal + len - 1; p >= literal; p--) {
+		char c = tolower((uint8_t) *p);
+
+		for (child = node->child; child != NULL; child = child->next) {
+			if (child->c == c) break;
+		}
+
+		if (!child) {
+			child = talloc_zero(realms_suffix, realm_suffix_t);
+			child->c = c;
+			child->next = node->child;
+			node->child = child;
+		}
+
+		node = child;
+	}
+
+	/*
+	 *	Realms are added in configuration order, so if
+	 *	there's already a regex here, it takes precedence.
+	 */
+	switch (type) {
+	case REALM_SUFFIX_ANY:
+		if (!node->any) node->any = rr;
+		break;
+
+	case REALM_SUFFIX_NONEMPTY:
+		if (!node->nonempty) node->nonempty = rr;
+		break;
+
+	case REALM_SUFFIX_EXACT:
+		if (!node->exact) node->exact = rr;
+		break;
+	}
+}
+
+/** Unescape the literal part of a realm regex
+ *
+ * @param[out] out where to write the literal.
+ * @param[in] in the pattern, starting at the literal.
+ * @param[in] inlen length of the literal part of the pattern.
+ * @return the length of the literal, or -1 if the pattern isn't a
+ *	plain literal (i.e. it has meta-characters, or non-ASCII
+ *	characters, which might be case-folded differently).
+ */
+static ssize_t realm_regex_literal(char *out, char const *in, size_t inlen)
+{
+	char const *p, *end = in + inlen;
+	char *q = out;
+
+	for (p = in; p < end; p++) {
+		if (*p == '\\') {
+			p++;
+			if ((p == end) || isalnum((uint8_t) *p)) return -1;
+
+		} else if (strchr(".[]()*+?{}|^$", *p)) {
+			return -1;
+		}
+
+		if (((uint8_t) *p < 0x20) || ((uint8_t) *p >= 0x7f)) return -1;
+
+		*q++ = *p;
+	}
+
+	if (q == out) return -1;
+
+	return q - out;
+}
+
+/** Try to index a realm regex in the suffix trie
+ *
+ * Recognises patterns made of a prefix we understand, a literal,
+ * and a final '$'.  Everything else is left for regex_exec().
+ *
+ * @return true if the regex is fully described by the trie.
+ */
+static bool realm_regex_index(realm_regex_t *rr, char const *pattern)
+{
+	size_t len = strlen(pattern);
+	ssize_t slen;
+	char *literal;
+
+	/*
+	 *	Prefixes, in the order they have to be checked.  Each
+	 *	one is either a single match on the literal, or an
+	 *	exact match on the literal plus a match on ".literal".
+	 */
+	static const struct {
+		char const		*prefix;
+		realm_suffix_type_t	type;		//!< For the literal.
+		bool			subdomain;	//!< Also match ".literal" with this type.
+		realm_suffix_type_t	sub_type;
+	} prefixes[] = {
+		{ "^(.*\\.)?",	REALM_SUFFIX_EXACT,	true,	REALM_SUFFIX_ANY },
+		{ "^(.+\\.)?",	REALM_SUFFIX_EXACT,	true,	REALM_SUFFIX_NONEMPTY },
+		{ "(.*\\.)?",	REALM_SUFFIX_ANY,	false,	REALM_SUFFIX_ANY },
+		{ "^.*",	REALM_SUFFIX_ANY,	false,	REALM_SUFFIX_ANY },
+		{ "^.+",	REALM_SUFFIX_NONEMPTY,	false,	REALM_SUFFIX_ANY },
+		{ ".*",		REALM_SUFFIX_ANY,	false,	REALM_SUFFIX_ANY },
+		{ ".+",		REALM_SUFFIX_NONEMPTY,	false,	REALM_SUFFIX_ANY },
+		{ "^",		REALM_SUFFIX_EXACT,	false,	REALM_SUFFIX_ANY },
+		{ "",		REALM_SUFFIX_ANY,	false,	REALM_SUFFIX_ANY },
+	};
+	size_t i, plen = 0;
+
+	/*
+	 *	Must end in an unescaped '$'.
+	 */
+	if ((len < 2) || (pattern[len - 1] != '$') || (pattern[len - 2] == '\\')) return false;
+	len--;
+
+	for (i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++) {
+		plen = strlen(prefixes[i].prefix);
+		if ((plen < len) && (strncmp(pattern, prefixes[i].prefix, plen) == 0)) break;
+	}
+	if (i == sizeof(prefixes) / sizeof(prefixes[0])) return false;
+
+	literal = talloc_array(NULL, char, len + 2);
+	literal[0] = '.';
+
+	slen = realm_regex_literal(literal + 1, pattern + plen, len - plen);
+	if (slen < 0) {
+		talloc_free(literal);
+		return false;
+	}
+
+	realm_suffix_add(rr, literal + 1, slen, prefixes[i].type);
+	if (prefixes[i].subdomain) realm_suffix_add(rr, literal, slen + 1, prefixes[i].sub_type);
+
+	talloc_free(literal);
+
+	return true;
+}
+
+/** Find the first regex realm matching a name, in configuration order
+ *
+ * @param[out] out the matching realm.
+ * @param[in] name to match.
+ * @return 1 if a realm matched, 0 if none did, -1 on error.
+ */
+static int realm_regex_find(REALM **out, char const *name)
+{
+	size_t len = strlen(name);
+	realm_regex_t *best = NULL, *this;
+
+	/*
+	 *	'$' and '.' treat newlines differently between PCRE
+	 *	and POSIX regexes, so for names with embedded newlines,
+	 *	don't second guess the regex library.
+	 */
+	if (realms_suffix && !memchr(name, '\n', len)) {
+		realm_suffix_t *node = realms_suffix;
+		char const *p = name + len;
+
+		while (node && (p > name)) {
+			realm_suffix_t *child;
+			char c = tolower((uint8_t) *--p);
+
+			for (child = node->child; child != NULL; child = child->next) {
+				if (child->c == c) break;
+			}
+			node = child;
+			if (!node) break;
+
+#define BETTER(_rr) if (_rr && (!best || (_rr->order < best->order))) best = _rr
+			BETTER(node->any);
+			if (p > name) BETTER(node->nonempty);
+			if (p == name) BETTER(node->exact);
+#undef BETTER
+		}
+	}
+
+	/*
+	 *	Only regexes which come before the best suffix match
+	 *	can override it.
+	 */
+	for (this = realms_regex; this != NULL; this = this->next) {
+		int compare;
+
+		if (best && (this->order >= best->order)) break;
+		if (this->indexed && !memchr(name, '\n', len)) continue;
+
+		compare = regex_exec(this->preg, name, len, NULL, NULL);
+		if (compare < 0) {
+			ERROR("Failed performing realm comparison: %s", fr_strerror());
+			return -1;
+		}
+		if (compare == 1) {
+			*out = this->realm;
+			return 1;
+		}
+	}
+
+	if (!best) return 0;
+
+	*out = best->realm;
+	return 1;
+}
+
 int realm_realm_add(REALM *r, CONF_SECTION *cs)
 #else
 int realm_realm_add(REALM *r, UNUSED CONF_SECTION *cs)
@@ -2069,7 +2334,9 @@ int realm_realm_add(REALM *r, UNUSED CONF_SECTION *cs)
 		while (*last) last = &((*last)->next);  /* O(N^2)... sue me. */
 
 		rr->realm = r;
+		rr->order = realms_regex_count++;
 		rr->next = NULL;
+		rr->indexed = realm_regex_index(rr, r->name + 1);
 
 		*last = rr;
 		return 1;
@@ -2164,7 +2431,7 @@ int realms_init(CONF_SECTION *config)
 	}
 
 	if (rc->dynamic) {
-		flags = RBTREE_FLAG_LOCK;
+		flags = RBTREE_FLAG_RWLOCK;
 	}
 
 	home_servers_byaddr = rbtree_create(NULL, home_server_addr_cmp, home_server_free, flags);
@@ -2311,19 +2578,15 @@ REALM *realm_find(char const *name)
 
 #ifdef HAVE_REGEX
 	if (realms_regex) {
-		realm_regex_t *this;
+		switch (realm_regex_find(&realm, name)) {
+		case 1:
+			return realm;
 
-		for (this = realms_regex;
-		     this != NULL;
-		     this = this->next) {
-			int compare;
+		case -1:
+			return NULL;
 
-			compare = regex_exec(this->preg, name, strlen(name), NULL, NULL);
-			if (compare < 0) {
-				ERROR("Failed performing realm comparison: %s", fr_strerror());
-				return NULL;
-			}
-			if (compare == 1) return this->realm;
+		default:
+			break;
 		}
 	}
 #endif
@@ -31,6 +31,26 @@ RCSID("$Id$")
 #include <freeradius-devel/md5.h>
 #include <freeradius-devel/rad_assert.h>
 
+#ifdef HAVE_STDATOMIC_H
+#  include <freeradius-devel/atomic_queue.h>
+#endif
+
+/*
+ *	The State table is split into shards, each with its own lock,
+ *	so that requests for different States don't contend with each
+ *	other.  Must be a power of 2.
+ *
+ *	The shards are only for locking.  The limit on the number of
+ *	entries is for the whole table, so one busy shard can hold
+ *	more than its share.
+ */
+#define STATE_SHARDS		(16)
+
+/*
+ *	How often (in seconds) the expiry thread looks for old entries.
+ */
+#define STATE_EXPIRE_INTERVAL	(1)
+
 typedef struct state_entry_t {
 	uint8_t		state[AUTH_VECTOR_LEN];
 
@@ -47,14 +67,43 @@ typedef struct state_entry_t {
 	void 		(*free_opaque)(void *opaque);
 } state_entry_t;
 
-struct fr_state_t {
-	rbtree_t *tree;
+typedef struct state_shard_t {
+	rbtree_t	*tree;
 
-	state_entry_t *head, *tail;
+	/*
+	 *	Every entry has the same lifetime, so a list in
+	 *	creation order is also ordered by cleanup time.
+	 */
+	state_entry_t	*head, *tail;
+
+	uint64_t	expired;
+	uint64_t	full;		//!< Entries not created because the table was full.
+	uint64_t	contended;
 
 #ifdef HAVE_PTHREAD_H
 	pthread_mutex_t mutex;
 #endif
+} state_shard_t;
+
+struct fr_state_t {
+	state_shard_t	shard[STATE_SHARDS];
+
+#ifdef HAVE_STDATOMIC_H
+	atomic_uint32_t	entries;
+#else
+	uint32_t	entries;	//!< Protected by entries_mutex.
+#  ifdef HAVE_PTHREAD_H
+	pthread_mutex_t	entries_mutex;
+#  endif
+#endif
+
+#ifdef HAVE_PTHREAD_H
+	pthread_t	expire_thread;
+	pthread_mutex_t	expire_mutex;
+	pthread_cond_t	expire_cond;
+	bool		expire_running;
+	bool		expire_stop;
+#endif
 };
 
 static fr_state_t global_state;
@@ -64,6 +113,18 @@ static fr_state_t global_state;
 #define PTHREAD_MUTEX_LOCK pthread_mutex_lock
 #define PTHREAD_MUTEX_UNLOCK pthread_mutex_unlock
 
+/*
+ *	Count how often the lock is already held, so that contention
+ *	shows up in the statistics.
+ */
+static inline void state_shard_lock(state_shard_t *shard)
+{
+	if (pthread_mutex_trylock(&shard->mutex) == 0) return;
+
+	pthread_mutex_lock(&shard->mutex);
+	shard->contended++;
+}
+
 #else
 /*
  *	This is easier than ifdef's throughout the code.
@@ -71,7 +132,55 @@ static fr_state_t global_state;
 #define PTHREAD_MUTEX_LOCK(_x)
 #define PTHREAD_MUTEX_UNLOCK(_x)
 
+#define state_shard_lock(_x)
+
+#endif
+
+#define state_shard_unlock(_x) PTHREAD_MUTEX_UNLOCK(&(_x)->mutex)
+
+/*
+ *	Count a new entry, unless the table is full.  Limit the size
+ *	of the table based on how many requests we can handle at the
+ *	same time.
+ */
+static bool state_entries_reserve(fr_state_t *state)
+{
+	uint32_t max = main_config.max_requests * 2;
+
+#ifdef HAVE_STDATOMIC_H
+	uint32_t num = load(state->entries);
+
+	do {
+		if (num >= max) return false;
+	} while (!cas_incr(state->entries, num));
+
+	return true;
+#else
+	bool reserved = false;
+
+	PTHREAD_MUTEX_LOCK(&state->entries_mutex);
+	if (state->entries < max) {
+		state->entries++;
+		reserved = true;
+	}
+	PTHREAD_MUTEX_UNLOCK(&state->entries_mutex);
+
+	return reserved;
+#endif
+}
+
+static void state_entries_release(fr_state_t *state)
+{
+#ifdef HAVE_STDATOMIC_H
+	uint32_t num = load(state->entries);
+
+	while (!cas_decr(state->entries, num));
+#else
+	PTHREAD_MUTEX_LOCK(&state->entries_mutex);
+	state->entries--;
+	PTHREAD_MUTEX_UNLOCK(&state->entries_mutex);
 #endif
+}
 
 /*
  *	rbtree callback.
@@ -84,13 +193,47 @@ static int state_entry_cmp(void const *one, void const *two)
 	return memcmp(a->state, b->state, sizeof(a->state));
 }
 
+/*
+ *	The shard an entry lives in depends only on its State.
+ */
+static state_shard_t *state_shard(fr_state_t *state, uint8_t const *key)
+{
+	return &state->shard[fr_hash(key, AUTH_VECTOR_LEN) & (STATE_SHARDS - 1)];
+}
+
+/*
+ *	Convert a State attribute to the key used to index the table.
+ */
+static void state_key(uint8_t key[AUTH_VECTOR_LEN], VALUE_PAIR const *vp)
+{
+	/*
+	 *	Assume our own State first.
+	 */
+	if (vp->vp_length == AUTH_VECTOR_LEN) {
+		memcpy(key, vp->vp_octets, AUTH_VECTOR_LEN);
+
+		/*
+		 *	Too big?  Get the MD5 hash, in order
+		 *	to depend on the entire contents of State.
+		 */
+	} else if (vp->vp_length > AUTH_VECTOR_LEN) {
+		fr_md5_calc(key, vp->vp_octets, vp->vp_length);
+
+		/*
+		 *	Too small?  Use the whole thing, and
+		 *	set the rest of the key to zero.
+		 */
+	} else {
+		memcpy(key, vp->vp_octets, vp->vp_length);
+		memset(key + vp->vp_length, 0, AUTH_VECTOR_LEN - vp->vp_length);
+	}
+}
+
 /*
  *	When an entry is free'd, it's removed from the linked list of
- *	cleanup times.
- *
- *	Note that
+ *	cleanup times.  Called with the shard mutex held.
  */
-static void state_entry_free(fr_state_t *state, state_entry_t *entry)
+static void state_entry_free(fr_state_t *state, state_shard_t *shard, state_entry_t *entry)
 {
 	state_entry_t *prev, *next;
 
@@ -98,25 +241,25 @@ static void state_entry_free(fr_state_t *state, state_entry_t *entry)
 	 *	If we're deleting the whole tree, don't bother doing
 	 *	all of the fixups.
 	 */
-	if (!state || !state->tree) return;
+	if (!shard->tree) return;
 
 	prev = entry->prev;
 	next = entry->next;
 
 	if (prev) {
-		rad_assert(state->head != entry);
+		rad_assert(shard->head != entry);
 		prev->next = next;
-	} else if (state->head) {
-		rad_assert(state->head == entry);
-		state->head = next;
+	} else if (shard->head) {
+		rad_assert(shard->head == entry);
+		shard->head = next;
 	}
 
 	if (next) {
-		rad_assert(state->tail != entry);
+		rad_assert(shard->tail != entry);
 		next->prev = prev;
-	} else if (state->tail) {
-		rad_assert(state->tail == entry);
-		state->tail = prev;
+	} else if (shard->tail) {
+		rad_assert(shard->tail == entry);
+		shard->tail = prev;
 	}
 
 	if (entry->opaque) {
@@ -126,122 +269,278 @@ static void state_entry_free(fr_state_t *state, state_entry_t *entry)
 #ifdef WITH_VERIFY_PTR
 	(void) talloc_get_type_abort(entry, state_entry_t);
 #endif
-	rbtree_deletebydata(state->tree, entry);
+	rbtree_deletebydata(shard->tree, entry);
 
 	if (entry->ctx) talloc_free(entry->ctx);
 
 	talloc_free(entry);
+
+	state_entries_release(state);
+}
+
+/*
+ *	Clean up old entries.  Called with the shard mutex held.
+ */
+static void state_shard_expire(fr_state_t *state, state_shard_t *shard, time_t now)
+{
+	state_entry_t *entry, *next;
+
+	for (entry = shard->head; entry != NULL; entry = next) {
+		next = entry->next;
+
+		/*
+		 *	Too old, we can delete it.
+		 */
+		if (entry->cleanup < now) {
+			state_entry_free(state, shard, entry);
+			shard->expired++;
+			continue;
+		}
+
+		/*
+		 *	Unused.  We can delete it, even if now isn't
+		 *	the time to clean it up.
+		 */
+		if (!entry->ctx && !entry->opaque) {
+			state_entry_free(state, shard, entry);
+			continue;
+		}
+
+		break;
+	}
+}
+
+#ifdef HAVE_PTHREAD_H
+/*
+ *	Expire old entries in the background, so that requests
+ *	creating new entries don't have to.
+ */
+static void *state_expire_thread(void *arg)
+{
+	fr_state_t *state = arg;
+	struct timespec when;
+	time_t now;
+	int i;
+
+	pthread_mutex_lock(&state->expire_mutex);
+	while (!state->expire_stop) {
+		when.tv_sec = time(NULL) + STATE_EXPIRE_INTERVAL;
+		when.tv_nsec = 0;
+
+		pthread_cond_timedwait(&state->expire_cond, &state->expire_mutex, &when);
+		if (state->expire_stop) break;
+
+		now = time(NULL);
+		for (i = 0; i < STATE_SHARDS; i++) {
+			state_shard_t *shard = &state->shard[i];
+
+			state_shard_lock(shard);
+			state_shard_expire(state, shard, now);
+			state_shard_unlock(shard);
+		}
+	}
+	pthread_mutex_unlock(&state->expire_mutex);
+
+	return NULL;
 }
+#endif
 
 fr_state_t *fr_state_init(TALLOC_CTX *ctx)
 {
 	fr_state_t *state;
+	int i;
 
 	if (!ctx) {
 		state = &global_state;
-		if (state->tree) return state;
+		if (state->shard[0].tree) return state;
 	} else {
 		state = talloc_zero(ctx, fr_state_t);
 		if (!state) return 0;
 	}
 
+	for (i = 0; i < STATE_SHARDS; i++) {
+		state_shard_t *shard = &state->shard[i];
+
 #ifdef HAVE_PTHREAD_H
-	if (pthread_mutex_init(&state->mutex, NULL) != 0) {
-		talloc_free(state);
-		return NULL;
+		if (pthread_mutex_init(&shard->mutex, NULL) != 0) goto error;
+#endif
+
+		shard->tree = rbtree_create(NULL, state_entry_cmp, NULL, 0);
+		if (!shard->tree) goto error;
 	}
+
+#ifdef HAVE_STDATOMIC_H
+	store(state->entries, 0);
+#else
+	state->entries = 0;
+#  ifdef HAVE_PTHREAD_H
+	pthread_mutex_init(&state->entries_mutex, NULL);
+#  endif
 #endif
 
-	state->tree = rbtree_create(NULL, state_entry_cmp, NULL, 0);
-	if (!state->tree) {
-		talloc_free(state);
-		return NULL;
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_init(&state->expire_mutex, NULL);
+	pthread_cond_init(&state->expire_cond, NULL);
+
+	/*
+	 *	If we can't start the thread, entries are expired
+	 *	when new ones are created.
+	 */
+	if (pthread_create(&state->expire_thread, NULL, state_expire_thread, state) != 0) {
+		WARN("Failed creating session-state expiry thread: %s", fr_syserror(errno));
+	} else {
+		state->expire_running = true;
 	}
+#endif
 
 	return state;
+
+error:
+	while (i >= 0) {
+		rbtree_free(state->shard[i].tree);
+		state->shard[i].tree = NULL;
+		i--;
+	}
+	if (state != &global_state) talloc_free(state);
+	return NULL;
 }
 
 void fr_state_delete(fr_state_t *state)
 {
 	rbtree_t *my_tree;
+	int i;
 
 	if (!state) return;
 
-	PTHREAD_MUTEX_LOCK(&state->mutex);
+#ifdef HAVE_PTHREAD_H
+	if (state->expire_running) {
+		pthread_mutex_lock(&state->expire_mutex);
+		state->expire_stop = true;
+		pthread_cond_signal(&state->expire_cond);
+		pthread_mutex_unlock(&state->expire_mutex);
+
+		pthread_join(state->expire_thread, NULL);
+		state->expire_running = false;
+		state->expire_stop = false;
+	}
+	pthread_cond_destroy(&state->expire_cond);
+	pthread_mutex_destroy(&state->expire_mutex);
+#endif
+
+	for (i = 0; i < STATE_SHARDS; i++) {
+		state_shard_t *shard = &state->shard[i];
 
-	/*
-	 *	Tell the talloc callback to NOT delete the entry from
-	 *	the tree.  We're deleting the entire tree.
-	 */
-	my_tree = state->tree;
-	state->tree = NULL;
+		state_shard_lock(shard);
+
+		/*
+		 *	Tell the talloc callback to NOT delete the entry from
+		 *	the tree.  We're deleting the entire tree.
+		 */
+		my_tree = shard->tree;
+		shard->tree = NULL;
+		shard->head = shard->tail = NULL;
 
-	rbtree_free(my_tree);
-	PTHREAD_MUTEX_UNLOCK(&state->mutex);
+		rbtree_free(my_tree);
+		state_shard_unlock(shard);
+	}
+
+#if !defined(HAVE_STDATOMIC_H) && defined(HAVE_PTHREAD_H)
+	pthread_mutex_destroy(&state->entries_mutex);
+#endif
 
 	if (state != &global_state) talloc_free(state);
 }
 
 /*
- *	Create a new entry.  Called with the mutex held.
+ *	Find the entry, based on the State attribute.  On success,
+ *	returns the entry with its shard locked.
  */
-static state_entry_t *fr_state_create(fr_state_t *state, const char *server, RADIUS_PACKET *packet, state_entry_t *old)
+static state_entry_t *fr_state_find(fr_state_t *state, state_shard_t **out,
+				    const char *server, RADIUS_PACKET *packet)
 {
-	size_t i;
-	uint32_t x;
-	time_t now = time(NULL);
 	VALUE_PAIR *vp;
-	state_entry_t *entry, *next;
-
-	/*
-	 *	Clean up old entries.
-	 */
-	for (entry = state->head; entry != NULL; entry = next) {
-		next = entry->next;
+	state_shard_t *shard;
+	state_entry_t *entry, my_entry;
 
-		if (entry == old) continue;
+	vp = fr_pair_find_by_num(packet->vps, PW_STATE, 0, TAG_ANY);
+	if (!vp) return NULL;
 
-		/*
-		 *	Too old, we can delete it.
-		 */
-		if (entry->cleanup < now) {
-			state_entry_free(state, entry);
-			continue;
-		}
+	state_key(my_entry.state, vp);
 
-		/*
-		 *	Unused.  We can delete it, even if now isn't
-		 *	the time to clean it up.
-		 */
-		if (!entry->ctx && !entry->opaque) {
-			state_entry_free(state, entry);
-			continue;
-		}
+	/*	Make unique for different virtual servers handling same request
+	 */
+	if (server) *((uint32_t *)(&my_entry.state[4])) ^= fr_hash_string(server);
 
-		break;
-	}
+	shard = state_shard(state, my_entry.state);
 
-	/*
-	 *	Limit the size of the cache based on how many requests
-	 *	we can handle at the same time.
-	 */
-	if (rbtree_num_elements(state->tree) >= main_config.max_requests * 2) {
+	state_shard_lock(shard);
+	entry = rbtree_finddata(shard->tree, &my_entry);
+	if (!entry) {
+		state_shard_unlock(shard);
 		return NULL;
 	}
 
+#ifdef WITH_VERIFY_PTR
+	(void) talloc_get_type_abort(entry, state_entry_t);
+#endif
+
+	*out = shard;
+	return entry;
+}
+
+/*
+ *	We're replacing an old entry with a new one.  Remember what
+ *	the new entry needs from the old one, and free the old one
+ *	if nothing else is using it.
+ *
+ *	This is done before the new entry is created, as the new one
+ *	may be in a different shard, and we never hold two shard
+ *	locks at once.
+ */
+static bool fr_state_release(fr_state_t *state, state_entry_t *old, const char *server,
+			     RADIUS_PACKET *original, void *data)
+{
+	state_shard_t *shard;
+	state_entry_t *entry;
+
+	if (!original) return false;
+
+	entry = fr_state_find(state, &shard, server, original);
+	if (!entry) return false;
+
+	memcpy(old->state, entry->state, sizeof(old->state));
+	old->tries = entry->tries;
+
 	/*
-	 *	Allocate a new one.
+	 *	If we're moving the data, ensure that we delete it
+	 *	from the old state.
 	 */
-	entry = talloc_zero(state->tree, state_entry_t);
-	if (!entry) return NULL;
+	if (data && (entry->opaque == data)) entry->opaque = NULL;
 
 	/*
-	 *	Limit the lifetime of this entry based on how long the
-	 *	server takes to process a request.  Doing it this way
-	 *	isn't perfect, but it's reasonable, and it's one less
-	 *	thing for an administrator to configure.
+	 *	The old one isn't used any more, so we can free it.
 	 */
-	entry->cleanup = now + main_config.max_request_time * 10;
+	if (!entry->opaque) state_entry_free(state, shard, entry);
+
+	state_shard_unlock(shard);
+	return true;
+}
+
+/*
+ *	Create a new entry.  On success, returns the entry with its
+ *	shard locked.
+ */
+static state_entry_t *fr_state_create(fr_state_t *state, state_shard_t **out,
+				      const char *server, RADIUS_PACKET *packet, state_entry_t const *old)
+{
+	size_t i;
+	uint32_t x;
+	time_t now = time(NULL);
+	VALUE_PAIR *vp;
+	state_shard_t *shard;
+	state_entry_t *entry, my_entry;
+
+	memset(&my_entry, 0, sizeof(my_entry));
 
 	/*
 	 *	Hacks for EAP, until we convert EAP to using the state API.
@@ -255,33 +554,28 @@ static state_entry_t *fr_state_create(fr_state_t *state, const char *server, RAD
 	 *	If possible, base the new one off of the old one.
 	 */
 	if (old) {
-		entry->tries = old->tries + 1;
+		my_entry.tries = old->tries + 1;
 
 		/*
 		 *	Track State
 		 */
 		if (!vp) {
-			memcpy(entry->state, old->state, sizeof(entry->state));
+			memcpy(my_entry.state, old->state, sizeof(my_entry.state));
 
-			entry->state[1] = entry->state[0] ^ entry->tries;
-			entry->state[8] = entry->state[2] ^ ((((uint32_t) HEXIFY(RADIUSD_VERSION)) >> 16) & 0xff);
-			entry->state[10] = entry->state[2] ^ ((((uint32_t) HEXIFY(RADIUSD_VERSION)) >> 8) & 0xff);
-			entry->state[12] = entry->state[2] ^ (((uint32_t) HEXIFY(RADIUSD_VERSION)) & 0xff);
+			my_entry.state[1] = my_entry.state[0] ^ my_entry.tries;
+			my_entry.state[8] = my_entry.state[2] ^ ((((uint32_t) HEXIFY(RADIUSD_VERSION)) >> 16) & 0xff);
+			my_entry.state[10] = my_entry.state[2] ^ ((((uint32_t) HEXIFY(RADIUSD_VERSION)) >> 8) & 0xff);
+			my_entry.state[12] = my_entry.state[2] ^ (((uint32_t) HEXIFY(RADIUSD_VERSION)) & 0xff);
 		}
 
-		/*
-		 *	The old one isn't used any more, so we can free it.
-		 */
-		if (!old->opaque) state_entry_free(state, old);
-
 	} else if (!vp) {
 		/*
 		 *	16 octets of randomness should be enough to
 		 *	have a globally unique state.
 		 */
-		for (i = 0; i < sizeof(entry->state) / sizeof(x); i++) {
+		for (i = 0; i < sizeof(my_entry.state) / sizeof(x); i++) {
 			x = fr_rand();
-			memcpy(entry->state + (i * 4), &x, sizeof(x));
+			memcpy(my_entry.state + (i * 4), &x, sizeof(x));
 		}
 	}
 
@@ -290,107 +584,82 @@ static state_entry_t *fr_state_create(fr_state_t *state, const char *server, RAD
 	 *	one we created above.
 	 */
 	if (vp) {
-		/*
-		 *	Assume our own State first.
-		 */
-		if (vp->vp_length == sizeof(entry->state)) {
-			memcpy(entry->state, vp->vp_octets, sizeof(entry->state));
-
-			/*
-			 *	Too big?  Get the MD5 hash, in order
-			 *	to depend on the entire contents of State.
-			 */
-		} else if (vp->vp_length > sizeof(entry->state)) {
-			fr_md5_calc(entry->state, vp->vp_octets, vp->vp_length);
-
-			/*
-			 *	Too small?  Use the whole thing, and
-			 *	set the rest of entry->state to zero.
-			 */
-		} else {
-			memcpy(entry->state, vp->vp_octets, vp->vp_length);
-			memset(&entry->state[vp->vp_length], 0, sizeof(entry->state) - vp->vp_length);
-		}
+		state_key(my_entry.state, vp);
 	} else {
 		vp = fr_pair_afrom_num(packet, PW_STATE, 0);
-		fr_pair_value_memcpy(vp, entry->state, sizeof(entry->state));
+		fr_pair_value_memcpy(vp, my_entry.state, sizeof(my_entry.state));
 		fr_pair_add(&packet->vps, vp);
 	}
 
 	/*	Make unique for different virtual servers handling same request
 	 */
-	if (server) *((uint32_t *)(&entry->state[4])) ^= fr_hash_string(server);
-
-	if (!rbtree_insert(state->tree, entry)) {
-		talloc_free(entry);
-		return NULL;
-	}
+	if (server) *((uint32_t *)(&my_entry.state[4])) ^= fr_hash_string(server);
 
-	/*
-	 *	Link it to the end of the list, which is implicitely
-	 *	ordered by cleanup time.
-	 */
-	if (!state->head) {
-		entry->prev = entry->next = NULL;
-		state->head = state->tail = entry;
-	} else {
-		rad_assert(state->tail != NULL);
+	shard = state_shard(state, my_entry.state);
 
-		entry->prev = state->tail;
-		state->tail->next = entry;
+	state_shard_lock(shard);
 
-		entry->next = NULL;
-		state->tail = entry;
+#ifdef HAVE_PTHREAD_H
+	if (!state->expire_running)
+#endif
+	{
+		state_shard_expire(state, shard, now);
 	}
 
-	return entry;
-}
-
+	if (!state_entries_reserve(state)) {
+		shard->full++;
+		goto error;
+	}
 
-/*
- *	Find the entry, based on the State attribute.
- */
-static state_entry_t *fr_state_find(fr_state_t *state, const char *server, RADIUS_PACKET *packet)
-{
-	VALUE_PAIR *vp;
-	state_entry_t *entry, my_entry;
+	/*
+	 *	Allocate a new one.
+	 */
+	entry = talloc_zero(shard->tree, state_entry_t);
+	if (!entry) {
+		state_entries_release(state);
+		goto error;
+	}
 
-	vp = fr_pair_find_by_num(packet->vps, PW_STATE, 0, TAG_ANY);
-	if (!vp) return NULL;
+	memcpy(entry->state, my_entry.state, sizeof(entry->state));
+	entry->tries = my_entry.tries;
 
 	/*
-	 *	Assume our own State first.
+	 *	Limit the lifetime of this entry based on how long the
+	 *	server takes to process a request.  Doing it this way
+	 *	isn't perfect, but it's reasonable, and it's one less
+	 *	thing for an administrator to configure.
 	 */
-	if (vp->vp_length == sizeof(my_entry.state)) {
-		memcpy(my_entry.state, vp->vp_octets, sizeof(my_entry.state));
-
-		/*
-		 *	Too big?  Get the MD5 hash, in order
-		 *	to depend on the entire contents of State.
-		 */
-	} else if (vp->vp_length > sizeof(my_entry.state)) {
-		fr_md5_calc(my_entry.state, vp->vp_octets, vp->vp_length);
+	entry->cleanup = now + main_config.max_request_time * 10;
 
-		/*
-		 *	Too small?  Use the whole thing, and
-		 *	set the rest of my_entry.state to zero.
-		 */
-	} else {
-		memcpy(my_entry.state, vp->vp_octets, vp->vp_length);
-		memset(&my_entry.state[vp->vp_length], 0, sizeof(my_entry.state) - vp->vp_length);
+	if (!rbtree_insert(shard->tree, entry)) {
+		talloc_free(entry);
+		state_entries_release(state);
+		goto error;
 	}
 
-	/*	Make unique for different virtual servers handling same request
+	/*
+	 *	Link it to the end of the list, which is implicitely
+	 *	ordered by cleanup time.
 	 */
-	if (server) *((uint32_t *)(&my_entry.state[4])) ^= fr_hash_string(server);
+	if (!shard->head) {
+		entry->prev = entry->next = NULL;
+		shard->head = shard->tail = entry;
+	} else {
+		rad_assert(shard->tail != NULL);
 
-	entry = rbtree_finddata(state->tree, &my_entry);
+		entry->prev = shard->tail;
+		shard->tail->next = entry;
 
-#ifdef WITH_VERIFY_PTR
-	if (entry)  (void) talloc_get_type_abort(entry, state_entry_t);
-#endif
+		entry->next = NULL;
+		shard->tail = entry;
+	}
 
+	*out = shard;
 	return entry;
+
+error:
+	state_shard_unlock(shard);
+	return NULL;
 }
 
 /*
@@ -400,20 +669,17 @@ static state_entry_t *fr_state_find(fr_state_t *state, const char *server, RADIU
 void fr_state_discard(REQUEST *request, RADIUS_PACKET *original)
 {
 	state_entry_t *entry;
+	state_shard_t *shard;
 	fr_state_t *state = &global_state;
 
 	fr_pair_list_free(&request->state);
 	request->state = NULL;
 
-	PTHREAD_MUTEX_LOCK(&state->mutex);
-	entry = fr_state_find(state, request->server, original);
-	if (!entry) {
-		PTHREAD_MUTEX_UNLOCK(&state->mutex);
-		return;
-	}
+	entry = fr_state_find(state, &shard, request->server, original);
+	if (!entry) return;
 
-	state_entry_free(state, entry);
-	PTHREAD_MUTEX_UNLOCK(&state->mutex);
+	state_entry_free(state, shard, entry);
+	state_shard_unlock(shard);
 	return;
 }
 
@@ -423,6 +689,7 @@ void fr_state_discard(REQUEST *request, RADIUS_PACKET *original)
 void fr_state_get_vps(REQUEST *request, RADIUS_PACKET *packet)
 {
 	state_entry_t *entry;
+	state_shard_t *shard;
 	fr_state_t *state = &global_state;
 	TALLOC_CTX *old_ctx = NULL;
 
@@ -436,31 +703,29 @@ void fr_state_get_vps(REQUEST *request, RADIUS_PACKET *packet)
 		return;
 	}
 
-	PTHREAD_MUTEX_LOCK(&state->mutex);
-	entry = fr_state_find(state, request->server, packet);
+	entry = fr_state_find(state, &shard, request->server, packet);
+	if (!entry) {
+		RDEBUG2("session-state: No cached attributes");
+		return;
+	}
 
 	/*
 	 *	This has to be done in a mutex lock, because talloc
 	 *	isn't thread-safe.
 	 */
-	if (entry) {
-		RDEBUG2("Restoring &session-state");
+	RDEBUG2("Restoring &session-state");
 
-		if (request->state_ctx) old_ctx = request->state_ctx;
+	if (request->state_ctx) old_ctx = request->state_ctx;
 
-		request->state_ctx = entry->ctx;
-		request->state = entry->vps;
+	request->state_ctx = entry->ctx;
+	request->state = entry->vps;
 
-		entry->ctx = NULL;
-		entry->vps = NULL;
+	entry->ctx = NULL;
+	entry->vps = NULL;
 
-		rdebug_pair_list(L_DBG_LVL_2, request, request->state, "&session-state:");
+	rdebug_pair_list(L_DBG_LVL_2, request, request->state, "&session-state:");
 
-	} else {
-		RDEBUG2("session-state: No cached attributes");
-	}
-
-	PTHREAD_MUTEX_UNLOCK(&state->mutex);
+	state_shard_unlock(shard);
 
 	/*
 	 *	Free this outside of the mutex for less contention.
@@ -479,7 +744,8 @@ void fr_state_get_vps(REQUEST *request, RADIUS_PACKET *packet)
  */
 bool fr_state_put_vps(REQUEST *request, RADIUS_PACKET *original, RADIUS_PACKET *packet)
 {
-	state_entry_t *entry, *old;
+	state_entry_t *entry, old;
+	state_shard_t *shard;
 	fr_state_t *state = &global_state;
 
 	if (!request->state) {
@@ -513,19 +779,12 @@ bool fr_state_put_vps(REQUEST *request, RADIUS_PACKET *original, RADIUS_PACKET *
 	RDEBUG2("session-state: Saving cached attributes");
 	rdebug_pair_list(L_DBG_LVL_1, request, request->state, NULL);
 
-	PTHREAD_MUTEX_LOCK(&state->mutex);
-
-	if (original) {
-		old = fr_state_find(state, request->server, original);
+	if (fr_state_release(state, &old, request->server, original, NULL)) {
+		entry = fr_state_create(state, &shard, request->server, packet, &old);
 	} else {
-		old = NULL;
-	}
-
-	entry = fr_state_create(state, request->server, packet, old);
-	if (!entry) {
-		PTHREAD_MUTEX_UNLOCK(&state->mutex);
-		return false;
+		entry = fr_state_create(state, &shard, request->server, packet, NULL);
 	}
+	if (!entry) return false;
 
 	rad_assert(entry->ctx == NULL);
 	entry->ctx = request->state_ctx;
@@ -534,7 +793,7 @@ bool fr_state_put_vps(REQUEST *request, RADIUS_PACKET *original, RADIUS_PACKET *
 	request->state_ctx = NULL;
 	request->state = NULL;
 
-	PTHREAD_MUTEX_UNLOCK(&state->mutex);
+	state_shard_unlock(shard);
 
 	VERIFY_REQUEST(request);
 	return true;
@@ -548,18 +807,15 @@ void *fr_state_find_data(fr_state_t *state, REQUEST *request, RADIUS_PACKET *pac
 {
 	void *data;
 	state_entry_t *entry;
+	state_shard_t *shard;
 
 	if (!state) return false;
 
-	PTHREAD_MUTEX_LOCK(&state->mutex);
-	entry = fr_state_find(state, request->server, packet);
-	if (!entry) {
-		PTHREAD_MUTEX_UNLOCK(&state->mutex);
-		return NULL;
-	}
+	entry = fr_state_find(state, &shard, request->server, packet);
+	if (!entry) return NULL;
 
 	data = entry->opaque;
-	PTHREAD_MUTEX_UNLOCK(&state->mutex);
+	state_shard_unlock(shard);
 
 	return data;
 }
@@ -573,19 +829,16 @@ void *fr_state_get_data(fr_state_t *state, REQUEST *request, RADIUS_PACKET *pack
 {
 	void *data;
 	state_entry_t *entry;
+	state_shard_t *shard;
 
 	if (!state) return NULL;
 
-	PTHREAD_MUTEX_LOCK(&state->mutex);
-	entry = fr_state_find(state, request->server, packet);
-	if (!entry) {
-		PTHREAD_MUTEX_UNLOCK(&state->mutex);
-		return NULL;
-	}
+	entry = fr_state_find(state, &shard, request->server, packet);
+	if (!entry) return NULL;
 
 	data = entry->opaque;
 	entry->opaque = NULL;
-	PTHREAD_MUTEX_UNLOCK(&state->mutex);
+	state_shard_unlock(shard);
 
 	return data;
 }
@@ -598,35 +851,51 @@ void *fr_state_get_data(fr_state_t *state, REQUEST *request, RADIUS_PACKET *pack
 bool fr_state_put_data(fr_state_t *state, REQUEST *request, RADIUS_PACKET *original, RADIUS_PACKET *packet,
 		       void *data, void (*free_data)(void *))
 {
-	state_entry_t *entry, *old;
+	state_entry_t *entry, old;
+	state_shard_t *shard;
 
 	if (!state) return false;
 
-	PTHREAD_MUTEX_LOCK(&state->mutex);
-
-	if (original) {
-		old = fr_state_find(state, request->server, original);
+	if (fr_state_release(state, &old, request->server, original, data)) {
+		entry = fr_state_create(state, &shard, request->server, packet, &old);
 	} else {
-		old = NULL;
-	}
-
-	entry = fr_state_create(state, request->server, packet, old);
-	if (!entry) {
-		PTHREAD_MUTEX_UNLOCK(&state->mutex);
-		return false;
-	}
-
-	/*
-	 *	If we're moving the data, ensure that we delete it
-	 *	from the old state.
-	 */
-	if (old && (old->opaque == data)) {
-		old->opaque = NULL;
+		entry = fr_state_create(state, &shard, request->server, packet, NULL);
 	}
+	if (!entry) return false;
 
 	entry->opaque = data;
 	entry->free_opaque = free_data;
 
-	PTHREAD_MUTEX_UNLOCK(&state->mutex);
+	state_shard_unlock(shard);
 	return true;
 }
+
+/*
+ *	Return the occupancy and lock contention of the State table.
+ */
+void fr_state_stats(fr_state_stats_t *stats)
+{
+	fr_state_t *state = &global_state;
+	uint32_t num;
+	int i;
+
+	memset(stats, 0, sizeof(*stats));
+
+	if (!state->shard[0].tree) return;
+
+	stats->shards = STATE_SHARDS;
+
+	for (i = 0; i < STATE_SHARDS; i++) {
+		state_shard_t *shard = &state->shard[i];
+
+		state_shard_lock(shard);
+		num = rbtree_num_elements(shard->tree);
+		stats->entries += num;
+		if (num > stats->max_shard_entries) stats->max_shard_entries = num;
+
+		stats->expired += shard->expired;
+		stats->full += shard->full;
+		stats->contended += shard->contended;
+		state_shard_unlock(shard);
+	}
+}
@@ -25,6 +25,7 @@ RCSID("$Id$")
 
 #include <freeradius-devel/radiusd.h>
 #include <freeradius-devel/rad_assert.h>
+#include <freeradius-devel/modpriv.h>
 
 #ifdef WITH_STATS
 
@@ -36,7 +37,7 @@ static struct timeval	start_time;
 static struct timeval	hup_time;
 
 #define FR_STATS_INIT { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 	\
-				 { 0, 0, 0, 0, 0, 0, 0, 0 }}
+				 { 0, 0, 0, 0, 0, 0, 0, 0 }, { 0, 0, 0, { 0 } }}
 
 fr_stats_t radius_auth_stats = FR_STATS_INIT;
 #ifdef WITH_ACCOUNTING
@@ -61,22 +62,18 @@ fr_stats_t proxy_dsc_stats = FR_STATS_INIT;
 static void stats_time(fr_stats_t *stats, struct timeval *start,
 		       struct timeval *end)
 {
-	struct timeval diff;
 	uint32_t delay;
 
-	if ((start->tv_sec == 0) || (end->tv_sec == 0) ||
-	    (end->tv_sec < start->tv_sec)) return;
+	if (!fr_stats_tv_usec(&delay, start, end)) return;
 
-	rad_tv_sub(end, start, &diff);
+	fr_stats_hist_add(&stats->latency, delay);
 
-	if (diff.tv_sec >= 10) {
+	if (delay >= (10 * USEC)) {
 		stats->elapsed[7]++;
 	} else {
 		int i;
 		uint32_t cmp;
 
-		delay = (diff.tv_sec * USEC) + diff.tv_usec;
-
 		cmp = 10;
 		for (i = 0; i < 7; i++) {
 			if (delay < cmp) {
@@ -441,6 +438,26 @@ static fr_stats2vp client_acctvp[] = {
 };
 #endif
 
+/*
+ *	Add p50, p99 and p999 of a histogram.  The three attributes
+ *	must be numbered consecutively, starting at "attr".
+ */
+static void request_stats_addhist(REQUEST *request, unsigned int attr, fr_stats_hist_t const *hist)
+{
+	VALUE_PAIR *vp;
+
+	if (!hist->count) return;
+
+	vp = radius_pair_create(request->reply, &request->reply->vps, attr, VENDORPEC_FREERADIUS);
+	if (vp) vp->vp_integer = fr_stats_hist_percentile(hist, 50.0);
+
+	vp = radius_pair_create(request->reply, &request->reply->vps, attr + 1, VENDORPEC_FREERADIUS);
+	if (vp) vp->vp_integer = fr_stats_hist_percentile(hist, 99.0);
+
+	vp = radius_pair_create(request->reply, &request->reply->vps, attr + 2, VENDORPEC_FREERADIUS);
+	if (vp) vp->vp_integer = fr_stats_hist_percentile(hist, 99.9);
+}
+
 static void request_stats_addvp(REQUEST *request,
 				fr_stats2vp *table, fr_stats_t *stats)
 {
@@ -456,6 +473,8 @@ static void request_stats_addvp(REQUEST *request,
 		counter = *(uint64_t *) (((uint8_t *) stats) + table[i].offset);
 		vp->vp_integer = counter;
 	}
+
+	request_stats_addhist(request, PW_FREERADIUS_STATS_LATENCY_USEC_P50, &stats->latency);
 }
 
 static void stats_error(REQUEST *request, char const *msg)
@@ -552,9 +571,51 @@ void request_stats_reply(REQUEST *request)
 			if (!vp) continue;
 			vp->vp_integer = pps[i];
 		}
+
+		{
+			fr_stats_hist_t hist;
+
+			fr_stats_latency_merge(&hist, &radius_queue_wait_stats);
+			request_stats_addhist(request, PW_FREERADIUS_STATS_QUEUE_WAIT_USEC_P50, &hist);
+
+			fr_stats_latency_merge(&hist, &radius_processing_stats);
+			request_stats_addhist(request, PW_FREERADIUS_STATS_PROCESSING_USEC_P50, &hist);
+		}
 #endif
 	}
 
+	/*
+	 *	For a particular module.
+	 */
+	if ((flag->vp_integer & 0x100) != 0) {
+		CONF_SECTION *cs;
+		module_instance_t *mi = NULL;
+		fr_stats_hist_t hist;
+
+		vp = fr_pair_find_by_num(request->packet->vps, PW_FREERADIUS_STATS_MODULE_NAME, VENDORPEC_FREERADIUS, TAG_ANY);
+		if (!vp) {
+			stats_error(request, "No module name supplied");
+			return;
+		}
+
+		cs = cf_section_find("modules");
+		if (cs) mi = module_find(cs, vp->vp_strvalue);
+		if (!mi) {
+			stats_error(request, "No such module");
+			return;
+		}
+
+		fr_pair_add(&request->reply->vps, fr_pair_copy(request->reply, vp));
+
+		fr_stats_latency_merge(&hist, &mi->stats);
+
+		vp = radius_pair_create(request->reply, &request->reply->vps,
+				       PW_FREERADIUS_STATS_LATENCY_SAMPLES, VENDORPEC_FREERADIUS);
+		if (vp) vp->vp_integer = hist.count;
+
+		request_stats_addhist(request, PW_FREERADIUS_STATS_LATENCY_USEC_P50, &hist);
+	}
+
 	/*
 	 *	For a particular client.
 	 */
@@ -379,6 +379,10 @@ int request_enqueue(REQUEST *request)
 
 	rad_assert(pool_initialized == true);
 
+#ifdef WITH_STATS
+	gettimeofday(&request->queued, NULL);
+#endif
+
 	/*
 	 *	If we haven't checked the number of child threads
 	 *	in a while, OR if the thread pool appears to be full,
@@ -741,6 +745,11 @@ retry:
 static void *request_handler_thread(void *arg)
 {
 	THREAD_HANDLE *self = (THREAD_HANDLE *) arg;
+#ifdef WITH_STATS
+	struct timeval start, end;
+
+	radius_stats_thread_init(self->thread_num);
+#endif
 
 	/*
 	 *	Loop forever, until told to exit.
@@ -823,9 +832,19 @@ static void *request_handler_thread(void *arg)
 #endif
 #endif
 
+#ifdef WITH_STATS
+		gettimeofday(&start, NULL);
+		fr_stats_latency_add(&radius_queue_wait_stats, &self->request->queued, &start);
+#endif
+
 		self->request->process(self->request, FR_ACTION_RUN);
 		self->request = NULL;
 
+#ifdef WITH_STATS
+		gettimeofday(&end, NULL);
+		fr_stats_latency_add(&radius_processing_stats, &start, &end);
+#endif
+
 #ifdef HAVE_STDATOMIC_H
 		CAS_DECR(thread_pool.active_threads);
 #else
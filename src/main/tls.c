@@ -42,6 +42,10 @@ USES_APPLE_DEPRECATED_API	/* OpenSSL API has been deprecated by Apple */
 #endif
 #include <ctype.h>
 
+#ifdef HAVE_DIRENT_H
+#include <dirent.h>
+#endif
+
 #ifdef WITH_TLS
 #  ifdef HAVE_OPENSSL_RAND_H
 #    include <openssl/rand.h>
@@ -538,6 +542,12 @@ tls_session_t *tls_new_client_session(TALLOC_CTX *ctx, fr_tls_server_conf_t *con
 	SSL_set_ex_data(ssn->ssl, FR_TLS_EX_INDEX_SSN, (void *)ssn);
 	if (certs) SSL_set_ex_data(ssn->ssl, fr_tls_ex_index_certs, (void *)certs);
 	SSL_set_fd(ssn->ssl, fd);
+#ifdef SSL_OP_ENABLE_KTLS
+	if (conf->ktls) {
+		SSL_set_options(ssn->ssl, SSL_OP_ENABLE_KTLS);
+		ssn->ktls = true;
+	}
+#endif
 	ret = SSL_connect(ssn->ssl);
 
 	if (ret < 0) {
@@ -562,10 +572,147 @@ tls_session_t *tls_new_client_session(TALLOC_CTX *ctx, fr_tls_server_conf_t *con
 	}
 
 	ssn->connected = true;
+	tls_session_ktls_account(NULL, ssn);
+
 	return ssn;
 }
 
 
+/*
+ *	Counters for connections which asked for kernel TLS.
+ */
+static fr_tls_ktls_stats_t ktls_stats;
+
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t ktls_stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+#  define KTLS_STATS_LOCK	pthread_mutex_lock(&ktls_stats_mutex)
+#  define KTLS_STATS_UNLOCK	pthread_mutex_unlock(&ktls_stats_mutex)
+#else
+#  define KTLS_STATS_LOCK
+#  define KTLS_STATS_UNLOCK
+#endif
+
+/** Have OpenSSL read and write the socket itself, so that it can use kernel TLS
+ *
+ * Replaces the memory BIOs created by tls_new_session() with a socket BIO.
+ * OpenSSL only moves record encryption into the kernel when it owns the
+ * socket.  Whether it does so is decided when the handshake finishes.  If
+ * the kernel, cipher or protocol version isn't supported, OpenSSL does the
+ * crypto itself, as before.
+ *
+ * The socket is made non-blocking, so that a partial record can't stall
+ * the caller.
+ *
+ * @param ssn to change.  Must not have started the handshake.
+ * @param fd of the connected socket.
+ * @return 0 on success, -1 on error.
+ */
+int tls_session_ktls(tls_session_t *ssn, int fd)
+{
+#ifdef SSL_OP_ENABLE_KTLS
+	if (fr_nonblock(fd) < 0) {
+		ERROR(LOG_PREFIX ": Failed setting non-blocking on socket: %s", fr_syserror(errno));
+		return -1;
+	}
+
+	/*
+	 *	Frees the memory BIOs.
+	 */
+	if (!SSL_set_fd(ssn->ssl, fd)) {
+		tls_error_log(NULL, "Failed setting socket for TLS session");
+		return -1;
+	}
+	ssn->into_ssl = ssn->from_ssl = NULL;
+
+	SSL_set_options(ssn->ssl, SSL_OP_ENABLE_KTLS);
+	ssn->ktls = true;
+
+	return 0;
+#else
+	fr_strerror_printf("Kernel TLS is not supported by this version of OpenSSL");
+	return -1;
+#endif
+}
+
+/** Record whether OpenSSL moved the record encryption into the kernel
+ *
+ * Should be called once, after the handshake has finished.
+ */
+void tls_session_ktls_account(REQUEST *request, tls_session_t *ssn)
+{
+	bool send = false, recv = false;
+
+	if (!ssn->ktls) return;
+
+#ifdef SSL_OP_ENABLE_KTLS
+	send = BIO_get_ktls_send(SSL_get_wbio(ssn->ssl));
+	recv = BIO_get_ktls_recv(SSL_get_rbio(ssn->ssl));
+#endif
+
+	KTLS_STATS_LOCK;
+	ktls_stats.connections++;
+	if (send) ktls_stats.send++;
+	if (recv) ktls_stats.recv++;
+	if (!send && !recv) ktls_stats.fallback++;
+	KTLS_STATS_UNLOCK;
+
+	if (request) {
+		RDEBUG2("TLS - Kernel TLS send %s, receive %s", send ? "enabled" : "disabled",
+			recv ? "enabled" : "disabled");
+	} else {
+		DEBUG2(LOG_PREFIX ": Kernel TLS send %s, receive %s", send ? "enabled" : "disabled",
+		       recv ? "enabled" : "disabled");
+	}
+}
+
+/** Wait for a socket which OpenSSL reads and writes itself
+ *
+ * SSL_write() returned WANT_READ or WANT_WRITE.  Wait for the socket
+ * to become ready, for at most TLS_WRITE_TIMEOUT since "start", so
+ * that the caller can retry the write with the same data.
+ *
+ * @param fd which the session reads and writes.
+ * @param ssl_error from SSL_get_error().
+ * @param start when the caller first tried to write the data.
+ * @return true if the write should be retried, false on timeout.
+ */
+bool tls_socket_write_wait(int fd, int ssl_error, struct timeval const *start)
+{
+	int rcode;
+	fd_set fds;
+	struct timeval now, elapsed, tv;
+
+	for (;;) {
+		gettimeofday(&now, NULL);
+		rad_tv_sub(&now, start, &elapsed);
+		if ((elapsed.tv_sec > 0) || (elapsed.tv_usec >= TLS_WRITE_TIMEOUT)) return false;
+
+		FD_ZERO(&fds);
+		FD_SET(fd, &fds);
+		tv.tv_sec = 0;
+		tv.tv_usec = TLS_WRITE_TIMEOUT - elapsed.tv_usec;
+
+		if (ssl_error == SSL_ERROR_WANT_READ) {
+			rcode = select(fd + 1, &fds, NULL, NULL, &tv);
+		} else {
+			rcode = select(fd + 1, NULL, &fds, NULL, &tv);
+		}
+		if ((rcode < 0) && (errno == EINTR)) continue;
+
+		return (rcode > 0);
+	}
+}
+
+/** Return a snapshot of the kernel TLS counters
+ *
+ */
+void tls_ktls_stats(fr_tls_ktls_stats_t *stats)
+{
+	KTLS_STATS_LOCK;
+	*stats = ktls_stats;
+	KTLS_STATS_UNLOCK;
+}
+
 /** Create a new TLS session
  *
  * Configures a new TLS session, configuring options, setting callbacks etc...
@@ -1227,6 +1374,10 @@ static CONF_PARSER ocsp_config[] = {
 	{ "use_nonce", FR_CONF_OFFSET(PW_TYPE_BOOLEAN, fr_tls_server_conf_t, ocsp_use_nonce), "yes" },
 	{ "timeout", FR_CONF_OFFSET(PW_TYPE_INTEGER, fr_tls_server_conf_t, ocsp_timeout), "yes" },
 	{ "softfail", FR_CONF_OFFSET(PW_TYPE_BOOLEAN, fr_tls_server_conf_t, ocsp_softfail), "no" },
+	{ "cache", FR_CONF_OFFSET(PW_TYPE_BOOLEAN, fr_tls_server_conf_t, ocsp_cache_enable), "no" },
+	{ "cache_lifetime", FR_CONF_OFFSET(PW_TYPE_INTEGER, fr_tls_server_conf_t, ocsp_cache_lifetime), "3600" },
+	{ "cache_refresh", FR_CONF_OFFSET(PW_TYPE_INTEGER, fr_tls_server_conf_t, ocsp_cache_refresh), "0" },
+	{ "cache_max_entries", FR_CONF_OFFSET(PW_TYPE_INTEGER, fr_tls_server_conf_t, ocsp_cache_max_entries), "16384" },
 	CONF_PARSER_TERMINATOR
 };
 #endif
@@ -1257,11 +1408,14 @@ static CONF_PARSER tls_server_config[] = {
 	{ "check_all_crl", FR_CONF_OFFSET(PW_TYPE_BOOLEAN, fr_tls_server_conf_t, check_all_crl), "no" },
 #endif
 	{ "allow_expired_crl", FR_CONF_OFFSET(PW_TYPE_BOOLEAN, fr_tls_server_conf_t, allow_expired_crl), NULL },
+	{ "crl_index", FR_CONF_OFFSET(PW_TYPE_BOOLEAN, fr_tls_server_conf_t, crl_index_enable), "no" },
+	{ "crl_reload_interval", FR_CONF_OFFSET(PW_TYPE_INTEGER, fr_tls_server_conf_t, crl_reload_interval), "0" },
 	{ "check_cert_cn", FR_CONF_OFFSET(PW_TYPE_STRING, fr_tls_server_conf_t, check_cert_cn), NULL },
 	{ "cipher_list", FR_CONF_OFFSET(PW_TYPE_STRING, fr_tls_server_conf_t, cipher_list), NULL },
 	{ "cipher_server_preference", FR_CONF_OFFSET(PW_TYPE_BOOLEAN, fr_tls_server_conf_t, cipher_server_preference), NULL },
 	{ "check_cert_issuer", FR_CONF_OFFSET(PW_TYPE_STRING, fr_tls_server_conf_t, check_cert_issuer), NULL },
 	{ "require_client_cert", FR_CONF_OFFSET(PW_TYPE_BOOLEAN, fr_tls_server_conf_t, require_client_cert), NULL },
+	{ "ktls", FR_CONF_OFFSET(PW_TYPE_BOOLEAN, fr_tls_server_conf_t, ktls), "no" },
 
 #if OPENSSL_VERSION_NUMBER >= 0x0090800fL
 #ifndef OPENSSL_NO_ECDH
@@ -1312,6 +1466,7 @@ static CONF_PARSER tls_client_config[] = {
 	{ "check_cert_cn", FR_CONF_OFFSET(PW_TYPE_STRING, fr_tls_server_conf_t, check_cert_cn), NULL },
 	{ "cipher_list", FR_CONF_OFFSET(PW_TYPE_STRING, fr_tls_server_conf_t, cipher_list), NULL },
 	{ "check_cert_issuer", FR_CONF_OFFSET(PW_TYPE_STRING, fr_tls_server_conf_t, check_cert_issuer), NULL },
+	{ "ktls", FR_CONF_OFFSET(PW_TYPE_BOOLEAN, fr_tls_server_conf_t, ktls), "no" },
 
 #if OPENSSL_VERSION_NUMBER >= 0x0090800fL
 #ifndef OPENSSL_NO_ECDH
@@ -1778,11 +1933,228 @@ static int ocsp_parse_cert_url(X509 *cert, char **host_out, char **port_out,
 /* Maximum leeway in validity period: default 5 minutes */
 #define MAX_VALIDITY_PERIOD     (5 * 60)
 
-typedef enum {
-	OCSP_STATUS_FAILED	= 0,
-	OCSP_STATUS_OK		= 1,
-	OCSP_STATUS_SKIPPED	= 2,
-} ocsp_status_t;
+/*
+ *	Responses are cached by the DER encoding of the OCSP_CERTID,
+ *	which identifies the issuer and the certificate serial number.
+ */
+#define OCSP_CACHE_KEY_MAX	256
+
+typedef struct ocsp_cache_entry {
+	uint8_t		key[OCSP_CACHE_KEY_MAX];
+	size_t		key_len;
+
+	ocsp_status_t	status;		//!< OCSP_STATUS_OK or OCSP_STATUS_FAILED.
+	time_t		expires;	//!< nextUpdate, or cache_lifetime if that's sooner.
+	uint32_t	hits;		//!< Since the response was fetched.
+	bool		refreshing;	//!< A request is fetching a new response.
+
+	int		heap;		//!< For the expiry heap.
+} ocsp_cache_entry_t;
+
+#ifdef HAVE_PTHREAD_H
+#  define OCSP_CACHE_LOCK(_conf)	pthread_mutex_lock(&(_conf)->ocsp_cache_mutex)
+#  define OCSP_CACHE_UNLOCK(_conf)	pthread_mutex_unlock(&(_conf)->ocsp_cache_mutex)
+#else
+#  define OCSP_CACHE_LOCK(_conf)
+#  define OCSP_CACHE_UNLOCK(_conf)
+#endif
+
+static uint32_t ocsp_cache_hash(void const *data)
+{
+	ocsp_cache_entry_t const *entry = data;
+
+	return fr_hash(entry->key, entry->key_len);
+}
+
+static int ocsp_cache_cmp(void const *one, void const *two)
+{
+	ocsp_cache_entry_t const *a = one;
+	ocsp_cache_entry_t const *b = two;
+
+	if (a->key_len != b->key_len) return a->key_len - b->key_len;
+
+	return memcmp(a->key, b->key, a->key_len);
+}
+
+static int ocsp_cache_heap_cmp(void const *one, void const *two)
+{
+	ocsp_cache_entry_t const *a = one;
+	ocsp_cache_entry_t const *b = two;
+
+	if (a->expires < b->expires) return -1;
+	if (a->expires > b->expires) return +1;
+
+	return 0;
+}
+
+static void _ocsp_cache_entry_free(void *data)
+{
+	talloc_free(data);
+}
+
+/** Remove an entry from the cache, and free it
+ *
+ * Must be called with the cache locked.
+ */
+static void ocsp_cache_delete(fr_tls_server_conf_t *conf, ocsp_cache_entry_t *entry)
+{
+	fr_heap_extract(conf->ocsp_cache_heap, entry);
+	fr_hash_table_delete(conf->ocsp_cache, entry);
+}
+
+/** Create the cache of OCSP responses
+ *
+ * @param conf the TLS configuration.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int tls_ocsp_cache_init(fr_tls_server_conf_t *conf)
+{
+	conf->ocsp_cache = fr_hash_table_create(ocsp_cache_hash, ocsp_cache_cmp, _ocsp_cache_entry_free);
+	if (!conf->ocsp_cache) {
+		ERROR(LOG_PREFIX ": Failed creating OCSP cache");
+		return -1;
+	}
+
+	conf->ocsp_cache_heap = fr_heap_create(ocsp_cache_heap_cmp, offsetof(ocsp_cache_entry_t, heap));
+	if (!conf->ocsp_cache_heap) {
+		ERROR(LOG_PREFIX ": Failed creating OCSP cache");
+		return -1;
+	}
+
+#ifdef HAVE_PTHREAD_H
+	if (pthread_mutex_init(&conf->ocsp_cache_mutex, NULL) < 0) {
+		ERROR(LOG_PREFIX ": Failed initializing mutex: %s", fr_syserror(errno));
+		return -1;
+	}
+#endif
+
+	return 0;
+}
+
+/** Find a cached response for a certificate
+ *
+ * If the response expires within cache_refresh seconds, and it's been
+ * used since it was fetched, the first caller to see it is told to
+ * fetch a new one.  Everyone else continues using the cached response
+ * until the new one arrives.
+ *
+ * @param request The current request.
+ * @param conf the TLS configuration.
+ * @param key DER encoded OCSP_CERTID.
+ * @param key_len Length of the key.
+ * @param out Where to write the cached status.
+ * @return
+ *	- true if a response was found.
+ *	- false if the caller should query the responder.
+ */
+bool tls_ocsp_cache_find(REQUEST *request, fr_tls_server_conf_t *conf,
+			 uint8_t const *key, size_t key_len, ocsp_status_t *out)
+{
+	ocsp_cache_entry_t	find, *entry;
+	time_t			now = time(NULL);
+
+	memcpy(find.key, key, key_len);
+	find.key_len = key_len;
+
+	OCSP_CACHE_LOCK(conf);
+	entry = fr_hash_table_finddata(conf->ocsp_cache, &find);
+	if (entry && (entry->expires <= now)) {
+		ocsp_cache_delete(conf, entry);
+		entry = NULL;
+	}
+
+	if (!entry) {
+		conf->ocsp_cache_misses++;
+		OCSP_CACHE_UNLOCK(conf);
+
+		RDEBUG2("ocsp: No cached response");
+		return false;
+	}
+
+	if (conf->ocsp_cache_refresh && entry->hits && !entry->refreshing &&
+	    ((entry->expires - now) <= (time_t) conf->ocsp_cache_refresh)) {
+		entry->refreshing = true;
+		OCSP_CACHE_UNLOCK(conf);
+
+		RDEBUG2("ocsp: Cached response expires in %d seconds, refreshing it", (int) (entry->expires - now));
+		return false;
+	}
+
+	entry->hits++;
+	conf->ocsp_cache_hits++;
+	*out = entry->status;
+
+	RDEBUG2("ocsp: Using cached response, expires in %d seconds (cache hits %" PRIu64 ", misses %" PRIu64 ")",
+		(int) (entry->expires - now), conf->ocsp_cache_hits, conf->ocsp_cache_misses);
+	OCSP_CACHE_UNLOCK(conf);
+
+	return true;
+}
+
+/** Cache a response, or note that we failed to get one
+ *
+ * Expired responses are removed first.  If the cache is still full,
+ * the response which expires soonest is removed to make room.
+ *
+ * @param conf the TLS configuration.
+ * @param key DER encoded OCSP_CERTID.
+ * @param key_len Length of the key.
+ * @param status of the certificate.
+ * @param expires When the response should no longer be used.  0 if
+ *	there's no response to cache.
+ */
+void tls_ocsp_cache_update(fr_tls_server_conf_t *conf, uint8_t const *key, size_t key_len,
+			   ocsp_status_t status, time_t expires)
+{
+	ocsp_cache_entry_t	find, *entry;
+	time_t			now = time(NULL);
+
+	memcpy(find.key, key, key_len);
+	find.key_len = key_len;
+
+	OCSP_CACHE_LOCK(conf);
+	entry = fr_hash_table_finddata(conf->ocsp_cache, &find);
+	if (!expires) {
+		if (entry) entry->refreshing = false;
+		goto done;
+	}
+
+	if (entry) {
+		fr_heap_extract(conf->ocsp_cache_heap, entry);
+	} else {
+		ocsp_cache_entry_t *old;
+
+		while ((old = fr_heap_peek(conf->ocsp_cache_heap)) != NULL) {
+			if ((old->expires > now) &&
+			    ((uint32_t) fr_heap_num_elements(conf->ocsp_cache_heap) < conf->ocsp_cache_max_entries)) break;
+
+			ocsp_cache_delete(conf, old);
+		}
+
+		entry = talloc_zero(NULL, ocsp_cache_entry_t);
+		if (!entry) goto done;
+
+		memcpy(entry->key, key, key_len);
+		entry->key_len = key_len;
+
+		if (!fr_hash_table_insert(conf->ocsp_cache, entry)) {
+			talloc_free(entry);
+			goto done;
+		}
+	}
+
+	entry->status = status;
+	entry->expires = expires;
+	entry->hits = 0;
+	entry->refreshing = false;
+
+	if (fr_heap_insert(conf->ocsp_cache_heap, entry) == 0) fr_hash_table_delete(conf->ocsp_cache, entry);
+
+done:
+	OCSP_CACHE_UNLOCK(conf);
+}
 
 static ocsp_status_t ocsp_check(REQUEST *request, X509_STORE *store, X509 *issuer_cert, X509 *client_cert,
 				fr_tls_server_conf_t *conf)
@@ -1809,16 +2181,44 @@ static ocsp_status_t ocsp_check(REQUEST *request, X509_STORE *store, X509 *issue
 	struct timeval	when;
 #endif
 	VALUE_PAIR	*vp;
+	uint8_t		key[OCSP_CACHE_KEY_MAX];
+	int		key_len = 0;
+	time_t		expires = 0;
 
 	if (issuer_cert == NULL) {
 		RWDEBUG("Could not get issuer certificate");
 		goto skipped;
 	}
 
+	certid = OCSP_cert_to_id(NULL, client_cert, issuer_cert);
+
+	/*
+	 *	Check for a cached response before going to the network.
+	 */
+	if (conf->ocsp_cache && certid) {
+		key_len = i2d_OCSP_CERTID(certid, NULL);
+		if ((key_len > 0) && (key_len <= (int) sizeof(key))) {
+			uint8_t *p = key;
+
+			i2d_OCSP_CERTID(certid, &p);
+			if (tls_ocsp_cache_find(request, conf, key, key_len, &ocsp_status)) {
+				OCSP_CERTID_free(certid);
+				key_len = 0;
+
+				if (ocsp_status == OCSP_STATUS_OK) {
+					vp = pair_make_request("TLS-OCSP-Cert-Valid", NULL, T_OP_SET);
+					vp->vp_integer = 1;	/* yes */
+				}
+				goto ocsp_cached;
+			}
+		} else {
+			key_len = 0;
+		}
+	}
+
 	/*
 	 * Create OCSP Request
 	 */
-	certid = OCSP_cert_to_id(NULL, client_cert, issuer_cert);
 	req = OCSP_REQUEST_new();
 	OCSP_request_add0_id(req, certid);
 	if (conf->ocsp_use_nonce) OCSP_request_add1_nonce(req, NULL, 8);
@@ -1996,6 +2396,25 @@ static ocsp_status_t ocsp_check(REQUEST *request, X509_STORE *store, X509 *issue
 		}
 	}
 
+	/*
+	 *	Work out how long the response may be cached for.
+	 */
+	if (key_len) {
+		expires = time(NULL) + conf->ocsp_cache_lifetime;
+
+#if OPENSSL_VERSION_NUMBER >= 0x10002000L
+		if (nextupd) {
+			int days, secs;
+
+			if (ASN1_TIME_diff(&days, &secs, NULL, nextupd)) {
+				time_t next = time(NULL) + (days * 86400) + secs;
+
+				if (next < expires) expires = next;
+			}
+		}
+#endif
+	}
+
 	switch (status) {
 	case V_OCSP_CERTSTATUS_GOOD:
 		RDEBUG2("ocsp: Cert status: good");
@@ -2028,6 +2447,7 @@ ocsp_end:
 	if (bio_out) BIO_free(bio_out);
 	OCSP_BASICRESP_free(bresp);
 
+ocsp_cached:
 	switch (ocsp_status) {
 	case OCSP_STATUS_OK:
 		RDEBUG2("ocsp: Certificate is valid");
@@ -2058,10 +2478,461 @@ ocsp_end:
 		break;
 	}
 
+	if (key_len) tls_ocsp_cache_update(conf, key, key_len, ocsp_status, expires);
+
 	return ocsp_status;
 }
 #endif	/* HAVE_OPENSSL_OCSP_H */
 
+#ifdef WITH_CRL_INDEX
+/*
+ *	Revoked serial numbers, indexed by the issuer of the CRL.
+ *
+ *	When the CRLs change a new index is built, and swapped in
+ *	under the write lock, so handshakes only ever see a complete
+ *	index.
+ */
+typedef struct tls_crl_serial {
+	uint8_t const		*data;
+	size_t			len;
+} tls_crl_serial_t;
+
+typedef struct tls_crl_issuer {
+	X509_NAME		*name;
+	uint32_t		hash;		//!< Of the canonical issuer name.
+	time_t			this_update;
+	time_t			next_update;	//!< 0 if the CRL didn't specify one.
+	fr_hash_table_t		*serials;	//!< Revoked serial numbers.
+} tls_crl_issuer_t;
+
+typedef struct tls_crl_index {
+	fr_hash_table_t		*issuers;
+
+	time_t			mtime;		//!< Newest of the files the index was built from.
+	uint32_t		num_files;	//!< Number of files the index was built from.
+	off_t			size;		//!< Total size of the files.
+} tls_crl_index_t;
+
+#ifdef HAVE_PTHREAD_H
+#  define CRL_INDEX_RDLOCK(_conf)	pthread_rwlock_rdlock(&(_conf)->crl_index_lock)
+#  define CRL_INDEX_WRLOCK(_conf)	pthread_rwlock_wrlock(&(_conf)->crl_index_lock)
+#  define CRL_INDEX_UNLOCK(_conf)	pthread_rwlock_unlock(&(_conf)->crl_index_lock)
+#else
+#  define CRL_INDEX_RDLOCK(_conf)
+#  define CRL_INDEX_WRLOCK(_conf)
+#  define CRL_INDEX_UNLOCK(_conf)
+#endif
+
+static uint32_t crl_serial_hash(void const *data)
+{
+	tls_crl_serial_t const *serial = data;
+
+	return fr_hash(serial->data, serial->len);
+}
+
+static int crl_serial_cmp(void const *one, void const *two)
+{
+	tls_crl_serial_t const *a = one;
+	tls_crl_serial_t const *b = two;
+
+	if (a->len != b->len) return a->len - b->len;
+
+	return memcmp(a->data, b->data, a->len);
+}
+
+static uint32_t crl_issuer_hash(void const *data)
+{
+	tls_crl_issuer_t const *issuer = data;
+
+	return issuer->hash;
+}
+
+static int crl_issuer_cmp(void const *one, void const *two)
+{
+	tls_crl_issuer_t const *a = one;
+	tls_crl_issuer_t const *b = two;
+
+	return X509_NAME_cmp(a->name, b->name);
+}
+
+static int _crl_issuer_free(tls_crl_issuer_t *issuer)
+{
+	if (issuer->serials) fr_hash_table_free(issuer->serials);
+	if (issuer->name) X509_NAME_free(issuer->name);
+
+	return 0;
+}
+
+static void _crl_issuer_table_free(void *data)
+{
+	talloc_free(data);
+}
+
+static int _crl_index_free(tls_crl_index_t *index)
+{
+	if (index->issuers) fr_hash_table_free(index->issuers);
+
+	return 0;
+}
+
+/** Convert an ASN1_TIME to a time_t, 0 if there isn't one
+ *
+ */
+static time_t crl_time(ASN1_TIME const *asn1)
+{
+	int days, secs;
+
+	if (!asn1 || !ASN1_TIME_diff(&days, &secs, NULL, asn1)) return 0;
+
+	return time(NULL) + ((time_t) days * 86400) + secs;
+}
+
+/** Add the serials revoked by a CRL to the index
+ *
+ * The CRL must be signed by one of the CAs we trust.  If there are
+ * multiple CRLs from the same issuer, the most recent one is used.
+ */
+static void crl_index_add(fr_tls_server_conf_t *conf, tls_crl_index_t *index, X509_CRL *crl, char const *file)
+{
+	X509_STORE_CTX		*store_ctx;
+	X509_OBJECT		*obj = NULL;
+	STACK_OF(X509_REVOKED)	*revoked;
+	tls_crl_issuer_t	find, *issuer;
+	tls_crl_serial_t	*serials;
+	uint8_t			*p;
+	size_t			total = 0;
+	time_t			this_update;
+	int			i, num;
+	bool			verified = false;
+
+	if (X509_CRL_get_ext_by_NID(crl, NID_delta_crl, -1) >= 0) {
+		WARN(LOG_PREFIX ": Ignoring delta CRL in %s", file);
+		return;
+	}
+
+	store_ctx = X509_STORE_CTX_new();
+	if (store_ctx && X509_STORE_CTX_init(store_ctx, SSL_CTX_get_cert_store(conf->ctx), NULL, NULL)) {
+		obj = X509_STORE_CTX_get_obj_by_subject(store_ctx, X509_LU_X509, X509_CRL_get_issuer(crl));
+	}
+	if (obj) {
+		verified = (X509_CRL_verify(crl, X509_get0_pubkey(X509_OBJECT_get0_X509(obj))) == 1);
+		X509_OBJECT_free(obj);
+	}
+	X509_STORE_CTX_free(store_ctx);
+
+	if (!verified) {
+		WARN(LOG_PREFIX ": Ignoring CRL in %s, it is not signed by a trusted CA", file);
+		ERR_clear_error();
+		return;
+	}
+
+	memset(&find, 0, sizeof(find));
+	find.name = X509_CRL_get_issuer(crl);
+	find.hash = X509_NAME_hash(find.name);
+	this_update = crl_time(X509_CRL_get0_lastUpdate(crl));
+
+	issuer = fr_hash_table_finddata(index->issuers, &find);
+	if (issuer) {
+		if (issuer->this_update >= this_update) return;
+
+		fr_hash_table_delete(index->issuers, issuer);
+	}
+
+	issuer = talloc_zero(index, tls_crl_issuer_t);
+	if (!issuer) return;
+	talloc_set_destructor(issuer, _crl_issuer_free);
+
+	issuer->name = X509_NAME_dup(find.name);
+	issuer->hash = find.hash;
+	issuer->this_update = this_update;
+	issuer->next_update = crl_time(X509_CRL_get0_nextUpdate(crl));
+	issuer->serials = fr_hash_table_create(crl_serial_hash, crl_serial_cmp, NULL);
+	if (!issuer->name || !issuer->serials) goto error;
+
+	/*
+	 *	Large CRLs have hundreds of thousands of entries, so
+	 *	allocate the serials as two arrays, not one chunk each.
+	 */
+	revoked = X509_CRL_get_REVOKED(crl);
+	num = sk_X509_REVOKED_num(revoked);
+	for (i = 0; i < num; i++) {
+		total += ASN1_STRING_length(X509_REVOKED_get0_serialNumber(sk_X509_REVOKED_value(revoked, i)));
+	}
+
+	if (num > 0) {
+		serials = talloc_array(issuer, tls_crl_serial_t, num);
+		p = talloc_array(issuer, uint8_t, total);
+		if (!serials || !p) goto error;
+
+		for (i = 0; i < num; i++) {
+			ASN1_INTEGER const *sn = X509_REVOKED_get0_serialNumber(sk_X509_REVOKED_value(revoked, i));
+
+			serials[i].len = ASN1_STRING_length(sn);
+			memcpy(p, ASN1_STRING_get0_data(sn), serials[i].len);
+			serials[i].data = p;
+			p += serials[i].len;
+
+			if (!fr_hash_table_replace(issuer->serials, &serials[i])) goto error;
+		}
+	}
+
+	if (!fr_hash_table_insert(index->issuers, issuer)) {
+	error:
+		ERROR(LOG_PREFIX ": Failed adding CRL in %s to the index", file);
+		talloc_free(issuer);
+		return;
+	}
+}
+
+/** Add any CRLs in a PEM file to the index
+ *
+ */
+static void crl_index_load_file(fr_tls_server_conf_t *conf, tls_crl_index_t *index, char const *file)
+{
+	BIO			*bio;
+	STACK_OF(X509_INFO)	*infos;
+	int			i;
+
+	bio = BIO_new_file(file, "r");
+	if (!bio) {
+		ERR_clear_error();
+		return;
+	}
+
+	infos = PEM_X509_INFO_read_bio(bio, NULL, NULL, NULL);
+	BIO_free(bio);
+	if (!infos) {
+		ERR_clear_error();
+		return;
+	}
+
+	for (i = 0; i < sk_X509_INFO_num(infos); i++) {
+		X509_INFO *info = sk_X509_INFO_value(infos, i);
+
+		if (info->crl) crl_index_add(conf, index, info->crl, file);
+	}
+
+	sk_X509_INFO_pop_free(infos, X509_INFO_free);
+}
+
+/** Look at every file which may contain CRLs, optionally loading them
+ *
+ * That's ca_file, and every regular file in ca_path.
+ *
+ * @param[in] conf the TLS configuration.
+ * @param[out] out Where to record the newest mtime, total size and number of files.
+ * @param[in] load If true, add the CRLs in the files to out.
+ */
+static void crl_index_sources(fr_tls_server_conf_t *conf, tls_crl_index_t *out, bool load)
+{
+	struct stat	st;
+
+	out->mtime = 0;
+	out->num_files = 0;
+	out->size = 0;
+
+#define CRL_SOURCE(_file) do { \
+		if (st.st_mtime > out->mtime) out->mtime = st.st_mtime; \
+		out->num_files++; \
+		out->size += st.st_size; \
+		if (load) crl_index_load_file(conf, out, _file); \
+	} while (0)
+
+	if (conf->ca_file && (stat(conf->ca_file, &st) == 0)) CRL_SOURCE(conf->ca_file);
+
+#ifdef HAVE_DIRENT_H
+	if (conf->ca_path) {
+		DIR		*dir;
+		struct dirent	*dp;
+		char		path[PATH_MAX];
+
+		dir = opendir(conf->ca_path);
+		if (!dir) return;
+
+		while ((dp = readdir(dir)) != NULL) {
+			if (dp->d_name[0] == '.') continue;
+
+			snprintf(path, sizeof(path), "%s/%s", conf->ca_path, dp->d_name);
+			if ((stat(path, &st) < 0) || !S_ISREG(st.st_mode)) continue;
+
+			CRL_SOURCE(path);
+		}
+		closedir(dir);
+	}
+#endif
+#undef CRL_SOURCE
+}
+
+/** Build a new index from the CRLs in ca_file and ca_path
+ *
+ */
+static tls_crl_index_t *crl_index_build(fr_tls_server_conf_t *conf)
+{
+	tls_crl_index_t *index;
+
+	index = talloc_zero(NULL, tls_crl_index_t);
+	if (!index) return NULL;
+	talloc_set_destructor(index, _crl_index_free);
+
+	index->issuers = fr_hash_table_create(crl_issuer_hash, crl_issuer_cmp, _crl_issuer_table_free);
+	if (!index->issuers) {
+		talloc_free(index);
+		return NULL;
+	}
+
+	crl_index_sources(conf, index, true);
+
+	INFO(LOG_PREFIX ": Loaded CRLs for %i issuers from %u files",
+	     fr_hash_table_num_elements(index->issuers), index->num_files);
+
+	return index;
+}
+
+/** Check a certificate against the CRL index
+ *
+ * @param conf the TLS configuration.
+ * @param cert to check.
+ * @return X509_V_OK if the certificate hasn't been revoked, else an X509_V_ERR_* code.
+ */
+int tls_crl_index_check(fr_tls_server_conf_t *conf, X509 *cert)
+{
+	tls_crl_issuer_t	find, *issuer;
+	tls_crl_serial_t	serial;
+	ASN1_INTEGER const	*sn;
+	int			err = X509_V_ERR_UNABLE_TO_GET_CRL;
+
+	memset(&find, 0, sizeof(find));
+	find.name = X509_get_issuer_name(cert);
+	find.hash = X509_NAME_hash(find.name);
+
+	sn = X509_get0_serialNumber(cert);
+	serial.data = ASN1_STRING_get0_data(sn);
+	serial.len = ASN1_STRING_length(sn);
+
+	CRL_INDEX_RDLOCK(conf);
+	issuer = fr_hash_table_finddata(conf->crl_index->issuers, &find);
+	if (issuer) {
+		if (fr_hash_table_finddata(issuer->serials, &serial)) {
+			err = X509_V_ERR_CERT_REVOKED;
+
+		} else if (issuer->next_update && (issuer->next_update < time(NULL))) {
+			err = X509_V_ERR_CRL_HAS_EXPIRED;
+
+		} else {
+			err = X509_V_OK;
+		}
+	}
+	CRL_INDEX_UNLOCK(conf);
+
+	return err;
+}
+
+#ifdef HAVE_PTHREAD_H
+/** Rebuild the index whenever the CRL files change
+ *
+ */
+static void *crl_reload_thread(void *arg)
+{
+	fr_tls_server_conf_t	*conf = arg;
+	tls_crl_index_t		now, *index, *old;
+	struct timespec		when;
+
+	pthread_mutex_lock(&conf->crl_reload_mutex);
+	while (!conf->crl_reload_stop) {
+		when.tv_sec = time(NULL) + conf->crl_reload_interval;
+		when.tv_nsec = 0;
+
+		pthread_cond_timedwait(&conf->crl_reload_cond, &conf->crl_reload_mutex, &when);
+		if (conf->crl_reload_stop) break;
+
+		/*
+		 *	Only this thread replaces the index, so it's
+		 *	safe to look at it without the lock.
+		 */
+		crl_index_sources(conf, &now, false);
+		if ((now.mtime == conf->crl_index->mtime) && (now.num_files == conf->crl_index->num_files) &&
+		    (now.size == conf->crl_index->size)) continue;
+
+		INFO(LOG_PREFIX ": CRL files have changed, reloading them");
+		index = crl_index_build(conf);
+		if (!index) continue;
+
+		CRL_INDEX_WRLOCK(conf);
+		old = conf->crl_index;
+		conf->crl_index = index;
+		CRL_INDEX_UNLOCK(conf);
+
+		talloc_free(old);
+	}
+	pthread_mutex_unlock(&conf->crl_reload_mutex);
+
+	return NULL;
+}
+#endif
+
+/** Load the CRL index, and start watching the CRL files for changes
+ *
+ */
+int tls_crl_index_init(fr_tls_server_conf_t *conf)
+{
+#ifdef HAVE_PTHREAD_H
+	if (pthread_rwlock_init(&conf->crl_index_lock, NULL) != 0) {
+		ERROR(LOG_PREFIX ": Failed initializing lock: %s", fr_syserror(errno));
+		return -1;
+	}
+#endif
+
+	conf->crl_index = crl_index_build(conf);
+	if (!conf->crl_index) return -1;
+
+#ifdef HAVE_PTHREAD_H
+	if (conf->crl_reload_interval) {
+		int rcode;
+
+		pthread_mutex_init(&conf->crl_reload_mutex, NULL);
+		pthread_cond_init(&conf->crl_reload_cond, NULL);
+
+		rcode = pthread_create(&conf->crl_reload_thread, NULL, crl_reload_thread, conf);
+		if (rcode != 0) {
+			ERROR(LOG_PREFIX ": Failed starting CRL reload thread: %s", fr_syserror(rcode));
+			return -1;
+		}
+		conf->crl_reload_running = true;
+	}
+#endif
+
+	return 0;
+}
+
+/** Stop the reload thread, and free the CRL index
+ *
+ */
+static void crl_index_free(fr_tls_server_conf_t *conf)
+{
+	if (!conf->crl_index) return;
+
+#ifdef HAVE_PTHREAD_H
+	if (conf->crl_reload_running) {
+		pthread_mutex_lock(&conf->crl_reload_mutex);
+		conf->crl_reload_stop = true;
+		pthread_cond_signal(&conf->crl_reload_cond);
+		pthread_mutex_unlock(&conf->crl_reload_mutex);
+
+		pthread_join(conf->crl_reload_thread, NULL);
+		pthread_cond_destroy(&conf->crl_reload_cond);
+		pthread_mutex_destroy(&conf->crl_reload_mutex);
+	}
+#endif
+
+	talloc_free(conf->crl_index);
+	conf->crl_index = NULL;
+
+#ifdef HAVE_PTHREAD_H
+	pthread_rwlock_destroy(&conf->crl_index_lock);
+#endif
+}
+#endif	/* WITH_CRL_INDEX */
+
 /*
  *	For creating certificate attributes.
  */
@@ -2333,6 +3204,25 @@ int cbtls_verify(int ok, X509_STORE_CTX *ctx)
 		return my_ok;
 	}
 
+#ifdef WITH_CRL_INDEX
+	/*
+	 *	OpenSSL isn't checking the CRLs, so we do it here.
+	 *	Root CAs can't be revoked by a CRL.
+	 */
+	if (conf->crl_index && ((depth == 0) || conf->check_all_crl) &&
+	    (X509_check_issued(client_cert, client_cert) != X509_V_OK)) {
+		err = tls_crl_index_check(conf, client_cert);
+		if ((err == X509_V_ERR_CRL_HAS_EXPIRED) && conf->allow_expired_crl) err = X509_V_OK;
+
+		if (err != X509_V_OK) {
+			X509_STORE_CTX_set_error(ctx, err);
+			RERROR("CRL check failed: %s", X509_verify_cert_error_string(err));
+			REXDENT();
+			return 0;
+		}
+	}
+#endif
+
 	if (lookup == 0) {
 #if OPENSSL_VERSION_NUMBER >= 0x10100000L && !defined(LIBRESSL_VERSION_NUMBER)
 		ext_list = X509_get0_extensions(client_cert);
@@ -3351,7 +4241,7 @@ post_ca:
 	 *	Check the certificates for revocation.
 	 */
 #ifdef X509_V_FLAG_CRL_CHECK
-	if (conf->check_crl) {
+	if (conf->check_crl && !conf->crl_index_enable) {
 		certstore = SSL_CTX_get_cert_store(ctx);
 		if (certstore == NULL) {
 			tls_error_log(NULL, "Error reading Certificate Store");
@@ -3464,6 +4354,14 @@ post_ca:
  */
 static int _tls_server_conf_free(fr_tls_server_conf_t *conf)
 {
+#ifdef WITH_CRL_INDEX
+	/*
+	 *	The reload thread uses the certificate store in the
+	 *	SSL_CTX, so it has to be stopped first.
+	 */
+	crl_index_free(conf);
+#endif
+
 	if (conf->ctx) SSL_CTX_free(conf->ctx);
 
 	if (conf->cache_ht) fr_hash_table_free(conf->cache_ht);
@@ -3471,6 +4369,15 @@ static int _tls_server_conf_free(fr_tls_server_conf_t *conf)
 #ifdef HAVE_OPENSSL_OCSP_H
 	if (conf->ocsp_store) X509_STORE_free(conf->ocsp_store);
 	conf->ocsp_store = NULL;
+
+	if (conf->ocsp_cache_heap) fr_heap_delete(conf->ocsp_cache_heap);
+
+	if (conf->ocsp_cache) {
+		fr_hash_table_free(conf->ocsp_cache);
+#ifdef HAVE_PTHREAD_H
+		pthread_mutex_destroy(&conf->ocsp_cache_mutex);
+#endif
+	}
 #endif
 
 #ifndef NDEBUG
@@ -3535,6 +4442,13 @@ fr_tls_server_conf_t *tls_server_conf_parse(CONF_SECTION *cs)
 	 */
 	if (conf->fragment_size < 100) conf->fragment_size = 100;
 
+#ifndef SSL_OP_ENABLE_KTLS
+	if (conf->ktls) {
+		WARN(LOG_PREFIX ": Ignoring \"ktls = yes\", as this version of OpenSSL does not support kernel TLS");
+		conf->ktls = false;
+	}
+#endif
+
 	/*
 	 *	Only check for certificate things if we don't have a
 	 *	PSK query.
@@ -3571,6 +4485,19 @@ fr_tls_server_conf_t *tls_server_conf_parse(CONF_SECTION *cs)
 		goto error;
 	}
 
+	/*
+	 *	Index the CRLs ourselves, instead of having OpenSSL
+	 *	check them.
+	 */
+	if (conf->check_crl && conf->crl_index_enable) {
+#ifdef WITH_CRL_INDEX
+		if (tls_crl_index_init(conf) < 0) goto error;
+#else
+		ERROR(LOG_PREFIX ": 'crl_index' requires OpenSSL 1.1.0 or later");
+		goto error;
+#endif
+	}
+
 	if (conf->session_cache_enable) {
 		CONF_SECTION	*subcs;
 		CONF_ITEM	*ci;
@@ -3635,6 +4562,13 @@ skip_list:
 	if (conf->ocsp_enable) {
 		conf->ocsp_store = init_revocation_store(conf);
 		if (conf->ocsp_store == NULL) goto error;
+
+		if (conf->ocsp_cache_enable) {
+			FR_INTEGER_BOUND_CHECK("cache_lifetime", conf->ocsp_cache_lifetime, >=, 1);
+			FR_INTEGER_BOUND_CHECK("cache_max_entries", conf->ocsp_cache_max_entries, >=, 1);
+
+			if (tls_ocsp_cache_init(conf) < 0) goto error;
+		}
 	}
 #endif /*HAVE_OPENSSL_OCSP_H*/
 	{
@@ -3700,6 +4634,13 @@ fr_tls_server_conf_t *tls_client_conf_parse(CONF_SECTION *cs)
 	 */
 	if (conf->fragment_size < 100) conf->fragment_size = 100;
 
+#ifndef SSL_OP_ENABLE_KTLS
+	if (conf->ktls) {
+		WARN(LOG_PREFIX ": Ignoring \"ktls = yes\", as this version of OpenSSL does not support kernel TLS");
+		conf->ktls = false;
+	}
+#endif
+
 	/*
 	 *	Initialize TLS
 	 */
@@ -3992,6 +4933,10 @@ fr_tls_status_t tls_application_data(tls_session_t *ssn, REQUEST *request)
 			err = 0;
 			break;
 
+		case SSL_ERROR_ZERO_RETURN:
+			RDEBUG("TLS session closed by peer");
+			return FR_TLS_FAIL;
+
 		default:
 			REDEBUG("Error in fragmentation logic");
 			tls_error_io_log(request, ssn, err,
@@ -119,11 +119,49 @@ static int CC_HINT(nonnull) tls_socket_write(rad_listen_t *listener, REQUEST *re
 	return 1;
 }
 
+/*
+ *	Write a reply when OpenSSL owns the socket.  The socket is
+ *	non-blocking, so wait (briefly) for it to drain if the
+ *	kernel buffers are full.
+ */
+static int CC_HINT(nonnull) tls_socket_ktls_write(rad_listen_t *listener, REQUEST *request)
+{
+	int rcode, ssl_error;
+	listen_socket_t *sock = listener->data;
+	struct timeval start;
+
+	gettimeofday(&start, NULL);
+
+	dump_hex("TUNNELED DATA < ", request->reply->data, request->reply->data_len);
+
+	while ((rcode = SSL_write(sock->ssn->ssl, request->reply->data, request->reply->data_len)) <= 0) {
+		ssl_error = SSL_get_error(sock->ssn->ssl, rcode);
+		switch (ssl_error) {
+		case SSL_ERROR_WANT_READ:
+		case SSL_ERROR_WANT_WRITE:
+			break;
+
+		default:
+			tls_error_io_log(request, sock->ssn, rcode, "Failed writing to TLS socket");
+			tls_socket_close(listener);
+			return 0;
+		}
+
+		if (!tls_socket_write_wait(request->packet->sockfd, ssl_error, &start)) {
+			RDEBUG("Timed out writing to TLS socket");
+			tls_socket_close(listener);
+			return 0;
+		}
+	}
+
+	return 1;
+}
 
 static int tls_socket_recv(rad_listen_t *listener)
 {
 	bool doing_init = false;
 	ssize_t rcode;
+	size_t length;
 	RADIUS_PACKET *packet;
 	REQUEST *request;
 	listen_socket_t *sock = listener->data;
@@ -176,6 +214,13 @@ static int tls_socket_recv(rad_listen_t *listener)
 		SSL_set_ex_data(sock->ssn->ssl, fr_tls_ex_index_certs, (void *) &sock->certs);
 		SSL_set_ex_data(sock->ssn->ssl, FR_TLS_EX_INDEX_TALLOC, sock);
 
+		if (listener->tls->ktls && (tls_session_ktls(sock->ssn, listener->fd) < 0)) {
+			TALLOC_FREE(sock->ssn);
+			TALLOC_FREE(sock->request);
+			sock->packet = NULL;
+			return 0;
+		}
+
 		doing_init = true;
 	}
 
@@ -189,6 +234,14 @@ static int tls_socket_recv(rad_listen_t *listener)
 	RDEBUG3("Reading from socket %d", request->packet->sockfd);
 	PTHREAD_MUTEX_LOCK(&sock->mutex);
 
+	/*
+	 *	The previous record had more than one packet in it.
+	 */
+	if (sock->ssn->clean_out.used > 0) {
+		RDEBUG3("Reading next packet from the previous record");
+		goto get_packet;
+	}
+
 	/*
 	 *	If there is pending application data, as set up by
 	 *	SSL_peek(), read that before reading more data from
@@ -200,6 +253,52 @@ static int tls_socket_recv(rad_listen_t *listener)
 		goto get_application_data;
 	}
 
+	/*
+	 *	OpenSSL reads the socket itself, and may have the
+	 *	kernel decrypt the records.  Run the handshake until
+	 *	it's finished, and then read application data.
+	 */
+	if (sock->ssn->ktls) {
+		if (doing_init) {
+			uint8_t first;
+
+			rcode = recv(request->packet->sockfd, &first, 1, MSG_PEEK);
+			if ((rcode < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+				PTHREAD_MUTEX_UNLOCK(&sock->mutex);
+				return 0;
+			}
+			if (rcode <= 0) goto do_close;
+
+			if (first != handshake) {
+				RDEBUG("Non-TLS data sent to TLS socket: closing");
+				goto do_close;
+			}
+		}
+
+		if (!sock->ssn->is_init_finished) {
+			rcode = SSL_do_handshake(sock->ssn->ssl);
+			if (rcode <= 0) {
+				switch (SSL_get_error(sock->ssn->ssl, rcode)) {
+				case SSL_ERROR_WANT_READ:
+				case SSL_ERROR_WANT_WRITE:
+					PTHREAD_MUTEX_UNLOCK(&sock->mutex);
+					return 0;
+
+				default:
+					tls_error_io_log(request, sock->ssn, rcode, "Failed in TLS handshake");
+					goto do_close;
+				}
+			}
+
+			RDEBUG2("TLS - Connection Established");
+			sock->ssn->is_init_finished = true;
+			sock->ssn->ssl_session = SSL_get_session(sock->ssn->ssl);
+			tls_session_ktls_account(request, sock->ssn);
+		}
+
+		goto get_application_data;
+	}
+
 	rcode = read(request->packet->sockfd,
 		     sock->ssn->dirty_in.data,
 		     sizeof(sock->ssn->dirty_in.data));
@@ -270,6 +369,12 @@ get_application_data:
 		return 0;
 	}
 
+	/*
+	 *	There's no buffered data to retry with, and the
+	 *	socket would otherwise stay readable forever.
+	 */
+	if ((status == FR_TLS_FAIL) && sock->ssn->ktls) goto do_close;
+
 	if (sock->ssn->clean_out.used == 0) {
 		PTHREAD_MUTEX_UNLOCK(&sock->mutex);
 		return 0;
@@ -280,21 +385,27 @@ get_application_data:
 	 */
 	dump_hex("TUNNELED DATA > ", sock->ssn->clean_out.data, sock->ssn->clean_out.used);
 
+get_packet:
 	/*
-	 *	If the packet is a complete RADIUS packet, return it to
-	 *	the caller.  Otherwise...
+	 *	If the record starts with a complete RADIUS packet,
+	 *	return it to the caller.  Peers may put several
+	 *	packets into one record, in which case the rest are
+	 *	left in clean_out for the next call.  Otherwise...
 	 */
-	if ((sock->ssn->clean_out.used < 20) ||
-	    (((sock->ssn->clean_out.data[2] << 8) | sock->ssn->clean_out.data[3]) != (int) sock->ssn->clean_out.used)) {
-		RDEBUG("Received bad packet: Length %zd contents %d",
-		       sock->ssn->clean_out.used,
-		       (sock->ssn->clean_out.data[2] << 8) | sock->ssn->clean_out.data[3]);
+	length = 0;
+	if (sock->ssn->clean_out.used >= 4) {
+		length = (sock->ssn->clean_out.data[2] << 8) | sock->ssn->clean_out.data[3];
+	}
+	if ((sock->ssn->clean_out.used < 20) || (length < 20) || (length > sock->ssn->clean_out.used)) {
+		RDEBUG("Received bad packet: Length %zd contents %zu",
+		       sock->ssn->clean_out.used, length);
+		sock->ssn->record_init(&sock->ssn->clean_out);
 		goto do_close;
 	}
 
 	packet = sock->packet;
-	packet->data = talloc_array(packet, uint8_t, sock->ssn->clean_out.used);
-	packet->data_len = sock->ssn->clean_out.used;
+	packet->data = talloc_array(packet, uint8_t, length);
+	packet->data_len = length;
 	sock->ssn->record_minus(&sock->ssn->clean_out, packet->data, packet->data_len);
 	packet->vps = NULL;
 	PTHREAD_MUTEX_UNLOCK(&sock->mutex);
@@ -417,6 +528,11 @@ redo:
 		return 0;
 	}
 
+	/*
+	 *	More packets from the same record.
+	 */
+	if (sock->ssn->clean_out.used > 0) goto redo;
+
 	/*
 	 *	Check for more application data.
 	 *
@@ -488,6 +604,12 @@ int dual_tls_send(rad_listen_t *listener, REQUEST *request)
 
 	PTHREAD_MUTEX_LOCK(&sock->mutex);
 
+	if (sock->ssn->ktls) {
+		tls_socket_ktls_write(listener, request);
+		PTHREAD_MUTEX_UNLOCK(&sock->mutex);
+		return 0;
+	}
+
 	/*
 	 *	Write the packet to the SSL buffers.
 	 */
@@ -573,6 +695,7 @@ static ssize_t proxy_tls_read(rad_listen_t *listener)
 		}
 
 		sock->ssn->connected = true;
+		tls_session_ktls_account(NULL, sock->ssn);
 	}
 
 	/*
@@ -749,9 +872,99 @@ int proxy_tls_recv(rad_listen_t *listener)
 }
 
 
+/*
+ *	Write everything which has been queued for the home server,
+ *	as one TLS record where possible.
+ *
+ *	Called with the mutex held.
+ */
+static int proxy_tls_write(rad_listen_t *listener, uint8_t const *data, size_t len, int packets);
+
+static int proxy_tls_flush(rad_listen_t *listener)
+{
+	int i, rcode, packets;
+	size_t len;
+	uint8_t *data;
+	int **error;
+	listen_socket_t *sock = listener->data;
+
+	/*
+	 *	Swap the queue for the spare buffer, so that other
+	 *	threads can keep queueing packets while we write.
+	 */
+	PTHREAD_MUTEX_LOCK(&sock->send_mutex);
+	data = sock->send_queue;
+	len = sock->send_queue_used;
+	packets = sock->send_queue_packets;
+	error = sock->send_error;
+
+	sock->send_queue = sock->send_spare;
+	sock->send_queue_used = 0;
+	sock->send_queue_packets = 0;
+	sock->send_error = sock->send_spare_error;
+	sock->send_spare = data;
+	sock->send_spare_error = error;
+	PTHREAD_MUTEX_UNLOCK(&sock->send_mutex);
+
+	if (len == 0) return 0;
+
+	rcode = proxy_tls_write(listener, data, len, packets);
+
+	/*
+	 *	The senders are waiting for the mutex we hold, and
+	 *	check their result once they have it.
+	 */
+	for (i = 0; i < packets; i++) *error[i] = (rcode < 0);
+
+	return rcode;
+}
+
+/*
+ *	Called with the mutex held.
+ */
+static int proxy_tls_write(rad_listen_t *listener, uint8_t const *data, size_t len, int packets)
+{
+	int rcode, ssl_error;
+	listen_socket_t *sock = listener->data;
+	struct timeval start;
+
+	gettimeofday(&start, NULL);
+
+	/*
+	 *	The data may be packets from several threads, so it
+	 *	can't be dropped when the socket is busy.  Wait for it,
+	 *	and retry with the same data, as OpenSSL requires.
+	 */
+	DEBUG3("Proxy is writing %zu bytes (%d packets) to SSL", len, packets);
+	while ((rcode = SSL_write(sock->ssn->ssl, data, len)) <= 0) {
+		ssl_error = SSL_get_error(sock->ssn->ssl, rcode);
+		switch (ssl_error) {
+		case SSL_ERROR_WANT_READ:
+		case SSL_ERROR_WANT_WRITE:
+			break;
+
+		default:
+			tls_error_log(NULL, "Failed in proxy send");
+			DEBUG("Closing TLS socket to home server");
+			tls_socket_close(listener);
+			return -1;
+		}
+
+		if (!tls_socket_write_wait(listener->fd, ssl_error, &start)) {
+			ERROR("Timed out writing %d packets to home server %s, closing the connection",
+			      packets, sock->home->log_name);
+			tls_socket_close(listener);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
 int proxy_tls_send(rad_listen_t *listener, REQUEST *request)
 {
 	int rcode;
+	int error = -1;	/* not written yet */
 	listen_socket_t *sock = listener->data;
 
 	VERIFY_REQUEST(request);
@@ -781,32 +994,53 @@ int proxy_tls_send(rad_listen_t *listener, REQUEST *request)
 		}
 
 		sock->ssn->connected = true;
+		tls_session_ktls_account(NULL, sock->ssn);
 	}
 
-	DEBUG3("Proxy is writing %u bytes to SSL",
-	       (unsigned int) request->proxy->data_len);
-	PTHREAD_MUTEX_LOCK(&sock->mutex);
-	rcode = SSL_write(sock->ssn->ssl, request->proxy->data,
-			  request->proxy->data_len);
-	if (rcode < 0) {
-		int err;
+	if (!sock->home->coalesce_writes) {
+		PTHREAD_MUTEX_LOCK(&sock->mutex);
+		rcode = proxy_tls_write(listener, request->proxy->data, request->proxy->data_len, 1);
+		PTHREAD_MUTEX_UNLOCK(&sock->mutex);
 
-		err = ERR_get_error();
-		switch (err) {
-		case SSL_ERROR_NONE:
-		case SSL_ERROR_WANT_READ:
-		case SSL_ERROR_WANT_WRITE:
-			break;	/* let someone else retry */
+		return (rcode < 0) ? 0 : 1;
+	}
 
-		default:
-			tls_error_log(NULL, "Failed in proxy send");
-			DEBUG("Closing TLS socket to home server");
-			tls_socket_close(listener);
-			PTHREAD_MUTEX_UNLOCK(&sock->mutex);
-			return 0;
+	/*
+	 *	Queue the packet.  Threads sending to the same home
+	 *	server wait for the mutex below.  The first one to get
+	 *	it writes all of their packets at once, and tells the
+	 *	others how that went.
+	 */
+	for (;;) {
+		PTHREAD_MUTEX_LOCK(&sock->send_mutex);
+		if ((sock->send_queue_used + request->proxy->data_len) <= SSL3_RT_MAX_PLAIN_LENGTH) {
+			memcpy(sock->send_queue + sock->send_queue_used,
+			       request->proxy->data, request->proxy->data_len);
+			sock->send_queue_used += request->proxy->data_len;
+			sock->send_error[sock->send_queue_packets++] = &error;
+			PTHREAD_MUTEX_UNLOCK(&sock->send_mutex);
+			break;
 		}
+		PTHREAD_MUTEX_UNLOCK(&sock->send_mutex);
+
+		/*
+		 *	The queue is full.  Empty it, and try again.
+		 */
+		PTHREAD_MUTEX_LOCK(&sock->mutex);
+		rcode = proxy_tls_flush(listener);
+		PTHREAD_MUTEX_UNLOCK(&sock->mutex);
+		if (rcode < 0) return 0;
 	}
+
+	/*
+	 *	If another thread has written our packet, it has
+	 *	already set "error".  Otherwise our packet is still
+	 *	queued, and we write it.
+	 */
+	PTHREAD_MUTEX_LOCK(&sock->mutex);
+	if (error < 0) proxy_tls_flush(listener);
 	PTHREAD_MUTEX_UNLOCK(&sock->mutex);
+	if (error) return 0;
 
 	return 1;
 }
@@ -102,7 +102,16 @@ static RADCLIENT *client_alloc(void *ctx)
 	return client;
 }
 
-static REQUEST *request_setup(FILE *fp)
+/** Create a request
+ *
+ * @param fp to read the request attributes from, or NULL to copy them from tmpl.
+ * @param tmpl attributes used to generate benchmark requests.  Double quoted
+ *	values containing %{...} are expanded for each request, so e.g.
+ *	"bob%{rand:1000}" varies the User-Name between requests.
+ * @param number of the request.
+ * @return the new request, or NULL on error.
+ */
+static REQUEST *request_setup(FILE *fp, VALUE_PAIR *tmpl, unsigned int number)
 {
 	VALUE_PAIR	*vp;
 	REQUEST		*request;
@@ -134,7 +143,7 @@ static REQUEST *request_setup(FILE *fp)
 	request->listener = listen_alloc(request);
 	request->client = client_alloc(request);
 
-	request->number = 0;
+	request->number = number;
 
 	request->master_state = REQUEST_ACTIVE;
 	request->child_state = REQUEST_RUNNING;
@@ -144,9 +153,11 @@ static REQUEST *request_setup(FILE *fp)
 	request->root = &main_config;
 
 	/*
-	 *	Read packet from fp
+	 *	Read packet from fp, or copy it from the template
 	 */
-	if (fr_pair_list_afrom_file(request->packet, &request->packet->vps, fp, &filedone) < 0) {
+	if (!fp) {
+		request->packet->vps = fr_pair_list_copy(request->packet, tmpl);
+	} else if (fr_pair_list_afrom_file(request->packet, &request->packet->vps, fp, &filedone) < 0) {
 		fr_perror("unittest");
 		talloc_free(request);
 		return NULL;
@@ -175,12 +186,20 @@ static REQUEST *request_setup(FILE *fp)
 	     vp = fr_cursor_next(&cursor)) {
 		/*
 		 *	Double quoted strings get marked up as xlat expansions,
-		 *	but we don't support that here.
+		 *	but we only support that for benchmark requests.
 		 */
 		if (vp->type == VT_XLAT) {
-			vp->vp_strvalue = vp->value.xlat;
-			vp->value.xlat = NULL;
-			vp->type = VT_DATA;
+			if (!fp) {
+				if (radius_xlat_do(request, vp) < 0) {
+					ERROR("Failed expanding %s: %s", vp->da->name, fr_strerror());
+					talloc_free(request);
+					return NULL;
+				}
+			} else {
+				vp->vp_strvalue = vp->value.xlat;
+				vp->value.xlat = NULL;
+				vp->type = VT_DATA;
+			}
 		}
 
 		if (!vp->da->vendor) switch (vp->da->attr) {
@@ -199,6 +218,15 @@ static REQUEST *request_setup(FILE *fp)
 			request->packet->dst_port = (vp->vp_integer & 0xffff);
 			break;
 
+			/*
+			 *	Allow it to set when the request arrived,
+			 *	so that tests don't have to wait for
+			 *	things to expire.
+			 */
+		case PW_PACKET_ORIGINAL_TIMESTAMP:
+			request->timestamp = vp->vp_date;
+			break;
+
 		case PW_PACKET_DST_IP_ADDRESS:
 			request->packet->dst_ipaddr.af = AF_INET;
 			request->packet->dst_ipaddr.ipaddr.ip4addr.s_addr = vp->vp_ipaddr;
@@ -617,6 +645,235 @@ static bool do_xlats(char const *filename, FILE *fp)
 }
 
 
+#ifdef WITH_STATS
+/*
+ *	State for one benchmark thread.
+ */
+typedef struct bench_thread_t {
+	int			num;			//!< Thread number.  Also selects the stats shard.
+	int			num_threads;		//!< Requests are divided round-robin between threads.
+	uint64_t		count;			//!< Total number of requests to process.
+
+	VALUE_PAIR		**templates;		//!< Attributes used to generate the requests.
+	int			num_templates;
+
+#ifdef WITH_THREADS
+	pthread_t		pthread_id;
+#endif
+	bool			failed;
+
+	fr_stats_hist_t		latency;		//!< Time spent processing each request.
+	uint64_t		blocks;			//!< talloc blocks still held by requests when they finished.
+							//!< Blocks which were freed during processing aren't counted.
+	uint64_t		bytes;			//!< Bytes still held by requests when they finished.
+	uint64_t		replies[PW_CODE_MAX];	//!< Number of replies of each type.
+} bench_thread_t;
+
+static void *bench_thread(void *arg)
+{
+	bench_thread_t	*thread = arg;
+	uint64_t	i;
+
+	radius_stats_thread_init(thread->num);
+
+	for (i = thread->num; i < thread->count; i += thread->num_threads) {
+		REQUEST		*request;
+		struct timeval	start, end;
+		uint32_t	usec;
+
+		request = request_setup(NULL, thread->templates[i % thread->num_templates], i);
+		if (!request) {
+			thread->failed = true;
+			break;
+		}
+
+		gettimeofday(&start, NULL);
+		switch (request->packet->code) {
+		case PW_CODE_ACCESS_REQUEST:
+			rad_virtual_server(request);
+			break;
+
+#ifdef WITH_ACCOUNTING
+		case PW_CODE_ACCOUNTING_REQUEST:
+			rad_accounting(request);
+			break;
+#endif
+
+		default:
+			ERROR("Can't benchmark packets of type %i", request->packet->code);
+			talloc_free(request);
+			thread->failed = true;
+			return NULL;
+		}
+		gettimeofday(&end, NULL);
+
+		if (fr_stats_tv_usec(&usec, &start, &end)) fr_stats_hist_add(&thread->latency, usec);
+
+		thread->blocks += talloc_total_blocks(request);
+		thread->bytes += talloc_total_size(request);
+		if (request->reply->code < PW_CODE_MAX) thread->replies[request->reply->code]++;
+
+		talloc_free(request);
+	}
+
+	return NULL;
+}
+
+static void bench_hist_print(char const *name, fr_stats_hist_t const *hist)
+{
+	if (!hist->count) return;
+
+	printf("  %-28s %10" PRIu64 " %10.1f %8u %8u %8u\n", name, hist->count,
+	       (double) hist->sum / hist->count,
+	       fr_stats_hist_percentile(hist, 50), fr_stats_hist_percentile(hist, 99), hist->max);
+}
+
+static int bench_module_print(UNUSED void *ctx, void *data)
+{
+	module_instance_t	*mi = data;
+	fr_stats_hist_t		hist;
+
+	fr_stats_latency_merge(&hist, &mi->stats);
+	bench_hist_print(mi->name, &hist);
+
+	return 0;
+}
+
+/** Run many requests generated from templates through the virtual server
+ *
+ * Access-Requests are passed to rad_virtual_server(), and Accounting-Requests
+ * to rad_accounting(), so no sockets are involved.  Each template is a list
+ * of attributes, in the same format as a normal test input file.  Templates
+ * are separated by blank lines, and used in turn.
+ *
+ * @param fp to read the templates from.
+ * @param count of requests to process.
+ * @param num_threads to process them with.
+ * @return 0 on success, -1 on error.
+ */
+static int bench(FILE *fp, uint64_t count, int num_threads)
+{
+	int		i, num_templates = 0;
+	int		rcode = 0;
+	VALUE_PAIR	**templates = NULL;
+	bench_thread_t	*threads;
+	fr_stats_hist_t	latency;
+	uint64_t	blocks = 0, bytes = 0, replies[PW_CODE_MAX];
+	struct timeval	start, end, elapsed;
+	double		secs;
+	TALLOC_CTX	*ctx;
+
+	ctx = talloc_init("bench");
+	if (!ctx) return -1;
+
+	while (!filedone) {
+		VALUE_PAIR *vps = NULL;
+
+		if (fr_pair_list_afrom_file(ctx, &vps, fp, &filedone) < 0) {
+			fr_perror("unittest");
+			rcode = -1;
+			goto finish;
+		}
+		if (!vps) continue;
+
+		templates = talloc_realloc(ctx, templates, VALUE_PAIR *, num_templates + 1);
+		templates[num_templates++] = vps;
+	}
+
+	if (!num_templates) {
+		fprintf(stderr, "No request templates in input\n");
+		rcode = -1;
+		goto finish;
+	}
+
+	threads = talloc_zero_array(ctx, bench_thread_t, num_threads);
+	if (!threads) {
+		rcode = -1;
+		goto finish;
+	}
+
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < num_threads; i++) {
+		threads[i].num = i;
+		threads[i].num_threads = num_threads;
+		threads[i].count = count;
+		threads[i].templates = templates;
+		threads[i].num_templates = num_templates;
+
+#ifdef WITH_THREADS
+		if (num_threads > 1) {
+			int rc;
+
+			rc = pthread_create(&threads[i].pthread_id, NULL, bench_thread, &threads[i]);
+			if (rc != 0) {
+				fprintf(stderr, "Failed creating thread: %s\n", fr_syserror(rc));
+				exit(EXIT_FAILURE);
+			}
+			continue;
+		}
+#endif
+		bench_thread(&threads[i]);
+	}
+
+#ifdef WITH_THREADS
+	if (num_threads > 1) for (i = 0; i < num_threads; i++) pthread_join(threads[i].pthread_id, NULL);
+#endif
+
+	gettimeofday(&end, NULL);
+	rad_tv_sub(&end, &start, &elapsed);
+	secs = elapsed.tv_sec + (elapsed.tv_usec / 1000000.0);
+
+	memset(&latency, 0, sizeof(latency));
+	memset(replies, 0, sizeof(replies));
+	for (i = 0; i < num_threads; i++) {
+		int j;
+
+		if (threads[i].failed) rcode = -1;
+
+		fr_stats_hist_merge(&latency, &threads[i].latency);
+		blocks += threads[i].blocks;
+		bytes += threads[i].bytes;
+		for (j = 0; j < PW_CODE_MAX; j++) replies[j] += threads[i].replies[j];
+	}
+
+	printf("Requests   : %" PRIu64 " from %i template(s), using %i thread(s)\n",
+	       latency.count, num_templates, num_threads);
+	printf("Time       : %.3fs\n", secs);
+	if (secs > 0) printf("Throughput : %.0f requests/s\n", latency.count / secs);
+	if (latency.count) {
+		printf("Memory     : %.1f talloc blocks, %.0f bytes live per request when it finished\n",
+		       (double) blocks / latency.count, (double) bytes / latency.count);
+	}
+	for (i = 0; i < PW_CODE_MAX; i++) {
+		if (!replies[i]) continue;
+
+		if (i == 0) {
+			printf("Replies    : %-20s %" PRIu64 "\n", "(no reply)", replies[i]);
+		} else if (is_radius_code(i)) {
+			printf("Replies    : %-20s %" PRIu64 "\n", fr_packet_codes[i], replies[i]);
+		} else {
+			printf("Replies    : %-20i %" PRIu64 "\n", i, replies[i]);
+		}
+	}
+
+	printf("\n  %-28s %10s %10s %8s %8s %8s\n", "Latency (usec)", "count", "avg", "p50", "p99", "max");
+	bench_hist_print("request", &latency);
+
+	for (i = 0; i < MOD_COUNT; i++) {
+		fr_stats_latency_merge(&latency, &radius_section_stats[i]);
+		bench_hist_print(section_type_value[i].section, &latency);
+	}
+
+	(void) module_instance_walk(bench_module_print, NULL);
+
+finish:
+	talloc_free(ctx);
+	return rcode;
+}
+#endif
+
+
 /*
  *	The main guy.
  */
@@ -633,6 +890,8 @@ int main(int argc, char *argv[])
 	VALUE_PAIR *filter_vps = NULL;
 	bool xlat_only = false;
 	fr_state_t *state = NULL;
+	uint64_t bench_count = 0;
+	int bench_threads = 1;
 
 	fr_talloc_fault_setup();
 
@@ -671,9 +930,14 @@ int main(int argc, char *argv[])
 	default_log.fd = STDOUT_FILENO;
 
 	/*  Process the options.  */
-	while ((argval = getopt(argc, argv, "d:D:f:hi:mMn:o:O:xX")) != EOF) {
+	while ((argval = getopt(argc, argv, "b:d:D:f:hi:j:mMn:o:O:xX")) != EOF) {
 
 		switch (argval) {
+			case 'b':
+				bench_count = strtoull(optarg, NULL, 10);
+				if (!bench_count) usage(1);
+				break;
+
 			case 'd':
 				set_radius_dir(NULL, optarg);
 				break;
@@ -694,6 +958,17 @@ int main(int argc, char *argv[])
 				input_file = optarg;
 				break;
 
+			case 'j':
+				bench_threads = atoi(optarg);
+				if (bench_threads < 1) usage(1);
+#ifndef WITH_THREADS
+				if (bench_threads > 1) {
+					fprintf(stderr, "Benchmark threads (-j) require a server built with threads\n");
+					exit(EXIT_FAILURE);
+				}
+#endif
+				break;
+
 			case 'm':
 				main_config.debug_memory = true;
 				break;
@@ -813,10 +1088,24 @@ int main(int argc, char *argv[])
 		goto finish;
 	}
 
+	/*
+	 *	Benchmark the virtual server, using the input as templates.
+	 */
+	if (bench_count) {
+#ifdef WITH_STATS
+		if (bench(fp, bench_count, bench_threads) < 0) rcode = EXIT_FAILURE;
+#else
+		fprintf(stderr, "Benchmarking (-b) requires a server built with statistics\n");
+		rcode = EXIT_FAILURE;
+#endif
+		if (input_file) fclose(fp);
+		goto finish;
+	}
+
 	/*
 	 *	Grab the VPs from stdin, or from the file.
 	 */
-	request = request_setup(fp);
+	request = request_setup(fp, NULL, 0);
 	if (!request) {
 		fprintf(stderr, "Failed reading input: %s\n", fr_strerror());
 		rcode = EXIT_FAILURE;
@@ -941,11 +1230,13 @@ static void NEVER_RETURNS usage(int status)
 
 	fprintf(output, "Usage: %s [options]\n", main_config.name);
 	fprintf(output, "Options:\n");
+	fprintf(output, "  -b count      Benchmark the server with 'count' requests, generated from the input.\n");
 	fprintf(output, "  -d raddb_dir  Configuration files are in \"raddb_dir/*\".\n");
 	fprintf(output, "  -D dict_dir   Dictionary files are in \"dict_dir/*\".\n");
 	fprintf(output, "  -f file       Filter reply against attributes in 'file'.\n");
 	fprintf(output, "  -h            Print this help message.\n");
 	fprintf(output, "  -i file       File containing request attributes.\n");
+	fprintf(output, "  -j threads    Number of threads to benchmark with (defaults to 1).\n");
 	fprintf(output, "  -m            On SIGINT or SIGQUIT exit cleanly instead of immediately.\n");
 	fprintf(output, "  -n name       Read raddb/name.conf instead of raddb/radiusd.conf.\n");
 	fprintf(output, "  -X            Turn on full debugging.\n");
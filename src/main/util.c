@@ -1730,3 +1730,278 @@ void rad_tv_sub(struct timeval const *end, struct timeval const *start, struct t
 		elapsed->tv_sec++;
 	}
 }
+
+#ifdef WITH_STATS
+/*
+ *	Time spent waiting in the thread pool queue, and time spent
+ *	being processed by a worker thread.
+ */
+fr_stats_latency_t radius_queue_wait_stats;
+fr_stats_latency_t radius_processing_stats;
+
+/*
+ *	Which shard of a fr_stats_latency_t this thread writes to.
+ *
+ *	Shard 0 is shared, and is written to under stats_shared_mutex.
+ *	The others are owned by at most one thread at a time.
+ */
+#ifdef __THREAD
+static __THREAD unsigned int stats_shard = 0;
+static bool stats_shard_used[FR_STATS_SHARDS];
+static pthread_key_t stats_shard_key;
+static pthread_once_t stats_shard_once = PTHREAD_ONCE_INIT;
+#else
+static unsigned int stats_shard = 0;
+#endif
+
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t stats_shard_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t stats_shared_mutex = PTHREAD_MUTEX_INITIALIZER;
+#  define PTHREAD_MUTEX_LOCK pthread_mutex_lock
+#  define PTHREAD_MUTEX_UNLOCK pthread_mutex_unlock
+#else
+#  define PTHREAD_MUTEX_LOCK(_x)
+#  define PTHREAD_MUTEX_UNLOCK(_x)
+#endif
+
+/** Convert the difference between two timevals to microseconds
+ *
+ * Saturates at UINT32_MAX (~71 minutes) instead of overflowing.
+ *
+ * @return false if either timeval is unset, or end is before start.
+ */
+bool fr_stats_tv_usec(uint32_t *out, struct timeval const *start, struct timeval const *end)
+{
+	struct timeval diff;
+
+	if ((start->tv_sec == 0) || (end->tv_sec == 0) ||
+	    (end->tv_sec < start->tv_sec)) return false;
+
+	rad_tv_sub(end, start, &diff);
+
+	if (diff.tv_sec > 4000) {
+		*out = UINT32_MAX;
+	} else {
+		*out = (diff.tv_sec * 1000000) + diff.tv_usec;
+	}
+
+	return true;
+}
+
+#ifdef __THREAD
+/** Give a shard back when the thread which claimed it exits
+ *
+ * The samples already recorded to it are kept, and the next thread
+ * to claim the shard adds to them.
+ */
+static void stats_shard_release(void *arg)
+{
+	PTHREAD_MUTEX_LOCK(&stats_shard_mutex);
+	stats_shard_used[(uintptr_t) arg] = false;
+	PTHREAD_MUTEX_UNLOCK(&stats_shard_mutex);
+}
+
+static void stats_shard_key_init(void)
+{
+	(void) pthread_key_create(&stats_shard_key, stats_shard_release);
+}
+#endif
+
+/** Claim a latency shard for the calling thread
+ *
+ * The thread gets the shard matching its number if that's free, and
+ * the next free one otherwise.  If all of the shards are owned by
+ * other threads, it records to the shared shard instead, which is
+ * slower, but doesn't lose samples.
+ *
+ * The shard is given back when the thread exits.
+ *
+ * @param thread_num of the calling thread.
+ */
+void radius_stats_thread_init(int thread_num)
+{
+#ifdef __THREAD
+	unsigned int i, shard;
+
+	if (stats_shard) return;
+
+	(void) pthread_once(&stats_shard_once, stats_shard_key_init);
+
+	PTHREAD_MUTEX_LOCK(&stats_shard_mutex);
+	for (i = 0; i < (FR_STATS_SHARDS - 1); i++) {
+		shard = 1 + (((unsigned int) thread_num + i) % (FR_STATS_SHARDS - 1));
+		if (stats_shard_used[shard]) continue;
+
+		stats_shard_used[shard] = true;
+		stats_shard = shard;
+		break;
+	}
+	PTHREAD_MUTEX_UNLOCK(&stats_shard_mutex);
+
+	if (stats_shard) (void) pthread_setspecific(stats_shard_key, (void *) (uintptr_t) stats_shard);
+#endif
+}
+
+/** Map a latency in microseconds to a histogram bucket
+ *
+ */
+static unsigned int stats_hist_bucket(uint32_t usec)
+{
+	unsigned int shift, bucket;
+
+	if (usec < FR_STATS_HIST_SUB) return usec;
+
+	shift = 0;
+	while ((usec >> shift) >= (2 * FR_STATS_HIST_SUB)) shift++;
+
+	bucket = ((shift + 1) << FR_STATS_HIST_SUB_BITS) + ((usec >> shift) - FR_STATS_HIST_SUB);
+	if (bucket >= FR_STATS_HIST_BUCKETS) bucket = FR_STATS_HIST_BUCKETS - 1;
+
+	return bucket;
+}
+
+/** Return the highest latency which maps to a histogram bucket
+ *
+ */
+static uint32_t stats_hist_bucket_max(unsigned int bucket)
+{
+	unsigned int shift;
+
+	if (bucket < FR_STATS_HIST_SUB) return bucket;
+
+	shift = (bucket >> FR_STATS_HIST_SUB_BITS) - 1;
+
+	return ((FR_STATS_HIST_SUB + (bucket & (FR_STATS_HIST_SUB - 1))) << shift) + ((1 << shift) - 1);
+}
+
+/** Record one latency sample
+ *
+ * @param hist to update.  The caller must ensure there is only one writer.
+ * @param usec latency in microseconds.
+ */
+void fr_stats_hist_add(fr_stats_hist_t *hist, uint32_t usec)
+{
+	hist->bucket[stats_hist_bucket(usec)]++;
+	hist->count++;
+	hist->sum += usec;
+	if (usec > hist->max) hist->max = usec;
+}
+
+/** Add the samples of one histogram to another
+ *
+ */
+void fr_stats_hist_merge(fr_stats_hist_t *out, fr_stats_hist_t const *in)
+{
+	int i;
+
+	for (i = 0; i < FR_STATS_HIST_BUCKETS; i++) out->bucket[i] += in->bucket[i];
+	out->count += in->count;
+	out->sum += in->sum;
+	if (in->max > out->max) out->max = in->max;
+}
+
+/** Return the latency below which pct percent of samples fall
+ *
+ * @param hist to query.
+ * @param pct percentile, e.g. 99.9.
+ * @return the upper bound of the matching bucket (never more than the
+ *	largest sample), or 0 if there are no samples.
+ */
+uint32_t fr_stats_hist_percentile(fr_stats_hist_t const *hist, double pct)
+{
+	int i;
+	uint64_t target, seen = 0;
+	uint32_t usec;
+
+	if (!hist->count) return 0;
+
+	target = (uint64_t) ((hist->count * pct) / 100.0);
+	if (target == 0) target = 1;
+	if (target > hist->count) target = hist->count;
+
+	for (i = 0; i < FR_STATS_HIST_BUCKETS; i++) {
+		seen += hist->bucket[i];
+		if (seen >= target) break;
+	}
+	/*
+	 *	The last bucket has no upper bound.
+	 */
+	if (i >= (FR_STATS_HIST_BUCKETS - 1)) return hist->max;
+
+	usec = stats_hist_bucket_max(i);
+	if (usec > hist->max) usec = hist->max;
+
+	return usec;
+}
+
+/** Return a shard of a multi-writer histogram, allocating it if needed
+ *
+ * Only the owner of a shard (or the holder of stats_shared_mutex, for
+ * shard 0) may call this.  The shard is allocated with calloc(), as
+ * talloc isn't thread safe.
+ */
+static fr_stats_hist_t *stats_latency_shard(fr_stats_latency_t *lat, unsigned int shard)
+{
+	if (!lat->shard[shard]) lat->shard[shard] = calloc(1, sizeof(*lat->shard[shard]));
+
+	return lat->shard[shard];
+}
+
+/** Record the time between two events from any thread
+ *
+ * If the calling thread owns a shard, the sample is written to it
+ * without taking any locks.  Otherwise it's written to the shared
+ * shard under a mutex.
+ */
+void fr_stats_latency_add(fr_stats_latency_t *lat, struct timeval const *start, struct timeval const *end)
+{
+	uint32_t	usec;
+	fr_stats_hist_t	*hist;
+
+	if (!fr_stats_tv_usec(&usec, start, end)) return;
+
+	if (stats_shard) {
+		hist = stats_latency_shard(lat, stats_shard);
+		if (hist) fr_stats_hist_add(hist, usec);
+		return;
+	}
+
+	PTHREAD_MUTEX_LOCK(&stats_shared_mutex);
+	hist = stats_latency_shard(lat, 0);
+	if (hist) fr_stats_hist_add(hist, usec);
+	PTHREAD_MUTEX_UNLOCK(&stats_shared_mutex);
+}
+
+/** Merge all shards of a multi-writer histogram
+ *
+ * The result is a snapshot.  Writers may be active while it is
+ * taken, so individual buckets may be off by the samples recorded
+ * during the merge.
+ */
+void fr_stats_latency_merge(fr_stats_hist_t *out, fr_stats_latency_t const *lat)
+{
+	int i;
+
+	memset(out, 0, sizeof(*out));
+
+	for (i = 0; i < FR_STATS_SHARDS; i++) {
+		if (!lat->shard[i]) continue;
+
+		fr_stats_hist_merge(out, lat->shard[i]);
+	}
+}
+
+/** Free the shards of a multi-writer histogram
+ *
+ * No other thread may be writing to it.
+ */
+void fr_stats_latency_free(fr_stats_latency_t *lat)
+{
+	int i;
+
+	for (i = 0; i < FR_STATS_SHARDS; i++) {
+		free(lat->shard[i]);
+		lat->shard[i] = NULL;
+	}
+}
+#endif	/* WITH_STATS */
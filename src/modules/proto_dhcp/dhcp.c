@@ -53,6 +53,14 @@ RCSID("$Id$")
 #define INADDR_BROADCAST INADDR_NONE
 #endif
 
+#ifdef HAVE_PTHREAD_H
+#  define PTHREAD_MUTEX_LOCK pthread_mutex_lock
+#  define PTHREAD_MUTEX_UNLOCK pthread_mutex_unlock
+#else
+#  define PTHREAD_MUTEX_LOCK(_x)
+#  define PTHREAD_MUTEX_UNLOCK(_x)
+#endif
+
 /* @todo: this is a hack */
 #  define DEBUG			if (fr_debug_lvl && fr_log_fp) fr_printf_log
 #  define debug_pair(vp)	do { if (fr_debug_lvl && fr_log_fp) { \
@@ -243,87 +251,46 @@ static uint8_t *dhcp_get_option(dhcp_packet_t *packet, size_t packet_size,
 }
 
 /*
- *	DHCPv4 is only for IPv4.  Broadcast only works if udpfromto is
- *	defined.
+ *	Check a packet which has been read from the socket, and fill
+ *	in its code, ID, vector and addresses.
  */
-RADIUS_PACKET *fr_dhcp_recv(int sockfd)
+static int dhcp_packet_ok(RADIUS_PACKET *packet,
+			  struct sockaddr_storage *src, socklen_t sizeof_src,
+			  struct sockaddr_storage *dst, socklen_t sizeof_dst)
 {
 	uint32_t		magic;
-	struct sockaddr_storage	src;
-	struct sockaddr_storage	dst;
-	socklen_t		sizeof_src;
-	socklen_t		sizeof_dst;
-	RADIUS_PACKET		*packet;
 	uint16_t		port;
 	uint8_t			*code;
-	ssize_t			data_len;
-
-	packet = rad_alloc(NULL, false);
-	if (!packet) {
-		fr_strerror_printf("Failed allocating packet");
-		return NULL;
-	}
-
-	packet->data = talloc_zero_array(packet, uint8_t, MAX_PACKET_SIZE);
-	if (!packet->data) {
-		fr_strerror_printf("Out of memory");
-		rad_free(&packet);
-		return NULL;
-	}
-
-	packet->sockfd = sockfd;
-	sizeof_src = sizeof(src);
-#ifdef WITH_UDPFROMTO
-	sizeof_dst = sizeof(dst);
-	data_len = recvfromto(sockfd, packet->data, MAX_PACKET_SIZE, 0,
-			      (struct sockaddr *)&src, &sizeof_src,
-			      (struct sockaddr *)&dst, &sizeof_dst);
-#else
-	data_len = recvfrom(sockfd, packet->data, MAX_PACKET_SIZE, 0,
-			    (struct sockaddr *)&src, &sizeof_src);
-#endif
-
-	if (data_len <= 0) {
-		fr_strerror_printf("Failed reading DHCP socket: %s", fr_syserror(errno));
-		rad_free(&packet);
-		return NULL;
-	}
 
-	packet->data_len = data_len;
 	if (packet->data_len < MIN_PACKET_SIZE) {
 		fr_strerror_printf("DHCP packet is too small (%zu < %d)",
 				   packet->data_len, MIN_PACKET_SIZE);
-		rad_free(&packet);
-		return NULL;
+		return -1;
 	}
 
 	if (packet->data_len > MAX_PACKET_SIZE) {
 		fr_strerror_printf("DHCP packet is too large (%zx > %d)",
 				   packet->data_len, MAX_PACKET_SIZE);
-		rad_free(&packet);
-		return NULL;
+		return -1;
 	}
 
 	if (packet->data[1] > 1) {
 		fr_strerror_printf("DHCP can only receive ethernet requests, not type %02x",
 		      packet->data[1]);
-		rad_free(&packet);
-		return NULL;
+		return -1;
 	}
 
 	if ((packet->data[2] != 0) && (packet->data[2] != 6)) {
 		fr_strerror_printf("Ethernet HW length is wrong length %d",
 			packet->data[2]);
-		rad_free(&packet);
-		return NULL;
+		return -1;
 	}
 
 	memcpy(&magic, packet->data + 236, 4);
 	magic = ntohl(magic);
 	if (magic != DHCP_OPTION_MAGIC_NUMBER) {
 		fr_strerror_printf("Cannot do BOOTP");
-		rad_free(&packet);
-		return NULL;
+		return -1;
 	}
 
 	/*
@@ -336,14 +303,12 @@ RADIUS_PACKET *fr_dhcp_recv(int sockfd)
 			       packet->data_len, PW_DHCP_MESSAGE_TYPE);
 	if (!code) {
 		fr_strerror_printf("No message-type option was found in the packet");
-		rad_free(&packet);
-		return NULL;
+		return -1;
 	}
 
 	if ((code[1] < 1) || (code[2] == 0) || (code[2] >= DHCP_MAX_MESSAGE_TYPE)) {
 		fr_strerror_printf("Unknown value %d for message-type option", code[2]);
-		rad_free(&packet);
-		return NULL;
+		return -1;
 	}
 
 	packet->code = code[2] | PW_DHCP_OFFSET;
@@ -376,23 +341,10 @@ RADIUS_PACKET *fr_dhcp_recv(int sockfd)
 	 *	FIXME: More checks, like DHCP packet type?
 	 */
 
-	sizeof_dst = sizeof(dst);
-
-#ifndef WITH_UDPFROMTO
-	/*
-	 *	This should never fail...
-	 */
-	if (getsockname(sockfd, (struct sockaddr *) &dst, &sizeof_dst) < 0) {
-		fr_strerror_printf("getsockname failed: %s", fr_syserror(errno));
-		rad_free(&packet);
-		return NULL;
-	}
-#endif
-
-	fr_sockaddr2ipaddr(&dst, sizeof_dst, &packet->dst_ipaddr, &port);
+	fr_sockaddr2ipaddr(dst, sizeof_dst, &packet->dst_ipaddr, &port);
 	packet->dst_port = port;
 
-	fr_sockaddr2ipaddr(&src, sizeof_src, &packet->src_ipaddr, &port);
+	fr_sockaddr2ipaddr(src, sizeof_src, &packet->src_ipaddr, &port);
 	packet->src_port = port;
 
 	if (fr_debug_lvl > 1) {
@@ -420,10 +372,108 @@ RADIUS_PACKET *fr_dhcp_recv(int sockfd)
 		       packet->dst_port);
 	}
 
+	return 0;
+}
+
+/*
+ *	DHCPv4 is only for IPv4.  Broadcast only works if udpfromto is
+ *	defined.
+ */
+RADIUS_PACKET *fr_dhcp_recv(int sockfd)
+{
+	struct sockaddr_storage	src;
+	struct sockaddr_storage	dst;
+	socklen_t		sizeof_src;
+	socklen_t		sizeof_dst;
+	RADIUS_PACKET		*packet;
+	ssize_t			data_len;
+
+	packet = rad_alloc(NULL, false);
+	if (!packet) {
+		fr_strerror_printf("Failed allocating packet");
+		return NULL;
+	}
+
+	packet->data = talloc_zero_array(packet, uint8_t, MAX_PACKET_SIZE);
+	if (!packet->data) {
+		fr_strerror_printf("Out of memory");
+		rad_free(&packet);
+		return NULL;
+	}
+
+	packet->sockfd = sockfd;
+	sizeof_src = sizeof(src);
+#ifdef WITH_UDPFROMTO
+	sizeof_dst = sizeof(dst);
+	data_len = recvfromto(sockfd, packet->data, MAX_PACKET_SIZE, 0,
+			      (struct sockaddr *)&src, &sizeof_src,
+			      (struct sockaddr *)&dst, &sizeof_dst);
+#else
+	data_len = recvfrom(sockfd, packet->data, MAX_PACKET_SIZE, 0,
+			    (struct sockaddr *)&src, &sizeof_src);
+#endif
+
+	if (data_len <= 0) {
+		fr_strerror_printf("Failed reading DHCP socket: %s", fr_syserror(errno));
+		rad_free(&packet);
+		return NULL;
+	}
+
+	packet->data_len = data_len;
+
+#ifndef WITH_UDPFROMTO
+	/*
+	 *	This should never fail...
+	 */
+	sizeof_dst = sizeof(dst);
+	if (getsockname(sockfd, (struct sockaddr *) &dst, &sizeof_dst) < 0) {
+		fr_strerror_printf("getsockname failed: %s", fr_syserror(errno));
+		rad_free(&packet);
+		return NULL;
+	}
+#endif
+
+	if (dhcp_packet_ok(packet, &src, sizeof_src, &dst, sizeof_dst) < 0) {
+		rad_free(&packet);
+		return NULL;
+	}
+
 	return packet;
 }
 
 
+static void dhcp_send_debug(RADIUS_PACKET *packet)
+{
+	char type_buf[64];
+	char const *name = type_buf;
+#ifdef WITH_UDPFROMTO
+	char src_ip_buf[INET6_ADDRSTRLEN];
+#endif
+	char dst_ip_buf[INET6_ADDRSTRLEN];
+
+	if ((packet->code >= PW_DHCP_DISCOVER) &&
+	    (packet->code < (1024 + DHCP_MAX_MESSAGE_TYPE))) {
+		name = dhcp_message_types[packet->code - PW_DHCP_OFFSET];
+	} else {
+		snprintf(type_buf, sizeof(type_buf), "%d",
+		    packet->code - PW_DHCP_OFFSET);
+	}
+
+	DEBUG(
+#ifdef WITH_UDPFROMTO
+	"Sending %s Id %08x from %s:%d to %s:%d\n",
+#else
+	"Sending %s Id %08x to %s:%d\n",
+#endif
+	   name, (unsigned int) packet->id,
+#ifdef WITH_UDPFROMTO
+	   inet_ntop(packet->src_ipaddr.af, &packet->src_ipaddr.ipaddr, src_ip_buf, sizeof(src_ip_buf)),
+	   packet->src_port,
+#endif
+	   inet_ntop(packet->dst_ipaddr.af, &packet->dst_ipaddr.ipaddr, dst_ip_buf, sizeof(dst_ip_buf)),
+	   packet->dst_port);
+}
+
 /*
  *	Send a DHCP packet.
  */
@@ -447,36 +497,7 @@ int fr_dhcp_send(RADIUS_PACKET *packet)
 		return -1;
 	}
 
-	if (fr_debug_lvl > 1) {
-		char type_buf[64];
-		char const *name = type_buf;
-#ifdef WITH_UDPFROMTO
-		char src_ip_buf[INET6_ADDRSTRLEN];
-#endif
-		char dst_ip_buf[INET6_ADDRSTRLEN];
-
-		if ((packet->code >= PW_DHCP_DISCOVER) &&
-		    (packet->code < (1024 + DHCP_MAX_MESSAGE_TYPE))) {
-			name = dhcp_message_types[packet->code - PW_DHCP_OFFSET];
-		} else {
-			snprintf(type_buf, sizeof(type_buf), "%d",
-			    packet->code - PW_DHCP_OFFSET);
-		}
-
-		DEBUG(
-#ifdef WITH_UDPFROMTO
-		"Sending %s Id %08x from %s:%d to %s:%d\n",
-#else
-		"Sending %s Id %08x to %s:%d\n",
-#endif
-		   name, (unsigned int) packet->id,
-#ifdef WITH_UDPFROMTO
-		   inet_ntop(packet->src_ipaddr.af, &packet->src_ipaddr.ipaddr, src_ip_buf, sizeof(src_ip_buf)),
-		   packet->src_port,
-#endif
-		   inet_ntop(packet->dst_ipaddr.af, &packet->dst_ipaddr.ipaddr, dst_ip_buf, sizeof(dst_ip_buf)),
-		   packet->dst_port);
-	}
+	if (fr_debug_lvl > 1) dhcp_send_debug(packet);
 
 #ifndef WITH_UDPFROMTO
 	/*
@@ -492,6 +513,363 @@ int fr_dhcp_send(RADIUS_PACKET *packet)
 #endif
 }
 
+/*
+ *	Reading and writing packets in batches.  A busy server can
+ *	have many packets waiting on the socket, and many replies
+ *	ready to go.  recvmmsg() and sendmmsg() move them with one
+ *	system call, instead of one per packet.
+ */
+#if defined(WITH_UDPFROMTO) && defined(HAVE_RECVMMSG)
+#  define WITH_DHCP_RECV_BATCH
+#endif
+
+#if defined(WITH_UDPFROMTO) && defined(HAVE_SENDMMSG)
+#  define WITH_DHCP_SEND_BATCH
+#endif
+
+#ifdef WITH_DHCP_SEND_BATCH
+/*
+ *	Replies waiting to be written.
+ */
+typedef struct dhcp_send_queue_t {
+	unsigned int		num;
+	struct mmsghdr		msg[DHCP_BATCH_SIZE];
+	struct iovec		iov[DHCP_BATCH_SIZE];
+	struct sockaddr_storage	src[DHCP_BATCH_SIZE];
+	struct sockaddr_storage	dst[DHCP_BATCH_SIZE];
+	char			cbuf[DHCP_BATCH_SIZE][UDPFROMTO_CMSG_SIZE];
+	uint8_t			data[DHCP_BATCH_SIZE][MAX_PACKET_SIZE];
+	int			*error[DHCP_BATCH_SIZE];	//!< Where to tell each sender how
+								//!< its reply was written.
+} dhcp_send_queue_t;
+#endif
+
+struct fr_dhcp_batch {
+	int			sockfd;
+
+#ifdef WITH_DHCP_RECV_BATCH
+	/*
+	 *	Only used by the thread reading the socket.
+	 */
+	int			recv_num;
+	struct mmsghdr		recv_msg[DHCP_BATCH_SIZE];
+	struct iovec		recv_iov[DHCP_BATCH_SIZE];
+	struct sockaddr_storage	recv_src[DHCP_BATCH_SIZE];
+	struct sockaddr_storage	recv_dst[DHCP_BATCH_SIZE];
+	socklen_t		recv_dst_len[DHCP_BATCH_SIZE];
+	char			recv_cbuf[DHCP_BATCH_SIZE][UDPFROMTO_CMSG_SIZE];
+	uint8_t			recv_data[DHCP_BATCH_SIZE][MAX_PACKET_SIZE];
+#endif
+
+#ifdef WITH_DHCP_SEND_BATCH
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_t		queue_mutex;	//!< Protects queue.
+	pthread_mutex_t		send_mutex;	//!< Held whilst writing.
+#endif
+	dhcp_send_queue_t	*queue;		//!< Replies being queued.
+	dhcp_send_queue_t	*spare;		//!< Replies being written.
+#endif
+};
+
+#if defined(WITH_DHCP_SEND_BATCH) && defined(HAVE_PTHREAD_H)
+static int _dhcp_batch_free(fr_dhcp_batch_t *batch)
+{
+	pthread_mutex_destroy(&batch->queue_mutex);
+	pthread_mutex_destroy(&batch->send_mutex);
+
+	return 0;
+}
+#endif
+
+/** Allocate the buffers for reading and writing packets in batches
+ *
+ * @param ctx to allocate the batch in.
+ * @param sockfd the socket the packets are read from, and written to.
+ * @return the new batch, or NULL on error.
+ */
+fr_dhcp_batch_t *fr_dhcp_batch_alloc(TALLOC_CTX *ctx, int sockfd)
+{
+	fr_dhcp_batch_t *batch;
+#ifdef WITH_DHCP_RECV_BATCH
+	int i;
+#endif
+
+	batch = talloc_zero(ctx, fr_dhcp_batch_t);
+	if (!batch) {
+		fr_strerror_printf("Out of memory");
+		return NULL;
+	}
+	batch->sockfd = sockfd;
+
+#ifdef WITH_DHCP_RECV_BATCH
+	for (i = 0; i < DHCP_BATCH_SIZE; i++) {
+		batch->recv_iov[i].iov_base = batch->recv_data[i];
+		batch->recv_iov[i].iov_len = MAX_PACKET_SIZE;
+
+		batch->recv_msg[i].msg_hdr.msg_iov = &batch->recv_iov[i];
+		batch->recv_msg[i].msg_hdr.msg_iovlen = 1;
+		batch->recv_msg[i].msg_hdr.msg_name = &batch->recv_src[i];
+		batch->recv_msg[i].msg_hdr.msg_control = batch->recv_cbuf[i];
+	}
+#endif
+
+#ifdef WITH_DHCP_SEND_BATCH
+	batch->queue = talloc_zero(batch, dhcp_send_queue_t);
+	batch->spare = talloc_zero(batch, dhcp_send_queue_t);
+	if (!batch->queue || !batch->spare) {
+		fr_strerror_printf("Out of memory");
+		talloc_free(batch);
+		return NULL;
+	}
+
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_init(&batch->queue_mutex, NULL);
+	pthread_mutex_init(&batch->send_mutex, NULL);
+	talloc_set_destructor(batch, _dhcp_batch_free);
+#endif
+#endif
+
+	return batch;
+}
+
+/** Read as many packets as are waiting on the socket, up to DHCP_BATCH_SIZE
+ *
+ * The packets are checked and returned by fr_dhcp_batch_packet().
+ *
+ * @param batch to read into.
+ * @return the number of packets read, or -1 on error.
+ */
+int fr_dhcp_batch_recv(fr_dhcp_batch_t *batch)
+{
+#ifdef WITH_DHCP_RECV_BATCH
+	int i, rcode;
+
+	for (i = 0; i < DHCP_BATCH_SIZE; i++) {
+		batch->recv_msg[i].msg_hdr.msg_namelen = sizeof(batch->recv_src[i]);
+		batch->recv_msg[i].msg_hdr.msg_controllen = UDPFROMTO_CMSG_SIZE;
+		batch->recv_msg[i].msg_hdr.msg_flags = 0;
+	}
+
+	batch->recv_num = 0;
+
+	/*
+	 *	Don't wait for the batch to fill.  Take whatever is
+	 *	there now.
+	 */
+	rcode = recvmmsgfromto(batch->sockfd, batch->recv_msg, DHCP_BATCH_SIZE, MSG_DONTWAIT,
+			       batch->recv_dst, batch->recv_dst_len);
+	if (rcode < 0) {
+		if ((errno == EAGAIN) || (errno == EINTR)) return 0;
+
+		fr_strerror_printf("Failed reading DHCP socket: %s", fr_syserror(errno));
+		return -1;
+	}
+
+	batch->recv_num = rcode;
+	return rcode;
+#else
+	/*
+	 *	fr_dhcp_batch_packet() reads one packet at a time.
+	 */
+	(void) batch;
+	return 1;
+#endif
+}
+
+/** Check one of the packets read by fr_dhcp_batch_recv()
+ *
+ * @param batch the packets were read into.
+ * @param i index of the packet.
+ * @return the packet, or NULL if it's malformed.
+ */
+RADIUS_PACKET *fr_dhcp_batch_packet(fr_dhcp_batch_t *batch, int i)
+{
+#ifdef WITH_DHCP_RECV_BATCH
+	RADIUS_PACKET	*packet;
+	struct msghdr	*msgh;
+
+	if ((i < 0) || (i >= batch->recv_num)) {
+		fr_strerror_printf("No packet %d in batch", i);
+		return NULL;
+	}
+	msgh = &batch->recv_msg[i].msg_hdr;
+
+	if (msgh->msg_flags & MSG_TRUNC) {
+		fr_strerror_printf("DHCP packet is too large (> %d)", MAX_PACKET_SIZE);
+		return NULL;
+	}
+
+	packet = rad_alloc(NULL, false);
+	if (!packet) {
+		fr_strerror_printf("Failed allocating packet");
+		return NULL;
+	}
+
+	/*
+	 *	Nothing writes past the end of a received packet, so
+	 *	it only needs as much memory as it uses.
+	 */
+	packet->data = talloc_memdup(packet, batch->recv_data[i], batch->recv_msg[i].msg_len);
+	if (!packet->data) {
+		fr_strerror_printf("Out of memory");
+		rad_free(&packet);
+		return NULL;
+	}
+	packet->data_len = batch->recv_msg[i].msg_len;
+	packet->sockfd = batch->sockfd;
+
+	if (dhcp_packet_ok(packet, &batch->recv_src[i], msgh->msg_namelen,
+			   &batch->recv_dst[i], batch->recv_dst_len[i]) < 0) {
+		rad_free(&packet);
+		return NULL;
+	}
+
+	return packet;
+#else
+	(void) i;
+	return fr_dhcp_recv(batch->sockfd);
+#endif
+}
+
+#ifdef WITH_DHCP_SEND_BATCH
+/*
+ *	Write everything which has been queued, and tell each sender
+ *	whether its reply was written: 0 if it was, or the errno.
+ *
+ *	Called with the send mutex held.  The senders are waiting for
+ *	it, so their error variables are still there.
+ */
+static void dhcp_batch_flush(fr_dhcp_batch_t *batch)
+{
+	unsigned int i;
+	dhcp_send_queue_t *queue;
+
+	/*
+	 *	Swap the queue for the spare, so that other threads
+	 *	can keep queueing replies while we write.
+	 */
+	PTHREAD_MUTEX_LOCK(&batch->queue_mutex);
+	queue = batch->queue;
+	batch->queue = batch->spare;
+	batch->spare = queue;
+	PTHREAD_MUTEX_UNLOCK(&batch->queue_mutex);
+
+	if (queue->num == 0) return;
+
+	/*
+	 *	A packet which couldn't be written has msg_len 0, and
+	 *	errno says why.  The others in the batch are still
+	 *	written.
+	 */
+	errno = 0;
+	(void) sendmmsgfromto(batch->sockfd, queue->msg, queue->num, 0, queue->src);
+
+	for (i = 0; i < queue->num; i++) {
+		if (queue->msg[i].msg_len > 0) {
+			*queue->error[i] = 0;
+		} else {
+			*queue->error[i] = errno ? errno : EIO;
+		}
+	}
+
+	queue->num = 0;
+}
+#endif
+
+/** Send a packet, along with any others which are waiting to be sent
+ *
+ * Threads replying at the same time queue their packets.  The first
+ * one to get the send mutex writes all of them with one system call,
+ * and the others find that their packet has been written.  Each
+ * thread is told whether its own packet was written.
+ *
+ * @param batch to queue the packet in.
+ * @param packet to send.  Must already be encoded.
+ * @return the length of the packet, or -1 on error.
+ */
+int fr_dhcp_batch_send(fr_dhcp_batch_t *batch, RADIUS_PACKET *packet)
+{
+#ifdef WITH_DHCP_SEND_BATCH
+	int			error = -1;	/* not written yet */
+	unsigned int		i;
+	dhcp_send_queue_t	*queue;
+	socklen_t		sizeof_src, sizeof_dst;
+
+	if (packet->data_len == 0) {
+		fr_strerror_printf("No data to send");
+		return -1;
+	}
+
+	if ((packet->data_len > MAX_PACKET_SIZE) || (packet->sockfd != batch->sockfd)) {
+		return fr_dhcp_send(packet);
+	}
+
+	if (fr_debug_lvl > 1) dhcp_send_debug(packet);
+
+	for (;;) {
+		PTHREAD_MUTEX_LOCK(&batch->queue_mutex);
+		queue = batch->queue;
+		if (queue->num < DHCP_BATCH_SIZE) break;
+		PTHREAD_MUTEX_UNLOCK(&batch->queue_mutex);
+
+		/*
+		 *	The queue is full.  Empty it, and try again.
+		 */
+		PTHREAD_MUTEX_LOCK(&batch->send_mutex);
+		dhcp_batch_flush(batch);
+		PTHREAD_MUTEX_UNLOCK(&batch->send_mutex);
+	}
+
+	i = queue->num;
+	if (!fr_ipaddr2sockaddr(&packet->dst_ipaddr, packet->dst_port, &queue->dst[i], &sizeof_dst)) {
+		PTHREAD_MUTEX_UNLOCK(&batch->queue_mutex);
+		fr_strerror_printf("Invalid destination address");
+		return -1;
+	}
+
+	/*
+	 *	No source address means let the kernel choose.
+	 */
+	if (!fr_ipaddr2sockaddr(&packet->src_ipaddr, packet->src_port, &queue->src[i], &sizeof_src)) {
+		memset(&queue->src[i], 0, sizeof(queue->src[i]));
+	}
+
+	memcpy(queue->data[i], packet->data, packet->data_len);
+	queue->iov[i].iov_base = queue->data[i];
+	queue->iov[i].iov_len = packet->data_len;
+
+	memset(&queue->msg[i], 0, sizeof(queue->msg[i]));
+	queue->msg[i].msg_hdr.msg_iov = &queue->iov[i];
+	queue->msg[i].msg_hdr.msg_iovlen = 1;
+	queue->msg[i].msg_hdr.msg_name = &queue->dst[i];
+	queue->msg[i].msg_hdr.msg_namelen = sizeof_dst;
+	queue->msg[i].msg_hdr.msg_control = queue->cbuf[i];
+	queue->error[i] = &error;
+
+	queue->num++;
+	PTHREAD_MUTEX_UNLOCK(&batch->queue_mutex);
+
+	/*
+	 *	If another thread has written our packet, it's
+	 *	already set "error".  Otherwise our packet is still
+	 *	in the queue, and we write it.
+	 */
+	PTHREAD_MUTEX_LOCK(&batch->send_mutex);
+	if (error < 0) dhcp_batch_flush(batch);
+	PTHREAD_MUTEX_UNLOCK(&batch->send_mutex);
+
+	if (error) {
+		fr_strerror_printf("Failed writing DHCP socket: %s", fr_syserror(error));
+		return -1;
+	}
+
+	return packet->data_len;
+#else
+	(void) batch;
+	return fr_dhcp_send(packet);
+#endif
+}
+
 static int fr_dhcp_attr2vp(TALLOC_CTX *ctx, VALUE_PAIR **vp_p, uint8_t const *p, size_t alen);
 
 /** Returns the number of array members for arrays with fixed element sizes
@@ -849,6 +1227,63 @@ static int fr_dhcp_attr2vp(TALLOC_CTX *ctx, VALUE_PAIR **vp_p, uint8_t const *da
 	return 0;
 }
 
+/*
+ *	The attributes for the header fields and options, indexed by
+ *	field and option number, so that decoding a packet doesn't
+ *	need a dictionary lookup for each one.
+ *
+ *	The tables are filled in when the first packet is decoded,
+ *	which is after the dictionaries have been loaded.  Options
+ *	which are added to the dictionary after that are looked up
+ *	the slow way.
+ */
+static DICT_ATTR const	*dhcp_header_attrs[14];
+static DICT_ATTR const	*dhcp_option_attrs[256];
+static DICT_ATTR const	*dhcp_adsl_attr;
+
+#ifdef HAVE_PTHREAD_H
+static pthread_once_t	dhcp_attr_tables_once = PTHREAD_ONCE_INIT;
+#else
+static bool		dhcp_attr_tables_done = false;
+#endif
+
+static void _dhcp_attr_tables_build(void)
+{
+	int i;
+
+	for (i = 0; i < 14; i++) {
+		dhcp_header_attrs[i] = dict_attrbyname(dhcp_header_names[i]);
+	}
+
+	/*
+	 *	0 and 255 are padding and end of options.
+	 */
+	for (i = 1; i < 255; i++) {
+		dhcp_option_attrs[i] = dict_attrbyvalue(i, DHCP_MAGIC_VENDOR);
+	}
+
+	dhcp_adsl_attr = dict_attrbyvalue(255, VENDORPEC_ADSL);
+}
+
+static inline void dhcp_attr_tables_build(void)
+{
+#ifdef HAVE_PTHREAD_H
+	pthread_once(&dhcp_attr_tables_once, _dhcp_attr_tables_build);
+#else
+	if (dhcp_attr_tables_done) return;
+
+	_dhcp_attr_tables_build();
+	dhcp_attr_tables_done = true;
+#endif
+}
+
+static inline DICT_ATTR const *dhcp_option_attr(uint8_t option)
+{
+	if (dhcp_option_attrs[option]) return dhcp_option_attrs[option];
+
+	return dict_attrbyvalue(option, DHCP_MAGIC_VENDOR);
+}
+
 /** Decode DHCP options
  *
  * @param[in,out] out Where to write the decoded options.
@@ -865,6 +1300,8 @@ ssize_t fr_dhcp_decode_options(TALLOC_CTX *ctx, VALUE_PAIR **out, uint8_t const
 	*out = NULL;
 	fr_cursor_init(&cursor, out);
 
+	dhcp_attr_tables_build();
+
 	/*
 	 *	FIXME: This should also check sname && file fields.
 	 *	See the dhcp_get_option() function above.
@@ -906,7 +1343,7 @@ ssize_t fr_dhcp_decode_options(TALLOC_CTX *ctx, VALUE_PAIR **out, uint8_t const
 		 *	Unknown attribute, create an octets type
 		 *	attribute with the contents of the sub-option.
 		 */
-		da = dict_attrbyvalue(p[0], DHCP_MAGIC_VENDOR);
+		da = dhcp_option_attr(p[0]);
 		if (!da) {
 			da = dict_unknown_afrom_fields(ctx, p[0], DHCP_MAGIC_VENDOR);
 			if (!da) {
@@ -929,7 +1366,8 @@ ssize_t fr_dhcp_decode_options(TALLOC_CTX *ctx, VALUE_PAIR **out, uint8_t const
 		 */
 		if ((p[0] == 125) && (p[1] > 6) && (p[2] == 0) && (p[3] == 0) && (p[4] == 0x0d) && (p[5] == 0xe9) &&
 		    (p[6] + 5 == p[1])) {
-			da = dict_attrbyvalue(255, VENDORPEC_ADSL);
+			da = dhcp_adsl_attr;
+			if (!da) da = dict_attrbyvalue(255, VENDORPEC_ADSL);
 			if (!da) goto normal;
 
 			vp = fr_pair_afrom_da(ctx, da);
@@ -999,12 +1437,27 @@ int fr_dhcp_decode(RADIUS_PACKET *packet)
 		return -1;
 	}
 
+	dhcp_attr_tables_build();
+
 	/*
 	 *	Decode the header.
 	 */
 	for (i = 0; i < 14; i++) {
+		if (dhcp_header_attrs[i]) {
+			/*
+			 *	Empty strings are discarded below, so
+			 *	don't bother creating them.  sname and
+			 *	file are usually empty.
+			 */
+			if ((dhcp_header_attrs[i]->type == PW_TYPE_STRING) && (*p == '\0')) {
+				p += dhcp_header_sizes[i];
+				continue;
+			}
 
-		vp = fr_pair_make(packet, NULL, dhcp_header_names[i], NULL, T_OP_EQ);
+			vp = fr_pair_afrom_da(packet, dhcp_header_attrs[i]);
+		} else {
+			vp = fr_pair_make(packet, NULL, dhcp_header_names[i], NULL, T_OP_EQ);
+		}
 		if (!vp) {
 			char buffer[256];
 			strlcpy(buffer, fr_strerror(), sizeof(buffer));
@@ -69,6 +69,7 @@ typedef struct dhcp_socket_t {
 	RADCLIENT	dhcp_client;
 	char const	*src_interface;
 	fr_ipaddr_t     src_ipaddr;
+	fr_dhcp_batch_t	*batch;
 } dhcp_socket_t;
 
 #ifdef WITH_UDPFROMTO
@@ -777,6 +778,12 @@ static int dhcp_socket_parse(CONF_SECTION *cs, rad_listen_t *this)
 	client->secret = client->shortname;
 	client->nas_type = talloc_typed_strdup(sock, "none");
 
+	sock->batch = fr_dhcp_batch_alloc(sock, this->fd);
+	if (!sock->batch) {
+		ERROR("%s", fr_strerror());
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -789,22 +796,36 @@ static int dhcp_socket_parse(CONF_SECTION *cs, rad_listen_t *this)
  */
 static int dhcp_socket_recv(rad_listen_t *listener)
 {
+	int		i, num, received = 0;
 	RADIUS_PACKET	*packet;
-	dhcp_socket_t	*sock;
+	dhcp_socket_t	*sock = listener->data;
 
-	packet = fr_dhcp_recv(listener->fd);
-	if (!packet) {
+	/*
+	 *	Read all of the packets which are waiting, so that a
+	 *	flood of DISCOVERs doesn't need one system call each.
+	 */
+	num = fr_dhcp_batch_recv(sock->batch);
+	if (num < 0) {
 		ERROR("%s", fr_strerror());
 		return 0;
 	}
 
-	sock = listener->data;
-	if (!request_receive(NULL, listener, packet, &sock->dhcp_client, dhcp_process)) {
-		rad_free(&packet);
-		return 0;
+	for (i = 0; i < num; i++) {
+		packet = fr_dhcp_batch_packet(sock->batch, i);
+		if (!packet) {
+			ERROR("%s", fr_strerror());
+			continue;
+		}
+
+		if (!request_receive(NULL, listener, packet, &sock->dhcp_client, dhcp_process)) {
+			rad_free(&packet);
+			continue;
+		}
+
+		received++;
 	}
 
-	return 1;
+	return (received > 0);
 }
 
 
@@ -828,7 +849,7 @@ static int dhcp_socket_send(rad_listen_t *listener, REQUEST *request)
 	sock = listener->data;
 	if (sock->suppress_responses) return 0;
 
-	return fr_dhcp_send(request->reply);
+	return fr_dhcp_batch_send(sock->batch, request->reply);
 }
 
 
@@ -33,15 +33,50 @@ RCSID("$Id$")
 #include	<ctype.h>
 #include	<fcntl.h>
 
+/** A single comparison from a filter entry
+ *
+ */
+typedef struct attr_filter_rule {
+	VALUE_PAIR		*check;		//!< Check item from the filter file.
+#ifdef HAVE_REGEX
+	regex_t			*preg;		//!< Pre-compiled regex for '=~' and '!~'.
+#endif
+} attr_filter_rule_t;
+
+/** All the rules in a filter entry which apply to one attribute
+ *
+ */
+typedef struct attr_filter_attr {
+	DICT_ATTR const		*da;		//!< Attribute the rules apply to.
+	attr_filter_rule_t	*rule;		//!< Rules in file order.
+	int			num;		//!< Number of rules.
+} attr_filter_attr_t;
+
+/** A filter entry, compiled so each input attribute is only compared against its own rules
+ *
+ */
+typedef struct attr_filter_entry {
+	PAIR_LIST		*pl;		//!< Entry from the filter file.
+	bool			fall_through;	//!< Entry contains Fall-Through = Yes.
+	bool			has_relax;	//!< Entry contains Relax-Filter.
+	bool			relax_filter;	//!< Value of the last Relax-Filter.
+	VALUE_PAIR		**set;		//!< ':=' items to add to the output, in file order.
+	int			num_set;	//!< Number of ':=' items.
+	int			vsa_any;	//!< Number of 'Vendor-Specific =* ANY' rules.
+	rbtree_t		*attrs;		//!< Tree of #attr_filter_attr_t keyed on DICT_ATTR.
+	struct attr_filter_entry *next;
+} attr_filter_entry_t;
+
 /*
  *	Define a structure with the module configuration, so it can
  *	be used as the instance handle.
  */
 typedef struct rlm_attr_filter {
-	char const	*filename;
-	char const	*key;
-	bool		relaxed;
-	PAIR_LIST	*attrs;
+	char const		*filename;
+	char const		*key;
+	bool			relaxed;
+	PAIR_LIST		*attrs;
+	attr_filter_entry_t	*entries;	//!< Compiled version of attrs.
 } rlm_attr_filter_t;
 
 static const CONF_PARSER module_config[] = {
@@ -52,12 +87,36 @@ static const CONF_PARSER module_config[] = {
 	CONF_PARSER_TERMINATOR
 };
 
-static void check_pair(REQUEST *request, VALUE_PAIR *check_item, VALUE_PAIR *reply_item, int *pass, int *fail)
+static void check_pair(REQUEST *request, attr_filter_rule_t const *rule, VALUE_PAIR *reply_item, int *pass, int *fail)
 {
-	int compare;
-
-	if (check_item->op == T_OP_SET) return;
-
+	VALUE_PAIR	*check_item = rule->check;
+	int		compare;
+
+#ifdef HAVE_REGEX
+	if (rule->preg) {
+		char	*value;
+		int	slen;
+
+		value = vp_aprints_value(request, reply_item, '\0');
+		if (!value) {
+			compare = -1;
+		} else {
+			/*
+			 *	Don't care about substring matches, oh well...
+			 */
+			slen = regex_exec(rule->preg, value, talloc_array_length(value) - 1, NULL, NULL);
+			talloc_free(value);
+
+			if (slen < 0) {
+				compare = -1;
+			} else if (check_item->op == T_OP_REG_EQ) {
+				compare = slen;
+			} else {
+				compare = !slen;
+			}
+		}
+	} else
+#endif
 	compare = fr_pair_cmp(check_item, reply_item);
 	if (compare < 0) {
 		REDEBUG("Comparison failed: %s", fr_strerror());
@@ -70,16 +129,27 @@ static void check_pair(REQUEST *request, VALUE_PAIR *check_item, VALUE_PAIR *rep
 	}
 
 	if (RDEBUG_ENABLED3) {
-		char rule[1024], pair[1024];
+		char rule_buff[1024], pair[1024];
 
-		vp_prints(rule, sizeof(rule), check_item);
+		vp_prints(rule_buff, sizeof(rule_buff), check_item);
 		vp_prints(pair, sizeof(pair), reply_item);
-		RDEBUG3("%s %s %s", pair, compare == 1 ? "allowed by" : "disallowed by", rule);
+		RDEBUG3("%s %s %s", pair, compare == 1 ? "allowed by" : "disallowed by", rule_buff);
 	}
 
 	return;
 }
 
+static int attr_filter_attr_cmp(void const *one, void const *two)
+{
+	attr_filter_attr_t const *a = one;
+	attr_filter_attr_t const *b = two;
+
+	if (a->da < b->da) return -1;
+	if (a->da > b->da) return +1;
+
+	return 0;
+}
+
 static int attr_filter_getfile(TALLOC_CTX *ctx, char const *filename, PAIR_LIST **pair_list)
 {
 	vp_cursor_t cursor;
@@ -125,7 +195,129 @@ static int attr_filter_getfile(TALLOC_CTX *ctx, char const *filename, PAIR_LIST
 	return 0;
 }
 
+/** Compile a filter entry into per-attribute rule tables
+ *
+ * @param ctx to allocate the compiled entry in.
+ * @param filename the entry was read from, for error messages.
+ * @param pl entry to compile.
+ * @return the compiled entry, or NULL on error.
+ */
+static attr_filter_entry_t *attr_filter_compile(TALLOC_CTX *ctx, char const *filename, PAIR_LIST *pl)
+{
+	vp_cursor_t		cursor;
+	VALUE_PAIR		*vp;
+	attr_filter_entry_t	*entry;
+	attr_filter_attr_t	*attr, my_attr;
+	attr_filter_rule_t	*rule;
+	int			num_set = 0;
+
+	entry = talloc_zero(ctx, attr_filter_entry_t);
+	if (!entry) return NULL;
+
+	entry->pl = pl;
+	entry->attrs = rbtree_create(entry, attr_filter_attr_cmp, NULL, RBTREE_FLAG_NONE);
+	if (!entry->attrs) goto error;
+
+	/*
+	 *	Size the tables first, so we don't have to keep
+	 *	growing them.
+	 */
+	for (vp = fr_cursor_init(&cursor, &pl->check); vp; vp = fr_cursor_next(&cursor)) {
+		if (!vp->da->vendor && (vp->da->attr == PW_FALL_THROUGH) && (vp->vp_integer == 1)) {
+			entry->fall_through = true;
+			continue;
+		} else if (!vp->da->vendor && (vp->da->attr == PW_RELAX_FILTER)) {
+			entry->has_relax = true;
+			entry->relax_filter = (vp->vp_integer != 0);
+			continue;
+		}
+
+		/*
+		 *	':=' items are copied to the output, and are
+		 *	never compared.
+		 */
+		if (vp->op == T_OP_SET) {
+			num_set++;
+			continue;
+		}
+
+		/*
+		 *	Vendor-Specific is special, and matches any VSA
+		 *	if the comparison is always true.
+		 */
+		if (!vp->da->vendor && (vp->da->attr == PW_VENDOR_SPECIFIC) && (vp->op == T_OP_CMP_TRUE)) {
+			entry->vsa_any++;
+		}
+
+		my_attr.da = vp->da;
+		attr = rbtree_finddata(entry->attrs, &my_attr);
+		if (!attr) {
+			attr = talloc_zero(entry, attr_filter_attr_t);
+			if (!attr) goto error;
+
+			attr->da = vp->da;
+			if (!rbtree_insert(entry->attrs, attr)) {
+				talloc_free(attr);
+				goto error;
+			}
+		}
+		attr->num++;
+	}
+
+	if (num_set) {
+		entry->set = talloc_array(entry, VALUE_PAIR *, num_set);
+		if (!entry->set) goto error;
+	}
+
+	for (vp = fr_cursor_init(&cursor, &pl->check); vp; vp = fr_cursor_next(&cursor)) {
+		/*
+		 *	Flags, as above.  They're neither rules nor
+		 *	things to add to the output.
+		 */
+		if (!vp->da->vendor && (((vp->da->attr == PW_FALL_THROUGH) && (vp->vp_integer == 1)) ||
+					(vp->da->attr == PW_RELAX_FILTER))) {
+			continue;
+		}
+
+		if (vp->op == T_OP_SET) {
+			entry->set[entry->num_set++] = vp;
+			continue;
+		}
+
+		my_attr.da = vp->da;
+		attr = rbtree_finddata(entry->attrs, &my_attr);
+		rad_assert(attr != NULL);
+
+		if (!attr->rule) {
+			attr->rule = talloc_zero_array(attr, attr_filter_rule_t, attr->num);
+			if (!attr->rule) goto error;
+			attr->num = 0;
+		}
+
+		rule = &attr->rule[attr->num++];
+		rule->check = vp;
+
+#ifdef HAVE_REGEX
+		if (((vp->op == T_OP_REG_EQ) || (vp->op == T_OP_REG_NE)) && (vp->da->type == PW_TYPE_STRING)) {
+			ssize_t slen;
 
+			slen = regex_compile(attr, &rule->preg, vp->value.xlat, talloc_array_length(vp->value.xlat) - 1,
+					     false, false, false, false);
+			if (slen <= 0) {
+				ERROR("[%s]:%d Error at offset %zu compiling regex for %s: %s",
+				      filename, pl->lineno, -slen, vp->da->name, fr_strerror());
+				goto error;
+			}
+		}
+#endif
+	}
+
+	return entry;
+
+error:
+	talloc_free(entry);
+	return NULL;
+}
 /*
  *	(Re-)read the "attrs" file into memory.
  */
@@ -134,6 +326,9 @@ static int mod_instantiate(UNUSED CONF_SECTION *conf, void *instance)
 	rlm_attr_filter_t *inst = instance;
 	int rcode;
 
+	PAIR_LIST *pl;
+	attr_filter_entry_t *entry, **last;
+
 	rcode = attr_filter_getfile(inst, inst->filename, &inst->attrs);
 	if (rcode != 0) {
 		ERROR("Errors reading %s", inst->filename);
@@ -141,6 +336,23 @@ static int mod_instantiate(UNUSED CONF_SECTION *conf, void *instance)
 		return -1;
 	}
 
+	/*
+	 *	Compile each entry, so that every input attribute is
+	 *	only compared against the rules for that attribute.
+	 */
+	last = &inst->entries;
+	for (pl = inst->attrs; pl; pl = pl->next) {
+		entry = attr_filter_compile(inst, inst->filename, pl);
+		if (!entry) {
+			ERROR("Errors compiling %s", inst->filename);
+
+			return -1;
+		}
+
+		*last = entry;
+		last = &entry->next;
+	}
+
 	return 0;
 }
 
@@ -152,11 +364,12 @@ static rlm_rcode_t CC_HINT(nonnull(1,2)) attr_filter_common(void *instance, REQU
 {
 	rlm_attr_filter_t *inst = instance;
 	VALUE_PAIR	*vp;
-	vp_cursor_t	input, check, out;
-	VALUE_PAIR	*input_item, *check_item, *output;
-	PAIR_LIST	*pl;
+	vp_cursor_t	input, out;
+	VALUE_PAIR	*input_item, *output;
+	attr_filter_entry_t *entry;
+	attr_filter_attr_t *attr, my_attr;
 	int		found = 0;
-	int		pass, fail = 0;
+	int		i, pass, fail = 0;
 	char const	*keyname = NULL;
 	char		buffer[256];
 
@@ -192,9 +405,9 @@ static rlm_rcode_t CC_HINT(nonnull(1,2)) attr_filter_common(void *instance, REQU
 	/*
 	 *      Find the attr_filter profile entry for the entry.
 	 */
-	for (pl = inst->attrs; pl; pl = pl->next) {
-		int fall_through = 0;
-		int relax_filter = inst->relaxed;
+	for (entry = inst->entries; entry; entry = entry->next) {
+		PAIR_LIST *pl = entry->pl;
+		int relax_filter = entry->has_relax ? entry->relax_filter : inst->relaxed;
 
 		/*
 		 *  If the current entry is NOT a default,
@@ -209,39 +422,24 @@ static rlm_rcode_t CC_HINT(nonnull(1,2)) attr_filter_common(void *instance, REQU
 		RDEBUG2("Matched entry %s at line %d", pl->name, pl->lineno);
 		found = 1;
 
-		for (check_item = fr_cursor_init(&check, &pl->check);
-		     check_item;
-		     check_item = fr_cursor_next(&check)) {
-			if (!check_item->da->vendor &&
-			    (check_item->da->attr == PW_FALL_THROUGH) &&
-				(check_item->vp_integer == 1)) {
-				fall_through = 1;
-				continue;
-			}
-			else if (!check_item->da->vendor && check_item->da->attr == PW_RELAX_FILTER) {
-				relax_filter = check_item->vp_integer;
-				continue;
-			}
-
-			/*
-			 *    If it is a SET operator, add the attribute to
-			 *    the output list without checking it.
-			 */
-			if (check_item->op == T_OP_SET ) {
-				vp = fr_pair_copy(packet, check_item);
-				if (!vp) {
-					goto error;
-				}
-				radius_xlat_do(request, vp);
-				fr_cursor_insert(&out, vp);
+		/*
+		 *    SET operators add the attribute to the output
+		 *    list without checking it.
+		 */
+		for (i = 0; i < entry->num_set; i++) {
+			vp = fr_pair_copy(packet, entry->set[i]);
+			if (!vp) {
+				goto error;
 			}
+			radius_xlat_do(request, vp);
+			fr_cursor_insert(&out, vp);
 		}
 
 		/*
 		 *	Iterate through the input items, comparing
-		 *	each item to every rule, then moving it to the
-		 *	output list only if it matches all rules
-		 *	for that attribute.  IE, Idle-Timeout is moved
+		 *	each item to the rules for that attribute,
+		 *	then moving it to the output list only if it
+		 *	matches all of them.  IE, Idle-Timeout is moved
 		 *	only if it matches all rules that describe an
 		 *	Idle-Timeout.
 		 */
@@ -251,26 +449,15 @@ static rlm_rcode_t CC_HINT(nonnull(1,2)) attr_filter_common(void *instance, REQU
 			pass = fail = 0; /* reset the pass,fail vars for each reply item */
 
 			/*
-			 *  Reset the check_item pointer to beginning of the list
+			 *  Vendor-Specific is special, and matches any VSA if the
+			 *  comparison is always true.
 			 */
-			for (check_item = fr_cursor_first(&check);
-			     check_item;
-			     check_item = fr_cursor_next(&check)) {
-				/*
-				 *  Vendor-Specific is special, and matches any VSA if the
-				 *  comparison is always true.
-				 */
-				if ((check_item->da->vendor == 0) &&
-				    (check_item->da->attr == PW_VENDOR_SPECIFIC) &&
-				    (input_item->da->vendor != 0) &&
-				    (check_item->op == T_OP_CMP_TRUE)) {
-					pass++;
-					continue;
-				}
+			if (input_item->da->vendor != 0) pass += entry->vsa_any;
 
-				if (input_item->da == check_item->da) {
-					check_pair(request, check_item, input_item, &pass, &fail);
-				}
+			my_attr.da = input_item->da;
+			attr = rbtree_finddata(entry->attrs, &my_attr);
+			if (attr) for (i = 0; i < attr->num; i++) {
+				check_pair(request, &attr->rule[i], input_item, &pass, &fail);
 			}
 
 			RDEBUG3("Attribute \"%s\" allowed by %i rules, disallowed by %i rules",
@@ -292,7 +479,7 @@ static rlm_rcode_t CC_HINT(nonnull(1,2)) attr_filter_common(void *instance, REQU
 		}
 
 		/* If we shouldn't fall through, break */
-		if (!fall_through) {
+		if (!entry->fall_through) {
 			break;
 		}
 	}
@@ -0,0 +1,652 @@
+/*
+ *   This program is is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or (at
+ *   your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file rlm_cache_htable.c
+ * @brief Sharded hash table based cache, with a memory bound.
+ *
+ * Entries are spread over a number of shards by the hash of their key,
+ * each shard having its own lock, so that requests for different keys
+ * rarely wait for each other.
+ *
+ * When a shard reaches its share of max_size, CLOCK picks an eviction
+ * candidate, and a TinyLFU frequency sketch decides whether the new
+ * entry is worth more than the candidate.  Keys seen only once don't
+ * push out popular ones.
+ *
+ * Expired entries are removed in batches, from a one second resolution
+ * timer wheel.
+ *
+ * @copyright 2015 The FreeRADIUS server project
+ */
+#include <freeradius-devel/radiusd.h>
+#include <freeradius-devel/rad_assert.h>
+#include "../../rlm_cache.h"
+
+#ifdef HAVE_PTHREAD_H
+#  define PTHREAD_MUTEX_LOCK pthread_mutex_lock
+#  define PTHREAD_MUTEX_UNLOCK pthread_mutex_unlock
+#else
+#  define PTHREAD_MUTEX_LOCK(_x)
+#  define PTHREAD_MUTEX_UNLOCK(_x)
+#endif
+
+#define CACHE_HTABLE_MAX_SHARDS		256
+#define CACHE_HTABLE_WHEEL_SIZE		256	//!< Expiry buckets, one per second.  Must be a power of 2.
+#define CACHE_HTABLE_SKETCH_DEPTH	4	//!< Rows in the frequency sketch.
+#define CACHE_HTABLE_SKETCH_MAX		15	//!< Counters saturate here.
+
+typedef struct rlm_cache_htable_entry rlm_cache_htable_entry_t;
+
+struct rlm_cache_htable_entry {
+	rlm_cache_entry_t		fields;		//!< Entry data.
+
+	uint32_t			hash;		//!< Hash of the key.
+	size_t				size;		//!< Memory charged to the shard.
+	bool				referenced;	//!< CLOCK bit, set whenever the entry is found.
+
+	rlm_cache_htable_entry_t	*clock_next;	//!< Next entry in the CLOCK ring.
+	rlm_cache_htable_entry_t	*clock_prev;	//!< Previous entry in the CLOCK ring.
+
+	rlm_cache_htable_entry_t	*wheel_next;	//!< Next entry in the same expiry bucket.
+	rlm_cache_htable_entry_t	**wheel_prev;	//!< Whatever points to this entry.
+};
+
+typedef struct cache_htable_shard {
+	fr_hash_table_t			*ht;		//!< Entries, indexed by key.
+	uint32_t			num;		//!< Number of entries.
+	size_t				size;		//!< Memory used by entries.
+	size_t				max_size;	//!< This shard's share of max_size.
+
+	rlm_cache_htable_entry_t	*hand;		//!< CLOCK hand.
+
+	rlm_cache_htable_entry_t	*wheel[CACHE_HTABLE_WHEEL_SIZE];	//!< Entries by expiry second.
+	time_t				swept;		//!< Every bucket up to here has been swept.
+
+	uint8_t				*sketch;	//!< Count-min sketch of key frequencies.
+	uint32_t			sketch_shift;	//!< 32 - log2(columns).
+	uint32_t			samples;	//!< Increments since the sketch was last aged.
+	uint32_t			sample_limit;	//!< Age the sketch after this many increments.
+
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_t			mutex;		//!< Protects everything above.
+#endif
+} cache_htable_shard_t;
+
+typedef struct rlm_cache_htable {
+	uint32_t			num_shards;	//!< Number of independently locked shards.
+	uint64_t			max_size;	//!< Maximum memory used by entries, 0 for no limit.
+
+	uint32_t			shard_shift;	//!< Shift to get a shard from a hash.
+	cache_htable_shard_t		*shards;
+} rlm_cache_htable_t;
+
+static const CONF_PARSER driver_config[] = {
+	{ "shards", FR_CONF_OFFSET(PW_TYPE_INTEGER, rlm_cache_htable_t, num_shards), "16" },
+	{ "max_size", FR_CONF_OFFSET(PW_TYPE_INTEGER64, rlm_cache_htable_t, max_size), "0" },
+	CONF_PARSER_TERMINATOR
+};
+
+static uint32_t const sketch_seed[CACHE_HTABLE_SKETCH_DEPTH] = {
+	0x97cb3127, 0xab3f4ebd, 0xc3a5c85c, 0x8f2b2f0f
+};
+
+static uint32_t cache_entry_hash(void const *data)
+{
+	rlm_cache_htable_entry_t const *e = data;
+
+	return e->hash;
+}
+
+static int cache_entry_cmp(void const *one, void const *two)
+{
+	rlm_cache_htable_entry_t const *a = one;
+	rlm_cache_htable_entry_t const *b = two;
+
+	return strcmp(a->fields.key, b->fields.key);
+}
+
+static void _cache_entry_free(void *data)
+{
+	talloc_free(data);
+}
+
+/** Return the index of a hash in one row of the sketch
+ *
+ */
+static inline uint32_t sketch_index(cache_htable_shard_t const *shard, uint32_t hash, int row)
+{
+	return ((hash ^ sketch_seed[row]) * 0x9e3779b1) >> shard->sketch_shift;
+}
+
+/** Record an access to a key
+ *
+ * Counters are halved periodically, so that keys which were popular a
+ * long time ago don't stay popular forever.
+ */
+static void sketch_increment(cache_htable_shard_t *shard, uint32_t hash)
+{
+	uint32_t	columns = (uint32_t)1 << (32 - shard->sketch_shift);
+	int		i;
+
+	for (i = 0; i < CACHE_HTABLE_SKETCH_DEPTH; i++) {
+		uint8_t *counter = &shard->sketch[(i * columns) + sketch_index(shard, hash, i)];
+
+		if (*counter < CACHE_HTABLE_SKETCH_MAX) (*counter)++;
+	}
+
+	if (++shard->samples < shard->sample_limit) return;
+
+	for (i = 0; i < (int)(columns * CACHE_HTABLE_SKETCH_DEPTH); i++) shard->sketch[i] >>= 1;
+	shard->samples /= 2;
+}
+
+/** Estimate how often a key has been accessed
+ *
+ */
+static uint8_t sketch_frequency(cache_htable_shard_t const *shard, uint32_t hash)
+{
+	uint32_t	columns = (uint32_t)1 << (32 - shard->sketch_shift);
+	uint8_t		freq = CACHE_HTABLE_SKETCH_MAX;
+	int		i;
+
+	for (i = 0; i < CACHE_HTABLE_SKETCH_DEPTH; i++) {
+		uint8_t counter = shard->sketch[(i * columns) + sketch_index(shard, hash, i)];
+
+		if (counter < freq) freq = counter;
+	}
+
+	return freq;
+}
+
+/** Add an entry to the expiry bucket for its expiry time
+ *
+ */
+static void wheel_insert(cache_htable_shard_t *shard, rlm_cache_htable_entry_t *e)
+{
+	rlm_cache_htable_entry_t **bucket;
+
+	bucket = &shard->wheel[e->fields.expires & (CACHE_HTABLE_WHEEL_SIZE - 1)];
+
+	e->wheel_next = *bucket;
+	if (e->wheel_next) e->wheel_next->wheel_prev = &e->wheel_next;
+	e->wheel_prev = bucket;
+	*bucket = e;
+}
+
+static void wheel_remove(rlm_cache_htable_entry_t *e)
+{
+	*e->wheel_prev = e->wheel_next;
+	if (e->wheel_next) e->wheel_next->wheel_prev = e->wheel_prev;
+	e->wheel_next = NULL;
+	e->wheel_prev = NULL;
+}
+
+/** Remove an entry from a shard, and free it
+ *
+ */
+static void shard_remove(cache_htable_shard_t *shard, rlm_cache_htable_entry_t *e)
+{
+	if (e->wheel_prev) wheel_remove(e);
+
+	/*
+	 *	Unlink from the CLOCK ring.
+	 */
+	if (e->clock_next == e) {
+		shard->hand = NULL;
+	} else {
+		if (shard->hand == e) shard->hand = e->clock_next;
+		e->clock_prev->clock_next = e->clock_next;
+		e->clock_next->clock_prev = e->clock_prev;
+	}
+
+	shard->num--;
+	shard->size -= e->size;
+
+	fr_hash_table_delete(shard->ht, e);	/* frees the entry */
+}
+
+/** Remove expired entries from the shard
+ *
+ * Sweeps every bucket between the last sweep and one second ago, so
+ * the cost is spread over the requests which use the shard.  Entries
+ * whose TTL was extended after they were inserted are moved to the
+ * bucket for their new expiry time.
+ */
+static void shard_sweep(cache_htable_shard_t *shard, time_t now)
+{
+	time_t	when, last = now - 1;
+
+	if (last <= shard->swept) return;
+
+	when = shard->swept + 1;
+	if ((last - when) >= CACHE_HTABLE_WHEEL_SIZE) when = last - (CACHE_HTABLE_WHEEL_SIZE - 1);
+
+	for (; when <= last; when++) {
+		rlm_cache_htable_entry_t *e, *next;
+
+		e = shard->wheel[when & (CACHE_HTABLE_WHEEL_SIZE - 1)];
+		shard->wheel[when & (CACHE_HTABLE_WHEEL_SIZE - 1)] = NULL;
+
+		for (; e; e = next) {
+			next = e->wheel_next;
+			e->wheel_prev = NULL;
+
+			if (e->fields.expires < now) {
+				shard_remove(shard, e);
+				continue;
+			}
+			wheel_insert(shard, e);
+		}
+	}
+
+	shard->swept = last;
+}
+
+/** Pick an entry to evict, using the CLOCK algorithm
+ *
+ */
+static rlm_cache_htable_entry_t *shard_victim(cache_htable_shard_t *shard)
+{
+	rlm_cache_htable_entry_t *e;
+
+	for (;;) {
+		e = shard->hand;
+		shard->hand = e->clock_next;
+
+		if (!e->referenced) return e;
+		e->referenced = false;
+	}
+}
+
+/** Lock the shard holding a particular hash
+ *
+ * The handle records which shard (if any) is locked, so the find and
+ * insert for the same key only take the lock once.
+ */
+static cache_htable_shard_t *shard_lock(rlm_cache_htable_t *driver, rlm_cache_handle_t **handle, uint32_t hash)
+{
+	cache_htable_shard_t *shard;
+
+	shard = &driver->shards[driver->shard_shift < 32 ? (hash >> driver->shard_shift) : 0];
+	if (*handle == shard) return shard;
+
+	if (*handle != driver) {
+		cache_htable_shard_t *old = *handle;
+
+		PTHREAD_MUTEX_UNLOCK(&old->mutex);
+	}
+
+	PTHREAD_MUTEX_LOCK(&shard->mutex);
+	*handle = shard;
+
+	return shard;
+}
+
+/** Cleanup a cache_htable instance
+ *
+ * @param driver to free.
+ * @return 0
+ */
+static int _mod_detach(rlm_cache_htable_t *driver)
+{
+	uint32_t i;
+
+	if (!driver->shards) return 0;
+
+	for (i = 0; i < driver->num_shards; i++) {
+		if (driver->shards[i].ht) fr_hash_table_free(driver->shards[i].ht);
+#ifdef HAVE_PTHREAD_H
+		pthread_mutex_destroy(&driver->shards[i].mutex);
+#endif
+	}
+
+	return 0;
+}
+
+/** Create a new cache_htable instance
+ *
+ * @param conf htable specific conf section.
+ * @param inst main rlm_cache instance.
+ * @return 0 on success, -1 on failure.
+ */
+static int mod_instantiate(CONF_SECTION *conf, rlm_cache_t *inst)
+{
+	rlm_cache_htable_t	*driver;
+	uint32_t		shards, columns, i;
+	uint32_t		bits = 0;
+
+	driver = talloc_zero(inst, rlm_cache_htable_t);
+	if (cf_section_parse(conf, driver, driver_config) < 0) return -1;
+
+	FR_INTEGER_BOUND_CHECK("shards", driver->num_shards, >=, 1);
+	FR_INTEGER_BOUND_CHECK("shards", driver->num_shards, <=, CACHE_HTABLE_MAX_SHARDS);
+
+	/*
+	 *	Round up to a power of 2, so the shard is just the
+	 *	top bits of the hash.  The hash table uses the low bits.
+	 */
+	for (shards = 1; shards < driver->num_shards; shards <<= 1) bits++;
+	driver->num_shards = shards;
+	driver->shard_shift = 32 - bits;
+
+	/*
+	 *	Size the sketch for the number of entries we expect
+	 *	each shard to hold.
+	 */
+	columns = 1024;
+	if (inst->max_entries > 0) {
+		for (columns = 64; (columns < (1 << 20)) && (columns < (inst->max_entries / shards)); columns <<= 1);
+	}
+	for (bits = 0; ((uint32_t)1 << bits) < columns; bits++);
+
+	driver->shards = talloc_zero_array(driver, cache_htable_shard_t, driver->num_shards);
+	if (!driver->shards) {
+		ERROR("Failed allocating cache shards");
+		return -1;
+	}
+	talloc_set_destructor(driver, _mod_detach);
+
+	for (i = 0; i < driver->num_shards; i++) {
+		cache_htable_shard_t *shard = &driver->shards[i];
+
+		shard->ht = fr_hash_table_create(cache_entry_hash, cache_entry_cmp, _cache_entry_free);
+		if (!shard->ht) {
+			ERROR("Failed to create cache");
+			return -1;
+		}
+
+		shard->max_size = driver->max_size / driver->num_shards;
+
+		shard->sketch = talloc_zero_array(driver->shards, uint8_t, columns * CACHE_HTABLE_SKETCH_DEPTH);
+		if (!shard->sketch) {
+			ERROR("Failed allocating frequency sketch");
+			return -1;
+		}
+		shard->sketch_shift = 32 - bits;
+		shard->sample_limit = columns * 10;
+
+#ifdef HAVE_PTHREAD_H
+		if (pthread_mutex_init(&shard->mutex, NULL) < 0) {
+			ERROR("Failed initializing mutex: %s", fr_syserror(errno));
+			return -1;
+		}
+#endif
+	}
+
+	inst->driver = driver;
+
+	return 0;
+}
+
+/** Custom allocation function for the driver
+ *
+ * Allows allocation of cache entry structures with additional fields.
+ *
+ * @param inst main rlm_cache instance.
+ * @param request The current request.
+ * @return 0 on success, -1 on failure.
+ */
+static rlm_cache_entry_t *cache_entry_alloc(UNUSED rlm_cache_t *inst, REQUEST *request)
+{
+	rlm_cache_htable_entry_t *c;
+
+	c = talloc_zero(NULL, rlm_cache_htable_entry_t);
+	if (!c) {
+		REDEBUG("Failed allocating cache entry");
+		return NULL;
+	}
+
+	return (rlm_cache_entry_t *)c;
+}
+
+/** Locate a cache entry
+ *
+ * @param out Where to write the search result.
+ * @param inst main rlm_cache instance.
+ * @param request The current request.
+ * @param handle The shard lock.
+ * @param key to search for.
+ * @return CACHE_OK on success CACHE_MISS if no entry found.
+ */
+static cache_status_t cache_entry_find(rlm_cache_entry_t **out, rlm_cache_t *inst, REQUEST *request,
+				       rlm_cache_handle_t **handle, char const *key)
+{
+	rlm_cache_htable_t		*driver = inst->driver;
+	cache_htable_shard_t		*shard;
+	rlm_cache_htable_entry_t	*e, my_e;
+
+	my_e.fields.key = key;
+	my_e.hash = fr_hash_string(key);
+
+	shard = shard_lock(driver, handle, my_e.hash);
+
+	shard_sweep(shard, request->timestamp);
+	sketch_increment(shard, my_e.hash);
+
+	e = fr_hash_table_finddata(shard->ht, &my_e);
+	if (!e) {
+		*out = NULL;
+		return CACHE_MISS;
+	}
+	e->referenced = true;
+	*out = &e->fields;
+
+	return CACHE_OK;
+}
+
+/** Insert a new entry into the data store
+ *
+ * If the shard is full, entries are evicted to make room, but only
+ * while the new entry is accessed more often than the eviction
+ * candidate.  Otherwise the new entry isn't stored.
+ *
+ * @param inst main rlm_cache instance.
+ * @param request The current request.
+ * @param handle The shard lock.
+ * @param c entry to insert.
+ * @return CACHE_OK on success, CACHE_REJECTED if the entry wasn't worth
+ *	storing, else CACHE_ERROR on error.
+ */
+static cache_status_t cache_entry_insert(rlm_cache_t *inst, REQUEST *request, rlm_cache_handle_t **handle,
+					 rlm_cache_entry_t *c)
+{
+	rlm_cache_htable_t		*driver = inst->driver;
+	cache_htable_shard_t		*shard;
+	rlm_cache_htable_entry_t	*e = (rlm_cache_htable_entry_t *)c;
+
+	e->hash = fr_hash_string(c->key);
+	e->size = talloc_total_size(e);
+
+	shard = shard_lock(driver, handle, e->hash);
+	shard_sweep(shard, request->timestamp);
+
+	if (shard->max_size) {
+		uint8_t freq = sketch_frequency(shard, e->hash);
+
+		while (shard->hand && ((shard->size + e->size) > shard->max_size)) {
+			rlm_cache_htable_entry_t *victim;
+
+			victim = shard_victim(shard);
+			if (freq <= sketch_frequency(shard, victim->hash)) break;
+
+			RDEBUG3("Evicting entry for \"%s\"", victim->fields.key);
+			shard_remove(shard, victim);
+		}
+
+		if ((shard->size + e->size) > shard->max_size) {
+			RDEBUG2("Not caching entry for \"%s\", it is used less often than existing entries",
+				c->key);
+
+			return CACHE_REJECTED;
+		}
+	}
+
+	if (!fr_hash_table_insert(shard->ht, e)) {
+		REDEBUG("Failed adding entry for key \"%s\"", c->key);
+
+		return CACHE_ERROR;
+	}
+
+	if (!shard->hand) {
+		e->clock_next = e->clock_prev = e;
+		shard->hand = e;
+	} else {
+		/*
+		 *	Behind the hand, so it's examined last.
+		 */
+		e->clock_next = shard->hand;
+		e->clock_prev = shard->hand->clock_prev;
+		e->clock_prev->clock_next = e;
+		shard->hand->clock_prev = e;
+	}
+
+	wheel_insert(shard, e);
+
+	shard->num++;
+	shard->size += e->size;
+
+	return CACHE_OK;
+}
+
+/** Free an entry and remove it from the data store
+ *
+ * @param inst main rlm_cache instance.
+ * @param request The current request.
+ * @param handle The shard lock.
+ * @param c entry to expire
+ * @return CACHE_OK.
+ */
+static cache_status_t cache_entry_expire(rlm_cache_t *inst, UNUSED REQUEST *request, rlm_cache_handle_t **handle,
+					 rlm_cache_entry_t *c)
+{
+	rlm_cache_htable_t		*driver = inst->driver;
+	rlm_cache_htable_entry_t	*e = (rlm_cache_htable_entry_t *)c;
+
+	shard_remove(shard_lock(driver, handle, e->hash), e);
+
+	return CACHE_OK;
+}
+
+/** Return the number of entries in the cache
+ *
+ * Only the caller's shard is locked, so the total is approximate.
+ *
+ * @param inst main rlm_cache instance.
+ * @param request The current request.
+ * @param handle The shard lock.
+ * @return the number of entries in the cache.
+ */
+static uint32_t cache_entry_count(rlm_cache_t *inst, UNUSED REQUEST *request, UNUSED rlm_cache_handle_t **handle)
+{
+	rlm_cache_htable_t	*driver = inst->driver;
+	uint32_t		i, num = 0;
+
+	for (i = 0; i < driver->num_shards; i++) num += driver->shards[i].num;
+
+	return num;
+}
+
+typedef struct cache_walk_ctx {
+	rlm_cache_walk_cb_t	callback;
+	void			*uctx;
+} cache_walk_ctx_t;
+
+static int _cache_entry_walk(void *ctx, void *data)
+{
+	cache_walk_ctx_t		*walk = ctx;
+	rlm_cache_htable_entry_t	*e = data;
+
+	return (walk->callback(&e->fields, walk->uctx) < 0) ? -1 : 0;
+}
+
+/** Call a function for every entry in the cache
+ *
+ * Each shard is locked in turn while its entries are visited.
+ *
+ * @param inst main rlm_cache instance.
+ * @param callback to call.
+ * @param uctx passed to the callback.
+ * @return 0 on success, -1 if the callback stopped the walk.
+ */
+static int cache_entry_walk(rlm_cache_t *inst, rlm_cache_walk_cb_t callback, void *uctx)
+{
+	rlm_cache_htable_t	*driver = inst->driver;
+	cache_walk_ctx_t	walk = { .callback = callback, .uctx = uctx };
+	uint32_t		i;
+	int			rcode = 0;
+
+	for (i = 0; (i < driver->num_shards) && (rcode == 0); i++) {
+		cache_htable_shard_t *shard = &driver->shards[i];
+
+		PTHREAD_MUTEX_LOCK(&shard->mutex);
+		rcode = fr_hash_table_walk(shard->ht, _cache_entry_walk, &walk);
+		PTHREAD_MUTEX_UNLOCK(&shard->mutex);
+	}
+
+	return rcode;
+}
+
+/** Get a handle
+ *
+ * No shard is locked until we know which key we're using.
+ *
+ * @param out Where to write the handle.
+ * @param inst rlm_cache instance.
+ * @param request The current request.
+ */
+static int cache_acquire(rlm_cache_handle_t **out, rlm_cache_t *inst, UNUSED REQUEST *request)
+{
+	*out = inst->driver;
+
+	return 0;
+}
+
+/** Release the handle, unlocking any shard we locked
+ *
+ * @param inst main rlm_cache instance.
+ * @param request The current request.
+ * @param handle The handle created by cache_acquire.
+ */
+static void cache_release(rlm_cache_t *inst, REQUEST *request, rlm_cache_handle_t **handle)
+{
+	if (*handle != inst->driver) {
+		cache_htable_shard_t *shard = *handle;
+
+		PTHREAD_MUTEX_UNLOCK(&shard->mutex);
+
+		RDEBUG3("Mutex released");
+	}
+
+	*handle = NULL;
+}
+
+extern cache_module_t rlm_cache_htable;
+cache_module_t rlm_cache_htable = {
+	.name		= "rlm_cache_htable",
+	.instantiate	= mod_instantiate,
+	.alloc		= cache_entry_alloc,
+
+	.find		= cache_entry_find,
+	.insert		= cache_entry_insert,
+	.expire		= cache_entry_expire,
+	.count		= cache_entry_count,
+	.walk		= cache_entry_walk,
+
+	.acquire	= cache_acquire,
+	.release	= cache_release,
+};
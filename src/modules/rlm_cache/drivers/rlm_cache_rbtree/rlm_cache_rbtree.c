@@ -284,6 +284,40 @@ static uint32_t cache_entry_count(rlm_cache_t *inst, REQUEST *request, rlm_cache
 	return rbtree_num_elements(driver->cache);
 }
 
+typedef struct cache_walk_ctx {
+	rlm_cache_walk_cb_t	callback;
+	void			*uctx;
+} cache_walk_ctx_t;
+
+static int _cache_entry_walk(void *ctx, void *data)
+{
+	cache_walk_ctx_t *walk = ctx;
+
+	return (walk->callback(data, walk->uctx) < 0) ? -1 : 0;
+}
+
+/** Call a function for every entry in the cache
+ *
+ * The tree is locked for the duration of the walk.
+ *
+ * @param inst main rlm_cache instance.
+ * @param callback to call.
+ * @param uctx passed to the callback.
+ * @return 0 on success, -1 if the callback stopped the walk.
+ */
+static int cache_entry_walk(rlm_cache_t *inst, rlm_cache_walk_cb_t callback, void *uctx)
+{
+	rlm_cache_rbtree_t	*driver = inst->driver;
+	cache_walk_ctx_t	walk = { .callback = callback, .uctx = uctx };
+	int			rcode;
+
+	PTHREAD_MUTEX_LOCK(&driver->mutex);
+	rcode = rbtree_walk(driver->cache, RBTREE_IN_ORDER, _cache_entry_walk, &walk);
+	PTHREAD_MUTEX_UNLOCK(&driver->mutex);
+
+	return rcode;
+}
+
 /** Lock the rbtree
  *
  * @param out Where to write the dummy handle.
@@ -345,6 +379,7 @@ cache_module_t rlm_cache_rbtree = {
 	.insert		= cache_entry_insert,
 	.expire		= cache_entry_expire,
 	.count		= cache_entry_count,
+	.walk		= cache_entry_walk,
 
 	.acquire	= cache_acquire,
 	.release	= cache_release,
@@ -30,6 +30,30 @@ RCSID("$Id$")
 #include <freeradius-devel/rad_assert.h>
 
 #include "rlm_cache.h"
+#include "serialize.h"
+
+#ifdef HAVE_PTHREAD_H
+#  define PTHREAD_MUTEX_LOCK pthread_mutex_lock
+#  define PTHREAD_MUTEX_UNLOCK pthread_mutex_unlock
+#else
+#  define PTHREAD_MUTEX_LOCK(_x)
+#  define PTHREAD_MUTEX_UNLOCK(_x)
+#endif
+
+/** A key which is currently being populated by a request
+ *
+ * Parented off the request which owns it, so that it's released
+ * when the request completes, even if the entry is never inserted.
+ * As that may be long after the request stopped processing, the
+ * claim also lapses after claim_timeout.
+ */
+typedef struct cache_flight {
+	rlm_cache_t		*inst;			//!< Instance the flight belongs to.
+	REQUEST			*request;		//!< Request populating the entry.
+	char const		*key;			//!< Key being populated.
+	struct timeval		expires;		//!< When the claim lapses.
+	bool			active;			//!< Still in the flights tree.
+} cache_flight_t;
 
 /*
  *	A mapping of configuration file names to internal variables.
@@ -49,6 +73,11 @@ static const CONF_PARSER module_config[] = {
 	/* Should be a type which matches time_t, @fixme before 2038 */
 	{ "epoch", FR_CONF_OFFSET(PW_TYPE_SIGNED, rlm_cache_t, epoch), "0" },
 	{ "add_stats", FR_CONF_OFFSET(PW_TYPE_BOOLEAN, rlm_cache_t, stats), "no" },
+	{ "stale_ttl", FR_CONF_OFFSET(PW_TYPE_INTEGER, rlm_cache_t, stale_ttl), "0" },
+	{ "wait_timeout", FR_CONF_OFFSET(PW_TYPE_TIMEVAL, rlm_cache_t, wait_timeout), "0" },
+	{ "claim_timeout", FR_CONF_OFFSET(PW_TYPE_TIMEVAL, rlm_cache_t, claim_timeout), "1.0" },
+	{ "snapshot", FR_CONF_OFFSET(PW_TYPE_FILE_OUTPUT, rlm_cache_t, snapshot), NULL },
+	{ "snapshot_interval", FR_CONF_OFFSET(PW_TYPE_INTEGER, rlm_cache_t, snapshot_interval), "0" },
 	CONF_PARSER_TERMINATOR
 };
 
@@ -74,6 +103,172 @@ static int cache_reconnect(rlm_cache_t *inst, REQUEST *request, rlm_cache_handle
 	return inst->module->reconnect(inst, request, handle);
 }
 
+static int cache_flight_cmp(void const *one, void const *two)
+{
+	cache_flight_t const *a = one;
+	cache_flight_t const *b = two;
+
+	return strcmp(a->key, b->key);
+}
+
+static int _cache_flight_free(cache_flight_t *flight)
+{
+	rlm_cache_t *inst = flight->inst;
+
+	PTHREAD_MUTEX_LOCK(&inst->flight_mutex);
+	if (flight->active) {
+		rbtree_deletebydata(inst->flights, flight);
+#ifdef HAVE_PTHREAD_H
+		pthread_cond_broadcast(&inst->flight_cond);
+#endif
+	}
+	PTHREAD_MUTEX_UNLOCK(&inst->flight_mutex);
+
+	return 0;
+}
+
+/** Find the flight for a key, removing it from the tree if its claim has lapsed
+ *
+ * The memory for a lapsed flight stays with the request which owns it.
+ *
+ * Called with the flight mutex held.
+ */
+static cache_flight_t *cache_flight_find(rlm_cache_t *inst, REQUEST *request, char const *key)
+{
+	cache_flight_t	find, *flight;
+	struct timeval	now;
+
+	memset(&find, 0, sizeof(find));
+	find.key = key;
+
+	flight = rbtree_finddata(inst->flights, &find);
+	if (!flight || (flight->request == request)) return flight;
+
+	gettimeofday(&now, NULL);
+	if (timercmp(&now, &flight->expires, <)) return flight;
+
+	RWDEBUG("Request %u did not populate entry for \"%s\" in time, ignoring its claim",
+		flight->request->number, key);
+	rbtree_deletebydata(inst->flights, flight);
+	flight->active = false;
+#ifdef HAVE_PTHREAD_H
+	pthread_cond_broadcast(&inst->flight_cond);
+#endif
+
+	return NULL;
+}
+
+/** Find which request is populating an entry, optionally claiming it
+ *
+ * @param inst Module instance.
+ * @param request The current request.
+ * @param key of the entry.
+ * @param claim If no other request is populating the entry, mark this request
+ *	as populating it.
+ * @return the request populating the entry, or NULL if there is none.
+ */
+static REQUEST *cache_flight_owner(rlm_cache_t *inst, REQUEST *request, char const *key, bool claim)
+{
+	cache_flight_t	*flight;
+	REQUEST		*owner = NULL;
+
+	if (!inst->flights) return NULL;
+
+	PTHREAD_MUTEX_LOCK(&inst->flight_mutex);
+	flight = cache_flight_find(inst, request, key);
+	if (flight) {
+		owner = flight->request;
+
+	} else if (claim) {
+		flight = talloc_zero(request, cache_flight_t);
+		if (flight) {
+			flight->inst = inst;
+			flight->request = request;
+			flight->key = talloc_typed_strdup(flight, key);
+
+			gettimeofday(&flight->expires, NULL);
+			timeradd(&flight->expires, &inst->claim_timeout, &flight->expires);
+
+			if (!rbtree_insert(inst->flights, flight)) {
+				talloc_free(flight);
+			} else {
+				flight->active = true;
+				talloc_set_destructor(flight, _cache_flight_free);
+				owner = request;
+			}
+		}
+	}
+	PTHREAD_MUTEX_UNLOCK(&inst->flight_mutex);
+
+	return owner;
+}
+
+/** Release an entry this request was populating, waking any requests waiting for it
+ *
+ */
+static void cache_flight_end(rlm_cache_t *inst, REQUEST *request, char const *key)
+{
+	cache_flight_t	find, *flight;
+
+	if (!inst->flights) return;
+
+	memset(&find, 0, sizeof(find));
+	find.key = key;
+
+	PTHREAD_MUTEX_LOCK(&inst->flight_mutex);
+	flight = rbtree_finddata(inst->flights, &find);
+	if (flight && (flight->request != request)) flight = NULL;
+	PTHREAD_MUTEX_UNLOCK(&inst->flight_mutex);
+
+	/*
+	 *	Only the owner can free the flight, so it can't have
+	 *	gone away after we released the mutex.
+	 */
+	talloc_free(flight);
+}
+
+/** Wait for another request to finish populating an entry
+ *
+ * Waits until the entry is inserted, the other request's claim lapses,
+ * or wait_timeout passes, whichever is first.
+ *
+ * Must be called without holding a driver handle, or the owner may
+ * never be able to insert the entry.
+ */
+static void cache_flight_wait(rlm_cache_t *inst, REQUEST *request, char const *key)
+{
+#ifdef HAVE_PTHREAD_H
+	cache_flight_t	*flight;
+	struct timeval	now, until;
+	struct timespec	when;
+
+	gettimeofday(&now, NULL);
+	timeradd(&now, &inst->wait_timeout, &until);
+
+	RDEBUG2("Waiting for another request to populate entry for \"%s\"", key);
+
+	pthread_mutex_lock(&inst->flight_mutex);
+	for (;;) {
+		struct timeval const *deadline = &until;
+
+		flight = cache_flight_find(inst, request, key);
+		if (!flight || (flight->request == request)) break;
+
+		if (timercmp(&flight->expires, deadline, <)) deadline = &flight->expires;
+
+		when.tv_sec = deadline->tv_sec;
+		when.tv_nsec = deadline->tv_usec * 1000;
+
+		if ((pthread_cond_timedwait(&inst->flight_cond, &inst->flight_mutex, &when) == ETIMEDOUT) &&
+		    (deadline == &until)) {
+			RWDEBUG("Timed out waiting for entry for \"%s\"", key);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&inst->flight_mutex);
+#endif
+}
+
 /** Allocate a cache entry
  *
  *  This is used so that drivers may use their own allocation functions
@@ -209,7 +404,22 @@ static rlm_rcode_t cache_find(rlm_cache_entry_t **out, rlm_cache_t *inst, REQUES
 		return RLM_MODULE_NOTFOUND;	/* Couldn't find a non-expired entry */
 	}
 
-	RDEBUG("Found entry for \"%s\"", key);
+	/*
+	 *	Past its TTL, but inside the grace period.  The first
+	 *	request to see it refreshes it, everyone else is served
+	 *	the stale entry in the meantime.
+	 */
+	if ((c->expires - (time_t) inst->stale_ttl) < request->timestamp) {
+		if (cache_flight_owner(inst, request, key, true) == request) {
+			RDEBUG("Entry for \"%s\" is stale, refreshing", key);
+			cache_free(inst, &c);
+			return RLM_MODULE_NOTFOUND;
+		}
+
+		RDEBUG("Found stale entry for \"%s\", another request is refreshing it", key);
+	} else {
+		RDEBUG("Found entry for \"%s\"", key);
+	}
 
 	c->hits++;
 	*out = c;
@@ -257,12 +467,20 @@ static rlm_rcode_t cache_insert(rlm_cache_t *inst, REQUEST *request, rlm_cache_h
 		return RLM_MODULE_FAIL;
 	}
 
+	/*
+	 *	A stale entry being refreshed is still in the datastore,
+	 *	so remove it before inserting its replacement.
+	 */
+	if (inst->stale_ttl && (inst->module->find(&c, inst, request, handle, key) == CACHE_OK)) {
+		cache_expire(inst, request, handle, &c);
+	}
+
 	c = cache_alloc(inst, request);
 	if (!c) return RLM_MODULE_FAIL;
 
 	c->key = talloc_typed_strdup(c, key);
 	c->created = c->expires = request->timestamp;
-	c->expires += ttl;
+	c->expires += ttl + inst->stale_ttl;
 
 	RDEBUG("Creating new cache entry");
 
@@ -352,6 +570,11 @@ static rlm_rcode_t cache_insert(rlm_cache_t *inst, REQUEST *request, rlm_cache_h
 			cache_free(inst, &c);
 			return RLM_MODULE_UPDATED;
 
+		case CACHE_REJECTED:
+			RDEBUG("Entry not committed, the cache kept its existing entries");
+			talloc_free(c);
+			return RLM_MODULE_NOOP;
+
 		default:
 			talloc_free(c);	/* Failed insertion - use talloc_free not the driver free */
 			return RLM_MODULE_FAIL;
@@ -359,6 +582,283 @@ static rlm_rcode_t cache_insert(rlm_cache_t *inst, REQUEST *request, rlm_cache_h
 	}
 }
 
+/*
+ *	Snapshot files start with this, followed by records of:
+ *
+ *	uint32_t key length, key, uint32_t entry length, serialized entry.
+ *
+ *	Lengths are in host byte order, snapshots are only meant
+ *	to be read by the server that wrote them.
+ */
+#define CACHE_SNAPSHOT_MAGIC	"FRCACHE1"
+#define CACHE_SNAPSHOT_MAX_LEN	(1 << 24)
+
+typedef struct cache_snapshot {
+	rlm_cache_t		*inst;
+	time_t			now;
+	uint32_t		count;
+	uint8_t			*data;		//!< Records, built while the driver is locked.
+	size_t			len;		//!< Length of the records in data.
+} cache_snapshot_t;
+
+/** Append to the records of a snapshot
+ *
+ */
+static int cache_snapshot_append(cache_snapshot_t *snap, void const *in, size_t inlen)
+{
+	size_t	size = talloc_array_length(snap->data);
+
+	if ((snap->len + inlen) > size) {
+		uint8_t *data;
+
+		size = (size * 2) + inlen;
+		data = talloc_realloc(NULL, snap->data, uint8_t, size);
+		if (!data) return -1;
+		snap->data = data;
+	}
+
+	memcpy(snap->data + snap->len, in, inlen);
+	snap->len += inlen;
+
+	return 0;
+}
+
+static int _cache_snapshot_entry(rlm_cache_entry_t *c, void *uctx)
+{
+	cache_snapshot_t	*snap = uctx;
+	char			*data;
+	uint32_t		len;
+	int			rcode = -1;
+
+	/*
+	 *	No point in saving entries we'd ignore on load.
+	 */
+	if ((c->expires < snap->now) || (c->created < snap->inst->epoch)) return 0;
+
+	if (cache_serialize(NULL, &data, c) < 0) return -1;
+
+	len = strlen(c->key);
+	if ((cache_snapshot_append(snap, &len, sizeof(len)) < 0) || (cache_snapshot_append(snap, c->key, len) < 0)) {
+		goto finish;
+	}
+
+	len = strlen(data);
+	if ((cache_snapshot_append(snap, &len, sizeof(len)) < 0) || (cache_snapshot_append(snap, data, len) < 0)) {
+		goto finish;
+	}
+
+	snap->count++;
+	rcode = 0;
+
+finish:
+	talloc_free(data);
+	return rcode;
+}
+
+/** Write all entries to the snapshot file
+ *
+ * Drivers may lock the whole datastore while it's walked, so the
+ * entries are only serialized during the walk.  The file is written
+ * afterwards, once other requests can use the cache again.
+ *
+ * The snapshot is written to a temporary file, which replaces the
+ * previous snapshot only once it's complete.
+ *
+ * @param inst Module instance.
+ * @return 0 on success, -1 on failure.
+ */
+static int cache_snapshot_write(rlm_cache_t *inst)
+{
+	cache_snapshot_t	snap;
+	char			path[PATH_MAX];
+	FILE			*fp;
+	int			rcode;
+
+	memset(&snap, 0, sizeof(snap));
+	snap.inst = inst;
+	snap.now = time(NULL);
+
+	if (inst->module->walk(inst, _cache_snapshot_entry, &snap) < 0) {
+		ERROR("rlm_cache (%s): Failed serializing entries", inst->name);
+		talloc_free(snap.data);
+		return -1;
+	}
+
+	snprintf(path, sizeof(path), "%s.tmp", inst->snapshot);
+
+	fp = fopen(path, "w");
+	if (!fp) {
+		ERROR("rlm_cache (%s): Failed opening \"%s\": %s", inst->name, path, fr_syserror(errno));
+		talloc_free(snap.data);
+		return -1;
+	}
+
+	rcode = fwrite(CACHE_SNAPSHOT_MAGIC, sizeof(CACHE_SNAPSHOT_MAGIC) - 1, 1, fp) == 1 ? 0 : -1;
+	if ((rcode == 0) && snap.len && (fwrite(snap.data, snap.len, 1, fp) != 1)) rcode = -1;
+	talloc_free(snap.data);
+
+	if ((fclose(fp) != 0) || (rcode != 0)) {
+		ERROR("rlm_cache (%s): Failed writing \"%s\": %s", inst->name, path, fr_syserror(errno));
+	error:
+		unlink(path);
+		return -1;
+	}
+
+	if (rename(path, inst->snapshot) < 0) {
+		ERROR("rlm_cache (%s): Failed renaming \"%s\" to \"%s\": %s", inst->name,
+		      path, inst->snapshot, fr_syserror(errno));
+		goto error;
+	}
+
+	DEBUG("rlm_cache (%s): Saved %u entries to \"%s\"", inst->name, snap.count, inst->snapshot);
+
+	return 0;
+}
+
+/** Read a length prefixed string from a snapshot
+ *
+ */
+static char *cache_snapshot_read_str(TALLOC_CTX *ctx, FILE *fp, uint32_t *len)
+{
+	char *out;
+
+	if (fread(len, sizeof(*len), 1, fp) != 1) return NULL;
+	if ((*len == 0) || (*len > CACHE_SNAPSHOT_MAX_LEN)) return NULL;
+
+	out = talloc_array(ctx, char, *len + 1);
+	if (!out) return NULL;
+
+	if (fread(out, *len, 1, fp) != 1) {
+		talloc_free(out);
+		return NULL;
+	}
+	out[*len] = '\0';
+
+	return out;
+}
+
+/** Load entries from the snapshot file
+ *
+ * Entries which have expired since the snapshot was written are
+ * skipped.  A missing snapshot is not an error.
+ *
+ * @param inst Module instance.
+ * @return 0 on success, -1 on failure.
+ */
+static int cache_snapshot_load(rlm_cache_t *inst)
+{
+	FILE			*fp;
+	REQUEST			*request;
+	char			magic[sizeof(CACHE_SNAPSHOT_MAGIC) - 1];
+	uint32_t		count = 0, skipped = 0;
+
+	fp = fopen(inst->snapshot, "r");
+	if (!fp) {
+		if (errno == ENOENT) return 0;
+
+		ERROR("rlm_cache (%s): Failed opening \"%s\": %s", inst->name, inst->snapshot, fr_syserror(errno));
+		return -1;
+	}
+
+	if ((fread(magic, sizeof(magic), 1, fp) != 1) || (memcmp(magic, CACHE_SNAPSHOT_MAGIC, sizeof(magic)) != 0)) {
+		WARN("rlm_cache (%s): Ignoring \"%s\", it is not a cache snapshot", inst->name, inst->snapshot);
+		fclose(fp);
+		return 0;
+	}
+
+	/*
+	 *	Drivers expect entries to be inserted on behalf of
+	 *	a request.
+	 */
+	request = request_alloc(NULL);
+	if (!request) {
+		fclose(fp);
+		return -1;
+	}
+
+	for (;;) {
+		rlm_cache_handle_t	*handle = NULL;
+		rlm_cache_entry_t	*c;
+		char			*key, *data;
+		uint32_t		len;
+		cache_status_t		ret;
+
+		key = cache_snapshot_read_str(request, fp, &len);
+		if (!key) break;
+
+		data = cache_snapshot_read_str(key, fp, &len);
+		if (!data) {
+			talloc_free(key);
+			break;
+		}
+
+		c = cache_alloc(inst, request);
+		if (!c) {
+			talloc_free(key);
+			break;
+		}
+
+		if (cache_deserialize(c, data, len) < 0) {
+			WARN("rlm_cache (%s): Skipping entry for \"%s\": %s", inst->name, key, fr_strerror());
+		skip:
+			talloc_free(c);
+			talloc_free(key);
+			skipped++;
+			continue;
+		}
+
+		if (c->expires < request->timestamp) goto skip;
+
+		c->key = talloc_typed_strdup(c, key);
+		talloc_free(key);
+
+		if (cache_acquire(&handle, inst, request) < 0) {
+			talloc_free(c);
+			break;
+		}
+		ret = inst->module->insert(inst, request, &handle, c);
+		cache_release(inst, request, &handle);
+
+		if (ret != CACHE_OK) {
+			talloc_free(c);	/* Failed insertion - use talloc_free not the driver free */
+			skipped++;
+			continue;
+		}
+		cache_free(inst, &c);
+		count++;
+	}
+
+	if (!feof(fp)) WARN("rlm_cache (%s): Snapshot \"%s\" is truncated or corrupt", inst->name, inst->snapshot);
+
+	INFO("rlm_cache (%s): Restored %u entries from \"%s\" (%u skipped)", inst->name,
+	     count, inst->snapshot, skipped);
+
+	talloc_free(request);
+	fclose(fp);
+
+	return 0;
+}
+
+/** Write a snapshot, if one is due
+ *
+ * Called by requests, so only one of them does the work.
+ */
+static void cache_snapshot_periodic(rlm_cache_t *inst, REQUEST *request)
+{
+#ifdef HAVE_PTHREAD_H
+	if (pthread_mutex_trylock(&inst->snapshot_mutex) != 0) return;
+#endif
+
+	if (request->timestamp >= inst->snapshot_next) {
+		inst->snapshot_next = request->timestamp + inst->snapshot_interval;
+
+		RDEBUG2("Saving cache entries to \"%s\"", inst->snapshot);
+		(void) cache_snapshot_write(inst);
+	}
+
+	PTHREAD_MUTEX_UNLOCK(&inst->snapshot_mutex);
+}
+
 /** Verify that a map in the cache section makes sense
  *
  */
@@ -460,12 +960,37 @@ static rlm_rcode_t CC_HINT(nonnull) mod_cache_it(void *instance, REQUEST *reques
 	if (rcode == RLM_MODULE_FAIL) goto finish;
 	rad_assert(handle);
 
+	/*
+	 *	Another request is already populating this entry, wait
+	 *	for it to finish instead of duplicating its work.
+	 */
+	if (!c && timerisset(&inst->wait_timeout)) {
+		REQUEST *owner;
+
+		owner = cache_flight_owner(inst, request, buffer, false);
+		if (owner && (owner != request)) {
+			cache_release(inst, request, &handle);
+			cache_flight_wait(inst, request, buffer);
+			if (cache_acquire(&handle, inst, request) < 0) return RLM_MODULE_FAIL;
+
+			rcode = cache_find(&c, inst, request, &handle, buffer);
+			if (rcode == RLM_MODULE_FAIL) goto finish;
+			rad_assert(handle);
+		}
+	}
+
 	/*
 	 *	If Cache-Status-Only == yes, only return whether we found a
 	 *	valid cache entry
 	 */
 	vp = fr_pair_find_by_num(request->config, PW_CACHE_STATUS_ONLY, 0, TAG_ANY);
 	if (vp && vp->vp_integer) {
+		/*
+		 *	The caller is probably about to fetch the data,
+		 *	so other requests should wait for it to do so.
+		 */
+		if (!c) cache_flight_owner(inst, request, buffer, true);
+
 		rcode = c ? RLM_MODULE_OK:
 			    RLM_MODULE_NOTFOUND;
 		goto finish;
@@ -509,7 +1034,7 @@ static rlm_rcode_t CC_HINT(nonnull) mod_cache_it(void *instance, REQUEST *reques
 			ttl *= -1;
 			goto insert;
 		}
-		c->expires = request->timestamp + ttl;
+		c->expires = request->timestamp + ttl + inst->stale_ttl;
 		RDEBUG("Setting TTL to %d", ttl);
 	}
 
@@ -529,6 +1054,7 @@ insert:
 	 */
 	vp = fr_pair_find_by_num(request->config, PW_CACHE_READ_ONLY, 0, TAG_ANY);
 	if (vp && vp->vp_integer) {
+		cache_flight_owner(inst, request, buffer, true);
 		rcode = RLM_MODULE_NOTFOUND;
 		goto finish;
 	}
@@ -539,10 +1065,16 @@ insert:
 	rcode = cache_insert(inst, request, &handle, buffer, ttl);
 	rad_assert(handle);
 
+	cache_flight_end(inst, request, buffer);
+
 finish:
 	cache_free(inst, &c);
 	cache_release(inst, request, &handle);
 
+	if (inst->snapshot_interval && (request->timestamp >= inst->snapshot_next)) {
+		cache_snapshot_periodic(inst, request);
+	}
+
 	/*
 	 *	Clear control attributes
 	 */
@@ -598,16 +1130,17 @@ static ssize_t cache_xlat(void *instance, REQUEST *request,
 
 	if (cache_acquire(&handle, inst, request) < 0) return -1;
 
-	switch (cache_find(&c, inst, request, handle, fmt)) {
+	switch (cache_find(&c, inst, request, &handle, fmt)) {
 	case RLM_MODULE_OK:		/* found */
 		break;
 
 	case RLM_MODULE_NOTFOUND:	/* not found */
 		*out = '\0';
-		return 0;
+		goto finish;
 
 	default:
-		return -1;
+		ret = -1;
+		goto finish;
 	}
 
 	switch (list) {
@@ -664,6 +1197,25 @@ static int mod_detach(void *instance)
 
 	talloc_free(inst->maps);
 
+	/*
+	 *	Save the entries before the driver is freed, so that
+	 *	they can be restored when the server starts.
+	 */
+	if (inst->snapshot && inst->driver) {
+		(void) cache_snapshot_write(inst);
+#ifdef HAVE_PTHREAD_H
+		pthread_mutex_destroy(&inst->snapshot_mutex);
+#endif
+	}
+
+	if (inst->flights) {
+		rbtree_free(inst->flights);
+#ifdef HAVE_PTHREAD_H
+		pthread_cond_destroy(&inst->flight_cond);
+		pthread_mutex_destroy(&inst->flight_mutex);
+#endif
+	}
+
 	/*
 	 *  We need to explicitly free all children, so if the driver
 	 *  parented any memory off the instance, their destructors
@@ -781,11 +1333,38 @@ static int mod_instantiate(CONF_SECTION *conf, void *instance)
 		return -1;
 	}
 
+	FR_TIMEVAL_BOUND_CHECK("claim_timeout", &inst->claim_timeout, >=, 0, 10000);
+	FR_TIMEVAL_BOUND_CHECK("claim_timeout", &inst->claim_timeout, <=, 60, 0);
+
 	if (inst->epoch != 0) {
 		cf_log_err_cs(conf, "Must not set 'epoch' in the configuration files");
 		return -1;
 	}
 
+	/*
+	 *	Track which keys are being populated, so that
+	 *	concurrent misses can wait for a single request to
+	 *	fill them, and stale entries are only refreshed once.
+	 */
+	if (inst->stale_ttl || timerisset(&inst->wait_timeout)) {
+		inst->flights = rbtree_create(inst, cache_flight_cmp, NULL, 0);
+		if (!inst->flights) {
+			cf_log_err_cs(conf, "Failed creating flight tree");
+			return -1;
+		}
+
+#ifdef HAVE_PTHREAD_H
+		if (pthread_mutex_init(&inst->flight_mutex, NULL) < 0) {
+			cf_log_err_cs(conf, "Failed initializing mutex: %s", fr_syserror(errno));
+			return -1;
+		}
+		if (pthread_cond_init(&inst->flight_cond, NULL) < 0) {
+			cf_log_err_cs(conf, "Failed initializing condition: %s", fr_syserror(errno));
+			return -1;
+		}
+#endif
+	}
+
 	update = cf_section_sub_find(inst->cs, "update");
 	if (!update) {
 		cf_log_err_cs(conf, "Must have an 'update' section in order to cache anything.");
@@ -806,6 +1385,24 @@ static int mod_instantiate(CONF_SECTION *conf, void *instance)
 
 		return -1;
 	}
+
+	if (inst->snapshot) {
+		if (!inst->module->walk) {
+			cf_log_err_cs(conf, "Driver %s does not support 'snapshot'", inst->driver_name);
+			return -1;
+		}
+
+#ifdef HAVE_PTHREAD_H
+		if (pthread_mutex_init(&inst->snapshot_mutex, NULL) < 0) {
+			cf_log_err_cs(conf, "Failed initializing mutex: %s", fr_syserror(errno));
+			return -1;
+		}
+#endif
+
+		if (cache_snapshot_load(inst) < 0) return -1;
+		inst->snapshot_next = time(NULL) + inst->snapshot_interval;
+	}
+
 	return 0;
 }
 
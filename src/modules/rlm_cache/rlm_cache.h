@@ -26,6 +26,10 @@ RCSIDH(cache_h, "$Id$")
 
 #include <freeradius-devel/radiusd.h>
 
+#ifdef HAVE_PTHREAD_H
+#  include <pthread.h>
+#endif
+
 typedef struct cache_module cache_module_t;
 
 typedef void rlm_cache_handle_t;
@@ -36,7 +40,8 @@ typedef enum {
 	CACHE_RECONNECT	= -2,				//!< Handle needs to be reconnected
 	CACHE_ERROR	= -1,				//!< Fatal error
 	CACHE_OK	= 0,				//!< Cache entry found/updated
-	CACHE_MISS	= 1				//!< Cache entry notfound
+	CACHE_MISS	= 1,				//!< Cache entry notfound
+	CACHE_REJECTED	= 2				//!< Entry not stored, the datastore kept what it had
 } cache_status_t;
 
 /*
@@ -59,6 +64,25 @@ typedef struct rlm_cache_t {
 	uint32_t		max_entries;		//!< Maximum entries allowed.
 	int32_t			epoch;			//!< Time after which entries are considered valid.
 	bool			stats;			//!< Generate statistics.
+	uint32_t		stale_ttl;		//!< How long an expired entry may still be served
+							//!< whilst another request refreshes it.
+	struct timeval		wait_timeout;		//!< How long to wait for another request to
+							//!< populate a missing entry.
+	struct timeval		claim_timeout;		//!< How long a request may take to populate an
+							//!< entry before other requests stop waiting for it.
+
+	rbtree_t		*flights;		//!< Keys currently being populated.
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_t		flight_mutex;		//!< Protects the flights tree.
+	pthread_cond_t		flight_cond;		//!< Signalled when a flight completes.
+#endif
+
+	char const		*snapshot;		//!< File to save entries to, and restore them from.
+	uint32_t		snapshot_interval;	//!< How often to save entries, 0 for only on exit.
+	time_t			snapshot_next;		//!< When the next periodic snapshot is due.
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_t		snapshot_mutex;		//!< Stops multiple snapshots being written at once.
+#endif
 
 	vp_map_t	*maps;			//!< Attribute map applied to users.
 							//!< and profiles.
@@ -77,6 +101,8 @@ typedef struct rlm_cache_entry_t {
 	VALUE_PAIR		*state;			//!< Cached session-state list.
 } rlm_cache_entry_t;
 
+typedef int			(*rlm_cache_walk_cb_t)(rlm_cache_entry_t *c, void *uctx);
+
 typedef int			(*cache_instantiate_t)(CONF_SECTION *conf, rlm_cache_t *inst);
 typedef rlm_cache_entry_t	*(*cache_entry_alloc_t)(rlm_cache_t *inst, REQUEST *request);
 typedef void			(*cache_entry_free_t)(rlm_cache_entry_t *c);
@@ -89,6 +115,7 @@ typedef cache_status_t		(*cache_entry_expire_t)(rlm_cache_t *inst, REQUEST *requ
 							rlm_cache_handle_t **handle, rlm_cache_entry_t *entry);
 typedef uint32_t		(*cache_entry_count_t)(rlm_cache_t *inst, REQUEST *request,
 						       rlm_cache_handle_t **handle);
+typedef int			(*cache_entry_walk_t)(rlm_cache_t *inst, rlm_cache_walk_cb_t callback, void *uctx);
 
 typedef int			(*cache_acquire_t)(rlm_cache_handle_t **out, rlm_cache_t *inst, REQUEST *request);
 typedef void			(*cache_release_t)(rlm_cache_t *inst, REQUEST *request, rlm_cache_handle_t **handle);
@@ -105,6 +132,7 @@ struct cache_module {
 	cache_entry_insert_t	insert;			//!< Add a new entry.
 	cache_entry_expire_t	expire;			//!< Remove an old entry.
 	cache_entry_count_t	count;			//!< Number of entries.
+	cache_entry_walk_t	walk;			//!< (optional) Call a function for every entry.
 
 	cache_acquire_t		acquire;		//!< (optional) Get a lock or connection handle.
 	cache_release_t		release;		//!< (optional) Release the lock or connection handle.
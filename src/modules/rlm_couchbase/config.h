@@ -0,0 +1,44 @@
+/* config.h.  Generated from config.h.in by configure.  */
+/* config.h.in.  Generated from configure.ac by autoheader.  */
+
+/* json.h is at json-c/json.h relative to include dir */
+/* #undef HAVE_JSONMC_JSON_H */
+
+/* Define to 1 if you have the `json_c_version' function. */
+/* #undef HAVE_JSON_C_VERSION */
+
+/* json.h is at json/json.h relative to include dir */
+/* #undef HAVE_JSON_JSON_H */
+
+/* Define to 1 if you have the `json_object_get_string_len' function. */
+/* #undef HAVE_JSON_OBJECT_GET_STRING_LEN */
+
+/* Define to 1 if you have the `json_object_new_int64' function. */
+/* #undef HAVE_JSON_OBJECT_NEW_INT64 */
+
+/* Define to 1 if you have the `json_object_object_get_ex' function. */
+/* #undef HAVE_JSON_OBJECT_OBJECT_GET_EX */
+
+/* Define to 1 if you have the `json_tokener_error_desc' function. */
+/* #undef HAVE_JSON_TOKENER_ERROR_DESC */
+
+/* Define to 1 if you have the `json_tokener_get_error' function. */
+/* #undef HAVE_JSON_TOKENER_GET_ERROR */
+
+/* Define to the address where bug reports for this package should be sent. */
+#define PACKAGE_BUGREPORT ""
+
+/* Define to the full name of this package. */
+#define PACKAGE_NAME ""
+
+/* Define to the full name and version of this package. */
+#define PACKAGE_STRING ""
+
+/* Define to the one symbol short name of this package. */
+#define PACKAGE_TARNAME ""
+
+/* Define to the home page for this package. */
+#define PACKAGE_URL ""
+
+/* Define to the version of this package. */
+#define PACKAGE_VERSION ""
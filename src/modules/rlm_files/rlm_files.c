@@ -26,44 +26,96 @@ RCSID("$Id$")
 
 #include	<freeradius-devel/radiusd.h>
 #include	<freeradius-devel/modules.h>
+#include	<freeradius-devel/rad_assert.h>
 
 #include	<ctype.h>
 #include	<fcntl.h>
 
+/** DEFAULT entries which share the value of an equality check
+ *
+ */
+typedef struct rlm_files_bucket_t {
+	VALUE_PAIR const	*key;		//!< Check item the entries were indexed on.
+	PAIR_LIST const		**entries;	//!< Entries in file order.
+	int			num;		//!< Number of entries in the bucket.
+} rlm_files_bucket_t;
+
+/** DEFAULT entries indexed on an '==' check against a single attribute
+ *
+ */
+typedef struct rlm_files_index_t {
+	DICT_ATTR const		*da;		//!< Attribute the entries are indexed on.
+	rbtree_t		*tree;		//!< Tree of #rlm_files_bucket_t keyed on value.
+	struct rlm_files_index_t *next;
+} rlm_files_index_t;
+
+/** A compiled users file
+ *
+ */
+typedef struct rlm_files_table_t {
+	rbtree_t		*tree;		//!< Entries keyed by name.
+	PAIR_LIST const		*defaults;	//!< All DEFAULT entries, in file order.
+	rlm_files_index_t	*index;		//!< DEFAULT entries with an indexable check item.
+	PAIR_LIST const		**unindexed;	//!< DEFAULT entries which always have to be evaluated.
+	int			num_unindexed;	//!< Number of unindexed DEFAULT entries.
+} rlm_files_table_t;
+
+/*
+ *	The maximum number of lists we'll merge when finding candidate
+ *	DEFAULT entries.  If a request has more instances of the indexed
+ *	attributes than this, we fall back to walking all the entries.
+ */
+#define FILES_MAX_CURSORS	(32)
+
+typedef struct rlm_files_cursor_t {
+	PAIR_LIST const		**entry;
+	PAIR_LIST const		**end;
+} rlm_files_cursor_t;
+
+/** Iterates over candidate DEFAULT entries in file order
+ *
+ */
+typedef struct rlm_files_merge_t {
+	PAIR_LIST const		*linear;	//!< Next entry when not using the index.
+	rlm_files_cursor_t	cursor[FILES_MAX_CURSORS];
+	int			num;		//!< Number of active cursors.
+	int			last;		//!< Order of the last entry returned.
+} rlm_files_merge_t;
+
 typedef struct rlm_files_t {
 	char const *compat_mode;
 
 	char const *key;
 
 	char const *filename;
-	rbtree_t *common;
+	rlm_files_table_t *common;
 
 	/* autz */
 	char const *usersfile;
-	rbtree_t *users;
+	rlm_files_table_t *users;
 
 
 	/* authenticate */
 	char const *auth_usersfile;
-	rbtree_t *auth_users;
+	rlm_files_table_t *auth_users;
 
 	/* preacct */
 	char const *acctusersfile;
-	rbtree_t *acctusers;
+	rlm_files_table_t *acctusers;
 
 #ifdef WITH_PROXY
 	/* pre-proxy */
 	char const *preproxy_usersfile;
-	rbtree_t *preproxy_users;
+	rlm_files_table_t *preproxy_users;
 
 	/* post-proxy */
 	char const *postproxy_usersfile;
-	rbtree_t *postproxy_users;
+	rlm_files_table_t *postproxy_users;
 #endif
 
 	/* post-authenticate */
 	char const *postauth_usersfile;
-	rbtree_t *postauth_users;
+	rlm_files_table_t *postauth_users;
 } rlm_files_t;
 
 
@@ -100,16 +152,291 @@ static int pairlist_cmp(void const *a, void const *b)
 		      ((PAIR_LIST const *)b)->name);
 }
 
-static int getusersfile(TALLOC_CTX *ctx, char const *filename, rbtree_t **ptree, char const *compat_mode_str)
+static int bucket_cmp(void const *one, void const *two)
+{
+	rlm_files_bucket_t const *a = one;
+	rlm_files_bucket_t const *b = two;
+
+	return value_data_cmp(a->key->da->type, &a->key->data, a->key->vp_length,
+			      b->key->da->type, &b->key->data, b->key->vp_length);
+}
+
+/** Find the check item a DEFAULT entry can be indexed on
+ *
+ * Only '==' checks against ordinary attributes are indexed.  Anything
+ * which is expanded at run-time, is tagged, is skipped by paircompare(),
+ * or has a comparison function registered for it, is left alone.
+ *
+ * @param entry to examine.
+ * @return the first indexable check item, or NULL if there is none.
+ */
+static VALUE_PAIR const *default_index_key(PAIR_LIST const *entry)
+{
+	vp_cursor_t	cursor;
+	VALUE_PAIR	*vp;
+
+	for (vp = fr_cursor_init(&cursor, &entry->check); vp; vp = fr_cursor_next(&cursor)) {
+		if (vp->op != T_OP_CMP_EQ) continue;
+		if (vp->type == VT_XLAT) continue;
+		if (vp->da->flags.has_tag || vp->da->flags.compare) continue;
+
+		if (!vp->da->vendor) switch (vp->da->attr) {
+		case PW_CRYPT_PASSWORD:
+		case PW_AUTH_TYPE:
+		case PW_AUTZ_TYPE:
+		case PW_ACCT_TYPE:
+		case PW_SESSION_TYPE:
+		case PW_STRIP_USER_NAME:
+		case PW_USER_PASSWORD:
+			continue;
+
+		default:
+			break;
+		}
+
+		if (radius_find_compare(vp->da)) continue;
+
+		switch (vp->da->type) {
+		case PW_TYPE_STRING:
+		case PW_TYPE_OCTETS:
+		case PW_TYPE_BYTE:
+		case PW_TYPE_SHORT:
+		case PW_TYPE_INTEGER:
+		case PW_TYPE_INTEGER64:
+		case PW_TYPE_SIGNED:
+		case PW_TYPE_DATE:
+		case PW_TYPE_IPV4_ADDR:
+		case PW_TYPE_IPV6_ADDR:
+			return vp;
+
+		default:
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/** Find (or create) the bucket of DEFAULT entries for a value
+ *
+ * @param table to search.
+ * @param key attribute and value to look for.
+ * @param create the index and bucket if they don't exist.
+ * @return the bucket, or NULL if there isn't one.
+ */
+static rlm_files_bucket_t *files_bucket_find(rlm_files_table_t *table, VALUE_PAIR const *key, bool create)
+{
+	rlm_files_index_t	*idx;
+	rlm_files_bucket_t	*bucket, my_bucket;
+
+	for (idx = table->index; idx; idx = idx->next) {
+		if (idx->da == key->da) break;
+	}
+
+	if (!idx) {
+		if (!create) return NULL;
+
+		idx = talloc_zero(table, rlm_files_index_t);
+		if (!idx) return NULL;
+
+		idx->da = key->da;
+		idx->tree = rbtree_create(idx, bucket_cmp, NULL, RBTREE_FLAG_NONE);
+		if (!idx->tree) {
+			talloc_free(idx);
+			return NULL;
+		}
+
+		idx->next = table->index;
+		table->index = idx;
+	}
+
+	my_bucket.key = key;
+	bucket = rbtree_finddata(idx->tree, &my_bucket);
+	if (bucket || !create) return bucket;
+
+	bucket = talloc_zero(idx, rlm_files_bucket_t);
+	if (!bucket) return NULL;
+
+	bucket->key = key;
+	if (!rbtree_insert(idx->tree, bucket)) {
+		talloc_free(bucket);
+		return NULL;
+	}
+
+	return bucket;
+}
+
+/** Compile the DEFAULT entries of a users file into per-attribute indexes
+ *
+ * Each DEFAULT entry is placed into the bucket for the value of its
+ * first indexable check item.  Entries without one go into the
+ * unindexed list, which is always evaluated.  Every list is kept in
+ * file order, so the entries can be merged back together by "order"
+ * at run-time.
+ *
+ * @param table to compile.
+ * @return 0 on success, -1 on error.
+ */
+static int files_table_compile(rlm_files_table_t *table)
+{
+	PAIR_LIST const		*entry;
+	VALUE_PAIR const	*key;
+	rlm_files_bucket_t	*bucket;
+	int			num_unindexed = 0;
+
+	/*
+	 *	Size everything first, so that we don't have to keep
+	 *	growing the arrays.
+	 */
+	for (entry = table->defaults; entry; entry = entry->next) {
+		key = default_index_key(entry);
+		if (!key) {
+			num_unindexed++;
+			continue;
+		}
+
+		bucket = files_bucket_find(table, key, true);
+		if (!bucket) return -1;
+
+		bucket->num++;
+	}
+
+	if (num_unindexed) {
+		table->unindexed = talloc_array(table, PAIR_LIST const *, num_unindexed);
+		if (!table->unindexed) return -1;
+	}
+
+	for (entry = table->defaults; entry; entry = entry->next) {
+		key = default_index_key(entry);
+		if (!key) {
+			table->unindexed[table->num_unindexed++] = entry;
+			continue;
+		}
+
+		bucket = files_bucket_find(table, key, false);
+		rad_assert(bucket != NULL);
+
+		if (!bucket->entries) {
+			bucket->entries = talloc_array(bucket, PAIR_LIST const *, bucket->num);
+			if (!bucket->entries) return -1;
+			bucket->num = 0;
+		}
+
+		bucket->entries[bucket->num++] = entry;
+	}
+
+	return 0;
+}
+
+/** Return the next candidate DEFAULT entry, in file order
+ *
+ */
+static PAIR_LIST const *files_default_next(rlm_files_merge_t *merge)
+{
+	PAIR_LIST const *pl;
+	int i, best;
+
+	if (merge->linear) {
+		pl = merge->linear;
+		merge->linear = pl->next;
+		return pl;
+	}
+
+	while (merge->num > 0) {
+		best = 0;
+		for (i = 1; i < merge->num; i++) {
+			if ((*merge->cursor[i].entry)->order < (*merge->cursor[best].entry)->order) best = i;
+		}
+
+		pl = *(merge->cursor[best].entry++);
+		if (merge->cursor[best].entry == merge->cursor[best].end) {
+			merge->cursor[best] = merge->cursor[--merge->num];
+		}
+
+		/*
+		 *	The same entry can be in two lists if the
+		 *	request has duplicate attributes.
+		 */
+		if (pl->order == merge->last) continue;
+
+		merge->last = pl->order;
+		return pl;
+	}
+
+	return NULL;
+}
+
+/** Find the DEFAULT entries which could match a request
+ *
+ * Looks up the values of the indexed attributes in the request, and
+ * merges the matching buckets with the unindexed entries.  If that
+ * isn't possible, all of the DEFAULT entries are walked in order.
+ *
+ * @param merge to initialise.
+ * @param table to search.
+ * @param vps from the request.
+ * @return the first candidate entry, or NULL if there are none.
+ */
+static PAIR_LIST const *files_default_first(rlm_files_merge_t *merge, rlm_files_table_t *table, VALUE_PAIR *vps)
+{
+	vp_cursor_t		cursor;
+	VALUE_PAIR		*vp;
+	rlm_files_index_t	*idx;
+	rlm_files_bucket_t	*bucket, my_bucket;
+
+	merge->linear = NULL;
+	merge->num = 0;
+	merge->last = -1;
+
+	if (table->num_unindexed) {
+		merge->cursor[0].entry = table->unindexed;
+		merge->cursor[0].end = table->unindexed + table->num_unindexed;
+		merge->num = 1;
+	}
+
+	for (idx = table->index; idx; idx = idx->next) {
+		/*
+		 *	A module instantiated after us registered a
+		 *	comparison function for the attribute.  The
+		 *	index can't be trusted.
+		 */
+		if (radius_find_compare(idx->da)) goto linear;
+
+		for (vp = fr_cursor_init(&cursor, &vps); vp; vp = fr_cursor_next(&cursor)) {
+			if (vp->da != idx->da) continue;
+
+			my_bucket.key = vp;
+			bucket = rbtree_finddata(idx->tree, &my_bucket);
+			if (!bucket) continue;
+
+			if (merge->num == FILES_MAX_CURSORS) goto linear;
+
+			merge->cursor[merge->num].entry = bucket->entries;
+			merge->cursor[merge->num].end = bucket->entries + bucket->num;
+			merge->num++;
+		}
+	}
+
+	return files_default_next(merge);
+
+linear:
+	merge->num = 0;
+	merge->linear = table->defaults;
+
+	return files_default_next(merge);
+}
+
+static int getusersfile(TALLOC_CTX *ctx, char const *filename, rlm_files_table_t **ptable, char const *compat_mode_str)
 {
 	int rcode;
 	PAIR_LIST *users = NULL;
 	PAIR_LIST *entry, *next;
 	PAIR_LIST *user_list, *default_list, **default_tail;
+	rlm_files_table_t *table;
 	rbtree_t *tree;
 
 	if (!filename) {
-		*ptree = NULL;
+		*ptable = NULL;
 		return 0;
 	}
 
@@ -235,8 +562,15 @@ static int getusersfile(TALLOC_CTX *ctx, char const *filename, rbtree_t **ptree,
 		}
 	}
 
-	tree = rbtree_create(ctx, pairlist_cmp, NULL, RBTREE_FLAG_NONE);
+	table = talloc_zero(ctx, rlm_files_table_t);
+	if (!table) {
+		pairlist_free(&users);
+		return -1;
+	}
+
+	tree = table->tree = rbtree_create(table, pairlist_cmp, NULL, RBTREE_FLAG_NONE);
 	if (!tree) {
+		talloc_free(table);
 		pairlist_free(&users);
 		return -1;
 	}
@@ -255,34 +589,17 @@ static int getusersfile(TALLOC_CTX *ctx, char const *filename, rbtree_t **ptree,
 		 */
 		next = entry->next;
 		entry->next = NULL;
-		(void) talloc_steal(tree, entry);
+		(void) talloc_steal(table, entry);
 
 		/*
 		 *	DEFAULT entries get their own list.
 		 */
 		if (strcmp(entry->name, "DEFAULT") == 0) {
-			if (!default_list) {
-				default_list = entry;
-
-				/*
-				 *	Insert the first DEFAULT into the tree.
-				 */
-				if (!rbtree_insert(tree, entry)) {
-				error:
-					pairlist_free(&entry);
-					pairlist_free(&next);
-					rbtree_free(tree);
-					return -1;
-				}
-
-			} else {
-				/*
-				 *	Tack this entry onto the tail
-				 *	of the DEFAULT list.
-				 */
-				*default_tail = entry;
-			}
-
+			/*
+			 *	Tack this entry onto the tail
+			 *	of the DEFAULT list.
+			 */
+			*default_tail = entry;
 			default_tail = &entry->next;
 			continue;
 		}
@@ -295,7 +612,11 @@ static int getusersfile(TALLOC_CTX *ctx, char const *filename, rbtree_t **ptree,
 			/*
 			 *	Insert the first one.
 			 */
-			if (!rbtree_insert(tree, entry)) goto error;
+			if (!rbtree_insert(tree, entry)) {
+				pairlist_free(&next);
+				talloc_free(table);
+				return -1;
+			}
 		} else {
 			/*
 			 *	Find the tail of this list, and add it
@@ -307,7 +628,17 @@ static int getusersfile(TALLOC_CTX *ctx, char const *filename, rbtree_t **ptree,
 		}
 	}
 
-	*ptree = tree;
+	/*
+	 *	Index the DEFAULT entries, so that we only have to
+	 *	evaluate the ones which could match the request.
+	 */
+	table->defaults = default_list;
+	if (files_table_compile(table) < 0) {
+		talloc_free(table);
+		return -1;
+	}
+
+	*ptable = table;
 
 	return 0;
 }
@@ -342,7 +673,7 @@ static int mod_instantiate(UNUSED CONF_SECTION *conf, void *instance)
 /*
  *	Common code called by everything below.
  */
-static rlm_rcode_t file_common(rlm_files_t *inst, REQUEST *request, char const *filename, rbtree_t *tree,
+static rlm_rcode_t file_common(rlm_files_t *inst, REQUEST *request, char const *filename, rlm_files_table_t *table,
 			       RADIUS_PACKET *request_packet, RADIUS_PACKET *reply_packet)
 {
 	char const	*name;
@@ -351,6 +682,7 @@ static rlm_rcode_t file_common(rlm_files_t *inst, REQUEST *request, char const *
 	PAIR_LIST const *user_pl, *default_pl;
 	bool		found = false;
 	PAIR_LIST	my_pl;
+	rlm_files_merge_t merge;
 	char		buffer[256];
 
 	if (!inst->key) {
@@ -369,12 +701,11 @@ static rlm_rcode_t file_common(rlm_files_t *inst, REQUEST *request, char const *
 		name = len ? buffer : "NONE";
 	}
 
-	if (!tree) return RLM_MODULE_NOOP;
+	if (!table) return RLM_MODULE_NOOP;
 
 	my_pl.name = name;
-	user_pl = rbtree_finddata(tree, &my_pl);
-	my_pl.name = "DEFAULT";
-	default_pl = rbtree_finddata(tree, &my_pl);
+	user_pl = rbtree_finddata(table->tree, &my_pl);
+	default_pl = files_default_first(&merge, table, request_packet->vps);
 
 	/*
 	 *	Find the entry for the user.
@@ -393,7 +724,7 @@ static rlm_rcode_t file_common(rlm_files_t *inst, REQUEST *request, char const *
 
 		} else if (!user_pl && default_pl) {
 			pl = default_pl;
-			default_pl = default_pl->next;
+			default_pl = files_default_next(&merge);
 
 		} else if (user_pl->order < default_pl->order) {
 			pl = user_pl;
@@ -401,7 +732,7 @@ static rlm_rcode_t file_common(rlm_files_t *inst, REQUEST *request, char const *
 
 		} else {
 			pl = default_pl;
-			default_pl = default_pl->next;
+			default_pl = files_default_next(&merge);
 		}
 
 		check_tmp = fr_pair_list_copy(request, pl->check);
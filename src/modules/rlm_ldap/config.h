@@ -0,0 +1,62 @@
+/* config.h.  Generated from config.h.in by configure.  */
+/* config.h.in.  Generated from configure.ac by autoheader.  */
+
+/* Define to 1 if you have the `ldap_create_sort_control' function. */
+/* #undef HAVE_LDAP_CREATE_SORT_CONTROL */
+
+/* Define to 1 if you have the `ldap_create_sort_keylist' function. */
+/* #undef HAVE_LDAP_CREATE_SORT_KEYLIST */
+
+/* Define to 1 if you have the `ldap_free_sort_keylist' function. */
+/* #undef HAVE_LDAP_FREE_SORT_KEYLIST */
+
+/* Define to 1 if you have the `ldap_initialize' function. */
+/* #undef HAVE_LDAP_INITIALIZE */
+
+/* Define to 1 if you have the `ldap_is_ldap_url' function. */
+/* #undef HAVE_LDAP_IS_LDAP_URL */
+
+/* Define to 1 if you have the `ldap_sasl_interactive_bind' function. */
+/* #undef HAVE_LDAP_SASL_INTERACTIVE_BIND */
+
+/* Define to 1 if you have the `ldap_set_rebind_proc' function. */
+/* #undef HAVE_LDAP_SET_REBIND_PROC */
+
+/* Define to 1 if you have the `ldap_start_tls_s' function. */
+/* #undef HAVE_LDAP_START_TLS_S */
+
+/* Define to 1 if you have the `ldap_unbind_ext_s' function. */
+/* #undef HAVE_LDAP_UNBIND_EXT_S */
+
+/* Define to 1 if you have the `ldap_url_desc2str' function. */
+/* #undef HAVE_LDAP_URL_DESC2STR */
+
+/* Define to 1 if you have the `ldap_url_parse' function. */
+/* #undef HAVE_LDAP_URL_PARSE */
+
+/* Number of arguments the rebind procedure takes */
+#define LDAP_SET_REBIND_PROC_ARGS 
+
+/* Define to the address where bug reports for this package should be sent. */
+#define PACKAGE_BUGREPORT ""
+
+/* Define to the full name of this package. */
+#define PACKAGE_NAME ""
+
+/* Define to the full name and version of this package. */
+#define PACKAGE_STRING ""
+
+/* Define to the one symbol short name of this package. */
+#define PACKAGE_TARNAME ""
+
+/* Define to the home page for this package. */
+#define PACKAGE_URL ""
+
+/* Define to the version of this package. */
+#define PACKAGE_VERSION ""
+
+/* Build the server with support for Novell eDir Universal Password */
+#define WITH_EDIR 1
+
+/* Build the server with support for SASL binds */
+/* #undef WITH_SASL */
@@ -30,11 +30,26 @@ RCSID("$Id$")
 
 #include	<ctype.h>
 
+/** Huntgroups or hints entries which share a key
+ *
+ */
+typedef struct preprocess_bucket_t {
+	VALUE_PAIR const	*key;		//!< NAS attribute the huntgroups were indexed on.
+	char const		*name;		//!< Name the hints were indexed on.
+	PAIR_LIST const		**entries;	//!< Entries in file order.
+	int			num;		//!< Number of entries in the bucket.
+} preprocess_bucket_t;
+
 typedef struct rlm_preprocess_t {
 	char const	*huntgroup_file;
 	char const	*hints_file;
 	PAIR_LIST	*huntgroups;
 	PAIR_LIST	*hints;
+
+	rbtree_t	*huntgroup_index;	//!< Huntgroups keyed on a NAS attribute.
+	PAIR_LIST const	**huntgroup_unindexed;	//!< Huntgroups which always have to be checked.
+	int		num_huntgroup_unindexed;
+	rbtree_t	*hints_index;		//!< Hints keyed on name.
 	bool		with_ascend_hack;
 	uint32_t	ascend_channels_per_line;
 	bool		with_ntdomain_hack;
@@ -337,6 +352,176 @@ static void rad_mangle(rlm_preprocess_t *inst, REQUEST *request)
 	}
 }
 
+static int huntgroup_bucket_cmp(void const *one, void const *two)
+{
+	preprocess_bucket_t const *a = one;
+	preprocess_bucket_t const *b = two;
+
+	if (a->key->da < b->key->da) return -1;
+	if (a->key->da > b->key->da) return +1;
+
+	return value_data_cmp(a->key->da->type, &a->key->data, a->key->vp_length,
+			      b->key->da->type, &b->key->data, b->key->vp_length);
+}
+
+static int hints_bucket_cmp(void const *one, void const *two)
+{
+	preprocess_bucket_t const *a = one;
+	preprocess_bucket_t const *b = two;
+
+	return strcmp(a->name, b->name);
+}
+
+/** Check whether a request attribute can be looked up in the huntgroup index
+ *
+ * Huntgroups are indexed on '==' checks against the attributes which
+ * identify the NAS.
+ */
+static bool huntgroup_indexable(VALUE_PAIR const *vp)
+{
+	if (vp->da->vendor) return false;
+
+	switch (vp->da->attr) {
+	case PW_NAS_IP_ADDRESS:
+	case PW_NAS_IPV6_ADDRESS:
+	case PW_NAS_IDENTIFIER:
+		break;
+
+	default:
+		return false;
+	}
+
+	return !radius_find_compare(vp->da);
+}
+
+static VALUE_PAIR const *huntgroup_key(PAIR_LIST const *entry)
+{
+	vp_cursor_t	cursor;
+	VALUE_PAIR	*vp;
+
+	for (vp = fr_cursor_init(&cursor, &entry->check); vp; vp = fr_cursor_next(&cursor)) {
+		if ((vp->op != T_OP_CMP_EQ) || (vp->type == VT_XLAT)) continue;
+
+		if (huntgroup_indexable(vp)) return vp;
+	}
+
+	return NULL;
+}
+
+/** Add an entry to the bucket for its key
+ *
+ * Called twice for every entry.  The first time the buckets are
+ * created and sized, the second time they're filled in.
+ *
+ * @param tree of buckets.
+ * @param my_bucket holding the key to look for.
+ * @param entry to add.
+ * @return 0 on success, -1 on error.
+ */
+static int preprocess_bucket_add(rbtree_t *tree, preprocess_bucket_t *my_bucket, PAIR_LIST const *entry)
+{
+	preprocess_bucket_t *bucket;
+
+	bucket = rbtree_finddata(tree, my_bucket);
+	if (!bucket) {
+		bucket = talloc_zero(tree, preprocess_bucket_t);
+		if (!bucket) return -1;
+
+		bucket->key = my_bucket->key;
+		bucket->name = my_bucket->name;
+		if (!rbtree_insert(tree, bucket)) {
+			talloc_free(bucket);
+			return -1;
+		}
+	}
+
+	if (!bucket->entries) {
+		if (!entry) {
+			bucket->num++;
+			return 0;
+		}
+
+		bucket->entries = talloc_array(bucket, PAIR_LIST const *, bucket->num);
+		if (!bucket->entries) return -1;
+		bucket->num = 0;
+	}
+
+	bucket->entries[bucket->num++] = entry;
+	return 0;
+}
+
+/** Index the huntgroups on the NAS attributes they check
+ *
+ * @param inst to build the index for.
+ * @return 0 on success, -1 on error.
+ */
+static int huntgroups_compile(rlm_preprocess_t *inst)
+{
+	PAIR_LIST		*entry;
+	preprocess_bucket_t	my_bucket;
+	int			num = 0;
+
+	inst->huntgroup_index = rbtree_create(inst, huntgroup_bucket_cmp, NULL, RBTREE_FLAG_NONE);
+	if (!inst->huntgroup_index) return -1;
+
+	memset(&my_bucket, 0, sizeof(my_bucket));
+
+	for (entry = inst->huntgroups; entry; entry = entry->next) {
+		my_bucket.key = huntgroup_key(entry);
+		if (!my_bucket.key) {
+			num++;
+			continue;
+		}
+
+		if (preprocess_bucket_add(inst->huntgroup_index, &my_bucket, NULL) < 0) return -1;
+	}
+
+	if (num) {
+		inst->huntgroup_unindexed = talloc_array(inst, PAIR_LIST const *, num);
+		if (!inst->huntgroup_unindexed) return -1;
+	}
+
+	for (entry = inst->huntgroups; entry; entry = entry->next) {
+		my_bucket.key = huntgroup_key(entry);
+		if (!my_bucket.key) {
+			inst->huntgroup_unindexed[inst->num_huntgroup_unindexed++] = entry;
+			continue;
+		}
+
+		if (preprocess_bucket_add(inst->huntgroup_index, &my_bucket, entry) < 0) return -1;
+	}
+
+	return 0;
+}
+
+/** Index the hints on the name of each entry
+ *
+ * @param inst to build the index for.
+ * @return 0 on success, -1 on error.
+ */
+static int hints_compile(rlm_preprocess_t *inst)
+{
+	PAIR_LIST		*entry;
+	preprocess_bucket_t	my_bucket;
+
+	inst->hints_index = rbtree_create(inst, hints_bucket_cmp, NULL, RBTREE_FLAG_NONE);
+	if (!inst->hints_index) return -1;
+
+	memset(&my_bucket, 0, sizeof(my_bucket));
+
+	for (entry = inst->hints; entry; entry = entry->next) {
+		my_bucket.name = entry->name;
+		if (preprocess_bucket_add(inst->hints_index, &my_bucket, NULL) < 0) return -1;
+	}
+
+	for (entry = inst->hints; entry; entry = entry->next) {
+		my_bucket.name = entry->name;
+		if (preprocess_bucket_add(inst->hints_index, &my_bucket, entry) < 0) return -1;
+	}
+
+	return 0;
+}
+
 /*
  *	Compare the request with the "reply" part in the
  *	huntgroup, which normally only contains username or group.
@@ -369,15 +554,17 @@ static int hunt_paircmp(REQUEST *req, VALUE_PAIR *request, VALUE_PAIR *check)
  *	Add hints to the info sent by the terminal server
  *	based on the pattern of the username, and other attributes.
  */
-static int hints_setup(PAIR_LIST *hints, REQUEST *request)
+static int hints_setup(rlm_preprocess_t const *inst, REQUEST *request)
 {
 	char const     	*name;
 	VALUE_PAIR	*add;
 	VALUE_PAIR	*tmp;
-	PAIR_LIST	*i;
+	PAIR_LIST const	*i;
 	int		updated = 0, ft;
+	preprocess_bucket_t *user_hints, *default_hints, my_bucket;
+	int		user_idx = 0, default_idx = 0;
 
-	if (!hints || !request->packet->vps)
+	if (!inst->hints || !request->packet->vps)
 		return RLM_MODULE_NOOP;
 
 	/*
@@ -392,12 +579,33 @@ static int hints_setup(PAIR_LIST *hints, REQUEST *request)
 		return RLM_MODULE_NOOP;
 	}
 
-	for (i = hints; i; i = i->next) {
+	my_bucket.name = name;
+	user_hints = rbtree_finddata(inst->hints_index, &my_bucket);
+	my_bucket.name = "DEFAULT";
+	default_hints = rbtree_finddata(inst->hints_index, &my_bucket);
+	if (user_hints == default_hints) user_hints = NULL;
+
+	/*
+	 *	Merge the entries for the user with the DEFAULT
+	 *	entries, so that they're checked in file order.
+	 */
+	while (true) {
+		if (user_hints && (user_idx < user_hints->num) &&
+		    (!default_hints || (default_idx >= default_hints->num) ||
+		     (user_hints->entries[user_idx]->order < default_hints->entries[default_idx]->order))) {
+			i = user_hints->entries[user_idx++];
+
+		} else if (default_hints && (default_idx < default_hints->num)) {
+			i = default_hints->entries[default_idx++];
+
+		} else {
+			break;
+		}
+
 		/*
 		 *	Use "paircompare", which is a little more general...
 		 */
-		if (((strcmp(i->name, "DEFAULT") == 0) || (strcmp(i->name, name) == 0)) &&
-		    (paircompare(request, request->packet->vps, i->check, NULL) == 0)) {
+		if (paircompare(request, request->packet->vps, i->check, NULL) == 0) {
 			RDEBUG2("hints: Matched %s at %d", i->name, i->lineno);
 			/*
 			 *	Now add all attributes to the request list,
@@ -425,12 +633,84 @@ static int hints_setup(PAIR_LIST *hints, REQUEST *request)
 	return RLM_MODULE_UPDATED;
 }
 
+/*
+ *	Find the first huntgroup in a list which matches the request.
+ *
+ *	The lists are in file order, so we can stop as soon as we've
+ *	passed an entry which has already matched.
+ */
+static void huntgroup_search(REQUEST *request, PAIR_LIST const **entries, int num, PAIR_LIST const **found)
+{
+	int i;
+
+	for (i = 0; i < num; i++) {
+		if (*found && (entries[i]->order > (*found)->order)) return;
+
+		if (paircompare(request, request->packet->vps, entries[i]->check, NULL) == 0) {
+			*found = entries[i];
+			return;
+		}
+	}
+}
+
+/*
+ *	Find the first huntgroup which matches the request.
+ */
+static PAIR_LIST const *huntgroup_find(rlm_preprocess_t const *inst, REQUEST *request)
+{
+	vp_cursor_t		cursor;
+	VALUE_PAIR		*vp;
+	PAIR_LIST const		*found = NULL;
+	preprocess_bucket_t	*bucket, my_bucket;
+
+	/*
+	 *	Only the huntgroups for the NAS attributes in the
+	 *	request, and the ones we couldn't index, can match.
+	 */
+	for (vp = fr_cursor_init(&cursor, &request->packet->vps); vp; vp = fr_cursor_next(&cursor)) {
+		if (vp->da->vendor) continue;
+
+		switch (vp->da->attr) {
+		case PW_NAS_IP_ADDRESS:
+		case PW_NAS_IPV6_ADDRESS:
+		case PW_NAS_IDENTIFIER:
+			break;
+
+		default:
+			continue;
+		}
+
+		/*
+		 *	Someone registered a comparison function for
+		 *	the attribute after we built the index.
+		 */
+		if (!huntgroup_indexable(vp)) goto linear;
+
+		my_bucket.key = vp;
+		bucket = rbtree_finddata(inst->huntgroup_index, &my_bucket);
+		if (!bucket) continue;
+
+		huntgroup_search(request, bucket->entries, bucket->num, &found);
+	}
+
+	huntgroup_search(request, inst->huntgroup_unindexed, inst->num_huntgroup_unindexed, &found);
+
+	return found;
+
+linear:
+	for (found = inst->huntgroups; found; found = found->next) {
+		if (paircompare(request, request->packet->vps, found->check, NULL) == 0) break;
+	}
+
+	return found;
+}
+
 /*
  *	See if we have access to the huntgroup.
  */
-static int huntgroup_access(REQUEST *request, PAIR_LIST *huntgroups)
+static int huntgroup_access(rlm_preprocess_t const *inst, REQUEST *request)
 {
-	PAIR_LIST	*i;
+	PAIR_LIST const	*i;
 	int		r = RLM_MODULE_OK;
 	VALUE_PAIR	*request_pairs = request->packet->vps;
 
@@ -438,18 +718,12 @@ static int huntgroup_access(REQUEST *request, PAIR_LIST *huntgroups)
 	 *	We're not controlling access by huntgroups:
 	 *	Allow them in.
 	 */
-	if (!huntgroups) {
+	if (!inst->huntgroups) {
 		return RLM_MODULE_OK;
 	}
 
-	for (i = huntgroups; i; i = i->next) {
-		/*
-		 *	See if this entry matches.
-		 */
-		if (paircompare(request, request_pairs, i->check, NULL) != 0) {
-			continue;
-		}
-
+	i = huntgroup_find(inst, request);
+	if (i) {
 		/*
 		 *	Now check for access.
 		 */
@@ -468,7 +742,6 @@ static int huntgroup_access(REQUEST *request, PAIR_LIST *huntgroups)
 			}
 			r = RLM_MODULE_OK;
 		}
-		break;
 	}
 
 	return r;
@@ -527,6 +800,12 @@ static int mod_instantiate(UNUSED CONF_SECTION *conf, void *instance)
 
 			return -1;
 		}
+
+		if (huntgroups_compile(inst) < 0) {
+			ERROR("rlm_preprocess: Error indexing %s", inst->huntgroup_file);
+
+			return -1;
+		}
 	}
 
 	/*
@@ -539,6 +818,12 @@ static int mod_instantiate(UNUSED CONF_SECTION *conf, void *instance)
 
 			return -1;
 		}
+
+		if (hints_compile(inst) < 0) {
+			ERROR("rlm_preprocess: Error indexing %s", inst->hints_file);
+
+			return -1;
+		}
 	}
 
 	return 0;
@@ -614,7 +899,7 @@ static rlm_rcode_t CC_HINT(nonnull) mod_authorize(void *instance, REQUEST *reque
 		return RLM_MODULE_FAIL;
 	}
 
-	hints_setup(inst->hints, request);
+	hints_setup(inst, request);
 
 	/*
 	 *      If there is a PW_CHAP_PASSWORD attribute but there
@@ -627,7 +912,7 @@ static rlm_rcode_t CC_HINT(nonnull) mod_authorize(void *instance, REQUEST *reque
 		fr_pair_value_memcpy(vp, request->packet->vector, AUTH_VECTOR_LEN);
 	}
 
-	if ((r = huntgroup_access(request, inst->huntgroups)) != RLM_MODULE_OK) {
+	if ((r = huntgroup_access(inst, request)) != RLM_MODULE_OK) {
 		char buf[1024];
 		RIDEBUG("No huntgroup access: [%s] (%s)",
 			request->username ? request->username->vp_strvalue : "<NO User-Name>",
@@ -685,7 +970,7 @@ static rlm_rcode_t CC_HINT(nonnull) mod_preaccounting(void *instance, REQUEST *r
 		return RLM_MODULE_FAIL;
 	}
 
-	hints_setup(inst->hints, request);
+	hints_setup(inst, request);
 
 	/*
 	 *	Add an event timestamp.  This means that the rest of
@@ -709,7 +994,7 @@ static rlm_rcode_t CC_HINT(nonnull) mod_preaccounting(void *instance, REQUEST *r
 		}
 	}
 
-	if ((r = huntgroup_access(request, inst->huntgroups)) != RLM_MODULE_OK) {
+	if ((r = huntgroup_access(inst, request)) != RLM_MODULE_OK) {
 		char buf[1024];
 		RIDEBUG("No huntgroup access: [%s] (%s)",
 			request->username ? request->username->vp_strvalue : "<NO User-Name>",
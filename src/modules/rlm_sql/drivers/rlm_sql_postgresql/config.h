@@ -0,0 +1,32 @@
+/* config.h.  Generated from config.h.in by configure.  */
+/* config.h.in.  Generated from configure.ac by autoheader.  */
+
+/* Whether the PGRES_COPY_BOTH constant is defined */
+#define HAVE_PGRES_COPY_BOTH 1
+
+/* Whether the PGRES_SINGLE_TUPLE constant is defined */
+#define HAVE_PGRES_SINGLE_TUPLE 1
+
+/* Define to 1 if you have the `PQinitOpenSSL' function. */
+#define HAVE_PQINITOPENSSL 1
+
+/* Define to 1 if you have the `PQinitSSL' function. */
+#define HAVE_PQINITSSL 1
+
+/* Define to the address where bug reports for this package should be sent. */
+#define PACKAGE_BUGREPORT ""
+
+/* Define to the full name of this package. */
+#define PACKAGE_NAME ""
+
+/* Define to the full name and version of this package. */
+#define PACKAGE_STRING ""
+
+/* Define to the one symbol short name of this package. */
+#define PACKAGE_TARNAME ""
+
+/* Define to the home page for this package. */
+#define PACKAGE_URL ""
+
+/* Define to the version of this package. */
+#define PACKAGE_VERSION ""
@@ -0,0 +1,38 @@
+/* config.h.  Generated from config.h.in by configure.  */
+/* config.h.in.  Generated from configure.ac by autoheader.  */
+
+/* Define to 1 if you have the `sqlite3_create_function_v2' function. */
+#define HAVE_SQLITE3_CREATE_FUNCTION_V2 1
+
+/* Define to 1 if you have the `sqlite3_errstr' function. */
+#define HAVE_SQLITE3_ERRSTR 1
+
+/* Define to 1 if you have the `sqlite3_extended_result_codes' function. */
+#define HAVE_SQLITE3_EXTENDED_RESULT_CODES 1
+
+/* Define to 1 if the system has the type `sqlite3_int64'. */
+#define HAVE_SQLITE3_INT64 1
+
+/* Define to 1 if you have the `sqlite3_open_v2' function. */
+#define HAVE_SQLITE3_OPEN_V2 1
+
+/* Define to 1 if you have the `sqlite3_prepare_v2' function. */
+#define HAVE_SQLITE3_PREPARE_V2 1
+
+/* Define to the address where bug reports for this package should be sent. */
+#define PACKAGE_BUGREPORT ""
+
+/* Define to the full name of this package. */
+#define PACKAGE_NAME ""
+
+/* Define to the full name and version of this package. */
+#define PACKAGE_STRING ""
+
+/* Define to the one symbol short name of this package. */
+#define PACKAGE_TARNAME ""
+
+/* Define to the home page for this package. */
+#define PACKAGE_URL ""
+
+/* Define to the version of this package. */
+#define PACKAGE_VERSION ""
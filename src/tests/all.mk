@@ -1,4 +1,4 @@
-SUBMAKEFILES := rbmonkey.mk unit/all.mk map/all.mk xlat/all.mk keywords/all.mk auth/all.mk modules/all.mk
+SUBMAKEFILES := rbmonkey.mk radbench.mk radunit.mk radclient/all.mk proxy/all.mk radsniff/all.mk unit/all.mk map/all.mk xlat/all.mk keywords/all.mk auth/all.mk modules/all.mk
 
 #
 #  Include all of the autoconf definitions into the Make variable space
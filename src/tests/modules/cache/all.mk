@@ -0,0 +1,41 @@
+#
+#  Test the "cache" module
+#
+#  Stale entries, and requests waiting for each other, need more
+#  than one request.  So these tests run the requests in FOO.requests
+#  through unittest's benchmark mode, with FOO.bench as the unlang.
+#  Every request must be accepted, and the log must contain the line
+#  which shows the path under test was taken.
+#
+#  Requests run by different threads are ordered with sync.sh, which
+#  uses files in $(BUILD_DIR)/tests/modules/cache/<name>.d
+#
+#	$(call CACHE_BENCH_TEST,name,requests,threads,log line)
+#
+define CACHE_BENCH_TEST
+$(BUILD_DIR)/tests/modules/cache/${1}: src/tests/modules/cache/${1}.bench src/tests/modules/cache/${1}.requests src/tests/modules/cache/module.conf src/tests/modules/cache/sync.sh $(TESTBINDIR)/unittest | build.raddb
+	@rm -rf $$@.d
+	@mkdir -p $$@.d
+	@echo MODULE-TEST cache ${1}
+	@if ! MODULE_TEST_DIR=src/tests/modules/cache MODULE_TEST_UNLANG=$$< $(TESTBIN)/unittest -D share -d src/tests/modules/ \
+			-i src/tests/modules/cache/${1}.requests -b ${2} -j ${3} -xx > $$@.log 2>&1 || \
+	     ! grep -q 'Access-Accept  *${2}$$$$' $$@.log || \
+	     ! grep -q '${4}' $$@.log; then \
+		cat $$@.log; \
+		echo "# $$@.log"; \
+		echo MODULE_TEST_DIR=src/tests/modules/cache MODULE_TEST_UNLANG=$$< $(TESTBIN)/unittest -D share -d src/tests/modules/ -i src/tests/modules/cache/${1}.requests -b ${2} -j ${3} -xx; \
+		exit 1; \
+	fi
+	@touch $$@
+
+cache.test: $(BUILD_DIR)/tests/modules/cache/${1}
+endef
+
+$(eval $(call CACHE_BENCH_TEST,stale,3,1,is stale))
+$(eval $(call CACHE_BENCH_TEST,stale_hit,4,2,another request is refreshing it))
+$(eval $(call CACHE_BENCH_TEST,coalesce,2,2,Waiting for another request))
+$(eval $(call CACHE_BENCH_TEST,abandon,3,2,did not populate entry))
+$(eval $(call CACHE_BENCH_TEST,htable_admit,1,1,used less often than existing entries))
+$(eval $(call CACHE_BENCH_TEST,htable_expire,4,1,Cache is full))
+
+cache.test: rlm_cache_htable.la
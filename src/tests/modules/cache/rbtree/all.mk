@@ -1,2 +1,11 @@
 cache_rbtree.test:
 
+#
+#  The snapshot tests need a new server for each step, and the
+#  "expire" entry has to expire between the two.
+#
+$(BUILD_DIR)/tests/modules/cache/rbtree/snapshot_wait: $(BUILD_DIR)/tests/modules/cache/rbtree/snapshot_save
+	@sleep 3
+	@touch $@
+
+$(BUILD_DIR)/tests/modules/cache/rbtree/snapshot_restore: $(BUILD_DIR)/tests/modules/cache/rbtree/snapshot_wait
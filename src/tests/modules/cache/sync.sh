@@ -0,0 +1,44 @@
+#!/bin/sh
+#
+#  Order requests which are run by different threads, so that
+#  one request only continues once another has reached a given
+#  point.  Prints "ok" on success, and nothing if it gives up.
+#
+#	sync.sh post <file>		Create <file>.
+#	sync.sh wait <file>		Wait for <file> to be created.
+#	sync.sh log <file> <regex>	Wait for a line matching <regex>
+#					to be written to <file>.
+#
+TRIES=800
+
+while [ $TRIES -gt 0 ]; do
+	case "$1" in
+	post)
+		touch "$2" && echo ok
+		exit 0
+		;;
+
+	wait)
+		if [ -e "$2" ]; then
+			echo ok
+			exit 0
+		fi
+		;;
+
+	log)
+		if grep -q "$3" "$2"; then
+			echo ok
+			exit 0
+		fi
+		;;
+
+	*)
+		exit 1
+		;;
+	esac
+
+	sleep 0.01
+	TRIES=`expr $TRIES - 1`
+done
+
+exit 1
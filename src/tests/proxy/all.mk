@@ -0,0 +1,50 @@
+#
+#  Tests for connections to TLS home servers.  The server proxies to
+#  itself, and the debug log shows which connections it opened.
+#
+PROXY_TEST_DIR	:= $(DIR)
+PROXY_TEST_PORT	:= $(shell grep '^proxy_port' $(DIR)/radiusd.conf | sed 's/.*= *//')
+
+#
+#  The tests are run with kernel TLS off, and then on.  Where the
+#  kernel or OpenSSL can't do kernel TLS, OpenSSL does all of the
+#  crypto, as before, and everything must still work.
+#
+#	$(call PROXY_TEST,name,ktls)
+#
+define PROXY_TEST
+.PHONY: $(BUILD_DIR)/tests/proxy/${1}
+$(BUILD_DIR)/tests/proxy/${1}:
+	@mkdir -p $$@
+
+#
+#  Start the server, run the tests, and always stop the server.
+#
+.PHONY: tests.proxy.${1}
+tests.proxy.${1}: $(TESTBINDIR)/radiusd $(TESTBINDIR)/radclient | $(BUILD_DIR)/tests/proxy/${1}
+	@$(MAKE) -C raddb/certs
+	@echo PROXY-TEST ${1}
+	@rm -f $(BUILD_DIR)/tests/proxy/radiusd.pid $(BUILD_DIR)/tests/proxy/${1}/radiusd.log
+	@if ! PROXY_TEST_KTLS=${2} $(TESTBIN)/radiusd -d $(PROXY_TEST_DIR) -n radiusd -D share -xxx -l $(BUILD_DIR)/tests/proxy/${1}/radiusd.log; then \
+		tail -n 20 $(BUILD_DIR)/tests/proxy/${1}/radiusd.log; \
+		exit 1; \
+	fi
+	@ret=0; \
+	PROXY_TEST_KTLS=${2} $(PROXY_TEST_DIR)/runtests.sh $(BUILD_DIR)/tests/proxy/${1} $(PROXY_TEST_PORT) \
+		env $(TESTBIN)/radclient -D share || ret=1; \
+	pid=`cat $(BUILD_DIR)/tests/proxy/radiusd.pid`; \
+	kill -TERM $$$$pid || ret=1; \
+	while kill -0 $$$$pid 2>/dev/null; do sleep 0.1; done; \
+	exit $$$$ret
+
+tests.proxy: tests.proxy.${1}
+endef
+
+.PHONY: tests.proxy
+$(eval $(call PROXY_TEST,tls,no))
+$(eval $(call PROXY_TEST,ktls,yes))
+
+#
+#  One at a time, as they use the same ports.
+#
+tests.proxy.ktls: tests.proxy.tls
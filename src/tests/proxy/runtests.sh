@@ -0,0 +1,110 @@
+#!/bin/sh
+#
+#  Proxy requests to TLS home servers, and check the connections
+#  which the server opened, and the packets which it wrote.
+#
+#	runtests.sh <output dir> <port> <radclient...>
+#
+OUT=$1
+PORT=$2
+shift 2
+
+LOG=$OUT/radiusd.log
+RCODE=0
+
+#
+#  Write "count" requests for a realm.
+#
+requests() {
+	I=0
+	while [ $I -lt $2 ]; do
+		I=`expr $I + 1`
+		echo "User-Name = \"user$I@$1\""
+		echo "User-Password = \"testing\""
+		echo
+	done > $OUT/$1.txt
+}
+
+#
+#  Proxy the requests for a realm, "parallel" at a time.  Every
+#  one should be accepted.  The server log from this run is saved
+#  to <realm>.debug
+#
+run() {
+	NAME=$1
+	PARALLEL=$2
+	shift 2
+
+	START=`wc -l < $LOG`
+
+	if ! "$@" -p $PARALLEL -f $OUT/$NAME.txt 127.0.0.1:$PORT auth testing123 > $OUT/$NAME.log 2>&1; then
+		echo "proxy $NAME : FAILED (not all requests were accepted)"
+		cat $OUT/$NAME.log
+		RCODE=1
+		return 1
+	fi
+
+	tail -n +`expr $START + 1` $LOG > $OUT/$NAME.debug
+	return 0
+}
+
+#
+#  How many connections were opened to a home server port.
+#
+connections() {
+	grep -c "Opened new proxy socket.*home_server (127.0.0.1, $1)" $LOG
+}
+
+check() {
+	if ! awk "BEGIN { exit !($2) }"; then
+		echo "proxy $1 : FAILED ($2)"
+		RCODE=1
+	fi
+}
+
+#
+#  One request at a time.  The pool is filled to min_connections,
+#  and no more, as no connection runs low on Ids.
+#
+requests pool 10
+if run pool 1 "$@"; then
+	check pool "`connections 12381` == 3"
+fi
+
+#
+#  Many requests at once, with spare_ids = 250.  Another connection
+#  is opened whenever the least loaded one has 6 outstanding
+#  requests, up to max_connections.
+#
+requests spare 50
+if run spare 50 "$@"; then
+	OPENED=`connections 12382`
+	check spare "$OPENED > 1 && $OPENED <= 4"
+fi
+
+#
+#  Many requests at once, with coalesce_writes = yes.  Every packet
+#  is written exactly once, whether or not it shared a record with
+#  others.
+#
+requests coalesce 50
+if run coalesce 50 "$@"; then
+	WRITTEN=`sed -n 's/.*Proxy is writing .* (\([0-9]*\) packets) to SSL.*/\1/p' $OUT/coalesce.debug | awk '{ n += $1 } END { print n + 0 }'`
+	check coalesce "$WRITTEN == 50"
+fi
+
+#
+#  With PROXY_TEST_KTLS=yes, both ends of every connection say
+#  whether the kernel took over the crypto.  Where it can't, they
+#  say it's disabled, and OpenSSL does it instead.
+#
+TOTAL=`grep -c "Opened new proxy socket" $LOG`
+if [ "$PROXY_TEST_KTLS" = "yes" ]; then
+	KTLS=$TOTAL
+else
+	KTLS=0
+fi
+check ktls "`grep -c 'tls: Kernel TLS send' $LOG` == $KTLS"
+check ktls "`grep -c 'TLS - Kernel TLS send' $LOG` == $KTLS"
+
+exit $RCODE
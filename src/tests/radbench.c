@@ -0,0 +1,712 @@
+/*
+ *   This program is is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or (at
+ *   your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file radbench.c
+ * @brief Micro-benchmarks for the hot paths in libfreeradius.
+ *
+ * Each benchmark runs one operation in a loop, increasing the number of
+ * iterations until the loop takes long enough to time accurately.  The
+ * results are written as CSV, one line per benchmark:
+ *
+ *	benchmark,iterations,ns/op,allocs/op
+ *
+ * so they can be saved, and compared between commits.
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/radiusd.h>
+#include <freeradius-devel/heap.h>
+#include <freeradius-devel/radpaths.h>
+
+#ifdef WITH_DHCP
+#	include <freeradius-devel/dhcp.h>
+#endif
+
+#ifdef HAVE_GETOPT_H
+#	include <getopt.h>
+#endif
+
+#include <sys/wait.h>
+
+#ifdef HAVE_PTHREAD_H
+pid_t rad_fork(void)
+{
+	return fork();
+}
+
+pid_t rad_waitpid(pid_t pid, int *status)
+{
+	return waitpid(pid, status, 0);
+}
+#endif
+
+#ifdef __GLIBC__
+/*
+ *	Count heap allocations by wrapping the glibc allocator.  talloc,
+ *	and everything else, ends up here.
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static uint64_t alloc_count;
+
+void *malloc(size_t size)
+{
+	alloc_count++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	alloc_count++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	alloc_count++;
+	return __libc_realloc(ptr, size);
+}
+#  define ALLOC_COUNT	alloc_count
+#else
+#  define ALLOC_COUNT	0
+#endif
+
+#define BENCH_ENTRIES	(100000)	//!< Number of entries in the hash table, and rbtree.
+#define BENCH_HEAP	(10000)		//!< Number of entries in the heap.
+
+/** Run a single operation
+ *
+ * @param ctx to allocate anything the operation needs.  Its children are freed after
+ *	each operation.
+ * @param i the iteration number.
+ * @return 0 on success, -1 on error.
+ */
+typedef int (*bench_op_t)(TALLOC_CTX *ctx, uint64_t i);
+
+typedef struct bench {
+	char const	*name;
+	bench_op_t	op;
+} bench_t;
+
+typedef struct bench_heap_entry {
+	int		heap_id;
+	uint32_t	key;
+} bench_heap_entry_t;
+
+static char const *secret = "testing123";
+
+static char const *access_request_attrs =
+	"User-Name = \"bob@example.com\", "
+	"User-Password = \"hello there\", "
+	"NAS-IP-Address = 192.0.2.1, "
+	"NAS-Port = 10, "
+	"NAS-Port-Type = Wireless-802.11, "
+	"Service-Type = Framed-User, "
+	"Framed-MTU = 1400, "
+	"Called-Station-Id = \"00-11-22-33-44-55:example\", "
+	"Calling-Station-Id = \"66-77-88-99-AA-BB\", "
+	"Connect-Info = \"CONNECT 54Mbps 802.11g\", "
+	"Acct-Session-Id = \"4D2C7A8E-0000001F\", "
+	"Cisco-AVPair = \"ssid=example\", "
+	"NAS-Identifier = \"ap-1.example.com\", "
+	"Message-Authenticator = 0x00";
+
+static char const *accounting_request_attrs =
+	"Acct-Status-Type = Interim-Update, "
+	"User-Name = \"bob@example.com\", "
+	"Acct-Session-Id = \"4D2C7A8E-0000001F\", "
+	"Acct-Multi-Session-Id = \"AB4F5C3E9D1A2B3C\", "
+	"NAS-IP-Address = 192.0.2.1, "
+	"NAS-Port = 10, "
+	"NAS-Port-Type = Wireless-802.11, "
+	"Framed-IP-Address = 198.51.100.7, "
+	"Called-Station-Id = \"00-11-22-33-44-55:example\", "
+	"Calling-Station-Id = \"66-77-88-99-AA-BB\", "
+	"Acct-Session-Time = 3600, "
+	"Acct-Input-Octets = 123456789, "
+	"Acct-Output-Octets = 987654321, "
+	"Acct-Input-Packets = 123456, "
+	"Acct-Output-Packets = 654321, "
+	"Acct-Input-Gigawords = 1, "
+	"Event-Timestamp = 1451606400, "
+	"Acct-Delay-Time = 0, "
+	"NAS-Identifier = \"ap-1.example.com\"";
+
+/*
+ *	Data shared by the benchmarks.  Set up once by bench_init().
+ */
+#ifdef WITH_DHCP
+static char const *dhcp_discover_attrs =
+	"DHCP-Opcode = Client-Message, "
+	"DHCP-Hardware-Type = Ethernet, "
+	"DHCP-Hardware-Address-Length = 6, "
+	"DHCP-Client-Hardware-Address = 02:00:00:00:00:01, "
+	"DHCP-Message-Type = DHCP-Discover, "
+	"DHCP-Client-Identifier = 0x01020000000001, "
+	"DHCP-Requested-IP-Address = 192.0.2.1, "
+	"DHCP-Hostname = \"cpe-000001\", "
+	"DHCP-Vendor-Class-Identifier = \"MSFT 5.0\", "
+	"DHCP-DHCP-Maximum-Msg-Size = 1500, "
+	"DHCP-Parameter-Request-List = 1, "
+	"DHCP-Parameter-Request-List = 3, "
+	"DHCP-Parameter-Request-List = 6, "
+	"DHCP-Parameter-Request-List = 15, "
+	"DHCP-Parameter-Request-List = 51, "
+	"DHCP-Parameter-Request-List = 54";
+
+static RADIUS_PACKET	*dhcp_discover;		//!< Encoded, with attributes.
+#endif
+
+static RADIUS_PACKET	*access_request;	//!< Encoded, with attributes.
+static RADIUS_PACKET	*accounting_request;	//!< Encoded, with attributes.
+
+static uint32_t		*keys;
+static fr_hash_table_t	*ht;
+static rbtree_t		*tree;
+static fr_heap_t	*heap;
+static bench_heap_entry_t *heap_entries;
+
+static REQUEST		*request;
+static xlat_exp_t	*xlat_compiled;
+
+static char const	*xlat_simple = "%{User-Name}";
+static char const	*xlat_complex = "%{User-Name}@%{NAS-IP-Address}:%{NAS-Port} (%{strlen:Connect-Info})";
+
+/*
+ *	Spread lookups over the whole table, rather than walking it
+ *	in the same order as it was populated.
+ */
+#define BENCH_KEY(_i) (keys[((_i) * 7919) % BENCH_ENTRIES])
+
+static uint32_t bench_hash(void const *data)
+{
+	return fr_hash(data, sizeof(uint32_t));
+}
+
+static int bench_cmp(void const *one, void const *two)
+{
+	uint32_t a = *(uint32_t const *) one;
+	uint32_t b = *(uint32_t const *) two;
+
+	return (a > b) - (a < b);
+}
+
+static int bench_heap_cmp(void const *one, void const *two)
+{
+	bench_heap_entry_t const *a = one;
+	bench_heap_entry_t const *b = two;
+
+	return (a->key > b->key) - (a->key < b->key);
+}
+
+static ssize_t xlat_bench(UNUSED void *instance, UNUSED REQUEST *xlat_request,
+			  UNUSED char const *fmt, UNUSED char *out, UNUSED size_t outlen)
+{
+	return 0;
+}
+
+/** Allocate a packet, and encode the attributes from a string
+ *
+ */
+static RADIUS_PACKET *bench_packet_alloc(TALLOC_CTX *ctx, PW_CODE code, char const *attrs)
+{
+	RADIUS_PACKET *packet;
+
+	packet = rad_alloc(ctx, true);
+	if (!packet) return NULL;
+
+	packet->code = code;
+	packet->id = 42;
+
+	if (fr_pair_list_afrom_str(packet, attrs, &packet->vps) == T_INVALID) goto error;
+
+	if ((rad_encode(packet, NULL, secret) < 0) || (rad_sign(packet, NULL, secret) < 0)) {
+	error:
+		fr_perror("radbench");
+		talloc_free(packet);
+		return NULL;
+	}
+
+	return packet;
+}
+
+/*
+ *	Packet encoding, decoding and verification.
+ */
+static int bench_encode(TALLOC_CTX *ctx, RADIUS_PACKET const *in)
+{
+	RADIUS_PACKET	*packet;
+	int		ret;
+
+	packet = rad_alloc(ctx, false);
+	if (!packet) return -1;
+
+	packet->code = in->code;
+	packet->id = in->id;
+	memcpy(packet->vector, in->vector, sizeof(packet->vector));
+
+	packet->vps = in->vps;
+	ret = rad_encode(packet, NULL, secret);
+	if (ret == 0) ret = rad_sign(packet, NULL, secret);
+	packet->vps = NULL;
+
+	return ret;
+}
+
+static int bench_encode_access_request(TALLOC_CTX *ctx, UNUSED uint64_t i)
+{
+	return bench_encode(ctx, access_request);
+}
+
+static int bench_encode_accounting_request(TALLOC_CTX *ctx, UNUSED uint64_t i)
+{
+	return bench_encode(ctx, accounting_request);
+}
+
+static int bench_decode(TALLOC_CTX *ctx, RADIUS_PACKET const *in)
+{
+	RADIUS_PACKET	*packet;
+
+	packet = rad_alloc(ctx, false);
+	if (!packet) return -1;
+
+	packet->data = talloc_memdup(packet, in->data, in->data_len);
+	if (!packet->data) return -1;
+	packet->data_len = in->data_len;
+
+	if (!rad_packet_ok(packet, 0, NULL)) return -1;
+
+	return rad_decode(packet, NULL, secret);
+}
+
+static int bench_decode_access_request(TALLOC_CTX *ctx, UNUSED uint64_t i)
+{
+	return bench_decode(ctx, access_request);
+}
+
+static int bench_decode_accounting_request(TALLOC_CTX *ctx, UNUSED uint64_t i)
+{
+	return bench_decode(ctx, accounting_request);
+}
+
+static int bench_verify_access_request(UNUSED TALLOC_CTX *ctx, UNUSED uint64_t i)
+{
+	return rad_verify(access_request, NULL, secret);
+}
+
+static int bench_verify_accounting_request(UNUSED TALLOC_CTX *ctx, UNUSED uint64_t i)
+{
+	return rad_verify(accounting_request, NULL, secret);
+}
+
+#ifdef WITH_DHCP
+static int bench_dhcp_decode_discover(TALLOC_CTX *ctx, UNUSED uint64_t i)
+{
+	RADIUS_PACKET	*packet;
+
+	packet = rad_alloc(ctx, false);
+	if (!packet) return -1;
+
+	packet->data = talloc_memdup(packet, dhcp_discover->data, dhcp_discover->data_len);
+	if (!packet->data) return -1;
+	packet->data_len = dhcp_discover->data_len;
+
+	return fr_dhcp_decode(packet);
+}
+#endif
+
+/*
+ *	Attribute lists.
+ */
+static int bench_pair_find_first(UNUSED TALLOC_CTX *ctx, UNUSED uint64_t i)
+{
+	return fr_pair_find_by_num(access_request->vps, PW_USER_NAME, 0, TAG_ANY) ? 0 : -1;
+}
+
+static int bench_pair_find_last(UNUSED TALLOC_CTX *ctx, UNUSED uint64_t i)
+{
+	return fr_pair_find_by_num(accounting_request->vps, PW_NAS_IDENTIFIER, 0, TAG_ANY) ? 0 : -1;
+}
+
+static int bench_pair_find_missing(UNUSED TALLOC_CTX *ctx, UNUSED uint64_t i)
+{
+	return fr_pair_find_by_num(accounting_request->vps, PW_REPLY_MESSAGE, 0, TAG_ANY) ? -1 : 0;
+}
+
+/*
+ *	Containers.
+ */
+static int bench_hash_find_hit(UNUSED TALLOC_CTX *ctx, uint64_t i)
+{
+	return fr_hash_table_finddata(ht, &BENCH_KEY(i)) ? 0 : -1;
+}
+
+static int bench_hash_find_miss(UNUSED TALLOC_CTX *ctx, uint64_t i)
+{
+	uint32_t key = BENCH_KEY(i) + 1;	/* keys are all even */
+
+	return fr_hash_table_finddata(ht, &key) ? -1 : 0;
+}
+
+static int bench_hash_insert_delete(UNUSED TALLOC_CTX *ctx, uint64_t i)
+{
+	uint32_t key = BENCH_KEY(i) + 1;
+
+	if (!fr_hash_table_insert(ht, &key)) return -1;
+
+	return fr_hash_table_delete(ht, &key) ? 0 : -1;
+}
+
+static int bench_rbtree_find(UNUSED TALLOC_CTX *ctx, uint64_t i)
+{
+	return rbtree_finddata(tree, &BENCH_KEY(i)) ? 0 : -1;
+}
+
+static int bench_heap_extract_insert(UNUSED TALLOC_CTX *ctx, uint64_t i)
+{
+	bench_heap_entry_t *entry;
+
+	entry = fr_heap_peek(heap);
+	if (!entry || !fr_heap_extract(heap, NULL)) return -1;
+
+	entry->key += BENCH_KEY(i) % BENCH_HEAP;
+
+	return fr_heap_insert(heap, entry) ? 0 : -1;
+}
+
+/*
+ *	String expansions.
+ */
+static int bench_xlat(TALLOC_CTX *ctx, char const *fmt)
+{
+	char *out = NULL;
+
+	if (radius_axlat(&out, request, fmt, NULL, NULL) < 0) return -1;
+	talloc_steal(ctx, out);
+
+	return 0;
+}
+
+static int bench_xlat_simple(TALLOC_CTX *ctx, UNUSED uint64_t i)
+{
+	return bench_xlat(ctx, xlat_simple);
+}
+
+static int bench_xlat_complex(TALLOC_CTX *ctx, UNUSED uint64_t i)
+{
+	return bench_xlat(ctx, xlat_complex);
+}
+
+static int bench_xlat_compiled(TALLOC_CTX *ctx, UNUSED uint64_t i)
+{
+	char *out = NULL;
+
+	if (radius_axlat_struct(&out, request, xlat_compiled, NULL, NULL) < 0) return -1;
+	talloc_steal(ctx, out);
+
+	return 0;
+}
+
+static bench_t const benchmarks[] = {
+	{ "radius.encode.access_request",	bench_encode_access_request },
+	{ "radius.encode.accounting_request",	bench_encode_accounting_request },
+	{ "radius.decode.access_request",	bench_decode_access_request },
+	{ "radius.decode.accounting_request",	bench_decode_accounting_request },
+	{ "radius.verify.access_request",	bench_verify_access_request },
+	{ "radius.verify.accounting_request",	bench_verify_accounting_request },
+
+#ifdef WITH_DHCP
+	{ "dhcp.decode.discover",		bench_dhcp_decode_discover },
+#endif
+
+	{ "pair.find_by_num.first",		bench_pair_find_first },
+	{ "pair.find_by_num.last",		bench_pair_find_last },
+	{ "pair.find_by_num.missing",		bench_pair_find_missing },
+
+	{ "hash.find.hit",			bench_hash_find_hit },
+	{ "hash.find.miss",			bench_hash_find_miss },
+	{ "hash.insert_delete",			bench_hash_insert_delete },
+	{ "rbtree.find",			bench_rbtree_find },
+	{ "heap.extract_insert",		bench_heap_extract_insert },
+
+	{ "xlat.expand.simple",			bench_xlat_simple },
+	{ "xlat.expand.complex",		bench_xlat_complex },
+	{ "xlat.expand.compiled",		bench_xlat_compiled },
+
+	{ NULL, NULL }
+};
+
+static int bench_init(TALLOC_CTX *ctx)
+{
+	int		i;
+	char		*fmt;
+	char const	*error;
+
+	access_request = bench_packet_alloc(ctx, PW_CODE_ACCESS_REQUEST, access_request_attrs);
+	if (!access_request) return -1;
+
+	accounting_request = bench_packet_alloc(ctx, PW_CODE_ACCOUNTING_REQUEST, accounting_request_attrs);
+	if (!accounting_request) return -1;
+
+#ifdef WITH_DHCP
+	dhcp_discover = rad_alloc(ctx, false);
+	if (!dhcp_discover) return -1;
+	dhcp_discover->code = PW_DHCP_DISCOVER;
+
+	if ((fr_pair_list_afrom_str(dhcp_discover, dhcp_discover_attrs, &dhcp_discover->vps) == T_INVALID) ||
+	    (fr_dhcp_encode(dhcp_discover) < 0)) return -1;
+#endif
+
+	/*
+	 *	Even numbers, so odd ones can be used for misses.
+	 */
+	keys = talloc_array(ctx, uint32_t, BENCH_ENTRIES);
+	if (!keys) return -1;
+	for (i = 0; i < BENCH_ENTRIES; i++) keys[i] = fr_rand() & ~1;
+
+	ht = fr_hash_table_create(bench_hash, bench_cmp, NULL);
+	tree = rbtree_create(ctx, bench_cmp, NULL, 0);
+	if (!ht || !tree) return -1;
+
+	for (i = 0; i < BENCH_ENTRIES; i++) {
+		fr_hash_table_replace(ht, &keys[i]);
+		rbtree_insert(tree, &keys[i]);
+	}
+
+	heap = fr_heap_create(bench_heap_cmp, offsetof(bench_heap_entry_t, heap_id));
+	heap_entries = talloc_zero_array(ctx, bench_heap_entry_t, BENCH_HEAP);
+	if (!heap || !heap_entries) return -1;
+
+	for (i = 0; i < BENCH_HEAP; i++) {
+		heap_entries[i].key = keys[i] >> 8;
+		if (!fr_heap_insert(heap, &heap_entries[i])) return -1;
+	}
+
+	/*
+	 *	Registering any xlat registers the built-in ones.
+	 */
+	if (xlat_register("bench", xlat_bench, NULL, NULL) < 0) return -1;
+
+	request = request_alloc(ctx);
+	if (!request) return -1;
+
+	request->packet = rad_alloc(request, false);
+	if (!request->packet) return -1;
+	request->packet->code = PW_CODE_ACCESS_REQUEST;
+	request->packet->vps = fr_pair_list_copy(request->packet, access_request->vps);
+	request->reply = rad_alloc(request, false);
+	if (!request->reply) return -1;
+
+	fmt = talloc_typed_strdup(ctx, xlat_complex);
+	if (xlat_tokenize(ctx, fmt, &xlat_compiled, &error) < 0) {
+		fprintf(stderr, "radbench: Failed parsing \"%s\": %s\n", xlat_complex, error);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void bench_free(void)
+{
+	fr_hash_table_free(ht);
+	fr_heap_delete(heap);
+}
+
+static uint64_t bench_now(void)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+
+	return ((uint64_t) now.tv_sec * 1000000) + now.tv_usec;
+}
+
+/** Run one benchmark, and print the results
+ *
+ * The number of iterations is increased until the loop runs for at least min_usec.
+ */
+static int bench_run(bench_t const *bench, uint64_t min_usec)
+{
+	TALLOC_CTX	*ctx;
+	uint64_t	i, n, start, usec, allocs;
+
+	ctx = talloc_init("radbench");
+	if (!ctx) return -1;
+
+	/*
+	 *	Warm up, and check the operation works.
+	 */
+	if (bench->op(ctx, 0) < 0) {
+		fprintf(stderr, "radbench: %s failed: %s\n", bench->name, fr_strerror());
+		talloc_free(ctx);
+		return -1;
+	}
+	talloc_free_children(ctx);
+
+	n = 1;
+	for (;;) {
+		allocs = ALLOC_COUNT;
+		start = bench_now();
+
+		for (i = 0; i < n; i++) {
+			if (bench->op(ctx, i) < 0) {
+				fprintf(stderr, "radbench: %s failed: %s\n", bench->name, fr_strerror());
+				talloc_free(ctx);
+				return -1;
+			}
+			talloc_free_children(ctx);
+		}
+
+		usec = bench_now() - start;
+		allocs = ALLOC_COUNT - allocs;
+
+		if (usec >= min_usec) break;
+
+		/*
+		 *	Aim for a bit more than min_usec next time, but
+		 *	don't grow too quickly from a bad estimate.
+		 */
+		if (usec < 1000) {
+			n *= 10;
+		} else {
+			n = (n * min_usec * 12) / (usec * 10);
+		}
+	}
+
+	printf("%s,%" PRIu64 ",%.1f,", bench->name, n, (usec * 1000.0) / n);
+#ifdef __GLIBC__
+	printf("%.1f\n", (double) allocs / n);
+#else
+	printf("-\n");
+#endif
+	fflush(stdout);
+
+	talloc_free(ctx);
+
+	return 0;
+}
+
+static void NEVER_RETURNS usage(void)
+{
+	fprintf(stderr, "usage: radbench [OPTS] [benchmark ...]\n");
+	fprintf(stderr, "  -d <raddb>             Set user dictionary directory (defaults to " RADDBDIR ").\n");
+	fprintf(stderr, "  -D <dictdir>           Set main dictionary directory (defaults to " DICTDIR ").\n");
+	fprintf(stderr, "  -l                     List the benchmarks.\n");
+	fprintf(stderr, "  -t <msec>              Minimum time to run each benchmark for (defaults to 250).\n");
+	fprintf(stderr, "Only benchmarks with names starting with one of the given prefixes are run.\n");
+
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	int		c, i, ret = 0;
+	char const	*radius_dir = RADDBDIR;
+	char const	*dict_dir = DICTDIR;
+	uint64_t	min_usec = 250000;
+	bench_t const	*bench;
+	TALLOC_CTX	*ctx;
+
+#ifndef NDEBUG
+	if (fr_fault_setup(getenv("PANIC_ACTION"), argv[0]) < 0) {
+		fr_perror("radbench");
+		exit(EXIT_FAILURE);
+	}
+#endif
+
+	while ((c = getopt(argc, argv, "d:D:lt:h")) != EOF) switch (c) {
+		case 'd':
+			radius_dir = optarg;
+			break;
+
+		case 'D':
+			dict_dir = optarg;
+			break;
+
+		case 'l':
+			for (bench = benchmarks; bench->name; bench++) printf("%s\n", bench->name);
+			exit(0);
+
+		case 't':
+			min_usec = strtoul(optarg, NULL, 10) * 1000;
+			if (!min_usec) usage();
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+	argc -= optind;
+	argv += optind;
+
+	/*
+	 *	Mismatch between the binary and the libraries it depends on
+	 */
+	if (fr_check_lib_magic(RADIUSD_MAGIC_NUMBER) < 0) {
+		fr_perror("radbench");
+		return 1;
+	}
+
+	if (dict_init(dict_dir, RADIUS_DICTIONARY) < 0) {
+		fr_perror("radbench");
+		return 1;
+	}
+
+	if (dict_read(radius_dir, RADIUS_DICTIONARY) == -1) {
+		fr_perror("radbench");
+		return 1;
+	}
+
+#ifdef WITH_DHCP
+	if (!dict_attrbyname("DHCP-Message-Type") && (dict_read(dict_dir, "dictionary.dhcp") == -1)) {
+		fr_perror("radbench");
+		return 1;
+	}
+#endif
+
+	ctx = talloc_init("radbench fixtures");
+	if (bench_init(ctx) < 0) {
+		fprintf(stderr, "radbench: Failed setting up benchmarks: %s\n", fr_strerror());
+		return 1;
+	}
+
+#ifdef WITH_VERIFY_PTR
+	fprintf(stderr, "radbench: WARNING - Built with WITH_VERIFY_PTR, results include the cost of the debug checks\n");
+#endif
+
+	printf("benchmark,iterations,ns/op,allocs/op\n");
+
+	for (bench = benchmarks; bench->name; bench++) {
+		if (argc > 0) {
+			for (i = 0; i < argc; i++) {
+				if (strncmp(bench->name, argv[i], strlen(argv[i])) == 0) break;
+			}
+			if (i == argc) continue;
+		}
+
+		if (bench_run(bench, min_usec) < 0) ret = 1;
+	}
+
+	bench_free();
+	talloc_free(ctx);
+
+	return ret;
+}
@@ -0,0 +1,23 @@
+TARGET := radbench
+
+SOURCES := radbench.c
+
+TGT_PREREQS	:= libfreeradius-server.a libfreeradius-radius.a
+ifneq "$(WITH_DHCP)" "no"
+TGT_PREREQS	+= libfreeradius-dhcp.a
+endif
+TGT_LDLIBS	:= $(LIBS)
+TGT_INSTALLDIR	:=
+
+#
+#  Run the micro-benchmarks, and save the results as CSV, so that
+#  they can be compared between builds.
+#
+#	make bench
+#	make BENCH_ARGS="-t 1000 hash." bench
+#
+.PHONY: bench
+bench: $(TESTBINDIR)/radbench
+	@mkdir -p $(BUILD_DIR)/tests
+	@$(TESTBIN)/radbench -D share $(BENCH_ARGS) > $(BUILD_DIR)/tests/bench.csv
+	@cat $(BUILD_DIR)/tests/bench.csv
@@ -0,0 +1,27 @@
+#
+#  Tests for radclient's load mode, against a server which
+#  accepts everything.
+#
+RADCLIENT_TEST_DIR	:= $(DIR)
+RADCLIENT_TEST_PORT	:= $(shell grep '^radclient_port' $(DIR)/radiusd.conf | sed 's/.*= *//')
+
+.PHONY: $(BUILD_DIR)/tests/radclient
+$(BUILD_DIR)/tests/radclient:
+	@mkdir -p $@
+
+#
+#  Start the server, run the tests, and always stop the server.
+#
+.PHONY: tests.radclient
+tests.radclient: $(TESTBINDIR)/radiusd $(TESTBINDIR)/radclient | $(BUILD_DIR)/tests/radclient
+	@echo RADCLIENT-TEST load
+	@rm -f $(BUILD_DIR)/tests/radclient/radiusd.pid
+	@if ! $(TESTBIN)/radiusd -d $(RADCLIENT_TEST_DIR) -n radiusd -D share -l $(BUILD_DIR)/tests/radclient/radiusd.log; then \
+		tail -n 20 $(BUILD_DIR)/tests/radclient/radiusd.log; \
+		exit 1; \
+	fi
+	@ret=0; \
+	$(RADCLIENT_TEST_DIR)/runtests.sh $(RADCLIENT_TEST_DIR) $(BUILD_DIR)/tests/radclient $(RADCLIENT_TEST_PORT) \
+		env $(TESTBIN)/radclient -D share || ret=1; \
+	kill -TERM `cat $(BUILD_DIR)/tests/radclient/radiusd.pid` || ret=1; \
+	exit $$ret
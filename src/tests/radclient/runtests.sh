@@ -0,0 +1,110 @@
+#!/bin/sh
+#
+#  Run radclient in load mode (-L) against a server which accepts
+#  everything, and check the summary it prints.
+#
+#	runtests.sh <test dir> <output dir> <port> <radclient...>
+#
+DIR=$1
+OUT=$2
+PORT=$3
+shift 3
+
+RCODE=0
+
+#
+#  Print a field from the load summary.
+#
+summary() {
+	grep "^	$2 *:" $1 | sed 's/.*: *//;s/[^0-9.].*//'
+}
+
+#
+#  Compare two numbers with awk, as the shell can't do floating point.
+#
+check() {
+	if ! awk "BEGIN { exit !($2) }"; then
+		echo "radclient $1 : FAILED ($2)"
+		RCODE=1
+		return 1
+	fi
+	return 0
+}
+
+#
+#  Run radclient, and check its exit code
+#
+run() {
+	NAME=$1
+	WANT=$2
+	shift 2
+
+	"$@" > $OUT/$NAME.log 2>&1
+	if [ "$?" != "$WANT" ]; then
+		echo "radclient $NAME : FAILED (exit code should be $WANT)"
+		cat $OUT/$NAME.log
+		RCODE=1
+		return 1
+	fi
+	return 0
+}
+
+#
+#  A constant rate.  Everything is answered, and the achieved rate is
+#  what was received over the time it took.
+#
+if run rate 0 "$@" -f $DIR/rate.txt -L 200 -T 2 127.0.0.1:$PORT auth testing123; then
+	SENT=`summary $OUT/rate.log Sent`
+	RECV=`summary $OUT/rate.log Received`
+	ELAPSED=`summary $OUT/rate.log Elapsed`
+	RATE=`summary $OUT/rate.log 'Achieved rate'`
+
+	check rate "$SENT >= 399 && $SENT <= 401" && \
+	check rate "$RECV == $SENT" && \
+	check rate "$ELAPSED >= 2" && \
+	check rate "($RATE - ($RECV / $ELAPSED)) ^ 2 < 0.01"
+fi
+
+#
+#  Nothing is listening, so every request is lost.  The time taken
+#  includes waiting for the last replies, which are sent just before
+#  the end of the first second.
+#
+if run lost 1 "$@" -f $DIR/rate.txt -L 20 -T 1 -t 1 127.0.0.1:`expr $PORT + 1` auth testing123; then
+	LOST=`summary $OUT/lost.log Lost`
+	ELAPSED=`summary $OUT/lost.log Elapsed`
+	RATE=`summary $OUT/lost.log 'Achieved rate'`
+
+	check lost "$LOST >= 19" && \
+	check lost "$ELAPSED >= 1.9" && \
+	check lost "$RATE == 0"
+fi
+
+#
+#  Ranges up to the full 64 bit range.
+#
+if run range 0 "$@" -f $DIR/range.txt -L 30 -T 1 127.0.0.1:$PORT auth testing123; then
+	SENT=`summary $OUT/range.log Sent`
+	ACCEPT=`summary $OUT/range.log Accepted`
+
+	check range "$SENT >= 29 && $ACCEPT == $SENT"
+fi
+
+#
+#  Each invalid substitution fails every packet.
+#
+LINE=0
+while read -r REQUEST; do
+	LINE=`expr $LINE + 1`
+	echo "$REQUEST" > $OUT/invalid_$LINE.txt
+
+	if run invalid_$LINE 1 "$@" -f $OUT/invalid_$LINE.txt -L 10 -T 1 127.0.0.1:$PORT auth testing123; then
+		if ! grep -q 'needs a range\|Invalid range' $OUT/invalid_$LINE.log; then
+			echo "radclient invalid_$LINE : FAILED (no error for $REQUEST)"
+			RCODE=1
+		fi
+		check invalid_$LINE "`summary $OUT/invalid_$LINE.log Sent` == 0"
+	fi
+done < $DIR/invalid.txt
+
+exit $RCODE
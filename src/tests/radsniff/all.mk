@@ -0,0 +1,37 @@
+#
+#  Tests for radsniff.  A capture of RADIUS traffic is written out,
+#  and the stats for it are compared with, and without worker
+#  threads.  They must be the same.
+#
+ifneq "$(PCAP_LIBS)" ""
+TARGET		:= pcapgen
+
+SOURCES		:= pcapgen.c
+
+TGT_PREREQS	:= libfreeradius-radius.a
+TGT_LDLIBS	:= $(LIBS) $(PCAP_LIBS)
+TGT_LDFLAGS	:= $(LDFLAGS) $(PCAP_LDFLAGS)
+TGT_INSTALLDIR	:=
+
+RADSNIFF_TEST_ARGS	:= -D share -C -W 1 -T 1000
+
+.PHONY: $(BUILD_DIR)/tests/radsniff
+$(BUILD_DIR)/tests/radsniff:
+	@mkdir -p $@
+
+.PHONY: tests.radsniff
+tests.radsniff: $(TESTBINDIR)/radsniff $(TESTBINDIR)/pcapgen | $(BUILD_DIR)/tests/radsniff
+	@echo RADSNIFF-TEST workers
+	@$(TESTBIN)/pcapgen $(BUILD_DIR)/tests/radsniff/test.pcap
+	@$(TESTBIN)/radsniff $(RADSNIFF_TEST_ARGS) -I $(BUILD_DIR)/tests/radsniff/test.pcap > $(BUILD_DIR)/tests/radsniff/single.out
+	@$(TESTBIN)/radsniff $(RADSNIFF_TEST_ARGS) -I $(BUILD_DIR)/tests/radsniff/test.pcap -j 4 > $(BUILD_DIR)/tests/radsniff/workers.out
+	@if ! grep -q 'Access-Request latency' $(BUILD_DIR)/tests/radsniff/single.out; then \
+		echo "radsniff didn't write any stats for $(BUILD_DIR)/tests/radsniff/test.pcap"; \
+		exit 1; \
+	fi
+	@diff $(BUILD_DIR)/tests/radsniff/single.out $(BUILD_DIR)/tests/radsniff/workers.out
+else
+.PHONY: tests.radsniff
+tests.radsniff:
+	@echo "RADSNIFF-TEST skipped, radsniff wasn't built"
+endif
@@ -0,0 +1,239 @@
+/*
+ *   This program is is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or (at
+ *   your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file pcapgen.c
+ * @brief Write a capture of RADIUS traffic, for testing radsniff.
+ *
+ * The capture is the same every time.  Requests come from many clients, so
+ * they're spread between radsniff's workers, and some of them are retransmitted,
+ * lost, or rejected.  Their latencies vary, so the stats for each interval differ.
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/libradius.h>
+#include <freeradius-devel/pcap.h>
+
+#define PCAPGEN_REQUESTS	4000		//!< Number of requests to write.
+#define PCAPGEN_GAP		2000		//!< Microseconds between requests.
+#define PCAPGEN_START		1500000000	//!< Time of the first request.
+
+typedef struct pcapgen_packet {
+	struct timeval		when;		//!< When the packet was "captured".
+	int			seq;		//!< Order the packet was generated in.
+
+	struct in_addr		src_ipaddr;
+	uint16_t		src_port;
+	struct in_addr		dst_ipaddr;
+	uint16_t		dst_port;
+
+	uint8_t			code;
+	uint8_t			id;
+	int			user;		//!< Number of the user making the request.
+} pcapgen_packet_t;
+
+static pcapgen_packet_t *packets;
+static int packets_num;
+
+static void NEVER_RETURNS usage(void)
+{
+	fprintf(stderr, "Usage: pcapgen <file>\n");
+	exit(1);
+}
+
+/** Add a packet to the capture, optionally a copy of another one
+ *
+ */
+static pcapgen_packet_t *pcapgen_add(pcapgen_packet_t const *copy, struct timeval const *when, long usec)
+{
+	pcapgen_packet_t *packet = &packets[packets_num];
+
+	if (copy) {
+		*packet = *copy;
+	} else {
+		memset(packet, 0, sizeof(*packet));
+	}
+	packet->when = *when;
+	packet->when.tv_usec += usec;
+	packet->when.tv_sec += packet->when.tv_usec / 1000000;
+	packet->when.tv_usec %= 1000000;
+	packet->seq = packets_num++;
+
+	return packet;
+}
+
+static int pcapgen_cmp(void const *one, void const *two)
+{
+	pcapgen_packet_t const *a = one, *b = two;
+
+	if (timercmp(&a->when, &b->when, <)) return -1;
+	if (timercmp(&a->when, &b->when, >)) return +1;
+
+	return a->seq - b->seq;
+}
+
+/** Wrap a RADIUS packet in Ethernet, IP and UDP headers, and write it to the capture
+ *
+ */
+static void pcapgen_write(fr_pcap_t *out, pcapgen_packet_t const *packet)
+{
+	uint8_t			buffer[256];
+	ethernet_header_t	*ether = (ethernet_header_t *) buffer;
+	ip_header_t		*ip = (ip_header_t *) (ether + 1);
+	udp_header_t		*udp = (udp_header_t *) (ip + 1);
+	uint8_t			*p = (uint8_t *) (udp + 1), *attr;
+	size_t			len;
+	struct pcap_pkthdr	header;
+
+	memset(buffer, 0, sizeof(buffer));
+
+	p[0] = packet->code;
+	p[1] = packet->id;
+	len = RADIUS_HDR_LEN;
+
+	if (packet->user >= 0) {
+		memcpy(p + 4, &packet->user, sizeof(packet->user));	/* each request has its own authenticator */
+
+		attr = p + len;
+		attr[0] = PW_USER_NAME;
+		attr[1] = 2 + snprintf((char *) attr + 2, 32, "user%i", packet->user);
+		len += attr[1];
+	}
+	p[2] = len >> 8;
+	p[3] = len & 0xff;
+
+	len += sizeof(*udp);
+	udp->src = htons(packet->src_port);
+	udp->dst = htons(packet->dst_port);
+	udp->len = htons(len);
+	udp->checksum = fr_udp_checksum((uint8_t const *) udp, len, 0, packet->src_ipaddr, packet->dst_ipaddr);
+
+	len += sizeof(*ip);
+	ip->ip_vhl = IP_VHL(4, 5);
+	ip->ip_len = htons(len);
+	ip->ip_ttl = 64;
+	ip->ip_p = IPPROTO_UDP;
+	ip->ip_src = packet->src_ipaddr;
+	ip->ip_dst = packet->dst_ipaddr;
+	ip->ip_sum = fr_iph_checksum((uint8_t const *) ip, 5);
+
+	len += sizeof(*ether);
+	ether->ether_type = htons(0x0800);
+
+	header.ts = packet->when;
+	header.caplen = header.len = len;
+
+	pcap_dump((void *) out->dumper, &header, buffer);
+}
+
+int main(int argc, char *argv[])
+{
+	fr_pcap_t		*out;
+	struct timeval		start = { PCAPGEN_START, 250000 };
+	struct in_addr		server, client, unknown;
+	int			i;
+
+	if (argc != 2) usage();
+
+	packets = talloc_array(NULL, pcapgen_packet_t, PCAPGEN_REQUESTS * 4);
+	if (!packets) {
+		fprintf(stderr, "pcapgen: Out of memory\n");
+		return 1;
+	}
+
+	server.s_addr = htonl(0xc0a80001);	/* 192.168.0.1 */
+	unknown.s_addr = htonl(0x0a090909);	/* 10.9.9.9 */
+
+	for (i = 0; i < PCAPGEN_REQUESTS; i++) {
+		pcapgen_packet_t	*request, *response;
+		long			latency = 1000 + ((i * 7919) % 40000);
+		bool			acct = ((i % 3) == 0);
+
+		client.s_addr = htonl(0x0a000000 | ((i % 4) << 8) | (1 + (i % 200)));
+
+		request = pcapgen_add(NULL, &start, (long) i * PCAPGEN_GAP);
+		request->src_ipaddr = client;
+		request->src_port = 1024 + (i % 1000);
+		request->dst_ipaddr = server;
+		request->dst_port = acct ? 1813 : 1812;
+		request->code = acct ? PW_CODE_ACCOUNTING_REQUEST : PW_CODE_ACCESS_REQUEST;
+		request->id = i & 0xff;
+		request->user = i;
+
+		/*
+		 *	Lost, so there's no response.
+		 */
+		if ((i % 23) == 0) continue;
+
+		/*
+		 *	Retransmitted before the response arrived.
+		 */
+		if ((i % 17) == 0) {
+			pcapgen_add(request, &request->when, latency / 2);
+		}
+
+		response = pcapgen_add(NULL, &request->when, latency);
+		response->src_ipaddr = server;
+		response->src_port = request->dst_port;
+		response->dst_ipaddr = client;
+		response->dst_port = request->src_port;
+		response->id = request->id;
+		response->user = -1;
+		if (acct) {
+			response->code = PW_CODE_ACCOUNTING_RESPONSE;
+		} else if ((i % 7) == 0) {
+			response->code = PW_CODE_ACCESS_REJECT;
+		} else {
+			response->code = PW_CODE_ACCESS_ACCEPT;
+		}
+
+		/*
+		 *	A response to a request which wasn't seen.
+		 */
+		if ((i % 29) == 0) {
+			pcapgen_packet_t *unlinked;
+
+			unlinked = pcapgen_add(NULL, &request->when, latency + 100);
+			unlinked->src_ipaddr = server;
+			unlinked->src_port = 1812;
+			unlinked->dst_ipaddr = unknown;
+			unlinked->dst_port = 1111;
+			unlinked->code = PW_CODE_ACCESS_ACCEPT;
+			unlinked->id = 7;
+			unlinked->user = -1;
+		}
+	}
+
+	/*
+	 *	Responses were added with their requests, so put
+	 *	everything in the order it was "captured".
+	 */
+	qsort(packets, packets_num, sizeof(*packets), pcapgen_cmp);
+
+	out = fr_pcap_init(packets, argv[1], PCAP_FILE_OUT);
+	if (!out || (fr_pcap_open(out) < 0)) {
+		fr_perror("pcapgen");
+		return 1;
+	}
+
+	for (i = 0; i < packets_num; i++) pcapgen_write(out, &packets[i]);
+
+	talloc_free(packets);
+
+	return 0;
+}
@@ -0,0 +1,1391 @@
+/*
+ *   This program is is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or (at
+ *   your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file radunit.c
+ * @brief Unit tests for parts of libfreeradius-server which can't be
+ *	reached from the keyword tests.
+ *
+ * Each test prints one line, "ok" or "FAIL", followed by the reason for
+ * any failure.  The exit code is non-zero if any test failed.
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/radiusd.h>
+#include <freeradius-devel/radpaths.h>
+#include <freeradius-devel/state.h>
+
+#ifdef WITH_DHCP
+#	include <freeradius-devel/dhcp.h>
+#	include <freeradius-devel/udpfromto.h>
+#endif
+
+#ifdef HAVE_GETOPT_H
+#	include <getopt.h>
+#endif
+
+#include <sys/wait.h>
+
+/*
+ *	The rest of this is because tls.c, etc. assume they're
+ *	running inside of the server.
+ */
+main_config_t main_config;
+bool event_loop_started = false;
+
+void exec_trigger(UNUSED REQUEST *request, UNUSED CONF_SECTION *cs, UNUSED char const *name, UNUSED int quench)
+{
+}
+
+#ifdef HAVE_PTHREAD_H
+pid_t rad_fork(void)
+{
+	return fork();
+}
+
+pid_t rad_waitpid(pid_t pid, int *status)
+{
+	return waitpid(pid, status, 0);
+}
+
+#  ifdef WITH_TLS
+/*
+ *	Only called by tls_global_init() when the server spawns
+ *	threads, which radunit never does.
+ */
+int tls_mutexes_init(void)
+{
+	return 0;
+}
+#  endif
+#endif
+
+/** Run a single test
+ *
+ * @param ctx to allocate anything the test needs.  Freed after the test.
+ * @return 0 on success, -1 on failure.
+ */
+typedef int (*test_func_t)(TALLOC_CTX *ctx);
+
+typedef struct unit_test {
+	char const	*name;
+	test_func_t	func;
+} unit_test_t;
+
+#define TEST_CHECK(_x) do { \
+		if (!(_x)) { \
+			printf("FAIL\n\t%s[%d]: %s\n", __FILE__, __LINE__, #_x); \
+			return -1; \
+		} \
+	} while (0)
+
+#ifdef WITH_STATS
+#define STATS_THREADS	(FR_STATS_SHARDS * 2)
+#define STATS_SAMPLES	(10000)
+
+/*
+ *	Samples whose bucket is known.  Below FR_STATS_HIST_SUB they're
+ *	exact, then each power of 2 is split into FR_STATS_HIST_SUB.
+ */
+static struct {
+	uint32_t	usec;
+	unsigned int	bucket;
+} const stats_hist_buckets[] = {
+	{ 0,		0 },
+	{ 7,		7 },
+	{ 8,		8 },
+	{ 15,		15 },
+	{ 16,		16 },
+	{ 17,		16 },
+	{ 18,		17 },
+	{ 31,		23 },
+	{ 32,		24 },
+	{ 1000,		63 },
+	{ UINT32_MAX,	FR_STATS_HIST_BUCKETS - 1 },
+};
+
+static int test_stats_hist_bucket(UNUSED TALLOC_CTX *ctx)
+{
+	size_t		i;
+	uint32_t	usec, upper;
+	fr_stats_hist_t	hist;
+
+	for (i = 0; i < sizeof(stats_hist_buckets) / sizeof(stats_hist_buckets[0]); i++) {
+		memset(&hist, 0, sizeof(hist));
+		fr_stats_hist_add(&hist, stats_hist_buckets[i].usec);
+
+		TEST_CHECK(hist.bucket[stats_hist_buckets[i].bucket] == 1);
+		TEST_CHECK(hist.count == 1);
+		TEST_CHECK(hist.max == stats_hist_buckets[i].usec);
+	}
+
+	/*
+	 *	With one sample, and a much larger one, the median is
+	 *	the upper bound of the first sample's bucket.  That must
+	 *	be within 1/FR_STATS_HIST_SUB of the sample.
+	 */
+	for (usec = 0; usec < 10000000; usec += (usec / 64) + 1) {
+		memset(&hist, 0, sizeof(hist));
+		fr_stats_hist_add(&hist, usec);
+		fr_stats_hist_add(&hist, UINT32_MAX);
+
+		upper = fr_stats_hist_percentile(&hist, 50.0);
+		TEST_CHECK(upper >= usec);
+		TEST_CHECK((upper - usec) <= (usec / FR_STATS_HIST_SUB));
+	}
+
+	return 0;
+}
+
+static int test_stats_hist_merge(UNUSED TALLOC_CTX *ctx)
+{
+	int		i;
+	fr_stats_hist_t	a, b;
+
+	memset(&a, 0, sizeof(a));
+	memset(&b, 0, sizeof(b));
+
+	for (i = 1; i <= 100; i++) fr_stats_hist_add(&a, i);
+	for (i = 101; i <= 200; i++) fr_stats_hist_add(&b, i * 10);
+
+	fr_stats_hist_merge(&a, &b);
+
+	TEST_CHECK(a.count == 200);
+	TEST_CHECK(a.sum == 5050 + 150500);
+	TEST_CHECK(a.max == 2000);
+	TEST_CHECK(fr_stats_hist_percentile(&a, 50.0) >= 100);
+	TEST_CHECK(fr_stats_hist_percentile(&a, 50.0) <= 100 + (100 / FR_STATS_HIST_SUB));
+	TEST_CHECK(fr_stats_hist_percentile(&a, 100.0) == 2000);
+
+	return 0;
+}
+
+#ifdef HAVE_PTHREAD_H
+static void *stats_latency_thread(void *arg)
+{
+	fr_stats_latency_t	*lat = arg;
+	struct timeval		start, end;
+	int			i;
+
+	radius_stats_thread_init(0);
+
+	start.tv_sec = end.tv_sec = 1;
+	start.tv_usec = 0;
+	for (i = 0; i < STATS_SAMPLES; i++) {
+		end.tv_usec = i % 1000;
+		fr_stats_latency_add(lat, &start, &end);
+	}
+
+	return NULL;
+}
+
+/*
+ *	More threads than shards, plus the main thread which never
+ *	claims one.  No samples may be lost.
+ */
+static int test_stats_latency_threads(TALLOC_CTX *ctx)
+{
+	int			i;
+	pthread_t		threads[STATS_THREADS];
+	fr_stats_latency_t	*lat;
+	fr_stats_hist_t		hist;
+	struct timeval		start, end;
+
+	lat = talloc_zero(ctx, fr_stats_latency_t);
+
+	for (i = 0; i < STATS_THREADS; i++) {
+		TEST_CHECK(pthread_create(&threads[i], NULL, stats_latency_thread, lat) == 0);
+	}
+
+	start.tv_sec = end.tv_sec = 1;
+	start.tv_usec = 0;
+	end.tv_usec = 5;
+	for (i = 0; i < STATS_SAMPLES; i++) fr_stats_latency_add(lat, &start, &end);
+
+	for (i = 0; i < STATS_THREADS; i++) pthread_join(threads[i], NULL);
+
+	fr_stats_latency_merge(&hist, lat);
+	fr_stats_latency_free(lat);
+
+	TEST_CHECK(hist.count == (uint64_t) (STATS_THREADS + 1) * STATS_SAMPLES);
+	TEST_CHECK(hist.max == 999);
+
+	return 0;
+}
+#endif	/* HAVE_PTHREAD_H */
+
+/*
+ *	Shards are allocated when they're first written to.  This
+ *	thread never claims one, so it only writes to the shared shard.
+ */
+static int test_stats_latency_lazy(UNUSED TALLOC_CTX *ctx)
+{
+	int			i;
+	fr_stats_latency_t	lat;
+	fr_stats_hist_t		hist;
+	struct timeval		start, end;
+
+	memset(&lat, 0, sizeof(lat));
+
+	fr_stats_latency_merge(&hist, &lat);
+	TEST_CHECK(hist.count == 0);
+
+	start.tv_sec = end.tv_sec = 1;
+	start.tv_usec = 0;
+	end.tv_usec = 5;
+	fr_stats_latency_add(&lat, &start, &end);
+
+	TEST_CHECK(lat.shard[0] != NULL);
+	for (i = 1; i < FR_STATS_SHARDS; i++) TEST_CHECK(lat.shard[i] == NULL);
+
+	fr_stats_latency_merge(&hist, &lat);
+	TEST_CHECK(hist.count == 1);
+	TEST_CHECK(hist.max == 5);
+
+	fr_stats_latency_free(&lat);
+	TEST_CHECK(lat.shard[0] == NULL);
+
+	return 0;
+}
+#endif	/* WITH_STATS */
+
+#define STATE_SHARDS	(16)
+
+static int state_freed;
+
+static void state_test_free(UNUSED void *data)
+{
+	state_freed++;
+}
+
+/** Store data against a new State, optionally in a given shard
+ *
+ * @return true if the State table accepted the entry.
+ */
+static bool state_test_put(TALLOC_CTX *ctx, fr_state_t *state, REQUEST *request, int shard, RADIUS_PACKET **out)
+{
+	RADIUS_PACKET	*packet;
+	VALUE_PAIR	*vp;
+	uint8_t		key[AUTH_VECTOR_LEN];
+	size_t		i;
+
+	packet = rad_alloc(ctx, false);
+	*out = packet;
+
+	/*
+	 *	The shard depends only on the State, so keep making
+	 *	them up until one lands in the right shard.
+	 */
+	if (shard >= 0) {
+		do {
+			for (i = 0; i < sizeof(key); i++) key[i] = fr_rand();
+		} while ((int) (fr_hash(key, sizeof(key)) & (STATE_SHARDS - 1)) != shard);
+
+		vp = fr_pair_afrom_num(packet, PW_STATE, 0);
+		fr_pair_value_memcpy(vp, key, sizeof(key));
+		fr_pair_add(&packet->vps, vp);
+	}
+
+	return fr_state_put_data(state, request, NULL, packet, packet, state_test_free);
+}
+
+/*
+ *	The limit is for the whole table, so one shard can hold
+ *	most of the entries.
+ */
+static int test_state_shards(TALLOC_CTX *ctx)
+{
+	fr_state_t		*state;
+	fr_state_stats_t	stats;
+	REQUEST			*request;
+	RADIUS_PACKET		*packets[200];
+	int			i, stored = 0;
+
+	main_config.max_requests = 64;
+	main_config.max_request_time = 30;
+
+	state = fr_state_init(NULL);
+	TEST_CHECK(state != NULL);
+	request = request_alloc(ctx);
+
+	for (i = 0; i < 100; i++) TEST_CHECK(state_test_put(ctx, state, request, 3, &packets[i]));
+
+	fr_state_stats(&stats);
+	TEST_CHECK(stats.shards == STATE_SHARDS);
+	TEST_CHECK(stats.entries == 100);
+	TEST_CHECK(stats.max_shard_entries == 100);
+	TEST_CHECK(stats.full == 0);
+
+	for (i = 100; i < 200; i++) {
+		if (state_test_put(ctx, state, request, -1, &packets[i])) stored++;
+	}
+	TEST_CHECK(stored == 28);
+
+	fr_state_stats(&stats);
+	TEST_CHECK(stats.entries == 128);
+	TEST_CHECK(stats.full == 72);
+
+	for (i = 0; i < 200; i++) {
+		void *data = fr_state_find_data(state, request, packets[i]);
+
+		TEST_CHECK((i < 128) ? (data == packets[i]) : (data == NULL));
+	}
+
+	/*
+	 *	Removing an entry makes room for another.
+	 */
+	TEST_CHECK(fr_state_get_data(state, request, packets[0]) == packets[0]);
+	fr_state_discard(request, packets[0]);
+	TEST_CHECK(state_test_put(ctx, state, request, -1, &packets[0]));
+	TEST_CHECK(!state_test_put(ctx, state, request, -1, &packets[0]));
+
+	fr_state_delete(state);
+
+	return 0;
+}
+
+#ifdef HAVE_PTHREAD_H
+/*
+ *	The expiry thread removes entries once they're older than
+ *	max_request_time * 10.
+ */
+static int test_state_expiry(TALLOC_CTX *ctx)
+{
+	fr_state_t		*state;
+	fr_state_stats_t	stats;
+	REQUEST			*request;
+	RADIUS_PACKET		*packet;
+	uint64_t		expired;
+	int			i;
+
+	main_config.max_requests = 64;
+	main_config.max_request_time = 0;
+
+	state = fr_state_init(NULL);
+	TEST_CHECK(state != NULL);
+	request = request_alloc(ctx);
+
+	fr_state_stats(&stats);
+	expired = stats.expired;
+	state_freed = 0;
+
+	for (i = 0; i < 100; i++) TEST_CHECK(state_test_put(ctx, state, request, i % STATE_SHARDS, &packet));
+
+	sleep(3);
+
+	fr_state_stats(&stats);
+	TEST_CHECK(stats.entries == 0);
+	TEST_CHECK(stats.expired - expired == 100);
+	TEST_CHECK(state_freed == 100);
+
+	/*
+	 *	The table is empty, so there's room for a full set.
+	 */
+	main_config.max_request_time = 30;
+	for (i = 0; i < 128; i++) TEST_CHECK(state_test_put(ctx, state, request, -1, &packet));
+
+	fr_state_delete(state);
+
+	return 0;
+}
+#endif
+
+#if defined(WITH_TLS) && defined(HAVE_OPENSSL_OCSP_H)
+#define OCSP_CACHE_KEY(_buf, _i) ((uint8_t const *) (_buf)), snprintf((_buf), sizeof(_buf), "certid-%d", (_i))
+
+static fr_tls_server_conf_t *ocsp_cache_alloc(TALLOC_CTX *ctx, uint32_t refresh, uint32_t max_entries)
+{
+	fr_tls_server_conf_t *conf;
+
+	conf = tls_server_conf_alloc(ctx);
+	if (!conf) return NULL;
+
+	conf->ocsp_cache_lifetime = 3600;
+	conf->ocsp_cache_refresh = refresh;
+	conf->ocsp_cache_max_entries = max_entries;
+	if (tls_ocsp_cache_init(conf) < 0) return NULL;
+
+	return conf;
+}
+
+static int test_tls_ocsp_cache_hit(TALLOC_CTX *ctx)
+{
+	fr_tls_server_conf_t	*conf;
+	REQUEST			*request;
+	ocsp_status_t		status;
+	char			key[32];
+	time_t			now = time(NULL);
+
+	conf = ocsp_cache_alloc(ctx, 0, 16);
+	TEST_CHECK(conf != NULL);
+	request = request_alloc(ctx);
+
+	TEST_CHECK(!tls_ocsp_cache_find(request, conf, OCSP_CACHE_KEY(key, 1), &status));
+	TEST_CHECK(conf->ocsp_cache_misses == 1);
+
+	tls_ocsp_cache_update(conf, OCSP_CACHE_KEY(key, 1), OCSP_STATUS_OK, now + 60);
+	tls_ocsp_cache_update(conf, OCSP_CACHE_KEY(key, 2), OCSP_STATUS_FAILED, now + 60);
+
+	status = OCSP_STATUS_SKIPPED;
+	TEST_CHECK(tls_ocsp_cache_find(request, conf, OCSP_CACHE_KEY(key, 1), &status));
+	TEST_CHECK(status == OCSP_STATUS_OK);
+
+	TEST_CHECK(tls_ocsp_cache_find(request, conf, OCSP_CACHE_KEY(key, 2), &status));
+	TEST_CHECK(status == OCSP_STATUS_FAILED);
+	TEST_CHECK(conf->ocsp_cache_hits == 2);
+
+	/*
+	 *	Failing to reach the responder doesn't remove the
+	 *	response we already have.
+	 */
+	tls_ocsp_cache_update(conf, OCSP_CACHE_KEY(key, 1), OCSP_STATUS_FAILED, 0);
+	TEST_CHECK(tls_ocsp_cache_find(request, conf, OCSP_CACHE_KEY(key, 1), &status));
+	TEST_CHECK(status == OCSP_STATUS_OK);
+
+	return 0;
+}
+
+static int test_tls_ocsp_cache_expiry(TALLOC_CTX *ctx)
+{
+	fr_tls_server_conf_t	*conf;
+	REQUEST			*request;
+	ocsp_status_t		status;
+	char			key[32];
+	time_t			now = time(NULL);
+
+	conf = ocsp_cache_alloc(ctx, 0, 16);
+	TEST_CHECK(conf != NULL);
+	request = request_alloc(ctx);
+
+	/*
+	 *	Expired responses are removed on lookup...
+	 */
+	tls_ocsp_cache_update(conf, OCSP_CACHE_KEY(key, 1), OCSP_STATUS_OK, now - 1);
+	TEST_CHECK(!tls_ocsp_cache_find(request, conf, OCSP_CACHE_KEY(key, 1), &status));
+	TEST_CHECK(fr_hash_table_num_elements(conf->ocsp_cache) == 0);
+
+	/*
+	 *	...and when another response is added, even if
+	 *	nothing looks for them again.
+	 */
+	tls_ocsp_cache_update(conf, OCSP_CACHE_KEY(key, 1), OCSP_STATUS_OK, now - 1);
+	tls_ocsp_cache_update(conf, OCSP_CACHE_KEY(key, 2), OCSP_STATUS_OK, now - 1);
+	tls_ocsp_cache_update(conf, OCSP_CACHE_KEY(key, 3), OCSP_STATUS_OK, now + 60);
+	TEST_CHECK(fr_hash_table_num_elements(conf->ocsp_cache) == 1);
+	TEST_CHECK(tls_ocsp_cache_find(request, conf, OCSP_CACHE_KEY(key, 3), &status));
+
+	return 0;
+}
+
+static int test_tls_ocsp_cache_refresh(TALLOC_CTX *ctx)
+{
+	fr_tls_server_conf_t	*conf;
+	REQUEST			*request;
+	ocsp_status_t		status;
+	char			key[32];
+	time_t			now = time(NULL);
+
+	conf = ocsp_cache_alloc(ctx, 30, 16);
+	TEST_CHECK(conf != NULL);
+	request = request_alloc(ctx);
+
+	/*
+	 *	Responses which haven't been used aren't refreshed.
+	 */
+	tls_ocsp_cache_update(conf, OCSP_CACHE_KEY(key, 1), OCSP_STATUS_OK, now + 10);
+	TEST_CHECK(tls_ocsp_cache_find(request, conf, OCSP_CACHE_KEY(key, 1), &status));
+
+	/*
+	 *	The next caller fetches a new response, everyone else
+	 *	uses the cached one until it arrives.
+	 */
+	TEST_CHECK(!tls_ocsp_cache_find(request, conf, OCSP_CACHE_KEY(key, 1), &status));
+	TEST_CHECK(tls_ocsp_cache_find(request, conf, OCSP_CACHE_KEY(key, 1), &status));
+	TEST_CHECK(tls_ocsp_cache_find(request, conf, OCSP_CACHE_KEY(key, 1), &status));
+
+	/*
+	 *	If the refresh fails, the next caller tries again.
+	 */
+	tls_ocsp_cache_update(conf, OCSP_CACHE_KEY(key, 1), OCSP_STATUS_FAILED, 0);
+	TEST_CHECK(!tls_ocsp_cache_find(request, conf, OCSP_CACHE_KEY(key, 1), &status));
+
+	/*
+	 *	A new response resets the counters.
+	 */
+	tls_ocsp_cache_update(conf, OCSP_CACHE_KEY(key, 1), OCSP_STATUS_OK, now + 60);
+	TEST_CHECK(tls_ocsp_cache_find(request, conf, OCSP_CACHE_KEY(key, 1), &status));
+	TEST_CHECK(tls_ocsp_cache_find(request, conf, OCSP_CACHE_KEY(key, 1), &status));
+	TEST_CHECK(status == OCSP_STATUS_OK);
+
+	return 0;
+}
+
+/*
+ *	A full cache drops the responses which expire soonest.
+ */
+static int test_tls_ocsp_cache_max_entries(TALLOC_CTX *ctx)
+{
+	fr_tls_server_conf_t	*conf;
+	REQUEST			*request;
+	ocsp_status_t		status;
+	char			key[32];
+	time_t			now = time(NULL);
+	int			i;
+
+	conf = ocsp_cache_alloc(ctx, 0, 8);
+	TEST_CHECK(conf != NULL);
+	request = request_alloc(ctx);
+
+	for (i = 0; i < 100; i++) {
+		tls_ocsp_cache_update(conf, OCSP_CACHE_KEY(key, i), OCSP_STATUS_OK, now + 100 + (i % 50));
+		TEST_CHECK(fr_hash_table_num_elements(conf->ocsp_cache) <= 8);
+	}
+	TEST_CHECK(fr_hash_table_num_elements(conf->ocsp_cache) == 8);
+
+	for (i = 0; i < 100; i++) {
+		TEST_CHECK(tls_ocsp_cache_find(request, conf, OCSP_CACHE_KEY(key, i), &status) == ((i % 50) >= 46));
+	}
+
+	return 0;
+}
+#endif	/* WITH_TLS && HAVE_OPENSSL_OCSP_H */
+
+#if defined(WITH_TLS) && defined(WITH_CRL_INDEX)
+static EVP_PKEY *crl_test_key(void)
+{
+	EVP_PKEY_CTX	*pctx;
+	EVP_PKEY	*key = NULL;
+
+	pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+	if (!pctx) return NULL;
+
+	if ((EVP_PKEY_keygen_init(pctx) <= 0) ||
+	    (EVP_PKEY_CTX_set_ec_paramgen_curve_nid(pctx, NID_X9_62_prime256v1) <= 0) ||
+	    (EVP_PKEY_keygen(pctx, &key) <= 0)) key = NULL;
+	EVP_PKEY_CTX_free(pctx);
+
+	return key;
+}
+
+/** Create a certificate, self-signed if there's no issuer
+ *
+ */
+static X509 *crl_test_cert(EVP_PKEY *key, X509 *issuer, EVP_PKEY *issuer_key, char const *cn, long serial)
+{
+	X509		*cert;
+	X509_NAME	*name;
+
+	cert = X509_new();
+	if (!cert) return NULL;
+
+	name = X509_get_subject_name(cert);
+	X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (unsigned char const *) cn, -1, -1, 0);
+
+	X509_set_version(cert, 2);
+	ASN1_INTEGER_set(X509_get_serialNumber(cert), serial);
+	X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+	X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+	X509_set_pubkey(cert, key);
+	X509_set_issuer_name(cert, issuer ? X509_get_subject_name(issuer) : name);
+
+	if (!X509_sign(cert, issuer ? issuer_key : key, EVP_sha256())) {
+		X509_free(cert);
+		return NULL;
+	}
+
+	return cert;
+}
+
+/** Write a CA certificate, and a CRL revoking the given serials, to a file
+ *
+ */
+static int crl_test_write(char const *file, X509 *ca, EVP_PKEY *ca_key, long const *revoked, int num)
+{
+	X509_CRL	*crl;
+	ASN1_TIME	*when;
+	FILE		*fp;
+	int		i, ret = -1;
+
+	crl = X509_CRL_new();
+	when = X509_gmtime_adj(NULL, 0);
+	if (!crl || !when) goto done;
+
+	X509_CRL_set_version(crl, 1);
+	X509_CRL_set_issuer_name(crl, X509_get_subject_name(ca));
+	X509_CRL_set1_lastUpdate(crl, when);
+
+	for (i = 0; i < num; i++) {
+		X509_REVOKED	*entry = X509_REVOKED_new();
+		ASN1_INTEGER	*serial = ASN1_INTEGER_new();
+
+		ASN1_INTEGER_set(serial, revoked[i]);
+		X509_REVOKED_set_serialNumber(entry, serial);
+		X509_REVOKED_set_revocationDate(entry, when);
+		X509_CRL_add0_revoked(crl, entry);
+		ASN1_INTEGER_free(serial);
+	}
+
+	X509_gmtime_adj(when, 3600);
+	X509_CRL_set1_nextUpdate(crl, when);
+	X509_CRL_sort(crl);
+	if (!X509_CRL_sign(crl, ca_key, EVP_sha256())) goto done;
+
+	fp = fopen(file, "w");
+	if (!fp) goto done;
+
+	if (PEM_write_X509(fp, ca) && PEM_write_X509_CRL(fp, crl)) ret = 0;
+	if (fclose(fp) != 0) ret = -1;
+
+done:
+	ASN1_TIME_free(when);
+	X509_CRL_free(crl);
+
+	return ret;
+}
+
+static int _crl_test_file_free(char *file)
+{
+	unlink(file);
+
+	return 0;
+}
+
+/*
+ *	One revoked and one good certificate from the same CA, and
+ *	one from a CA which hasn't published a CRL.  The index then
+ *	picks up a new CRL, with the reload thread running.
+ */
+static int test_tls_crl_index(TALLOC_CTX *ctx)
+{
+	fr_tls_server_conf_t	*conf;
+	EVP_PKEY		*ca_key, *key;
+	X509			*ca, *other, *revoked, *good, *unknown;
+	char			*file;
+	int			fd;
+	long const		serials[] = { 2, 3 };
+
+	ca_key = crl_test_key();
+	key = crl_test_key();
+	TEST_CHECK(ca_key && key);
+
+	ca = crl_test_cert(ca_key, NULL, NULL, "radunit CA", 1);
+	other = crl_test_cert(ca_key, NULL, NULL, "radunit other CA", 1);
+	TEST_CHECK(ca && other);
+
+	revoked = crl_test_cert(key, ca, ca_key, "revoked", 2);
+	good = crl_test_cert(key, ca, ca_key, "good", 3);
+	unknown = crl_test_cert(key, other, ca_key, "unknown", 2);
+	TEST_CHECK(revoked && good && unknown);
+
+	file = talloc_strdup(ctx, "/tmp/radunit-crl.XXXXXX");
+	fd = mkstemp(file);
+	TEST_CHECK(fd >= 0);
+	close(fd);
+	talloc_set_destructor(file, _crl_test_file_free);
+
+	TEST_CHECK(crl_test_write(file, ca, ca_key, serials, 1) == 0);
+
+	conf = tls_server_conf_alloc(ctx);
+	TEST_CHECK(conf != NULL);
+
+	conf->ctx = SSL_CTX_new(SSLv23_method());
+	TEST_CHECK(conf->ctx != NULL);
+	TEST_CHECK(X509_STORE_add_cert(SSL_CTX_get_cert_store(conf->ctx), ca) == 1);
+
+	conf->ca_file = file;
+	conf->crl_reload_interval = 1;
+	TEST_CHECK(tls_crl_index_init(conf) == 0);
+
+	TEST_CHECK(tls_crl_index_check(conf, revoked) == X509_V_ERR_CERT_REVOKED);
+	TEST_CHECK(tls_crl_index_check(conf, good) == X509_V_OK);
+	TEST_CHECK(tls_crl_index_check(conf, unknown) == X509_V_ERR_UNABLE_TO_GET_CRL);
+
+	/*
+	 *	The reload thread only checks the files once a second.
+	 */
+	TEST_CHECK(crl_test_write(file, ca, ca_key, serials, 2) == 0);
+	sleep(3);
+	TEST_CHECK(tls_crl_index_check(conf, revoked) == X509_V_ERR_CERT_REVOKED);
+	TEST_CHECK(tls_crl_index_check(conf, good) == X509_V_ERR_CERT_REVOKED);
+
+	/*
+	 *	Stops the reload thread, and frees the SSL_CTX.
+	 */
+	talloc_free(conf);
+
+	X509_free(unknown);
+	X509_free(good);
+	X509_free(revoked);
+	X509_free(other);
+	X509_free(ca);
+	EVP_PKEY_free(key);
+	EVP_PKEY_free(ca_key);
+
+	return 0;
+}
+#endif	/* WITH_TLS && WITH_CRL_INDEX */
+
+#ifdef WITH_TLS
+/*
+ *	Fill a socket which nothing reads from.
+ */
+static int tls_write_fill(int fd[2])
+{
+	int		bufsize = 4096;
+	uint8_t		buffer[1024];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fd) < 0) return -1;
+
+	(void) setsockopt(fd[0], SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+	if (fr_nonblock(fd[0]) < 0) return -1;
+
+	memset(buffer, 0, sizeof(buffer));
+	while (write(fd[0], buffer, sizeof(buffer)) > 0);
+
+	return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : -1;
+}
+
+/*
+ *	A peer which doesn't read is given TLS_WRITE_TIMEOUT in total,
+ *	including the time spent on earlier attempts.
+ */
+static int test_tls_write_timeout(UNUSED TALLOC_CTX *ctx)
+{
+	int		fd[2];
+	bool		ready;
+	uint8_t		buffer[65536];
+	struct timeval	start, end, now, elapsed;
+
+	TEST_CHECK(tls_write_fill(fd) == 0);
+
+	gettimeofday(&start, NULL);
+	ready = tls_socket_write_wait(fd[0], SSL_ERROR_WANT_WRITE, &start);
+	gettimeofday(&end, NULL);
+	rad_tv_sub(&end, &start, &elapsed);
+
+	TEST_CHECK(!ready);
+	TEST_CHECK((elapsed.tv_sec > 0) || (elapsed.tv_usec >= TLS_WRITE_TIMEOUT));
+	TEST_CHECK(elapsed.tv_sec < 1);
+
+	/*
+	 *	The whole timeout was used up by the first wait, so
+	 *	a retry gives up without waiting.
+	 */
+	ready = tls_socket_write_wait(fd[0], SSL_ERROR_WANT_WRITE, &start);
+	gettimeofday(&now, NULL);
+	rad_tv_sub(&now, &end, &elapsed);
+
+	TEST_CHECK(!ready);
+	TEST_CHECK((elapsed.tv_sec == 0) && (elapsed.tv_usec < TLS_WRITE_TIMEOUT));
+
+	/*
+	 *	Once the peer reads, the write can be retried.
+	 */
+	while (read(fd[1], buffer, sizeof(buffer)) == sizeof(buffer));
+
+	gettimeofday(&start, NULL);
+	TEST_CHECK(tls_socket_write_wait(fd[0], SSL_ERROR_WANT_WRITE, &start));
+
+	close(fd[0]);
+	close(fd[1]);
+
+	return 0;
+}
+#endif	/* WITH_TLS */
+
+#if defined(WITH_DHCP) && defined(WITH_UDPFROMTO)
+#define DHCP_TEST_PACKETS	(DHCP_BATCH_SIZE / 2)
+#define DHCP_TEST_THREADS	(8)
+#define DHCP_TEST_REPLIES	(8)
+
+/*
+ *	A UDP socket on 127.0.0.1, with an ephemeral port.
+ */
+static int dhcp_test_socket(bool fromto, uint16_t *port)
+{
+	int			fd;
+	struct sockaddr_in	sin;
+	socklen_t		len = sizeof(sin);
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0) return -1;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if ((bind(fd, (struct sockaddr *) &sin, sizeof(sin)) < 0) ||
+	    (fromto && (udpfromto_init(fd) < 0)) ||
+	    (getsockname(fd, (struct sockaddr *) &sin, &len) < 0)) {
+		close(fd);
+		return -1;
+	}
+
+	*port = ntohs(sin.sin_port);
+	return fd;
+}
+
+static RADIUS_PACKET *dhcp_test_discover(TALLOC_CTX *ctx)
+{
+	RADIUS_PACKET *packet;
+
+	packet = rad_alloc(ctx, false);
+	if (!packet) return NULL;
+	packet->code = PW_DHCP_DISCOVER;
+
+	if ((fr_pair_list_afrom_str(packet, "DHCP-Opcode = Client-Message, "
+				    "DHCP-Hardware-Type = Ethernet, "
+				    "DHCP-Hardware-Address-Length = 6, "
+				    "DHCP-Client-Hardware-Address = 02:00:00:00:00:01, "
+				    "DHCP-Message-Type = DHCP-Discover", &packet->vps) == T_INVALID) ||
+	    (fr_dhcp_encode(packet) < 0)) return NULL;
+
+	return packet;
+}
+
+#ifdef HAVE_RECVMMSG
+/*
+ *	Everything waiting on the socket is read with one call, and
+ *	each packet is checked on its own.
+ */
+static int test_dhcp_batch_recv(TALLOC_CTX *ctx)
+{
+	int			server, client, i;
+	uint16_t		server_port, client_port;
+	uint32_t		xid;
+	struct sockaddr_in	sin;
+	RADIUS_PACKET		*discover, *packet;
+	fr_dhcp_batch_t		*batch;
+
+	discover = dhcp_test_discover(ctx);
+	TEST_CHECK(discover != NULL);
+
+	server = dhcp_test_socket(true, &server_port);
+	TEST_CHECK(server >= 0);
+	client = dhcp_test_socket(false, &client_port);
+	TEST_CHECK(client >= 0);
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sin.sin_port = htons(server_port);
+
+	for (i = 0; i < DHCP_TEST_PACKETS; i++) {
+		xid = htonl(i);
+		memcpy(discover->data + 4, &xid, sizeof(xid));
+		TEST_CHECK(sendto(client, discover->data, discover->data_len, 0,
+				  (struct sockaddr *) &sin, sizeof(sin)) == (ssize_t) discover->data_len);
+	}
+
+	/*
+	 *	Too short to be DHCP.
+	 */
+	TEST_CHECK(sendto(client, discover->data, 100, 0, (struct sockaddr *) &sin, sizeof(sin)) == 100);
+
+	batch = fr_dhcp_batch_alloc(ctx, server);
+	TEST_CHECK(batch != NULL);
+	TEST_CHECK(fr_dhcp_batch_recv(batch) == DHCP_TEST_PACKETS + 1);
+
+	for (i = 0; i < DHCP_TEST_PACKETS; i++) {
+		packet = fr_dhcp_batch_packet(batch, i);
+		TEST_CHECK(packet != NULL);
+		TEST_CHECK(packet->code == PW_DHCP_DISCOVER);
+		TEST_CHECK(packet->id == i);
+		TEST_CHECK(packet->sockfd == server);
+		TEST_CHECK(packet->src_port == client_port);
+		TEST_CHECK(packet->dst_port == server_port);
+		TEST_CHECK(packet->dst_ipaddr.ipaddr.ip4addr.s_addr == htonl(INADDR_LOOPBACK));
+		rad_free(&packet);
+	}
+
+	TEST_CHECK(fr_dhcp_batch_packet(batch, DHCP_TEST_PACKETS) == NULL);
+	TEST_CHECK(fr_dhcp_batch_packet(batch, DHCP_TEST_PACKETS + 1) == NULL);
+
+	/*
+	 *	Nothing left, and it doesn't wait for more.
+	 */
+	TEST_CHECK(fr_dhcp_batch_recv(batch) == 0);
+
+	close(client);
+	close(server);
+
+	return 0;
+}
+#endif	/* HAVE_RECVMMSG */
+
+#if defined(HAVE_SENDMMSG) && defined(HAVE_PTHREAD_H)
+typedef struct dhcp_test_sender {
+	pthread_t		thread;
+	fr_dhcp_batch_t		*batch;
+	RADIUS_PACKET		*reply;
+	uint16_t		port;		//!< Where the client is listening.
+	int			sent;		//!< Replies which were written.
+	int			failed;		//!< Replies which weren't.
+} dhcp_test_sender_t;
+
+/*
+ *	Every fourth reply goes to the broadcast address, which the
+ *	socket isn't allowed to write to.
+ */
+static void *dhcp_test_send_thread(void *arg)
+{
+	dhcp_test_sender_t	*sender = arg;
+	int			i;
+
+	for (i = 0; i < DHCP_TEST_REPLIES; i++) {
+		sender->reply->dst_ipaddr.af = AF_INET;
+		sender->reply->dst_ipaddr.prefix = 32;
+		sender->reply->dst_port = sender->port;
+
+		if ((i % 4) == 3) {
+			sender->reply->dst_ipaddr.ipaddr.ip4addr.s_addr = htonl(INADDR_BROADCAST);
+			if (fr_dhcp_batch_send(sender->batch, sender->reply) < 0) sender->failed++;
+			continue;
+		}
+
+		sender->reply->dst_ipaddr.ipaddr.ip4addr.s_addr = htonl(INADDR_LOOPBACK);
+		if (fr_dhcp_batch_send(sender->batch, sender->reply) == (int) sender->reply->data_len) sender->sent++;
+	}
+
+	return NULL;
+}
+
+/*
+ *	Threads replying at the same time share writes.  Each one is
+ *	told what happened to its own reply, even when another thread
+ *	wrote it, and even when others in the same write failed.
+ */
+static int test_dhcp_batch_send(TALLOC_CTX *ctx)
+{
+	int			server, client, i, received = 0;
+	uint16_t		server_port, client_port;
+	uint8_t			buffer[MAX_PACKET_LEN];
+	dhcp_test_sender_t	senders[DHCP_TEST_THREADS];
+	fr_dhcp_batch_t		*batch;
+
+	server = dhcp_test_socket(true, &server_port);
+	TEST_CHECK(server >= 0);
+	client = dhcp_test_socket(false, &client_port);
+	TEST_CHECK(client >= 0);
+
+	batch = fr_dhcp_batch_alloc(ctx, server);
+	TEST_CHECK(batch != NULL);
+
+	for (i = 0; i < DHCP_TEST_THREADS; i++) {
+		memset(&senders[i], 0, sizeof(senders[i]));
+		senders[i].batch = batch;
+		senders[i].port = client_port;
+		senders[i].reply = dhcp_test_discover(ctx);
+		TEST_CHECK(senders[i].reply != NULL);
+		senders[i].reply->sockfd = server;
+	}
+
+	for (i = 0; i < DHCP_TEST_THREADS; i++) {
+		TEST_CHECK(pthread_create(&senders[i].thread, NULL, dhcp_test_send_thread, &senders[i]) == 0);
+	}
+	for (i = 0; i < DHCP_TEST_THREADS; i++) pthread_join(senders[i].thread, NULL);
+
+	for (i = 0; i < DHCP_TEST_THREADS; i++) {
+		TEST_CHECK(senders[i].sent == (DHCP_TEST_REPLIES * 3) / 4);
+		TEST_CHECK(senders[i].failed == DHCP_TEST_REPLIES / 4);
+	}
+
+	while (recv(client, buffer, sizeof(buffer), MSG_DONTWAIT) > 0) received++;
+	TEST_CHECK(received == (DHCP_TEST_THREADS * DHCP_TEST_REPLIES * 3) / 4);
+
+	close(client);
+	close(server);
+
+	return 0;
+}
+#endif	/* HAVE_SENDMMSG && HAVE_PTHREAD_H */
+#endif	/* WITH_DHCP && WITH_UDPFROMTO */
+
+#ifdef HAVE_REGEX
+/*
+ *	Realms, in configuration order.  The regexes which can be
+ *	indexed by suffix are mixed with ones which can't, so that
+ *	realm_find() has to use both the index and the linear scan.
+ */
+static char const *realm_test_names[] = {
+	"example.com",
+	"NULL",
+	"DEFAULT",
+	"~.*\\.long\\.example\\.com$",		/* longer suffix first */
+	"~.*\\.example\\.com$",
+	"~^(.*\\.)?example\\.org$",		/* shorter suffix first */
+	"~.+\\.sub\\.example\\.org$",
+	"~^(.+\\.)?example\\.net$",
+	"~^exact\\.test$",
+	"~^.+nonempty\\.test$",
+	"~^foo\\+bar\\.test$",			/* escaped meta-character */
+	"~^[0-9]+\\.test$",			/* not indexed */
+	"~^caf\xc3\xa9\\.test$",			/* not indexed, non-ASCII */
+	"~^multi\nline\\.test$",		/* not indexed, newline */
+	"~\\.test$",
+	"~^[a-z]+\\.late\\.example\\.org$",	/* not indexed, after a match */
+	NULL
+};
+
+static struct {
+	char const	*name;
+	char const	*realm;
+} const realm_test_finds[] = {
+	{ NULL,				"NULL" },
+	{ "example.com",		"example.com" },
+	{ "EXAMPLE.COM",		"example.com" },
+	{ "nowhere.invalid",		"DEFAULT" },
+
+	/*
+	 *	The first match in configuration order wins, not the
+	 *	longest suffix.
+	 */
+	{ "a.long.example.com",		"~.*\\.long\\.example\\.com$" },
+	{ "a.other.example.com",	"~.*\\.example\\.com$" },
+	{ "a.sub.example.org",		"~^(.*\\.)?example\\.org$" },
+	{ "a.late.example.org",		"~^(.*\\.)?example\\.org$" },
+
+	/*
+	 *	Exact, and non-empty prefixes.
+	 */
+	{ "example.org",		"~^(.*\\.)?example\\.org$" },
+	{ ".example.org",		"~^(.*\\.)?example\\.org$" },
+	{ "badexample.org",		"DEFAULT" },
+	{ "example.net",		"~^(.+\\.)?example\\.net$" },
+	{ "a.example.net",		"~^(.+\\.)?example\\.net$" },
+	{ ".example.net",		"DEFAULT" },
+	{ "exact.test",			"~^exact\\.test$" },
+	{ "a.exact.test",		"~\\.test$" },
+	{ "nonempty.test",		"~\\.test$" },
+	{ "anonempty.test",		"~^.+nonempty\\.test$" },
+
+	/*
+	 *	Case folding.
+	 */
+	{ "A.LONG.Example.Com",		"~.*\\.long\\.example\\.com$" },
+	{ "EXACT.TEST",			"~^exact\\.test$" },
+
+	/*
+	 *	Patterns which aren't indexed are still checked, in
+	 *	order.
+	 */
+	{ "foo+bar.test",		"~^foo\\+bar\\.test$" },
+	{ "foobar.test",		"~\\.test$" },
+	{ "123.test",			"~^[0-9]+\\.test$" },
+	{ "caf\xc3\xa9.test",		"~^caf\xc3\xa9\\.test$" },
+	{ "multi\nline.test",		"~^multi\nline\\.test$" },
+	{ "abc.test",			"~\\.test$" },
+};
+
+/*
+ *	What realm_find() should return, found by checking every
+ *	realm in order.
+ */
+static char const *realm_test_expected(TALLOC_CTX *ctx, char const * const *names, char const *name)
+{
+	char const * const *p;
+	regex_t *preg;
+	bool have_default = false;
+
+	if (!name) name = "NULL";
+
+	for (p = names; *p; p++) {
+		if ((*p)[0] == '~') continue;
+		if (strcasecmp(*p, name) == 0) return *p;
+		if (strcmp(*p, "DEFAULT") == 0) have_default = true;
+	}
+
+	for (p = names; *p; p++) {
+		int rcode;
+
+		if ((*p)[0] != '~') continue;
+
+		if (regex_compile(ctx, &preg, *p + 1, strlen(*p) - 1, true, false, false, false) <= 0) return NULL;
+		rcode = regex_exec(preg, name, strlen(name), NULL, NULL);
+		talloc_free(preg);
+
+		if (rcode == 1) return *p;
+	}
+
+	return have_default ? "DEFAULT" : NULL;
+}
+
+static bool realm_test_init(TALLOC_CTX *ctx, char const * const *names)
+{
+	CONF_SECTION	*config, *cs;
+	char const	* const *p;
+
+	config = cf_section_alloc(NULL, "main", NULL);
+	if (!config) return false;
+	talloc_steal(ctx, config);
+
+	for (p = names; *p; p++) {
+		cs = cf_section_alloc(config, "realm", *p);
+		if (!cs) return false;
+		cf_section_add(config, cs);
+	}
+
+	return realms_init(config) == 1;
+}
+
+static bool realm_test_check(TALLOC_CTX *ctx, char const * const *names, char const *name, char const *expected)
+{
+	REALM *realm;
+
+	realm = realm_find(name);
+	if (!expected) return (realm == NULL);
+
+	return realm && (strcmp(realm->name, expected) == 0) &&
+	       (strcmp(realm->name, realm_test_expected(ctx, names, name)) == 0);
+}
+
+/*
+ *	Every case has an explicit answer, which must also be what
+ *	checking the realms one by one gives.
+ */
+static int test_realm_find(TALLOC_CTX *ctx)
+{
+	size_t i;
+
+	TEST_CHECK(realm_test_init(ctx, realm_test_names));
+
+	for (i = 0; i < sizeof(realm_test_finds) / sizeof(realm_test_finds[0]); i++) {
+		if (!realm_test_check(ctx, realm_test_names, realm_test_finds[i].name, realm_test_finds[i].realm)) {
+			printf("FAIL\n\t%s[%d]: realm for \"%s\"\n", __FILE__, __LINE__,
+			       realm_test_finds[i].name ? realm_test_finds[i].name : "(null)");
+			realms_free();
+			return -1;
+		}
+	}
+
+	realms_free();
+
+	return 0;
+}
+
+/*
+ *	'$' doesn't match before a trailing newline with POSIX
+ *	regexes, but does with PCRE.  Names with newlines skip the
+ *	index, so they get whatever the regex library says.
+ */
+static int test_realm_find_newline(TALLOC_CTX *ctx)
+{
+	static char const *names[] = {
+		"a.example.org\n",
+		"a\n.example.org",
+		"example.com\n",
+		"exact.test\n",
+		"multi\nline.test\n",
+		"\n",
+	};
+	size_t i;
+
+	TEST_CHECK(realm_test_init(ctx, realm_test_names));
+
+	for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		if (!realm_test_check(ctx, realm_test_names, names[i],
+				      realm_test_expected(ctx, realm_test_names, names[i]))) {
+			printf("FAIL\n\t%s[%d]: realm for name %zu\n", __FILE__, __LINE__, i);
+			realms_free();
+			return -1;
+		}
+	}
+
+	realms_free();
+
+	return 0;
+}
+
+/*
+ *	With no NULL or DEFAULT realm, names which aren't in a realm
+ *	are looked up as "NULL", and the regexes may still match that.
+ */
+static int test_realm_find_no_default(TALLOC_CTX *ctx)
+{
+	static char const *names[] = {
+		"~^(.*\\.)?example\\.org$",
+		"~^null$",
+		NULL
+	};
+
+	TEST_CHECK(realm_test_init(ctx, names));
+
+	TEST_CHECK(realm_test_check(ctx, names, NULL, "~^null$"));
+	TEST_CHECK(realm_test_check(ctx, names, "NULL", "~^null$"));
+	TEST_CHECK(realm_test_check(ctx, names, "a.example.org", "~^(.*\\.)?example\\.org$"));
+	TEST_CHECK(realm_test_check(ctx, names, "DEFAULT", NULL));
+	TEST_CHECK(realm_test_check(ctx, names, "nowhere.invalid", NULL));
+
+	realms_free();
+
+	return 0;
+}
+#endif	/* HAVE_REGEX */
+
+static unit_test_t const tests[] = {
+#ifdef WITH_STATS
+	{ "stats.hist.bucket",			test_stats_hist_bucket },
+	{ "stats.hist.merge",			test_stats_hist_merge },
+#  ifdef HAVE_PTHREAD_H
+	{ "stats.latency.threads",		test_stats_latency_threads },
+#  endif
+	{ "stats.latency.lazy",			test_stats_latency_lazy },
+#endif
+
+	{ "state.shards",			test_state_shards },
+#ifdef HAVE_PTHREAD_H
+	{ "state.expiry",			test_state_expiry },
+#endif
+
+#if defined(WITH_TLS) && defined(HAVE_OPENSSL_OCSP_H)
+	{ "tls.ocsp.cache.hit",			test_tls_ocsp_cache_hit },
+	{ "tls.ocsp.cache.expiry",		test_tls_ocsp_cache_expiry },
+	{ "tls.ocsp.cache.refresh",		test_tls_ocsp_cache_refresh },
+	{ "tls.ocsp.cache.max_entries",		test_tls_ocsp_cache_max_entries },
+#endif
+
+#if defined(WITH_TLS) && defined(WITH_CRL_INDEX)
+	{ "tls.crl.index",			test_tls_crl_index },
+#endif
+
+#ifdef WITH_TLS
+	{ "tls.write.timeout",			test_tls_write_timeout },
+#endif
+
+#ifdef HAVE_REGEX
+	{ "realm.find",				test_realm_find },
+	{ "realm.find.newline",			test_realm_find_newline },
+	{ "realm.find.no_default",		test_realm_find_no_default },
+#endif
+
+#if defined(WITH_DHCP) && defined(WITH_UDPFROMTO)
+#  ifdef HAVE_RECVMMSG
+	{ "dhcp.batch.recv",			test_dhcp_batch_recv },
+#  endif
+#  if defined(HAVE_SENDMMSG) && defined(HAVE_PTHREAD_H)
+	{ "dhcp.batch.send",			test_dhcp_batch_send },
+#  endif
+#endif
+
+	{ NULL, NULL }
+};
+
+static void NEVER_RETURNS usage(void)
+{
+	fprintf(stderr, "usage: radunit [OPTS] [test ...]\n");
+	fprintf(stderr, "  -d <raddb>             Set user dictionary directory (defaults to " RADDBDIR ").\n");
+	fprintf(stderr, "  -D <dictdir>           Set main dictionary directory (defaults to " DICTDIR ").\n");
+	fprintf(stderr, "  -l                     List the tests.\n");
+	fprintf(stderr, "  -x                     Print log messages.  More x's means more debugging.\n");
+	fprintf(stderr, "Only tests with names starting with one of the given prefixes are run.\n");
+
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	int			c, i, ret = 0;
+	char const		*radius_dir = RADDBDIR;
+	char const		*dict_dir = DICTDIR;
+	unit_test_t const	*test;
+	TALLOC_CTX		*ctx;
+
+#ifndef NDEBUG
+	if (fr_fault_setup(getenv("PANIC_ACTION"), argv[0]) < 0) {
+		fr_perror("radunit");
+		exit(EXIT_FAILURE);
+	}
+#endif
+
+	/*
+	 *	Log messages would get mixed up with the results.
+	 */
+	default_log.dst = L_DST_NULL;
+
+	while ((c = getopt(argc, argv, "d:D:lxh")) != EOF) switch (c) {
+		case 'd':
+			radius_dir = optarg;
+			break;
+
+		case 'D':
+			dict_dir = optarg;
+			break;
+
+		case 'l':
+			for (test = tests; test->name; test++) printf("%s\n", test->name);
+			exit(0);
+
+		case 'x':
+			default_log.dst = L_DST_STDOUT;
+			rad_debug_lvl++;
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+	argc -= optind;
+	argv += optind;
+
+	/*
+	 *	Mismatch between the binary and the libraries it depends on
+	 */
+	if (fr_check_lib_magic(RADIUSD_MAGIC_NUMBER) < 0) {
+		fr_perror("radunit");
+		return 1;
+	}
+
+	if (dict_init(dict_dir, RADIUS_DICTIONARY) < 0) {
+		fr_perror("radunit");
+		return 1;
+	}
+
+	if (dict_read(radius_dir, RADIUS_DICTIONARY) == -1) {
+		fr_perror("radunit");
+		return 1;
+	}
+
+#ifdef WITH_DHCP
+	if (!dict_attrbyname("DHCP-Message-Type") && (dict_read(dict_dir, "dictionary.dhcp") == -1)) {
+		fr_perror("radunit");
+		return 1;
+	}
+#endif
+
+	for (test = tests; test->name; test++) {
+		if (argc > 0) {
+			for (i = 0; i < argc; i++) {
+				if (strncmp(test->name, argv[i], strlen(argv[i])) == 0) break;
+			}
+			if (i == argc) continue;
+		}
+
+		printf("%-40s ", test->name);
+		fflush(stdout);
+
+		ctx = talloc_init("%s", test->name);
+		if (test->func(ctx) < 0) {
+			ret = 1;
+		} else {
+			printf("ok\n");
+		}
+		talloc_free(ctx);
+	}
+
+	return ret;
+}
@@ -0,0 +1,21 @@
+TARGET := radunit
+
+SOURCES := radunit.c ../main/state.c ../main/realms.c
+
+ifneq ($(OPENSSL_LIBS),)
+SOURCES		+= ../main/cb.c ../main/files.c ../main/tls.c
+endif
+
+TGT_PREREQS	:= libfreeradius-server.a libfreeradius-radius.a
+ifneq "$(WITH_DHCP)" "no"
+TGT_PREREQS	+= libfreeradius-dhcp.a
+endif
+TGT_LDLIBS	:= $(LIBS) $(OPENSSL_LIBS)
+TGT_INSTALLDIR	:=
+
+#
+#  Run the unit tests for the server library.
+#
+.PHONY: tests.radunit
+tests.radunit: $(TESTBINDIR)/radunit
+	@$(TESTBIN)/radunit -D share
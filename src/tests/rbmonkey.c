@@ -34,7 +34,9 @@ struct rbtree_t {
 	bool			replace;
 #ifdef HAVE_PTHREAD_H
 	bool			lock;
+	bool			rwlock;
 	pthread_mutex_t		mutex;
+	pthread_rwlock_t	rwmutex;
 #endif
 };
 
@@ -184,7 +186,7 @@ again:
 	fprintf(stderr, "filter = %x mask = %x n= %i\n",
 		thresh, mask, n);
 
-	t = rbtree_create(NULL, comp, free, RBTREE_FLAG_LOCK);
+	t = rbtree_create(NULL, comp, free, (rep & 1) ? RBTREE_FLAG_LOCK : RBTREE_FLAG_RWLOCK);
 	/* Find out the value of the NIL node */
 	NIL = t->root->left;
 
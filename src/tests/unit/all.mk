@@ -30,6 +30,19 @@ $(BUILD_DIR)/share/dictionary: $(top_srcdir)/share/dictionary $(top_srcdir)/shar
 		echo '$$INCLUDE ' "$$x" >> $@; \
 	done
 
+#
+#  Compile the dictionaries once, so that the tests can be run
+#  again, loading them from the cache.
+#
+$(BUILD_DIR)/tests/unit/dictionary.cache: $(BUILD_DIR)/bin/radattr $(TESTBINDIR)/radattr $(BUILD_DIR)/share/dictionary | $(BUILD_DIR)/tests/unit
+	@rm -f $@
+	@FR_DICTIONARY_CACHE=$@ $(TESTBIN)/radattr -D $(BUILD_DIR)/share /dev/null
+	@test -f $@
+
+.PHONY: $(BUILD_DIR)/tests/unit/cached
+$(BUILD_DIR)/tests/unit/cached:
+	@mkdir -p $@
+
 #
 #  Files in the output dir depend on the unit tests
 #
@@ -41,10 +54,48 @@ $(BUILD_DIR)/tests/unit/%: $(DIR)/% $(BUILD_DIR)/bin/radattr $(TESTBINDIR)/radat
 	fi
 	@touch $@
 
+#
+#  The same tests, with the dictionaries loaded from the cache.
+#
+$(BUILD_DIR)/tests/unit/cached/%: $(DIR)/% $(BUILD_DIR)/bin/radattr $(TESTBINDIR)/radattr $(BUILD_DIR)/share/dictionary $(BUILD_DIR)/tests/unit/dictionary.cache | $(BUILD_DIR)/tests/unit/cached
+	@echo UNIT-TEST cached/$(notdir $@)
+	@if ! FR_DICTIONARY_CACHE=$(BUILD_DIR)/tests/unit/dictionary.cache $(TESTBIN)/radattr -D $(BUILD_DIR)/share $<; then \
+		echo "FR_DICTIONARY_CACHE=$(BUILD_DIR)/tests/unit/dictionary.cache $(TESTBIN)/radattr -D $(BUILD_DIR)/share $<"; \
+		exit 1; \
+	fi
+	@touch $@
+
+#
+#  Changing a dictionary file must invalidate the cache.  Compile a
+#  dictionary, then change one of its files without changing its
+#  size, and check that the change is seen.  The file is first made
+#  older, so that the change is seen even in the same second.
+#
+DICT_CACHE_DIR := $(BUILD_DIR)/tests/unit/dict_cache
+
+$(BUILD_DIR)/tests/unit/dict_cache.txt: $(DIR)/dict_cache.txt $(BUILD_DIR)/bin/radattr $(TESTBINDIR)/radattr | $(BUILD_DIR)/tests/unit
+	@echo UNIT-TEST $(notdir $@)
+	@rm -rf $(DICT_CACHE_DIR)
+	@mkdir -p $(DICT_CACHE_DIR)
+	@echo '$$INCLUDE $(top_srcdir)/share/dictionary' > $(DICT_CACHE_DIR)/dictionary
+	@echo '$$INCLUDE dictionary.local' >> $(DICT_CACHE_DIR)/dictionary
+	@echo 'VALUE	Service-Type	Cache-Test-Old	1000' > $(DICT_CACHE_DIR)/dictionary.local
+	@touch -t 200001010000 $(DICT_CACHE_DIR)/dictionary.local
+	@FR_DICTIONARY_CACHE=$(DICT_CACHE_DIR)/cache $(TESTBIN)/radattr -D $(DICT_CACHE_DIR) /dev/null
+	@test -f $(DICT_CACHE_DIR)/cache
+	@echo 'VALUE	Service-Type	Cache-Test-New	1000' > $(DICT_CACHE_DIR)/dictionary.local
+	@if ! FR_DICTIONARY_CACHE=$(DICT_CACHE_DIR)/cache $(TESTBIN)/radattr -D $(DICT_CACHE_DIR) $<; then \
+		echo "FR_DICTIONARY_CACHE=$(DICT_CACHE_DIR)/cache $(TESTBIN)/radattr -D $(DICT_CACHE_DIR) $<"; \
+		exit 1; \
+	fi
+	@touch $@
+
 #
 #  Get all of the unit test output files
 #
-TESTS.UNIT_FILES := $(addprefix $(BUILD_DIR)/tests/unit/,$(FILES))
+TESTS.UNIT_FILES := $(addprefix $(BUILD_DIR)/tests/unit/,$(FILES)) \
+		    $(addprefix $(BUILD_DIR)/tests/unit/cached/,$(FILES)) \
+		    $(BUILD_DIR)/tests/unit/dict_cache.txt
 
 #
 #  Depend on the output files, and create the directory first.